@@ -16,13 +16,21 @@
 ##
 
 """
-Compound query builder. We do this in Python to avoid having to mess
-with pass a complex Python object hierarchy into C. These classes allow us to
-build the query in Python and generate the compound query string that the directory
-service C api requires.
+Compound query builder. These classes allow us to build the query in Python and
+generate the compound query string that the directory service C api requires.
+When the native opendirectory module is available the string is generated by it,
+which also provides the canonical form of a query and parses query strings back
+into these classes.
 """
 
 import dsattributes
+import types
+
+try:
+    import opendirectory
+    _native = isinstance(getattr(opendirectory, "generateQuery", None), types.BuiltinFunctionType)
+except ImportError:
+    _native = False
 
 class match(object):
     """
@@ -35,6 +43,8 @@ class match(object):
         self.matchType = matchType
     
     def generate(self):
+        if _native:
+            return opendirectory.generateQuery(self)
         return {
             dsattributes.eDSExact :        "(%s=%s)",
             dsattributes.eDSStartsWith :   "(%s=%s*)",
@@ -44,6 +54,9 @@ class match(object):
             dsattributes.eDSGreaterThan :  "(%s>%s)",
         }.get(self.matchType, "(%s=*%s*)") % (self.attribute, self.value,)
 
+    def canonical(self):
+        return canonical(self)
+
 class expression(object):
     """
     Represents a query expression that includes a boolean operator, and a list
@@ -61,6 +74,8 @@ class expression(object):
         self.subexpressions = subexpressions
     
     def generate(self):
+        if _native:
+            return opendirectory.generateQuery(self)
         result = ""
         if self.operator == expression.NOT:
             result += "("
@@ -76,7 +91,38 @@ class expression(object):
             if len(self.subexpressions) > 1:
                 result += ")"
         return result
-    
+
+    def canonical(self):
+        return canonical(self)
+
+def canonical(query):
+    """
+    Return the canonical form of a query, the same for queries that differ only in
+    the order, nesting or repetition of AND/OR operands or in double negation. Needs
+    the native opendirectory module.
+
+    @param query: an expression or match object, or a compound query string.
+    @return: the canonical compound query string.
+    """
+    return opendirectory.canonicalQuery(query)
+
+def parse(compound):
+    """
+    Parse a compound query string of the form generate() returns. Needs the native
+    opendirectory module.
+
+    @param compound: the compound query string.
+    @return: an expression or match object.
+    """
+    return _fromTuple(opendirectory.parseQuery(compound))
+
+def _fromTuple(parsed):
+    if len(parsed) == 3:
+        return match(*parsed)
+    operator, subexpressions = parsed
+    if operator == expression.NOT:
+        return expression(operator, _fromTuple(subexpressions))
+    return expression(operator, tuple([_fromTuple(sub) for sub in subexpressions]))
 
 # Do some tests
 if __name__=='__main__':
@@ -131,4 +177,16 @@ if __name__=='__main__':
         gen = expr.generate()
         if gen != result:
             print "Generate expression %s != %s" % (gen, result,)
+        if _native and parse(result).generate() != result:
+            print "Parse expression %s != %s" % (parse(result).generate(), result,)
+
+    if _native:
+        canonicals = (
+            ("(|(ResourceType=xyz)(ResourceType=abc))", "(|(ResourceType=abc)(ResourceType=xyz))"),
+            ("(&(a=1)(&(b=2)(a=1)))", "(&(a=1)(b=2))"),
+            ("(!(!(a=1)))", "(a=1)"),
+        )
+        for query, result in canonicals:
+            if canonical(query) != result:
+                print "Canonical expression %s != %s" % (canonical(query), result,)
     print "Done."
@@ -109,6 +109,22 @@ def listAllRecordsWithAttributes_list(obj, recordType, attributes, count=0):
         for each record found, or C{None} otherwise.
     """
 
+def iterAllRecordsWithAttributes(obj, recordType, attributes, count=0):
+    """
+    Iterate over records in Open Directory, returning key attributes for each one.
+    Records are read from the directory in chunks as the iterator is consumed, rather than all at once.
+    The attributes can be a C{str} for the attribute name, or a C{tuple} or C{list} where the first C{str}
+    is the attribute name, and the second C{str} is an encoding type, either "str" or "base64".
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{iterator} yielding a C{list} of C{str} (record name) and C{dict} attributes 
+        for each record found, or C{None} otherwise. Call C{close()} on the iterator to stop
+        early and release the directory resources it holds.
+    """
+
 def queryRecordsWithAttribute_list(obj, attr, value, matchType, casei, recordType, attributes, count=0):
     """
     List records in Open Directory matching specified attribute/value, and return key attributes for each one.
@@ -143,9 +159,177 @@ def queryRecordsWithAttributes_list(obj, compound, casei, recordType, attributes
         for each record found, or C{None} otherwise.
     """
 
+def queryRecordsWithAttributePaged(obj, attr, value, matchType, casei, recordType, attributes, count=0):
+    """
+    Start a query for records in Open Directory matching specified attribute and value, returning a
+    cursor that fetches the matching records a page at a time. The cursor holds a directory session
+    until the query is complete or C{close()} is called, and is closed automatically once it has been
+    left unused for longer than the "cursor_idle_timeout" option.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} containing the attribute to search.
+    @param value: C{str} containing the value to search for.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param count: C{int} maximum number of records to return over all pages (zero returns all).
+    @return: C{QueryCursor} whose C{next_page(n)} returns a C{list} containing a C{list} of C{str}
+        (record name) and C{dict} attributes for up to C{n} records, or an empty C{list} once the
+        query is complete, or C{None} otherwise.
+    """
+
+def queryRecordsWithAttributesPaged(obj, compound, casei, recordType, attributes, count=0):
+    """
+    Start a compound query for records in Open Directory, returning a cursor that fetches the matching
+    records a page at a time. The cursor behaves as for L{queryRecordsWithAttributePaged}.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param compound: C{str} containing the compound search query to use.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param count: C{int} maximum number of records to return over all pages (zero returns all).
+    @return: C{QueryCursor} whose C{next_page(n)} returns a C{list} containing a C{list} of C{str}
+        (record name) and C{dict} attributes for up to C{n} records, or an empty C{list} once the
+        query is complete, or C{None} otherwise.
+    """
+
+def prepareQuery(obj, attr, matchType, casei, recordType, attributes):
+    """
+    Prepare a query for records in Open Directory matching a value of the specified attribute, so that
+    it can be run for many values without converting the record types and attributes each time.
+    The attributes can be a C{str} for the attribute name, or a C{tuple} or C{list} where the first C{str}
+    is the attribute name, and the second C{str} is an encoding type, either "str" or "base64".
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} containing the attribute to search.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{PreparedQuery} whose C{execute(value, count=0)} returns a C{list} containing a C{list}
+        of C{str} (record name) and C{dict} attributes for each record found, or C{None} otherwise.
+    """
+
+def getRecordsByNames(obj, recordType, names, attributes):
+    """
+    Get records in Open Directory by exact record name, and return key attributes for each one.
+    This is much cheaper than searching on the record name attribute. Long lists of names are
+    split into several concurrent lookups.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param names: C{list} or C{tuple} of C{str} record names to look up.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{dict} containing a C{dict} of attributes for each record found,
+        or C{None} otherwise.
+    """
+
+def getRecordsByNames_list(obj, recordType, names, attributes):
+    """
+    Get records in Open Directory by exact record name, and return key attributes for each one.
+    This is much cheaper than searching on the record name attribute. Long lists of names are
+    split into several concurrent lookups.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param names: C{list} or C{tuple} of C{str} record names to look up.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes
+        for each record found, or C{None} otherwise.
+    """
+
+def queryRecordsWithAttributeValues(obj, attr, values, casei, recordType, attributes):
+    """
+    Look up records in Open Directory by several exact values of one attribute in a single call,
+    for example to resolve many GeneratedUIDs or email addresses at once, and return key attributes
+    for each one. The values are looked up by concurrent compound queries that each cover up to
+    batch_width values (see setOption).
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} containing the attribute to search.
+    @param values: C{list} or C{tuple} of C{str} values to look up.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+        The searched attribute is always returned.
+    @return: C{dict} of each C{str} value to a C{list} containing a C{list} of C{str} (record name)
+        and C{dict} attributes for each record matching that value, which is empty if none did.
+    """
+
+def queryNodesWithAttribute_list(obj, nodes, attr, value, matchType, casei, recordType, attributes, dedupe=False, count=0):
+    """
+    List records matching specified attribute/value in several Open Directory nodes, querying the
+    nodes concurrently, and return key attributes for each one. This bypasses the search policy of
+    a search node, so the time taken is bounded by the slowest node rather than all of them.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodes: C{list} or C{tuple} of C{str} node names, such as those returned by listNodes.
+    @param attr: C{str} containing the attribute to search.
+    @param value: C{str} containing the value to search for.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param dedupe: C{True} to return only the first record with each GeneratedUID, in which case the
+        GeneratedUID is always returned, C{False} otherwise.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes 
+        for each record found, ordered by record name and then by the order of nodes.
+    """
+
+def queryNodesWithAttributes_list(obj, nodes, compound, casei, recordType, attributes, dedupe=False, count=0):
+    """
+    List records matching specified criteria in several Open Directory nodes, querying the
+    nodes concurrently, and return key attributes for each one.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodes: C{list} or C{tuple} of C{str} node names, such as those returned by listNodes.
+    @param compound: C{str} containing the compound search query to use.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param dedupe: C{True} to return only the first record with each GeneratedUID, in which case the
+        GeneratedUID is always returned, C{False} otherwise.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes 
+        for each record found, ordered by record name and then by the order of nodes.
+    """
+
+def generateQuery(expr):
+    """
+    Generate the compound query string for a query built with dsquery, in native code. The result
+    is the same as expr.generate().
+    
+    @param expr: C{dsquery.expression} or C{dsquery.match} the query.
+    @return: C{str} the compound query string.
+    """
+
+def canonicalQuery(expr):
+    """
+    Get the canonical form of a compound query: AND and OR operands are flattened, sorted and
+    de-duplicated, and double negations removed. Queries that differ only in those ways have the
+    same canonical form, which is also what the query cache keys results on.
+    
+    @param expr: C{dsquery.expression}, C{dsquery.match} or C{str} compound query string.
+    @return: C{str} the canonical compound query string.
+    """
+
+def parseQuery(compound):
+    """
+    Parse a compound query string of the form dsquery generates.
+    
+    @param compound: C{str} the compound query string.
+    @return: C{tuple} (attribute, value, matchType) for a match, (operator, C{list} of operands)
+        for AND and OR, or ("!", operand) for NOT. dsquery.parse turns this into dsquery objects.
+    """
+
 def authenticateUserBasic(obj, nodename, user, pswd):
     """
-    Authenticate a user with a password to Open Directory.
+    Authenticate a user with a password to Open Directory. Calls from different threads
+    run concurrently, up to the auth_sessions option. With the auth_cache_ttl option set, a
+    password matching a recent successful authentication is accepted without asking the directory.
     
     @param obj: C{object} the object obtained from an odInit call.
     @param nodename: C{str} the directory nodename for the record to check.
@@ -167,6 +351,215 @@ def authenticateUserDigest(obj, nodename, user, challenge, response, method):
     @return: C{True} if the user was found, C{False} otherwise.
     """
 
+def getDigestMD5ChallengeFromActiveDirectory(obj, nodename):
+    """
+    Get a SASL DIGEST-MD5 challenge from an Active Directory node. With the challenge_pool_depth
+    option set, a challenge fetched ahead of time in the background is returned if one is ready.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename of the Active Directory node.
+    @return: C{str} the challenge, or C{None} if the node did not provide one.
+    """
+
+def authenticateUserDigestToActiveDirectory(obj, nodename, user, response):
+    """
+    Authenticate using SASL DIGEST-MD5 credentials to an Active Directory node.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param response: C{str} the response sent from the client to a challenge from
+        getDigestMD5ChallengeFromActiveDirectory.
+    @return: C{True} if the user was found, C{False} otherwise.
+    """
+
+def invalidateAuthCache(obj, nodename=None, user=None):
+    """
+    Forget remembered Basic authentications, for example after a password change. Only used when
+    the auth_cache_ttl option is set.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename to forget authentications for, or C{None} for all nodes.
+    @param user: C{str} the user to forget the authentication of, or C{None} for all users of the node.
+    """
+
+def loadMirror(obj, recordType, attributes):
+    """
+    Load all records of the specified types into an in-memory mirror, replacing what it held before.
+    Exact queryRecordsWithAttribute lookups on GeneratedUID, RecordName, EMailAddress or
+    ServicesLocator are then answered from the mirror, as long as they are on the node it was
+    loaded from and all the record types and attributes asked for are mirrored. The mirror is only
+    as fresh as the last load.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to mirror,
+        or an empty C{list} to empty the mirror.
+    @param attributes: C{list} or C{tuple} containing the attributes to mirror for each record.
+        The indexed attributes are always mirrored.
+    """
+
+def refreshMirror(obj, full=False):
+    """
+    Bring the mirror loaded by loadMirror up to date by fetching only the records whose
+    ModificationTimestamp is at or after the latest one it holds. Deleted records are only noticed
+    by a full reload, which is done when asked for or when mirror_reconcile_interval (see setOption)
+    has passed since the last one, so this should be called periodically.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param full: C{True} to reload the mirror completely, C{False} otherwise.
+    """
+
+def writeMirrorSnapshot(obj, path):
+    """
+    Write the records held by the mirror loaded by loadMirror to a snapshot file. The file is
+    written under a temporary name and renamed into place, so it can be replaced while other
+    processes have it loaded.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param path: C{str} the file to write.
+    @return: C{True} if the snapshot was written, C{False} if no mirror is loaded.
+    """
+
+def loadMirrorSnapshot(obj, path):
+    """
+    Map a snapshot file written by writeMirrorSnapshot, replacing the contents of the mirror. Exact
+    lookups on indexed attributes of the node the snapshot was written from are answered from the
+    file straight away, without reading it into memory first. The next refreshMirror call reloads
+    the mirror from the directory.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param path: C{str} the file to map.
+    """
+
+def submitQueryRecordsWithAttribute(obj, attr, value, matchType, casei, recordType, attributes, count=0):
+    """
+    Start a query for records in Open Directory matching specified attribute and value on the module's
+    worker threads, returning straight away. The result is collected with L{getCompletedResults} once
+    the file descriptor from L{getCompletionFD} becomes readable.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} for the attribute to query.
+    @param value: C{str} for the attribute value to query.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{int} handle identifying the call in the completed results, whose result is a C{list}
+        containing a C{list} of C{str} (record name) and C{dict} attributes for each record found.
+    """
+
+def submitQueryRecordsWithAttributes(obj, compound, casei, recordType, attributes, count=0):
+    """
+    Start a compound query for records in Open Directory on the module's worker threads, returning
+    straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param compound: C{str} containing the compound search query to use.
+    @param casei: C{True} to do case-insensitive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{int} handle identifying the call in the completed results, whose result is a C{list}
+        containing a C{list} of C{str} (record name) and C{dict} attributes for each record found.
+    """
+
+def submitAuthenticateUserBasic(obj, nodename, user, pswd):
+    """
+    Start authenticating a user with basic auth to Open Directory on the module's worker threads,
+    returning straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param pswd: C{str} containing the password to check.
+    @return: C{int} handle identifying the call in the completed results, whose result is C{True}
+        if the user was found and the password matches, C{False} otherwise.
+    """
+
+def submitAuthenticateUserDigest(obj, nodename, user, challenge, response, method):
+    """
+    Start authenticating a user with digest auth to Open Directory on the module's worker threads,
+    returning straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param challenge: C{str} the HTTP challenge sent to the client.
+    @param response: C{str} the HTTP response sent from the client.
+    @param method: C{str} the HTTP method being used.
+    @return: C{int} handle identifying the call in the completed results, whose result is C{True}
+        if the user was found and the response matches, C{False} otherwise.
+    """
+
+def getCompletionFD(obj):
+    """
+    Return the file descriptor that becomes readable when calls submitted to the module's worker
+    threads have completed, for an event loop to watch. Call L{getCompletedResults} when it does.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{int} the file descriptor, which must not be read or closed by the caller.
+    """
+
+def getCompletedResults(obj):
+    """
+    Collect the results of calls submitted to the module's worker threads that have completed since
+    the last time this was called. All results are converted to Python objects in one go.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{list} of C{tuple} of C{int} handle returned when the call was submitted, the result of
+        the call (C{None} if it failed), and the L{ODError} it failed with (C{None} if it succeeded).
+    """
+
+def getStatistics(obj):
+    """
+    Return counters kept by the module, such as how often data buffers were reused.
+    queries_coalesced counts the queries answered by an identical query already in flight.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{dict} of C{str} counter name to C{int} value.
+    """
+
+def setOption(obj, name, value):
+    """
+    Change an option controlling how calls are made. Known options are:
+    
+        fanout:         C{True} to run calls covering several record types as concurrent
+                        per-type calls, merged in the order the record types were given.
+        fanout_threads: the most threads a single fanned out call may use.
+        batch_width:    the most values looked up by one compound query in
+                        queryRecordsWithAttributeValues.
+        query_cache_ttl:          seconds query results are cached for, zero (the
+                                  default) turns the cache off.
+        query_cache_negative_ttl: seconds empty query results are cached for, zero
+                                  uses query_cache_ttl.
+        query_cache_bytes:        the most bytes of query results cached.
+        mirror_reconcile_interval: seconds after which refreshMirror reloads the mirror
+                                   completely, zero to only do so when asked.
+        cursor_idle_timeout:      seconds after which a paged query cursor left unused
+                                  is closed, zero to keep it open until closed.
+        async_threads:            the most worker threads running submitted calls.
+        auth_sessions:            the most directory sessions used by concurrent
+                                  authentications, further ones wait for a session.
+        node_cache_size:          the most nodes whose directory and node references are
+                                  kept open for queries and authentications, 32 by default.
+        auth_cache_ttl:           seconds a successful authenticateUserBasic is remembered
+                                  for, zero (the default) turns the cache off.
+        auth_cache_iterations:    PBKDF2 iterations used to derive a remembered password
+                                  verifier, 1000 by default.
+        challenge_pool_depth:     challenges getDigestMD5ChallengeFromActiveDirectory
+                                  keeps fetched ahead for each node, zero (the default)
+                                  turns the pool off.
+        challenge_pool_max_age:   seconds a prefetched challenge may be kept, 60 by
+                                  default, zero for no limit.
+        coalesce_queries:         C{True} (the default) to let a query identical to one
+                                  already in flight wait for and share its result.
+    
+    @param obj: C{object} the object obtained from an odInit call.
+    @param name: C{str} the option name.
+    @param value: C{int} the new value.
+    """
+
 class ODError(Exception):
     """
     Exceptions from DirectoryServices errors.
@@ -32,6 +32,24 @@ if sys.platform in ["darwin", "macosx"]:
             'src/CDirectoryServiceManager.cpp',
             'src/CDirectoryService.cpp',
             'src/CDirectoryServiceAuth.cpp',
+            'src/CDirectoryServiceAuthPool.cpp',
+            'src/CDirectoryServiceAuthCache.cpp',
+            'src/CDirectoryServiceChallengePool.cpp',
+            'src/CDirectoryServiceRecordIterator.cpp',
+            'src/CDirectoryServicePreparedQuery.cpp',
+            'src/CDirectoryServiceRecordOutput.cpp',
+            'src/CDirectoryServiceAttributeSchema.cpp',
+            'src/CDirectoryServiceSessionPool.cpp',
+            'src/CDirectoryServiceNodeCache.cpp',
+            'src/CDirectoryServiceSingleFlight.cpp',
+            'src/CDirectoryServiceBufferPool.cpp',
+            'src/CDirectoryServiceTaskGroup.cpp',
+            'src/CDirectoryServiceWorkQueue.cpp',
+            'src/CDirectoryServiceRecordMerge.cpp',
+            'src/CDirectoryServiceQueryCache.cpp',
+            'src/CDirectoryServiceQueryExpression.cpp',
+            'src/CDirectoryServiceMirror.cpp',
+            'src/CDirectoryServiceSnapshot.cpp',
             'src/CDirectoryServiceException.cpp',
             'src/CFStringUtil.cpp',
             'src/base64.cpp',
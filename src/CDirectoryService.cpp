@@ -19,7 +19,18 @@
 
 #include "CDirectoryService.h"
 
+#include "CDirectoryServiceBufferPool.h"
 #include "CDirectoryServiceException.h"
+#include "CDirectoryServiceManager.h"
+#include "CDirectoryServiceMirror.h"
+#include "CDirectoryServiceNodeCache.h"
+#include "CDirectoryServiceQueryCache.h"
+#include "CDirectoryServiceQueryExpression.h"
+#include "CDirectoryServiceRecordDecoder.h"
+#include "CDirectoryServiceRecordMerge.h"
+#include "CDirectoryServiceSessionPool.h"
+#include "CDirectoryServiceSingleFlight.h"
+#include "CDirectoryServiceTaskGroup.h"
 
 #include "base64.h"
 #include "CFStringUtil.h"
@@ -27,22 +38,283 @@
 #include <Python.h>
 
 #include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <set>
+#include <vector>
 
 extern PyObject* ODException_class;
 
 const int cBufferSize = 32 * 1024;        // 32K buffer for Directory Services operations
+const CFIndex cNamesPerCall = 256;        // record names looked up by a single dsGetRecordList call
+
+// Runs a list or query call into an arena, as one part of a call split across record types or
+// nodes. Each task uses its own CDirectoryService and so its own pooled session and buffer.
+class CDirectoryService::CArenaTask : public CDirectoryServiceTask
+{
+public:
+    CDirectoryServiceManager*   mManager;
+    const char*                 mNodeName;
+    bool                        mQuery;
+    const char*                 mAttr;
+    const char*                 mValue;
+    int                         mMatchType;
+    const char*                 mCompound;
+    bool                        mCaseI;
+    CFArrayRef                  mNames;
+    CFDictionaryRef             mAttributes;
+    UInt32                      mMaxRecordCount;
+    bool                        mUseMirror;
+    bool                        mCoalesce;
+    bool                        mUseCache;
+    CFArrayRef                  mRecordTypes;       // owned by the task
+    CDirectoryServiceRecordArena    mArena;
+
+    CArenaTask()
+    {
+        mManager = NULL;
+        mNodeName = NULL;
+        mQuery = false;
+        mAttr = NULL;
+        mValue = NULL;
+        mMatchType = 0;
+        mCompound = NULL;
+        mCaseI = false;
+        mNames = NULL;
+        mAttributes = NULL;
+        mMaxRecordCount = 0;
+        mUseMirror = true;
+        mCoalesce = true;
+        mUseCache = true;
+        mRecordTypes = NULL;
+    }
+
+    virtual ~CArenaTask()
+    {
+        if (mRecordTypes != NULL)
+            ::CFRelease(mRecordTypes);
+    }
+
+protected:
+    virtual void Run()
+    {
+        CDirectoryService ds(mNodeName, mManager);
+        ds.mUseMirror = mUseMirror;
+        ds.mCoalesce = mCoalesce;
+        ds.mUseCache = mUseCache;
+        for(int attempt = 1; ; attempt++)
+        {
+            try
+            {
+                if (mQuery)
+                    ds._QueryRecordsWithAttributes(mAttr, mValue, mMatchType, mCompound, mCaseI, mRecordTypes, mAttributes, mMaxRecordCount, NULL, &mArena);
+                else
+                    ds._ListAllRecordsWithAttributes(mRecordTypes, mNames, mAttributes, mMaxRecordCount, NULL, &mArena);
+                return;
+            }
+            catch(CDirectoryServiceException& dserror)
+            {
+                // A pooled reference may have gone stale, in which case retry once with a fresh one
+                if ((attempt == 1) && ds.RecoverSession(dserror))
+                {
+                    mArena.Clear();
+                    continue;
+                }
+                throw;
+            }
+        }
+    }
+};
+
+// Runs a query on the manager's work queue into an arena, which is converted to Python once the
+// query has completed. The task keeps its own copies of the query arguments, as the call that
+// submitted it returns straight away.
+class CDirectoryService::CAsyncQueryTask : public CDirectoryService::CAsyncTask
+{
+public:
+    CAsyncQueryTask(CDirectoryServiceManager* manager, const char* nodename, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount) :
+        mSchema(attributes)
+    {
+        mManager = manager;
+        mNodeName = nodename;
+        mCompound = (compound != NULL);
+        mAttr = (attr != NULL) ? attr : "";
+        mValue = (compound != NULL) ? compound : ((value != NULL) ? value : "");
+        mMatchType = matchType;
+        mCaseI = casei;
+        mRecordTypes = recordTypes;
+        ::CFRetain(mRecordTypes);
+        mAttributes = attributes;
+        ::CFRetain(mAttributes);
+        mMaxRecordCount = maxRecordCount;
+    }
+
+    virtual ~CAsyncQueryTask()
+    {
+        ::CFRelease(mRecordTypes);
+        ::CFRelease(mAttributes);
+    }
+
+    virtual PyObject* GetResultAsPython()
+    {
+        PyObject* result = PyList_New(0);
+        CDirectoryServicePyOutput output(result);
+        mArena.Replay(mSchema, output, 0, mArena.GetRecordCount());
+        return result;
+    }
+
+protected:
+    CDirectoryServiceManager*           mManager;
+    const char*                         mNodeName;          // owned by the manager, which outlives its work queue
+    bool                                mCompound;
+    std::string                         mAttr;
+    std::string                         mValue;             // the compound query when mCompound is set
+    int                                 mMatchType;
+    bool                                mCaseI;
+    CFArrayRef                          mRecordTypes;
+    CFDictionaryRef                     mAttributes;
+    UInt32                              mMaxRecordCount;
+    CDirectoryServiceAttributeSchema    mSchema;
+    CDirectoryServiceRecordArena        mArena;
+
+    virtual void Run()
+    {
+        CDirectoryService ds(mNodeName, mManager);
+        for(int attempt = 1; ; attempt++)
+        {
+            try
+            {
+                if (mCompound)
+                    ds._QueryRecordsWithAttributes(NULL, NULL, 0, mValue.c_str(), mCaseI, mRecordTypes, mAttributes, mMaxRecordCount, NULL, &mArena);
+                else
+                    ds._QueryRecordsWithAttributes(mAttr.c_str(), mValue.c_str(), mMatchType, NULL, mCaseI, mRecordTypes, mAttributes, mMaxRecordCount, NULL, &mArena);
+                return;
+            }
+            catch(CDirectoryServiceException& dserror)
+            {
+                // A pooled reference may have gone stale, in which case retry once with a fresh one
+                if ((attempt == 1) && ds.RecoverSession(dserror))
+                {
+                    mArena.Clear();
+                    continue;
+                }
+                throw;
+            }
+        }
+    }
+};
+
+// Copy a request attribute dictionary, adding an attribute the call itself needs to see.
+static CFMutableDictionaryRef CopyAttributesAdding(CFDictionaryRef attributes, CFStringRef attr)
+{
+    CFMutableDictionaryRef result = ::CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, attributes);
+    ThrowIfNULL(result);
+    if (!::CFDictionaryContainsKey(result, attr))
+        ::CFDictionarySetValue(result, attr, CFSTR("str"));
+    return result;
+}
+
+// Convert a CFArray of CFString to UTF-8 strings.
+static void CFStringArrayToVector(CFArrayRef strs, std::vector<std::string>& result)
+{
+    CFIndex count = ::CFArrayGetCount(strs);
+    for(CFIndex i = 0; i < count; i++)
+    {
+        CFStringUtil str((CFStringRef)::CFArrayGetValueAtIndex(strs, i));
+        const char* cstr = str.temp_str();
+        ThrowIfNULL(cstr);
+        result.push_back(cstr);
+    }
+}
+
+// Build the result cache key for a query from everything that affects its result: the node,
+// the query, the match type, the case flag, the record types in order, the attributes and
+// their encodings, and the record limit.
+std::string CDirectoryService::QueryCacheKey(const char* nodename, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount)
+{
+    const char cSeparator = '\x1f';
+    char number[32];
+
+    std::string result(nodename);
+    result += cSeparator;
+    if (compound != NULL)
+    {
+        // Equivalent compound queries written differently share results
+        result += "compound";
+        result += cSeparator;
+        result += CDirectoryServiceQueryExpression::Canonicalize(compound);
+    }
+    else
+    {
+        result += attr;
+        result += cSeparator;
+        result += value;
+        result += cSeparator;
+        ::snprintf(number, sizeof(number), "%d", matchType & 0xFEFF);
+        result += number;
+    }
+    result += cSeparator;
+    result += casei ? "i" : "s";
+
+    result += cSeparator;
+    std::vector<std::string> types;
+    CFStringArrayToVector(recordTypes, types);
+    for(std::vector<std::string>::const_iterator iter = types.begin(); iter != types.end(); iter++)
+    {
+        result += *iter;
+        result += ',';
+    }
+
+    // Attribute order does not affect the result
+    result += cSeparator;
+    std::vector<std::string> attributes;
+    for(size_t i = 0; i < schema.GetCount(); i++)
+        attributes.push_back(schema.GetSlot(i).mName + ((schema.GetSlot(i).mKind == CDirectoryServiceAttributeSchema::eDecodeBase64) ? ":base64" : ":str"));
+    std::sort(attributes.begin(), attributes.end());
+    for(std::vector<std::string>::const_iterator iter = attributes.begin(); iter != attributes.end(); iter++)
+    {
+        result += *iter;
+        result += ',';
+    }
+
+    result += cSeparator;
+    ::snprintf(number, sizeof(number), "%u", (unsigned int)maxRecordCount);
+    result += number;
+
+    return result;
+}
+
+// ASCII lower-case copy of a string, for case-insensitive matching of values.
+static std::string LowerCase(const char* str, size_t len)
+{
+    std::string result(str, len);
+    for(std::string::iterator iter = result.begin(); iter != result.end(); iter++)
+        *iter = ::tolower((unsigned char)*iter);
+    return result;
+}
 
 #pragma mark -----Public API
 
-CDirectoryService::CDirectoryService(const char* nodename)
+CDirectoryService::CDirectoryService(const char* nodename, CDirectoryServiceManager* manager)
 {
     mNodeName = CStringFromData(nodename, ::strlen(nodename));
     mDir = 0L;
     mNode = 0L;
     mData = NULL;
     mDataSize = 0;
+    mManager = manager;
+    mUseMirror = true;
+    mCoalesce = true;
+    mUseCache = true;
+    mPool = (manager != NULL) ? manager->GetNodeCache()->Acquire(mNodeName) : NULL;
+    mSessionDir = 0L;
+    mSessionNode = 0L;
+    mBufferPool = (manager != NULL) ? manager->GetBufferPool() : NULL;
+    mBufferReallocs = 0;
 }
 
 CDirectoryService::~CDirectoryService()
@@ -51,8 +323,18 @@ CDirectoryService::~CDirectoryService()
     if (mData != NULL)
     {
         assert(mDir != 0L);
-        ::dsDataBufferDeAllocate(mDir, mData);
-        mData = 0L;
+        RemoveBuffer();
+    }
+
+    if (mPool != NULL)
+    {
+        // Hand any session still checked out back to the pool
+        if (mDir != 0L)
+            mPool->Checkin(mDir, mNode);
+        mNode = 0L;
+        mDir = 0L;
+        mManager->GetNodeCache()->Release(mPool);
+        mPool = NULL;
     }
 
     if (mNode != 0L)
@@ -79,25 +361,31 @@ CDirectoryService::~CDirectoryService()
 //
 CFMutableArrayRef CDirectoryService::ListNodes(bool using_python)
 {
-    try
-    {
-        StPythonThreadState threading(using_python);
-		
-        // Get list
-        return _ListNodes();
-    }
-    catch(CDirectoryServiceException& dserror)
-    {
-		if (using_python)
-			dserror.SetPythonException();
-        return NULL;
-    }
-    catch(...)
+    for(int attempt = 1; ; attempt++)
     {
-        CDirectoryServiceException dserror;
-		if (using_python)
-	        dserror.SetPythonException();
-        return NULL;
+        try
+        {
+            StPythonThreadState threading(using_python);
+			
+            // Get list
+            return _ListNodes();
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+				dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
     }
 }
 
@@ -111,25 +399,31 @@ CFMutableArrayRef CDirectoryService::ListNodes(bool using_python)
 //
 CFMutableDictionaryRef CDirectoryService::GetNodeAttributes(const char* nodename, CFDictionaryRef attributes, bool using_python)
 {
-    try
+    for(int attempt = 1; ; attempt++)
     {
-        StPythonThreadState threading(using_python);
-		
-        // Get list
-        return _GetNodeAttributes(nodename, attributes);
-    }
-    catch(CDirectoryServiceException& dserror)
-    {
-		if (using_python)
-			dserror.SetPythonException();
-        return NULL;
-    }
-    catch(...)
-    {
-        CDirectoryServiceException dserror;
-		if (using_python)
-	        dserror.SetPythonException();
-        return NULL;
+        try
+        {
+            StPythonThreadState threading(using_python);
+			
+            // Get list
+            return _GetNodeAttributes(nodename, attributes);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+				dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
     }
 }
 
@@ -148,25 +442,31 @@ CFMutableDictionaryRef CDirectoryService::GetNodeAttributes(const char* nodename
 //
 CFMutableArrayRef CDirectoryService::ListAllRecordsWithAttributes(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
 {
-    try
+    for(int attempt = 1; ; attempt++)
     {
-        StPythonThreadState threading(using_python);
+        try
+        {
+            StPythonThreadState threading(using_python);
 
-        // Get attribute map
-        return _ListAllRecordsWithAttributes(recordTypes, NULL, attributes, maxRecordCount);
-    }
-    catch(CDirectoryServiceException& dserror)
-    {
-		if (using_python)
-			dserror.SetPythonException();
-        return NULL;
-    }
-    catch(...)
-    {
-        CDirectoryServiceException dserror;
-		if (using_python)
-	        dserror.SetPythonException();
-        return NULL;
+            // Get attribute map
+            return _ListAllRecordsWithAttributes(recordTypes, NULL, attributes, maxRecordCount);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+				dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
     }
 }
 
@@ -188,64 +488,559 @@ CFMutableArrayRef CDirectoryService::ListAllRecordsWithAttributes(CFArrayRef rec
 //          or NULL if it fails.
 //
 CFMutableArrayRef CDirectoryService::QueryRecordsWithAttribute(const char* attr, const char* value, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            // Get attribute map
+            return _QueryRecordsWithAttributes(attr, value, matchType, NULL, casei, recordTypes, attributes, maxRecordCount);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// QueryRecordsWithAttributes
+//
+// Get specific attributes for one or more user records with matching attributes in the directory.
+//
+// @param query: the compund query string to use.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to list.
+// @param attributes: CFArray of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record, where the CFStringRef is the record name and CFMutableDictionaryRef of CFStringRef key
+//          and value entries for each attribute/value requested in the record indexed by uid,
+//          or NULL if it fails.
+//
+CFMutableArrayRef CDirectoryService::QueryRecordsWithAttributes(const char* query, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            // Get attribute map
+            return _QueryRecordsWithAttributes(NULL, NULL, 0, query, casei, recordTypes, attributes, maxRecordCount);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// GetRecordsByNames
+//
+// Get specific attributes for records with the given names in the directory.
+//
+// @param recordTypes: the record types to look in.
+// @param names: CFArray of CFString record names to look up.
+// @param attributes: CFArray of CFString listing the attributes to return for each record.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record, where the CFStringRef is the record name and CFMutableDictionaryRef of CFStringRef key
+//          and value entries for each attribute/value requested in the record indexed by uid,
+//          or NULL if it fails.
+//
+CFMutableArrayRef CDirectoryService::GetRecordsByNames(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            // Get attribute map
+            return _GetRecordsByNames(recordTypes, names, attributes);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// LoadMirror
+//
+// Load all records of the given types into the manager's mirror, replacing what it held before.
+// Exact lookups on indexed attributes are then answered from the mirror.
+//
+// @param recordTypes: the record types to mirror, none to empty the mirror.
+// @param attributes: CFArray of CFString listing the attributes to mirror for each record. The
+//                    indexed attributes are always mirrored.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the mirror was loaded, false if it fails.
+//
+bool CDirectoryService::LoadMirror(CFArrayRef recordTypes, CFDictionaryRef attributes, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            // Load records
+            _LoadMirror(recordTypes, attributes);
+            return true;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+		        dserror.SetPythonException();
+            return false;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return false;
+        }
+    }
+}
+
+// RefreshMirror
+//
+// Bring the manager's mirror up to date with the records changed since it was last loaded or
+// refreshed. A full reload is done instead when asked for or when the manager's reconcile interval
+// has passed since the last one, as that is the only way deleted records are noticed. A mirror
+// loaded from another node is left alone.
+//
+// @param full: true to reload the mirror completely, false to fetch changed records if possible.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the mirror was refreshed or is not loaded, false if it fails.
+//
+bool CDirectoryService::RefreshMirror(bool full, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            // Refresh records
+            _RefreshMirror(full);
+            return true;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            // A pooled reference may have gone stale, in which case retry once with a fresh one
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+			if (using_python)
+		        dserror.SetPythonException();
+            return false;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+			if (using_python)
+		        dserror.SetPythonException();
+            return false;
+        }
+    }
+}
+
+// WriteMirrorSnapshot
+//
+// Write the records held by the manager's mirror to a snapshot file, which other processes can
+// load to answer lookups without listing the directory first.
+//
+// @param path: the file to write, replaced if it exists.
+// @param written: set to true if the snapshot was written, false if the mirror is not loaded.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if no errors occurred, false if it fails.
+//
+bool CDirectoryService::WriteMirrorSnapshot(const char* path, bool& written, bool using_python)
 {
     try
     {
         StPythonThreadState threading(using_python);
 
-        // Get attribute map
-        return _QueryRecordsWithAttributes(attr, value, matchType, NULL, casei, recordTypes, attributes, maxRecordCount);
+        // Nothing to write without a manager
+        written = false;
+        if (mManager != NULL)
+            written = mManager->GetMirror()->WriteSnapshot(path);
+        return true;
     }
     catch(CDirectoryServiceException& dserror)
     {
-		if (using_python)
-	        dserror.SetPythonException();
-        return NULL;
+        if (using_python)
+            dserror.SetPythonException();
+        return false;
     }
     catch(...)
     {
         CDirectoryServiceException dserror;
-		if (using_python)
-	        dserror.SetPythonException();
-        return NULL;
+        if (using_python)
+            dserror.SetPythonException();
+        return false;
     }
 }
 
-// QueryRecordsWithAttributes
+// LoadMirrorSnapshot
 //
-// Get specific attributes for one or more user records with matching attributes in the directory.
+// Map a snapshot file into the manager's mirror, replacing what it held before. Lookups are answered
+// from the snapshot straight away, until the next refresh loads the mirror from the directory.
+//
+// @param path: the file written by WriteMirrorSnapshot.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the snapshot was loaded, false if it fails.
+//
+bool CDirectoryService::LoadMirrorSnapshot(const char* path, bool using_python)
+{
+    try
+    {
+        StPythonThreadState threading(using_python);
+
+        // Nothing to load into without a manager
+        if (mManager == NULL)
+            return false;
+        mManager->GetMirror()->LoadSnapshot(path);
+        return true;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        if (using_python)
+            dserror.SetPythonException();
+        return false;
+    }
+    catch(...)
+    {
+        CDirectoryServiceException dserror;
+        if (using_python)
+            dserror.SetPythonException();
+        return false;
+    }
+}
+
+// ListAllRecordsWithAttributesAsPython
+//
+// Get specific attributes for one or more user records in the directory, decoding the directory
+// data straight into Python objects rather than going through CoreFoundation. Must only be
+// called from Python.
+//
+// @param recordTypes: the record types to list.
+// @param attributes: CFArray of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param list: set to true to return a list of records, false to return a dict indexed by record name.
+// @return: PyObject dict of record name to dict of attributes, or list of [record name, dict of attributes]
+//          lists, or NULL if it fails.
+//
+PyObject* CDirectoryService::ListAllRecordsWithAttributesAsPython(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool list)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        PyObject* result = list ? PyList_New(0) : PyDict_New();
+        try
+        {
+            StPythonThreadState threading;
+
+            // Get attribute map
+            _ListAllRecordsWithAttributes(recordTypes, NULL, attributes, maxRecordCount, result);
+            return result;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            Py_DECREF(result);
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            Py_DECREF(result);
+            CDirectoryServiceException dserror;
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// QueryRecordsWithAttributeAsPython
+//
+// Get specific attributes for one or more user records with matching attribute/value in the directory,
+// decoding the directory data straight into Python objects. Must only be called from Python.
+//
+// @param attr: the attribute to query.
+// @param value: the value to query.
+// @param matchType: the match type to use.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to list.
+// @param attributes: CFArray of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param list: set to true to return a list of records, false to return a dict indexed by record name.
+// @return: PyObject dict of record name to dict of attributes, or list of [record name, dict of attributes]
+//          lists, or NULL if it fails.
+//
+PyObject* CDirectoryService::QueryRecordsWithAttributeAsPython(const char* attr, const char* value, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool list)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        PyObject* result = list ? PyList_New(0) : PyDict_New();
+        try
+        {
+            StPythonThreadState threading;
+
+            // Get attribute map
+            _QueryRecordsWithAttributes(attr, value, matchType, NULL, casei, recordTypes, attributes, maxRecordCount, result);
+            return result;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            Py_DECREF(result);
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            Py_DECREF(result);
+            CDirectoryServiceException dserror;
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// QueryRecordsWithAttributesAsPython
+//
+// Get specific attributes for one or more user records with matching attributes in the directory,
+// decoding the directory data straight into Python objects. Must only be called from Python.
 //
 // @param query: the compund query string to use.
 // @param casei: true if case-insensitive match is to be used, false otherwise.
 // @param recordTypes: the record types to list.
 // @param attributes: CFArray of CFString listing the attributes to return for each record.
 // @param maxRecordCount: maximum number of records to return (zero returns all).
-// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
-// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
-//          each record, where the CFStringRef is the record name and CFMutableDictionaryRef of CFStringRef key
-//          and value entries for each attribute/value requested in the record indexed by uid,
+// @param list: set to true to return a list of records, false to return a dict indexed by record name.
+// @return: PyObject dict of record name to dict of attributes, or list of [record name, dict of attributes]
+//          lists, or NULL if it fails.
+//
+PyObject* CDirectoryService::QueryRecordsWithAttributesAsPython(const char* query, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool list)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        PyObject* result = list ? PyList_New(0) : PyDict_New();
+        try
+        {
+            StPythonThreadState threading;
+
+            // Get attribute map
+            _QueryRecordsWithAttributes(NULL, NULL, 0, query, casei, recordTypes, attributes, maxRecordCount, result);
+            return result;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            Py_DECREF(result);
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            Py_DECREF(result);
+            CDirectoryServiceException dserror;
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// QueryNodesWithAttributesAsPython
+//
+// Run the same query against several nodes concurrently, each with its own session, and merge the
+// results. Querying the nodes of a search policy directly bounds the time taken by the slowest node
+// rather than the sum of all of them.
+//
+// @param nodes: CFArray of CFString node names to query.
+// @param attr: the attribute to query (NULL if compound is being used).
+// @param value: the value to query (NULL if compound is being used).
+// @param matchType: the match type to use (0 if compound is being used).
+// @param compound: the compound query to use rather than single attribute/value (NULL if compound is not being used).
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to check.
+// @param attributes: a list of attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param dedupe: true to return only the first record with each GeneratedUID, false to return all records.
+// @return: Python list of [name, dict] records ordered by record name, ties in node order,
 //          or NULL if it fails.
 //
-CFMutableArrayRef CDirectoryService::QueryRecordsWithAttributes(const char* query, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
+PyObject* CDirectoryService::QueryNodesWithAttributesAsPython(CFArrayRef nodes, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool dedupe)
 {
+    PyObject* result = PyList_New(0);
     try
     {
-        StPythonThreadState threading(using_python);
+        StPythonThreadState threading;
+
+        // Query nodes
+        _QueryNodes(nodes, attr, value, matchType, compound, casei, recordTypes, attributes, maxRecordCount, dedupe, result);
+        return result;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        Py_DECREF(result);
+        dserror.SetPythonException();
+        return NULL;
+    }
+    catch(...)
+    {
+        Py_DECREF(result);
+        CDirectoryServiceException dserror;
+        dserror.SetPythonException();
+        return NULL;
+    }
+}
+
+// NewQueryTask
+//
+// Create a task that runs a query on the manager's work queue.
+//
+// @param attr: the attribute to query, or NULL for a compound query.
+// @param value: the value to query, or NULL for a compound query.
+// @param matchType: the match type to use.
+// @param compound: compound query to use instead of attr, value and matchType, or NULL.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to query.
+// @param attributes: CFDictionary of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @return: the task, owned by the caller.
+//
+CDirectoryService::CAsyncTask* CDirectoryService::NewQueryTask(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount)
+{
+    return new CAsyncQueryTask(mManager, mNodeName, attr, value, matchType, compound, casei, recordTypes, attributes, maxRecordCount);
+}
+
+// GetRecordsByNamesAsPython
+//
+// Get specific attributes for records with the given names in the directory, decoding the directory
+// data straight into Python objects. Must only be called from Python.
+//
+// @param recordTypes: the record types to look in.
+// @param names: CFArray of CFString record names to look up.
+// @param attributes: CFArray of CFString listing the attributes to return for each record.
+// @param list: set to true to return a list of records, false to return a dict indexed by record name.
+// @return: PyObject dict of record name to dict of attributes, or list of [record name, dict of attributes]
+//          lists, or NULL if it fails.
+//
+PyObject* CDirectoryService::GetRecordsByNamesAsPython(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, bool list)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        PyObject* result = list ? PyList_New(0) : PyDict_New();
+        try
+        {
+            StPythonThreadState threading;
+
+            // Get attribute map
+            _GetRecordsByNames(recordTypes, names, attributes, result);
+            return result;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            Py_DECREF(result);
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            Py_DECREF(result);
+            CDirectoryServiceException dserror;
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// QueryRecordsWithAttributeValuesAsPython
+//
+// Look up records by several exact values of one attribute in a single call. The values are
+// split into chunks, each chunk is queried as one compound OR expression, and the chunks are
+// run concurrently.
+//
+// @param attr: the attribute to query.
+// @param values: CFArray of CFString values to look up.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to check.
+// @param attributes: a list of attributes to return.
+// @return: Python dict of each value to a list of the [name, dict] records that matched it,
+//          which is empty if none did, or NULL if it fails.
+//
+PyObject* CDirectoryService::QueryRecordsWithAttributeValuesAsPython(const char* attr, CFArrayRef values, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes)
+{
+    PyObject* result = PyDict_New();
+    try
+    {
+        StPythonThreadState threading;
 
-        // Get attribute map
-        return _QueryRecordsWithAttributes(NULL, NULL, 0, query, casei, recordTypes, attributes, maxRecordCount);
+        // Query values
+        _QueryRecordsWithAttributeValues(attr, values, casei, recordTypes, attributes, result);
+        return result;
     }
     catch(CDirectoryServiceException& dserror)
     {
-		if (using_python)
-	        dserror.SetPythonException();
+        Py_DECREF(result);
+        dserror.SetPythonException();
         return NULL;
     }
     catch(...)
     {
+        Py_DECREF(result);
         CDirectoryServiceException dserror;
-		if (using_python)
-	        dserror.SetPythonException();
+        dserror.SetPythonException();
         return NULL;
     }
 }
@@ -269,7 +1064,7 @@ CFMutableArrayRef CDirectoryService::_ListNodes()
         OpenService();
 		
         // We need a buffer for what comes next
-        CreateBuffer();
+        CreateBuffer("nodes");
 		
         result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
 
@@ -316,7 +1111,7 @@ CFMutableArrayRef CDirectoryService::_ListNodes()
             ::dsReleaseContinueData(mDir, context);
 
         RemoveBuffer();
-        CloseService();
+        DiscardService(dsStatus.GetDSError());
 		
         if (result != NULL)
         {
@@ -340,13 +1135,10 @@ CFMutableArrayRef CDirectoryService::_ListNodes()
 CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodename, CFDictionaryRef attributes)
 {
     CFMutableDictionaryRef result = NULL;
-    CFMutableArrayRef values = NULL;
 	tDirNodeReference node = 0L;
     tDataListPtr attrTypes = NULL;
     tContextData context = NULL;
     tAttributeListRef attrListRef = 0L;
-	tAttributeValueListRef attributeValueListRef = 0L;
-	tAttributeEntryPtr attributeInfoPtr = NULL;
 	
     try
     {
@@ -356,7 +1148,7 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
 		node = OpenNamedNode(nodename);
 		
         // We need a buffer for what comes next
-        CreateBuffer();
+        CreateBuffer("nodeinfo");
 		
         // Build data list of attributes
         attrTypes = ::dsDataListAllocate(mDir);
@@ -364,6 +1156,7 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
         BuildStringDataListFromKeys(attributes, attrTypes);
 		
         result = ::CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        CDirectoryServiceAttributeSchema schema(attributes);
 		
         do
         {
@@ -377,71 +1170,10 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
                     ReallocBuffer();
             } while(err == eDSBufferTooSmall);
             ThrowIfDSErr(err);
-            for(UInt32 i = 1; i <= attrCount; i++)
-            {
-				
-				ThrowIfDSErr(::dsGetAttributeEntry(node, mData, attrListRef, i, &attributeValueListRef, &attributeInfoPtr));
-				
-				if (attributeInfoPtr->fAttributeValueCount > 0)
-				{
-					// Determine what the attribute is and where in the result list it should be put
-					std::auto_ptr<char> attrname(CStringFromBuffer(&attributeInfoPtr->fAttributeSignature));
-					CFStringUtil cfattrname(attrname.get());
-					
-					// Determine whether string/base64 encoding is needed
-					bool base64 = false;
-					CFStringRef encoding = (CFStringRef)::CFDictionaryGetValue(attributes, cfattrname.get());
-					if (encoding && (::CFStringCompare(encoding, CFSTR("base64"), 0) == kCFCompareEqualTo))
-						base64 = true;
-					
-					if (attributeInfoPtr->fAttributeValueCount > 1)
-					{
-						values = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-						
-						for(unsigned long k = 1; k <= attributeInfoPtr->fAttributeValueCount; k++)
-						{
-							// Get the attribute value and store in results
-							tAttributeValueEntryPtr attributeValue = NULL;
-							ThrowIfDSErr(::dsGetAttributeValue(node, mData, k, attributeValueListRef, &attributeValue));
-							std::auto_ptr<char> data;
-							if (base64)
-								data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-							else
-								data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-							CFStringUtil strvalue(data.get());
-							::CFArrayAppendValue(values, strvalue.get());
-							::dsDeallocAttributeValueEntry(mDir, attributeValue);
-							attributeValue = NULL;
-						}
-						::CFDictionarySetValue(result, cfattrname.get(), values);
-						::CFRelease(values);
-						values = NULL;
-					}
-					else
-					{
-						// Get the attribute value and store in results
-						tAttributeValueEntryPtr attributeValue = NULL;
-						ThrowIfDSErr(::dsGetAttributeValue(node, mData, 1, attributeValueListRef, &attributeValue));
-						std::auto_ptr<char> data;
-						if (base64)
-							data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-						else
-							data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-						CFStringUtil strvalue(data.get());
-						if (strvalue.get() != NULL)
-						{
-							::CFDictionarySetValue(result, cfattrname.get(), strvalue.get());
-						}
-						::dsDeallocAttributeValueEntry(mDir, attributeValue);
-						attributeValue = NULL;
-					}
-				}
-				
-				::dsCloseAttributeValueList(attributeValueListRef);
-				attributeValueListRef = NULL;
-				::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
-				attributeInfoPtr = NULL;
-            }
+            CDirectoryServiceCFOutput output(result);
+            CDirectoryServiceRecordDecoder<CDirectoryServiceCFOutput>(mDir, node, mData, schema, output).DecodeAttributes(attrListRef, attrCount);
+            ::dsCloseAttributeList(attrListRef);
+            attrListRef = 0L;
         } while (context != NULL); // Loop until all data has been obtained.
 		
         ::dsDataListDeallocate(mDir, attrTypes);
@@ -457,10 +1189,8 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
     catch(CDirectoryServiceException& dsStatus)
     {
         // Cleanup
-        if (attributeValueListRef != 0L)
-			::dsCloseAttributeValueList(attributeValueListRef);
-        if (attributeInfoPtr != NULL)
-			::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
+        if (attrListRef != 0L)
+            ::dsCloseAttributeList(attrListRef);
         if (context != NULL)
             ::dsReleaseContinueData(mDir, context);
 		
@@ -476,13 +1206,8 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
 			::dsCloseDirNode(node);
 			node = 0L;
 		}
-        CloseService();
+        DiscardService(dsStatus.GetDSError());
 		
-        if (values != NULL)
-        {
-            ::CFRelease(values);
-            values = NULL;
-        }
         if (result != NULL)
         {
             ::CFRelease(result);
@@ -502,30 +1227,38 @@ CFMutableDictionaryRef CDirectoryService::_GetNodeAttributes(const char* nodenam
 // @param names: a list of record names to target if NULL all records are matched.
 // @param attributes: a list of attributes to return.
 // @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param pyresult: Python dict or list to add records to directly, or NULL to return CoreFoundation objects.
+// @param arenaresult: arena to add records to directly, used when the call runs without the GIL on a worker thread.
 // @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
 //          each record, where the CFStringRef is the record name and CFMutableDictionaryRef of CFStringRef key
 //          and value entries for each attribute/value requested in the record indexed by uid,
-//          or NULL if it fails.
+//          or NULL if it fails or pyresult or arenaresult is used.
 //
-CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, UInt32 maxRecordCount)
+CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, UInt32 maxRecordCount, PyObject* pyresult, CDirectoryServiceRecordArena* arenaresult)
 {
     CFMutableArrayRef result = NULL;
-    CFMutableArrayRef record_tuple = NULL;
-    CFMutableDictionaryRef record = NULL;
-    CFMutableArrayRef values = NULL;
     tDataListPtr recNames = NULL;
     tDataListPtr recTypes = NULL;
     tDataListPtr attrTypes = NULL;
     tContextData context = NULL;
-    tAttributeListRef attrListRef = 0L;
-    tRecordEntry* pRecEntry = NULL;
-	tAttributeValueListRef attributeValueListRef = 0L;
-	tAttributeEntryPtr attributeInfoPtr = NULL;
 
     // Must have attributes
     if (::CFDictionaryGetCount(attributes) == 0)
         return NULL;
 
+    // Resolve the requested attributes once for the whole query
+    CDirectoryServiceAttributeSchema schema(attributes);
+
+    // Run one call per record type concurrently if the manager wants that
+    if (UseFanOut(recordTypes))
+    {
+        CArenaTask prototype;
+        prototype.mNames = names;
+        prototype.mAttributes = attributes;
+        prototype.mMaxRecordCount = maxRecordCount;
+        return _FanOutRecordTypes(prototype, recordTypes, schema, maxRecordCount, pyresult, arenaresult);
+    }
+
     try
     {
         // Make sure we have a valid directory service
@@ -535,7 +1268,7 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
         OpenNode();
 
         // We need a buffer for what comes next
-        CreateBuffer();
+        CreateBuffer((names != NULL) ? "names" : "list", recordTypes);
 
         // Build data list of names
         recNames = ::dsDataListAllocate(mDir);
@@ -555,12 +1288,14 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
         ThrowIfNULL(attrTypes);
         BuildStringDataListFromKeys(attributes, attrTypes);
 
-        result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+        if ((pyresult == NULL) && (arenaresult == NULL))
+            result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
 
+        UInt32 total = 0;
         do
         {
-            // List all the appropriate records
-            UInt32 recCount = maxRecordCount;
+            // List all the appropriate records, never asking for more than the overall limit allows
+            UInt32 recCount = (maxRecordCount != 0) ? maxRecordCount - total : 0;
             tDirStatus err;
             do
             {
@@ -569,104 +1304,34 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
                     ReallocBuffer();
             } while(err == eDSBufferTooSmall);
             ThrowIfDSErr(err);
-            for(UInt32 i = 1; i <= recCount; i++)
-            {
-                // Get the record entry
-                ThrowIfDSErr(::dsGetRecordEntry(mNode, mData, i, &attrListRef, &pRecEntry));
-
-                // Get the entry's name
-                char* temp = NULL;
-                ThrowIfDSErr(::dsGetRecordNameFromEntry(pRecEntry, &temp));
-                std::auto_ptr<char> recname(temp);
-
-                // Create a dictionary for the values
-                record = ::CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-
-                // Look at each requested attribute and get one value
-                for(unsigned long j = 1; j <= pRecEntry->fRecordAttributeCount; j++)
-                {
-                    ThrowIfDSErr(::dsGetAttributeEntry(mNode, mData, attrListRef, j, &attributeValueListRef, &attributeInfoPtr));
-
-                    if (attributeInfoPtr->fAttributeValueCount > 0)
-                    {
-                        // Determine what the attribute is and where in the result list it should be put
-                        std::auto_ptr<char> attrname(CStringFromBuffer(&attributeInfoPtr->fAttributeSignature));
-                        CFStringUtil cfattrname(attrname.get());
-
-						// Determine whether string/base64 encoding is needed
-						bool base64 = false;
-						CFStringRef encoding = (CFStringRef)::CFDictionaryGetValue(attributes, cfattrname.get());
-						if (encoding && (::CFStringCompare(encoding, CFSTR("base64"), 0) == kCFCompareEqualTo))
-							base64 = true;
-
-                        if (attributeInfoPtr->fAttributeValueCount > 1)
-                        {
-                            values = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-
-                            for(unsigned long k = 1; k <= attributeInfoPtr->fAttributeValueCount; k++)
-                            {
-                                // Get the attribute value and store in results
-                                tAttributeValueEntryPtr attributeValue = NULL;
-                                ThrowIfDSErr(::dsGetAttributeValue(mNode, mData, k, attributeValueListRef, &attributeValue));
-								std::auto_ptr<char> data;
-								if (base64)
-									data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-								else
-									data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-                                CFStringUtil strvalue(data.get());
-                                ::CFArrayAppendValue(values, strvalue.get());
-                                ::dsDeallocAttributeValueEntry(mDir, attributeValue);
-                                attributeValue = NULL;
-                            }
-                            ::CFDictionarySetValue(record, cfattrname.get(), values);
-                            ::CFRelease(values);
-                            values = NULL;
-                        }
-                        else
-                        {
-                            // Get the attribute value and store in results
-                            tAttributeValueEntryPtr attributeValue = NULL;
-                            ThrowIfDSErr(::dsGetAttributeValue(mNode, mData, 1, attributeValueListRef, &attributeValue));
-                            std::auto_ptr<char> data;
-							if (base64)
-								data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-							else
-								data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-                            CFStringUtil strvalue(data.get());
-							if (strvalue.get() != NULL)
-							{
-								::CFDictionarySetValue(record, cfattrname.get(), strvalue.get());
-							}
-							::dsDeallocAttributeValueEntry(mDir, attributeValue);
-                            attributeValue = NULL;
-                        }
-                    }
 
-                    ::dsCloseAttributeValueList(attributeValueListRef);
-                    attributeValueListRef = NULL;
-                    ::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
-                    attributeInfoPtr = NULL;
-                }
+            // Never decode past the limit, whatever the directory sends back
+            if ((maxRecordCount != 0) && (recCount > maxRecordCount - total))
+                recCount = maxRecordCount - total;
+            if (pyresult != NULL)
+            {
+                // Decode directly into Python objects - the GIL is only held while this chunk is decoded
+                StPythonGILState gil;
+                CDirectoryServicePyOutput output(pyresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServicePyOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            else if (arenaresult != NULL)
+            {
+                CDirectoryServiceArenaOutput output(*arenaresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceArenaOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            else
+            {
+                CDirectoryServiceCFOutput output(result);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceCFOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            total += recCount;
 
-                // Create tuple of record name and record values
-                CFStringUtil str(recname.get());
-
-                record_tuple = ::CFArrayCreateMutable(kCFAllocatorDefault, 2, &kCFTypeArrayCallBacks);
-                ::CFArrayAppendValue(record_tuple, str.get());
-                ::CFArrayAppendValue(record_tuple, record);
-                ::CFRelease(record);
-                record = NULL;
-
-                // Append tuple to results array
-                ::CFArrayAppendValue(result, record_tuple);
-                ::CFRelease(record_tuple);
-                record_tuple = NULL;
-
-                // Clean-up
-                ::dsCloseAttributeList(attrListRef);
-                attrListRef = 0L;
-                ::dsDeallocRecordEntry(mDir, pRecEntry);
-                pRecEntry = NULL;
+            // Stop the directory gathering any more once the limit has been reached
+            if ((maxRecordCount != 0) && (total >= maxRecordCount) && (context != NULL))
+            {
+                ::dsReleaseContinueData(mDir, context);
+                context = NULL;
             }
         } while (context != NULL); // Loop until all data has been obtained.
 
@@ -684,16 +1349,8 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
     catch(CDirectoryServiceException& dsStatus)
     {
         // Cleanup
-        if (attributeValueListRef != 0L)
-			::dsCloseAttributeValueList(attributeValueListRef);
-        if (attributeInfoPtr != NULL)
-			::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
         if (context != NULL)
             ::dsReleaseContinueData(mDir, context);
-        if (attrListRef != 0L)
-            ::dsCloseAttributeList(attrListRef);
-        if (pRecEntry != NULL)
-            dsDeallocRecordEntry(mDir, pRecEntry);
         if (recNames != NULL)
         {
             ::dsDataListDeallocate(mDir, recNames);
@@ -714,31 +1371,88 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
         }
         RemoveBuffer();
         CloseNode();
-        CloseService();
+        DiscardService(dsStatus.GetDSError());
 
-        if (values != NULL)
+        if (result != NULL)
         {
-            ::CFRelease(values);
-            values = NULL;
+            ::CFRelease(result);
+            result = NULL;
         }
-        if (record != NULL)
+        throw;
+    }
+
+    return result;
+}
+
+// _GetRecordsByNames
+//
+// Get specific attributes for records with the given names. Long name lists are split into
+// several exact-name record list calls that run concurrently.
+//
+// @param recordTypes: the record types to look in.
+// @param names: CFArray of CFString record names to look up.
+// @param attributes: a list of attributes to return.
+// @param pyresult: Python dict or list to add records to directly, or NULL to return CoreFoundation objects.
+// @return: CFMutableArrayRef as returned by _ListAllRecordsWithAttributes, or NULL if pyresult is used.
+// @throw: yes
+//
+CFMutableArrayRef CDirectoryService::_GetRecordsByNames(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, PyObject* pyresult)
+{
+    // Short lists need only the one call, and no names match no records
+    CFIndex nameCount = ::CFArrayGetCount(names);
+    if (nameCount == 0)
+        return (pyresult == NULL) ? ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks) : NULL;
+    if (nameCount <= cNamesPerCall)
+        return _ListAllRecordsWithAttributes(recordTypes, names, attributes, 0, pyresult);
+
+    // Must have attributes
+    if (::CFDictionaryGetCount(attributes) == 0)
+        return NULL;
+
+    CDirectoryServiceAttributeSchema schema(attributes);
+    std::vector<CFArrayRef> chunks;
+    CFMutableArrayRef result = NULL;
+    try
+    {
+        CDirectoryServiceTaskGroup group((mManager != NULL) ? mManager->GetFanOutThreads() : 1);
+        for(CFIndex i = 0; i < nameCount; i += cNamesPerCall)
         {
-            ::CFRelease(record);
-            record = NULL;
+            CFIndex count = (nameCount - i < cNamesPerCall) ? nameCount - i : cNamesPerCall;
+            chunks.push_back(::CFArrayCreateMutable(kCFAllocatorDefault, count, &kCFTypeArrayCallBacks));
+            ::CFArrayAppendArray((CFMutableArrayRef)chunks.back(), names, ::CFRangeMake(i, count));
+
+            CArenaTask* task = new CArenaTask;
+            task->mManager = mManager;
+            task->mNodeName = mNodeName;
+            task->mNames = chunks.back();
+            task->mAttributes = attributes;
+            task->mRecordTypes = (CFArrayRef)::CFRetain(recordTypes);
+            group.Add(task);
         }
-        if (record_tuple != NULL)
+
+        group.Run();
+        group.ThrowIfFailed();
+
+        // Merge in the order of the names
+        if (pyresult == NULL)
+            result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+        for(size_t i = 0; i < group.GetCount(); i++)
         {
-            ::CFRelease(record_tuple);
-            record_tuple = NULL;
+            const CDirectoryServiceRecordArena& arena = static_cast<CArenaTask*>(group.GetTask(i))->mArena;
+            AppendRecords(arena, schema, arena.GetRecordCount(), pyresult, result);
         }
+    }
+    catch(...)
+    {
+        for(std::vector<CFArrayRef>::iterator iter = chunks.begin(); iter != chunks.end(); iter++)
+            ::CFRelease(*iter);
         if (result != NULL)
-        {
             ::CFRelease(result);
-            result = NULL;
-        }
         throw;
     }
 
+    for(std::vector<CFArrayRef>::iterator iter = chunks.begin(); iter != chunks.end(); iter++)
+        ::CFRelease(*iter);
     return result;
 }
 
@@ -754,32 +1468,160 @@ CFMutableArrayRef CDirectoryService::_ListAllRecordsWithAttributes(CFArrayRef re
 // @param recordTypes: the record type to check.
 // @param attributes: a list of attributes to return.
 // @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param pyresult: Python dict or list to add records to directly, or NULL to return CoreFoundation objects.
+// @param arenaresult: arena to add records to directly, used when the call runs without the GIL on a worker thread.
 // @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
 //          each record, where the CFStringRef is the record name and CFMutableDictionaryRef of CFStringRef key
 //          and value entries for each attribute/value requested in the record indexed by uid,
-//          or NULL if it fails.
+//          or NULL if it fails or pyresult or arenaresult is used.
 //
-CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount)
+CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, PyObject* pyresult, CDirectoryServiceRecordArena* arenaresult)
 {
     CFMutableArrayRef result = NULL;
-    CFMutableArrayRef record_tuple = NULL;
-    CFMutableDictionaryRef record = NULL;
-    CFMutableArrayRef values = NULL;
     tDataNodePtr queryAttr = NULL;
     tDataNodePtr queryValue = NULL;
     tDataListPtr recTypes = NULL;
     tDataListPtr attrTypes = NULL;
     tContextData context = NULL;
-    tAttributeListRef attrListRef = 0L;
-    tRecordEntry* pRecEntry = NULL;
-	tAttributeValueListRef attributeValueListRef = 0L;
-	tAttributeEntryPtr attributeInfoPtr = NULL;
 
 
     // Must have attributes
     if (::CFDictionaryGetCount(attributes) == 0)
         return NULL;
 
+    // Resolve the requested attributes once for the whole query
+    CDirectoryServiceAttributeSchema schema(attributes);
+
+    // Answer from the manager's mirror when it holds everything asked for: exact lookups of indexed
+    // attributes directly from an index, anything else by evaluating the query against the records
+    CDirectoryServiceMirror* mirror = ((mManager != NULL) && mUseMirror) ? mManager->GetMirror() : NULL;
+    if (mirror != NULL)
+    {
+        std::vector<std::string> types;
+        CFStringArrayToVector(recordTypes, types);
+        CDirectoryServiceRecordArena arena;
+        bool answered = false;
+        if (compound != NULL)
+        {
+            std::auto_ptr<CDirectoryServiceQueryExpression> expr(CDirectoryServiceQueryExpression::Parse(compound));
+            answered = (expr.get() != NULL) && mirror->QueryExpression(mNodeName, *expr, casei, types, schema, maxRecordCount, arena);
+        }
+        else if (((matchType & 0xFEFF) == eDSExact) && CDirectoryServiceMirror::IsIndexed(attr))
+            answered = mirror->Query(mNodeName, attr, value, casei, types, schema, maxRecordCount, arena);
+        else if (((matchType & 0xFEFF) >= eDSExact) && ((matchType & 0xFEFF) <= eDSContains))
+        {
+            CDirectoryServiceQueryExpression expr(attr, value, matchType & 0xFEFF);
+            answered = mirror->QueryExpression(mNodeName, expr, casei, types, schema, maxRecordCount, arena);
+        }
+        if (answered)
+        {
+            CFMutableArrayRef result = NULL;
+            if ((pyresult == NULL) && (arenaresult == NULL))
+                result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+            AppendRecords(arena, schema, arena.GetRecordCount(), pyresult, result, arenaresult);
+            return result;
+        }
+    }
+
+    // Answer from the manager's result cache when it is turned on. A miss is filled by making the
+    // call into an arena without the cache, so that it does not look itself up again.
+    CDirectoryServiceQueryCache* cache = (mUseCache && (mManager != NULL)) ? mManager->GetQueryCache() : NULL;
+    if ((cache != NULL) && cache->IsEnabled())
+    {
+        std::string key = QueryCacheKey(mNodeName, attr, value, matchType, compound, casei, recordTypes, schema, maxRecordCount);
+        CDirectoryServiceRecordArena arena;
+        if (!cache->Find(key, arena))
+        {
+            mUseCache = false;
+            try
+            {
+                _QueryRecordsWithAttributes(attr, value, matchType, compound, casei, recordTypes, attributes, maxRecordCount, NULL, &arena);
+            }
+            catch(...)
+            {
+                mUseCache = true;
+                throw;
+            }
+            mUseCache = true;
+            cache->Insert(key, arena);
+        }
+
+        CFMutableArrayRef result = NULL;
+        if ((pyresult == NULL) && (arenaresult == NULL))
+            result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+        AppendRecords(arena, schema, arena.GetRecordCount(), pyresult, result, arenaresult);
+        return result;
+    }
+
+    // Share the result of an identical query that is already in flight rather than repeating it. The
+    // first caller makes the call into a shared arena, without coalescing so that its own calls
+    // cannot end up waiting for it, and any others wait for it to finish.
+    CDirectoryServiceSingleFlight* flight = (mCoalesce && (mManager != NULL)) ? mManager->GetSingleFlight() : NULL;
+    if (flight != NULL)
+    {
+        std::string key = QueryCacheKey(mNodeName, attr, value, matchType, compound, casei, recordTypes, schema, maxRecordCount);
+        bool leader = false;
+        CDirectoryServiceSingleFlight::Call* call = flight->Join(key, leader);
+        tDirStatus error = eDSNoErr;
+        if (leader)
+        {
+            mCoalesce = false;
+            try
+            {
+                _QueryRecordsWithAttributes(attr, value, matchType, compound, casei, recordTypes, attributes, maxRecordCount, NULL, &call->GetArena());
+            }
+            catch(CDirectoryServiceException& dserror)
+            {
+                error = dserror.GetDSError();
+            }
+            catch(...)
+            {
+                error = eUndefinedError;
+            }
+            mCoalesce = true;
+            flight->Finish(key, call, error);
+        }
+        else
+            error = flight->Wait(call);
+
+        CFMutableArrayRef result = NULL;
+        try
+        {
+            ThrowIfDSErr(error);
+            if ((pyresult == NULL) && (arenaresult == NULL))
+                result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+            const CDirectoryServiceRecordArena& arena = call->GetArena();
+            AppendRecords(arena, schema, arena.GetRecordCount(), pyresult, result, arenaresult);
+        }
+        catch(...)
+        {
+            if (result != NULL)
+                ::CFRelease(result);
+            flight->Release(call);
+            throw;
+        }
+        flight->Release(call);
+        return result;
+    }
+
+    // Run one call per record type concurrently if the manager wants that
+    if (UseFanOut(recordTypes))
+    {
+        CArenaTask prototype;
+        prototype.mQuery = true;
+        prototype.mAttr = attr;
+        prototype.mValue = value;
+        prototype.mMatchType = matchType;
+        prototype.mCompound = compound;
+        prototype.mCaseI = casei;
+        prototype.mAttributes = attributes;
+        prototype.mMaxRecordCount = maxRecordCount;
+        prototype.mUseMirror = mUseMirror;
+        prototype.mCoalesce = mCoalesce;
+        prototype.mUseCache = mUseCache;
+        return _FanOutRecordTypes(prototype, recordTypes, schema, maxRecordCount, pyresult, arenaresult);
+    }
+
     try
     {
         // Make sure we have a valid directory service
@@ -789,7 +1631,7 @@ CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* att
         OpenNode();
 
         // We need a buffer for what comes next
-        CreateBuffer();
+        CreateBuffer("query", recordTypes);
 
         if (compound == NULL)
         {
@@ -826,117 +1668,50 @@ CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* att
         ThrowIfNULL(attrTypes);
         BuildStringDataListFromKeys(attributes, attrTypes);
 
-        result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+        if ((pyresult == NULL) && (arenaresult == NULL))
+            result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
 
+        UInt32 total = 0;
         do
         {
-            // List all the appropriate records
-            UInt32 recCount = maxRecordCount;
-            tDirStatus err;
-            do
-            {
-                err = ::dsDoAttributeValueSearchWithData(mNode, mData, recTypes, queryAttr, (tDirPatternMatch)matchType, queryValue, attrTypes, false, &recCount, &context);
-                if (err == eDSBufferTooSmall)
-                    ReallocBuffer();
-            } while(err == eDSBufferTooSmall);
-            ThrowIfDSErr(err);
-            for(UInt32 i = 1; i <= recCount; i++)
-            {
-                // Get the record entry
-                ThrowIfDSErr(::dsGetRecordEntry(mNode, mData, i, &attrListRef, &pRecEntry));
-
-                // Get the entry's name
-                char* temp = NULL;
-                ThrowIfDSErr(::dsGetRecordNameFromEntry(pRecEntry, &temp));
-                std::auto_ptr<char> recname(temp);
-
-                // Create a dictionary for the values
-                record = ::CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-
-                // Look at each requested attribute and get one value
-                for(unsigned long j = 1; j <= pRecEntry->fRecordAttributeCount; j++)
-                {
-                    ThrowIfDSErr(::dsGetAttributeEntry(mNode, mData, attrListRef, j, &attributeValueListRef, &attributeInfoPtr));
-
-                    if (attributeInfoPtr->fAttributeValueCount > 0)
-                    {
-                        // Determine what the attribute is and where in the result list it should be put
-                        std::auto_ptr<char> attrname(CStringFromBuffer(&attributeInfoPtr->fAttributeSignature));
-                        CFStringUtil cfattrname(attrname.get());
-
-						// Determine whether string/base64 encoding is needed
-						bool base64 = false;
-						CFStringRef encoding = (CFStringRef)::CFDictionaryGetValue(attributes, cfattrname.get());
-						if (encoding && (::CFStringCompare(encoding, CFSTR("base64"), 0) == kCFCompareEqualTo))
-							base64 = true;
-
-                        if (attributeInfoPtr->fAttributeValueCount > 1)
-                        {
-                            values = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
-
-                            for(unsigned long k = 1; k <= attributeInfoPtr->fAttributeValueCount; k++)
-                            {
-                                // Get the attribute value and store in results
-                                tAttributeValueEntryPtr attributeValue = NULL;
-                                ThrowIfDSErr(::dsGetAttributeValue(mNode, mData, k, attributeValueListRef, &attributeValue));
-								std::auto_ptr<char> data;
-								if (base64)
-									data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-								else
-									data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-                                CFStringUtil strvalue(data.get());
-								if (strvalue.get() != NULL)
-									::CFArrayAppendValue(values, strvalue.get());
-                                ::dsDeallocAttributeValueEntry(mDir, attributeValue);
-                                attributeValue = NULL;
-                            }
-                            ::CFDictionarySetValue(record, cfattrname.get(), values);
-                            ::CFRelease(values);
-                            values = NULL;
-                        }
-                        else
-                        {
-                            // Get the attribute value and store in results
-                            tAttributeValueEntryPtr attributeValue = NULL;
-                            ThrowIfDSErr(::dsGetAttributeValue(mNode, mData, 1, attributeValueListRef, &attributeValue));
-                            std::auto_ptr<char> data;
-							if (base64)
-								data.reset(CStringBase64FromBuffer(&attributeValue->fAttributeValueData));
-							else
-								data.reset(CStringFromBuffer(&attributeValue->fAttributeValueData));
-                            CFStringUtil strvalue(data.get());
-							if (strvalue.get() != NULL)
-								::CFDictionarySetValue(record, cfattrname.get(), strvalue.get());
-                            ::dsDeallocAttributeValueEntry(mDir, attributeValue);
-                            attributeValue = NULL;
-                        }
-                    }
+            // List all the appropriate records, never asking for more than the overall limit allows
+            UInt32 recCount = (maxRecordCount != 0) ? maxRecordCount - total : 0;
+            tDirStatus err;
+            do
+            {
+                err = ::dsDoAttributeValueSearchWithData(mNode, mData, recTypes, queryAttr, (tDirPatternMatch)matchType, queryValue, attrTypes, false, &recCount, &context);
+                if (err == eDSBufferTooSmall)
+                    ReallocBuffer();
+            } while(err == eDSBufferTooSmall);
+            ThrowIfDSErr(err);
 
-                    ::dsCloseAttributeValueList(attributeValueListRef);
-                    attributeValueListRef = NULL;
-                    ::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
-                    attributeInfoPtr = NULL;
-                }
+            // Never decode past the limit, whatever the directory sends back
+            if ((maxRecordCount != 0) && (recCount > maxRecordCount - total))
+                recCount = maxRecordCount - total;
+            if (pyresult != NULL)
+            {
+                // Decode directly into Python objects - the GIL is only held while this chunk is decoded
+                StPythonGILState gil;
+                CDirectoryServicePyOutput output(pyresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServicePyOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            else if (arenaresult != NULL)
+            {
+                CDirectoryServiceArenaOutput output(*arenaresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceArenaOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            else
+            {
+                CDirectoryServiceCFOutput output(result);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceCFOutput>(mDir, mNode, mData, schema, output).DecodeRecords(recCount);
+            }
+            total += recCount;
 
-                // Create tuple of record name and record values
-                CFStringUtil str(recname.get());
-
-                record_tuple = ::CFArrayCreateMutable(kCFAllocatorDefault, 2, &kCFTypeArrayCallBacks);
-                ::CFArrayAppendValue(record_tuple, str.get());
-                ::CFArrayAppendValue(record_tuple, record);
-                ::CFRelease(record);
-                record = NULL;
-
-                // Append tuple to results array
-                ::CFArrayAppendValue(result, record_tuple);
-                ::CFRelease(record_tuple);
-                record_tuple = NULL;
-
-                // Clean-up
-                ::dsCloseAttributeList(attrListRef);
-                attrListRef = 0L;
-                ::dsDeallocRecordEntry(mDir, pRecEntry);
-                pRecEntry = NULL;
+            // Stop the directory gathering any more once the limit has been reached
+            if ((maxRecordCount != 0) && (total >= maxRecordCount) && (context != NULL))
+            {
+                ::dsReleaseContinueData(mDir, context);
+                context = NULL;
             }
         } while (context != NULL); // Loop until all data has been obtained.
 
@@ -954,16 +1729,8 @@ CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* att
     catch(CDirectoryServiceException& dsStatus)
     {
         // Cleanup
-        if (attributeValueListRef != 0L)
-			::dsCloseAttributeValueList(attributeValueListRef);
-        if (attributeInfoPtr != NULL)
-			::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
         if (context != NULL)
             ::dsReleaseContinueData(mDir, context);
-        if (attrListRef != 0L)
-            ::dsCloseAttributeList(attrListRef);
-        if (pRecEntry != NULL)
-            dsDeallocRecordEntry(mDir, pRecEntry);
         if (recTypes != NULL)
         {
             ::dsDataListDeallocate(mDir, recTypes);
@@ -988,34 +1755,546 @@ CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* att
         }
         RemoveBuffer();
         CloseNode();
-        CloseService();
+        DiscardService(dsStatus.GetDSError());
+
+        if (result != NULL)
+        {
+            ::CFRelease(result);
+            result = NULL;
+        }
+        throw;
+    }
+
+    return result;
+}
+
+// _QueryNodes
+//
+// Run a query against several nodes concurrently and merge the results.
+//
+// @param nodes: CFArray of CFString node names to query.
+// @param attr: the attribute to query (NULL if compound is being used).
+// @param value: the value to query (NULL if compound is being used).
+// @param matchType: the match type to use (0 if compound is being used).
+// @param compound: the compound query to use rather than single attribute/value (NULL if compound is not being used).
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to check.
+// @param attributes: a list of attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param dedupe: true to return only the first record with each GeneratedUID. The GeneratedUID is
+//                fetched, and so returned, even if it is not in attributes.
+// @param pyresult: Python list to add records to.
+// @throw: yes
+//
+void CDirectoryService::_QueryNodes(CFArrayRef nodes, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool dedupe, PyObject* pyresult)
+{
+    // Must have attributes
+    if (::CFDictionaryGetCount(attributes) == 0)
+        return;
+
+    // De-duplicating needs the GeneratedUID of every record
+    CFMutableDictionaryRef queryAttributes = dedupe ? CopyAttributesAdding(attributes, CFSTR(kDS1AttrGeneratedUID)) : ::CFDictionaryCreateMutableCopy(kCFAllocatorDefault, 0, attributes);
+
+    try
+    {
+        CDirectoryServiceAttributeSchema schema(queryAttributes);
+
+        std::vector<std::string> nodeNames;
+        CFStringArrayToVector(nodes, nodeNames);
+
+        // One thread per node so the call takes as long as the slowest node
+        CDirectoryServiceTaskGroup group(nodeNames.size());
+        for(size_t i = 0; i < nodeNames.size(); i++)
+        {
+            CArenaTask* task = new CArenaTask;
+            task->mManager = mManager;
+            task->mNodeName = nodeNames[i].c_str();
+            task->mQuery = true;
+            task->mAttr = attr;
+            task->mValue = value;
+            task->mMatchType = matchType;
+            task->mCompound = compound;
+            task->mCaseI = casei;
+            task->mAttributes = queryAttributes;
+            task->mMaxRecordCount = maxRecordCount;
+            task->mUseMirror = false;
+            task->mRecordTypes = (CFArrayRef)::CFRetain(recordTypes);
+            group.Add(task);
+        }
+
+        group.Run();
+        group.ThrowIfFailed();
+
+        CDirectoryServiceRecordMerge merge(dedupe);
+        for(size_t i = 0; i < group.GetCount(); i++)
+            merge.Add(static_cast<CArenaTask*>(group.GetTask(i))->mArena);
+        CDirectoryServiceRecordMerge::TEntryList entries;
+        merge.Merge(entries, maxRecordCount);
+
+        StPythonGILState gil;
+        CDirectoryServicePyOutput output(pyresult);
+        for(CDirectoryServiceRecordMerge::TEntryList::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+            merge.GetArena((*iter).mArena).Replay(schema, output, (*iter).mRecord, 1);
+    }
+    catch(...)
+    {
+        ::CFRelease(queryAttributes);
+        throw;
+    }
+
+    ::CFRelease(queryAttributes);
+}
+
+// _LoadMirror
+//
+// Load all records of the given types into the manager's mirror, listing the record types concurrently.
+//
+// @param recordTypes: the record types to mirror, none to empty the mirror.
+// @param attributes: a list of attributes to mirror, to which the indexed attributes and the
+//                    modification timestamp are added.
+// @throw: yes
+//
+void CDirectoryService::_LoadMirror(CFArrayRef recordTypes, CFDictionaryRef attributes)
+{
+    // Nothing to load into without a manager
+    if (mManager == NULL)
+        return;
+    CDirectoryServiceMirror* mirror = mManager->GetMirror();
+
+    std::vector<std::string> types;
+    CFStringArrayToVector(recordTypes, types);
+    if (types.empty())
+    {
+        mirror->Clear();
+        return;
+    }
 
-        if (values != NULL)
+    CFMutableDictionaryRef mirrorAttributes = CopyAttributesAdding(attributes, CFSTR(kDS1AttrGeneratedUID));
+    try
+    {
+        ::CFDictionarySetValue(mirrorAttributes, CFSTR(kDSNAttrRecordName), CFSTR("str"));
+        ::CFDictionarySetValue(mirrorAttributes, CFSTR(kDSNAttrEMailAddress), CFSTR("str"));
+        ::CFDictionarySetValue(mirrorAttributes, CFSTR(kDSNAttrServicesLocator), CFSTR("str"));
+        ::CFDictionarySetValue(mirrorAttributes, CFSTR(kDS1AttrModificationTimestamp), CFSTR("str"));
+        CDirectoryServiceAttributeSchema schema(mirrorAttributes);
+
+        CDirectoryServiceTaskGroup group(mManager->GetFanOutThreads());
+        for(CFIndex i = 0; i < ::CFArrayGetCount(recordTypes); i++)
         {
-            ::CFRelease(values);
-            values = NULL;
+            const void* recordType = ::CFArrayGetValueAtIndex(recordTypes, i);
+            CArenaTask* task = new CArenaTask;
+            task->mManager = mManager;
+            task->mNodeName = mNodeName;
+            task->mUseMirror = false;
+            task->mCoalesce = false;
+            task->mUseCache = false;
+            task->mAttributes = mirrorAttributes;
+            task->mRecordTypes = ::CFArrayCreate(kCFAllocatorDefault, &recordType, 1, &kCFTypeArrayCallBacks);
+            group.Add(task);
         }
-        if (record != NULL)
+
+        group.Run();
+        group.ThrowIfFailed();
+
+        std::vector<const CDirectoryServiceRecordArena*> arenas;
+        for(size_t i = 0; i < group.GetCount(); i++)
+            arenas.push_back(&static_cast<CArenaTask*>(group.GetTask(i))->mArena);
+        mirror->Load(mNodeName, types, schema, arenas);
+    }
+    catch(...)
+    {
+        ::CFRelease(mirrorAttributes);
+        throw;
+    }
+
+    ::CFRelease(mirrorAttributes);
+}
+
+// _RefreshMirror
+//
+// Refresh the manager's mirror, either by fetching records with a ModificationTimestamp at or after the
+// watermark, or by reloading it completely.
+//
+// @param full: true to reload the mirror completely, false to fetch changed records if possible.
+// @throw: yes
+//
+void CDirectoryService::_RefreshMirror(bool full)
+{
+    // Nothing to refresh without a loaded mirror
+    if (mManager == NULL)
+        return;
+    CDirectoryServiceMirror* mirror = mManager->GetMirror();
+    std::string nodename;
+    std::vector<std::string> types;
+    std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind> profile;
+    std::string watermark;
+    CFAbsoluteTime loadedAt;
+    if (!mirror->GetProfile(nodename, types, profile, watermark, loadedAt))
+        return;
+
+    // The mirror only holds one node, so leave one loaded from another node alone
+    if (nodename != mNodeName)
+        return;
+
+    CFMutableArrayRef recordTypes = ::CFArrayCreateMutable(kCFAllocatorDefault, types.size(), &kCFTypeArrayCallBacks);
+    CFMutableDictionaryRef attributes = ::CFDictionaryCreateMutable(kCFAllocatorDefault, profile.size(), &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    try
+    {
+        for(std::vector<std::string>::const_iterator iter = types.begin(); iter != types.end(); iter++)
         {
-            ::CFRelease(record);
-            record = NULL;
+            CFStringUtil type((*iter).c_str());
+            ::CFArrayAppendValue(recordTypes, type.get());
         }
-        if (record_tuple != NULL)
+        for(std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>::const_iterator iter = profile.begin(); iter != profile.end(); iter++)
         {
-            ::CFRelease(record_tuple);
-            record_tuple = NULL;
+            CFStringUtil name((*iter).first.c_str());
+            ::CFDictionarySetValue(attributes, name.get(), ((*iter).second == CDirectoryServiceAttributeSchema::eDecodeBase64) ? CFSTR("base64") : CFSTR("str"));
         }
-        if (result != NULL)
+
+        // Only a full reload notices deleted records, so do one every so often
+        CFTimeInterval interval = mManager->GetMirrorReconcileInterval();
+        if (full || watermark.empty() || ((interval > 0) && (::CFAbsoluteTimeGetCurrent() - loadedAt >= interval)))
+            _LoadMirror(recordTypes, attributes);
+        else
         {
-            ::CFRelease(result);
-            result = NULL;
+            // Records changed in the same second as the watermark may not have been seen yet
+            std::string compound = "(|(" kDS1AttrModificationTimestamp ">" + watermark + ")(" kDS1AttrModificationTimestamp "=" + watermark + "))";
+
+            // Go to the directory every time, as a cached or shared result would hide the changes
+            CDirectoryServiceTaskGroup group(mManager->GetFanOutThreads());
+            for(CFIndex i = 0; i < ::CFArrayGetCount(recordTypes); i++)
+            {
+                const void* recordType = ::CFArrayGetValueAtIndex(recordTypes, i);
+                CArenaTask* task = new CArenaTask;
+                task->mManager = mManager;
+                task->mNodeName = mNodeName;
+                task->mQuery = true;
+                task->mCompound = compound.c_str();
+                task->mUseMirror = false;
+                task->mCoalesce = false;
+                task->mUseCache = false;
+                task->mAttributes = attributes;
+                task->mRecordTypes = ::CFArrayCreate(kCFAllocatorDefault, &recordType, 1, &kCFTypeArrayCallBacks);
+                group.Add(task);
+            }
+
+            group.Run();
+            group.ThrowIfFailed();
+
+            for(size_t i = 0; i < group.GetCount(); i++)
+            {
+                const CDirectoryServiceRecordArena& arena = static_cast<CArenaTask*>(group.GetTask(i))->mArena;
+                for(size_t j = 0; j < arena.GetRecordCount(); j++)
+                    mirror->Put(types[i], arena, j);
+            }
+        }
+    }
+    catch(...)
+    {
+        ::CFRelease(attributes);
+        ::CFRelease(recordTypes);
+        throw;
+    }
+
+    ::CFRelease(attributes);
+    ::CFRelease(recordTypes);
+}
+
+// _QueryRecordsWithAttributeValues
+//
+// Look up records by several exact values of one attribute, and work out which values each record
+// matched. Values holding characters that have a meaning in compound queries are looked up on their
+// own rather than escaped, as are chunks of one value.
+//
+// @param attr: the attribute to query.
+// @param values: CFArray of CFString values to look up.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to check.
+// @param attributes: a list of attributes to return. The queried attribute is always fetched, and so returned.
+// @param pyresult: Python dict to add each value and its matching records to.
+// @throw: yes
+//
+void CDirectoryService::_QueryRecordsWithAttributeValues(const char* attr, CFArrayRef values, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, PyObject* pyresult)
+{
+    std::vector<std::string> requested;
+    CFStringArrayToVector(values, requested);
+
+    // Look up each distinct value once
+    std::vector<std::string> valueList;
+    std::set<std::string> distinct;
+    for(std::vector<std::string>::const_iterator iter = requested.begin(); iter != requested.end(); iter++)
+    {
+        if (distinct.insert(*iter).second)
+            valueList.push_back(*iter);
+    }
+
+    // Every value is in the result, even if nothing matches it
+    {
+        StPythonGILState gil;
+        for(std::vector<std::string>::const_iterator iter = valueList.begin(); iter != valueList.end(); iter++)
+        {
+            PyObject* records = PyList_New(0);
+            ThrowIfNULL(records);
+            int err = PyDict_SetItemString(pyresult, (*iter).c_str(), records);
+            Py_DECREF(records);
+            ThrowIfPyErr(err);
+        }
+    }
+
+    // Must have attributes
+    if ((valueList.size() == 0) || (::CFDictionaryGetCount(attributes) == 0))
+        return;
+
+    // Split the values into chunks and build each chunk's query
+    size_t width = (mManager != NULL) ? mManager->GetBatchWidth() : 32;
+    std::vector<std::string> queries;
+    std::vector< std::vector<size_t> > chunks;
+    std::vector<size_t> current;
+    for(size_t i = 0; i <= valueList.size(); i++)
+    {
+        bool single = (i < valueList.size()) && (valueList[i].find_first_of("()*\\") != std::string::npos);
+        if ((current.size() > 0) && ((i == valueList.size()) || single || (current.size() == width)))
+        {
+            std::string query;
+            if (current.size() > 1)
+            {
+                query = "(|";
+                for(std::vector<size_t>::const_iterator iter = current.begin(); iter != current.end(); iter++)
+                    query += "(" + std::string(attr) + "=" + valueList[*iter] + ")";
+                query += ")";
+            }
+            queries.push_back(query);
+            chunks.push_back(current);
+            current.clear();
+        }
+        if (single)
+        {
+            queries.push_back(std::string());
+            chunks.push_back(std::vector<size_t>(1, i));
+        }
+        else if (i < valueList.size())
+            current.push_back(i);
+    }
+
+    // Map each value back to its index, exactly and case-insensitively
+    std::map<std::string, std::vector<size_t> > exactValues;
+    std::map<std::string, std::vector<size_t> > lowerValues;
+    std::vector<size_t> valueChunks(valueList.size());
+    for(size_t i = 0; i < chunks.size(); i++)
+    {
+        for(std::vector<size_t>::const_iterator iter = chunks[i].begin(); iter != chunks[i].end(); iter++)
+        {
+            valueChunks[*iter] = i;
+            exactValues[valueList[*iter]].push_back(*iter);
+            lowerValues[LowerCase(valueList[*iter].data(), valueList[*iter].size())].push_back(*iter);
+        }
+    }
+
+    // Matching records to values needs the queried attribute
+    CFStringUtil cfattr(attr);
+    CFMutableDictionaryRef queryAttributes = CopyAttributesAdding(attributes, cfattr.get());
+    try
+    {
+        CDirectoryServiceAttributeSchema schema(queryAttributes);
+
+        CDirectoryServiceTaskGroup group((mManager != NULL) ? mManager->GetFanOutThreads() : 1);
+        for(size_t i = 0; i < chunks.size(); i++)
+        {
+            CArenaTask* task = new CArenaTask;
+            task->mManager = mManager;
+            task->mNodeName = mNodeName;
+            task->mQuery = true;
+            if (queries[i].empty())
+            {
+                task->mAttr = attr;
+                task->mValue = valueList[chunks[i][0]].c_str();
+                task->mMatchType = eDSExact;
+            }
+            else
+                task->mCompound = queries[i].c_str();
+            task->mCaseI = casei;
+            task->mAttributes = queryAttributes;
+            task->mRecordTypes = (CFArrayRef)::CFRetain(recordTypes);
+            group.Add(task);
+        }
+
+        group.Run();
+        group.ThrowIfFailed();
+
+        StPythonGILState gil;
+        for(size_t i = 0; i < group.GetCount(); i++)
+        {
+            const CDirectoryServiceRecordArena& arena = static_cast<CArenaTask*>(group.GetTask(i))->mArena;
+            for(size_t j = 0; j < arena.GetRecordCount(); j++)
+            {
+                // Find the values of this chunk that the record matched
+                std::set<size_t> matched;
+                const CDirectoryServiceRecordArena::Record& record = arena.GetRecord(j);
+                for(size_t k = 0; k < record.mAttributeCount; k++)
+                {
+                    const CDirectoryServiceRecordArena::Attribute& attribute = arena.GetAttribute(record, k);
+                    if (::strcmp(arena.GetString(attribute.mName), attr) != 0)
+                        continue;
+                    for(size_t l = 0; l < attribute.mValueCount; l++)
+                    {
+                        const CDirectoryServiceRecordArena::Value& value = arena.GetValue(attribute, l);
+                        const std::vector<size_t>* indexes = NULL;
+                        std::map<std::string, std::vector<size_t> >::const_iterator found = exactValues.find(std::string(arena.GetString(value), value.mLength));
+                        if (found != exactValues.end())
+                            indexes = &(*found).second;
+                        else if (casei)
+                        {
+                            found = lowerValues.find(LowerCase(arena.GetString(value), value.mLength));
+                            if (found != lowerValues.end())
+                                indexes = &(*found).second;
+                        }
+                        if (indexes == NULL)
+                            continue;
+                        for(std::vector<size_t>::const_iterator iter = indexes->begin(); iter != indexes->end(); iter++)
+                        {
+                            if (valueChunks[*iter] == i)
+                                matched.insert(*iter);
+                        }
+                    }
+                }
+                if (matched.empty())
+                    continue;
+
+                // Decode the record once and add it to each value it matched
+                PyObject* decoded = PyList_New(0);
+                ThrowIfNULL(decoded);
+                try
+                {
+                    CDirectoryServicePyOutput output(decoded);
+                    arena.Replay(schema, output, j, 1);
+                    if (PyList_GET_SIZE(decoded) == 1)
+                    {
+                        PyObject* item = PyList_GET_ITEM(decoded, 0);
+                        for(std::set<size_t>::const_iterator iter = matched.begin(); iter != matched.end(); iter++)
+                        {
+                            PyObject* records = PyDict_GetItemString(pyresult, valueList[*iter].c_str());
+                            ThrowIfNULL(records);
+                            ThrowIfPyErr(PyList_Append(records, item));
+                        }
+                    }
+                }
+                catch(...)
+                {
+                    Py_DECREF(decoded);
+                    throw;
+                }
+                Py_DECREF(decoded);
+            }
         }
+    }
+    catch(...)
+    {
+        ::CFRelease(queryAttributes);
         throw;
     }
 
+    ::CFRelease(queryAttributes);
+}
+
+// UseFanOut
+//
+// Check whether a call covering the given record types should be split into per-type calls.
+//
+// @param recordTypes: the record types of the call.
+// @return: true if the manager has fan-out enabled and there is more than one record type, false otherwise.
+//
+bool CDirectoryService::UseFanOut(CFArrayRef recordTypes) const
+{
+    return (mManager != NULL) && mManager->GetFanOut() && (::CFArrayGetCount(recordTypes) > 1);
+}
+
+// _FanOutRecordTypes
+//
+// Run a list or query call as one call per record type, concurrently and without the GIL, then
+// merge the results in the order the record types were given.
+//
+// @param prototype: task holding the arguments of the call, copied for each record type.
+// @param recordTypes: the record types to split the call over.
+// @param schema: the schema for the requested attributes.
+// @param maxRecordCount: maximum number of records to return overall (zero returns all).
+// @param pyresult: Python dict or list to add records to directly, or NULL to return CoreFoundation objects.
+// @param arenaresult: arena to add records to directly, or NULL.
+// @return: CFMutableArrayRef as returned by _ListAllRecordsWithAttributes, or NULL if pyresult or arenaresult is used.
+// @throw: yes
+//
+CFMutableArrayRef CDirectoryService::_FanOutRecordTypes(const CArenaTask& prototype, CFArrayRef recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, PyObject* pyresult, CDirectoryServiceRecordArena* arenaresult)
+{
+    CDirectoryServiceTaskGroup group(mManager->GetFanOutThreads());
+    CFIndex typeCount = ::CFArrayGetCount(recordTypes);
+    for(CFIndex i = 0; i < typeCount; i++)
+    {
+        const void* recordType = ::CFArrayGetValueAtIndex(recordTypes, i);
+        CArenaTask* task = new CArenaTask(prototype);
+        task->mManager = mManager;
+        task->mNodeName = mNodeName;
+        task->mRecordTypes = ::CFArrayCreate(kCFAllocatorDefault, &recordType, 1, &kCFTypeArrayCallBacks);
+        group.Add(task);
+    }
+
+    group.Run();
+    group.ThrowIfFailed();
+
+    // Merge in record type order, keeping to the overall record limit
+    CFMutableArrayRef result = NULL;
+    if ((pyresult == NULL) && (arenaresult == NULL))
+        result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+    size_t remaining = maxRecordCount;
+    for(size_t i = 0; i < group.GetCount(); i++)
+    {
+        const CDirectoryServiceRecordArena& arena = static_cast<CArenaTask*>(group.GetTask(i))->mArena;
+        size_t count = arena.GetRecordCount();
+        if (maxRecordCount != 0)
+        {
+            if (count > remaining)
+                count = remaining;
+            remaining -= count;
+        }
+
+        AppendRecords(arena, schema, count, pyresult, result, arenaresult);
+
+        if ((maxRecordCount != 0) && (remaining == 0))
+            break;
+    }
+
     return result;
 }
 
+// AppendRecords
+//
+// Add records held in an arena to whichever kind of result a call is building.
+//
+// @param arena: the arena holding the records.
+// @param schema: the schema the records were decoded with.
+// @param count: the number of records to add, from the start of the arena.
+// @param pyresult: Python dict or list to add records to, or NULL.
+// @param result: CFMutableArray to add records to, or NULL.
+// @param arenaresult: arena to add records to, or NULL.
+//
+void CDirectoryService::AppendRecords(const CDirectoryServiceRecordArena& arena, const CDirectoryServiceAttributeSchema& schema, size_t count, PyObject* pyresult, CFMutableArrayRef result, CDirectoryServiceRecordArena* arenaresult)
+{
+    if (pyresult != NULL)
+    {
+        StPythonGILState gil;
+        CDirectoryServicePyOutput output(pyresult);
+        arena.Replay(schema, output, 0, count);
+    }
+    else if (arenaresult != NULL)
+    {
+        CDirectoryServiceArenaOutput output(*arenaresult);
+        arena.Replay(schema, output, 0, count);
+    }
+    else
+    {
+        CDirectoryServiceCFOutput output(result);
+        arena.Replay(schema, output, 0, count);
+    }
+}
+
 // OpenService
 //
 // Open the directory service.
@@ -1024,7 +2303,12 @@ CFMutableArrayRef CDirectoryService::_QueryRecordsWithAttributes(const char* att
 //
 void CDirectoryService::OpenService()
 {
-    if (mDir == 0L)
+    if ((mDir == 0L) && (mPool != NULL))
+    {
+        // A pooled session comes with our node already open
+        mPool->Checkout(mDir, mNode);
+    }
+    else if (mDir == 0L)
     {
     	tDirStatus dirStatus = ::dsOpenDirService(&mDir);
         if (dirStatus != eDSNoErr)
@@ -1037,17 +2321,77 @@ void CDirectoryService::OpenService()
 
 // CloseService
 //
-// Close the directory service if previously open.
+// Close the directory service if previously open, or return it to the session pool.
 //
 void CDirectoryService::CloseService()
 {
-    if (mDir != 0L)
+    if ((mDir != 0L) && (mPool != NULL))
+    {
+        mSessionDir = mDir;
+        mSessionNode = mNode;
+        mPool->Checkin(mDir, mNode);
+        mNode = 0L;
+        mDir = 0L;
+    }
+    else if (mDir != 0L)
     {
         ::dsCloseDirService(mDir);
         mDir = 0L;
     }
 }
 
+// DiscardService
+//
+// Called instead of CloseService when a call fails. A pooled session that hit a stale reference is
+// not returned to the pool, so no other caller can pick it up before RecoverSession runs: a bad node
+// reference only causes the node to be closed, a bad directory reference closes the whole session.
+// Any other failure closes the service as usual.
+//
+// @param error: the error the call failed with.
+//
+void CDirectoryService::DiscardService(tDirStatus error)
+{
+    if ((mDir == 0L) || (mPool == NULL) || !CDirectoryServiceSessionPool::IsStaleReference(error))
+    {
+        CloseService();
+        return;
+    }
+
+    mSessionDir = mDir;
+    mSessionNode = mNode;
+    if (error == eDSInvalidNodeRef)
+    {
+        if (mNode != 0L)
+            ::dsCloseDirNode(mNode);
+        mPool->Checkin(mDir, 0L);
+    }
+    else
+        mPool->Discard(mDir, mNode);
+    mNode = 0L;
+    mDir = 0L;
+}
+
+// RecoverSession
+//
+// Called when a call fails. If the failure was caused by a stale reference in a pooled session,
+// the broken reference is discarded so that the call can be retried with a fresh one, and the node
+// is reported to the node cache as failing.
+//
+// @param dserror: the error the call failed with.
+// @return: true if the call should be retried, false otherwise.
+//
+bool CDirectoryService::RecoverSession(const CDirectoryServiceException& dserror)
+{
+    if ((mPool == NULL) || !CDirectoryServiceSessionPool::IsStaleReference(dserror.GetDSError()))
+        return false;
+
+    mPool->Invalidate(mSessionDir, mSessionNode, dserror.GetDSError());
+    mManager->GetNodeCache()->ReportFailure(mPool, dserror.GetDSError());
+    mSessionDir = 0L;
+    mSessionNode = 0L;
+    return true;
+}
+
 // OpenNode
 //
 // Open a node in the directory.
@@ -1056,7 +2400,9 @@ void CDirectoryService::CloseService()
 //
 void CDirectoryService::OpenNode()
 {
-    mNode = OpenNamedNode(mNodeName);
+    // Pooled sessions already have the node open
+    if (mNode == 0L)
+        mNode = OpenNamedNode(mNodeName);
 }
 
 // OpenNamedNode
@@ -1111,7 +2457,8 @@ tDirNodeReference CDirectoryService::OpenNamedNode(const char* nodename)
 //
 void CDirectoryService::CloseNode()
 {
-    if (mNode != 0L)
+    // Pooled node references go back to the pool with the session in CloseService
+    if ((mNode != 0L) && (mPool == NULL))
     {
         ::dsCloseDirNode(mNode);
         mNode = 0L;
@@ -1120,13 +2467,32 @@ void CDirectoryService::CloseNode()
 
 // CreateBuffer
 //
-// Create a data buffer for use with directory service calls.
+// Create a data buffer for use with directory service calls. With a buffer pool, a recycled buffer
+// sized for the kind of call is used.
 //
+// @param operation: name of the call the buffer is for.
+// @param recordTypes: the record types the call is for, or NULL.
 // @throw: yes
 //
-void CDirectoryService::CreateBuffer()
+void CDirectoryService::CreateBuffer(const char* operation, CFArrayRef recordTypes)
 {
-    if (mData == NULL)
+    if ((mData == NULL) && (mBufferPool != NULL))
+    {
+        mBufferKey = (operation != NULL) ? operation : "";
+        if (recordTypes != NULL)
+        {
+            for(CFIndex i = 0; i < ::CFArrayGetCount(recordTypes); i++)
+            {
+                CFStringUtil recordType((CFStringRef)::CFArrayGetValueAtIndex(recordTypes, i));
+                mBufferKey += ":";
+                mBufferKey += recordType.temp_str();
+            }
+        }
+        mData = mBufferPool->Acquire(mDir, mBufferKey);
+        mDataSize = mData->fBufferSize;
+        mBufferReallocs = 0;
+    }
+    else if (mData == NULL)
     {
         mData = ::dsDataBufferAllocate(mDir, cBufferSize);
         if (mData == NULL)
@@ -1139,11 +2505,16 @@ void CDirectoryService::CreateBuffer()
 
 // RemoveBuffer
 //
-// Destroy the data buffer.
+// Destroy the data buffer, or return it to the buffer pool.
 //
 void CDirectoryService::RemoveBuffer()
 {
-    if (mData != NULL)
+    if ((mData != NULL) && (mBufferPool != NULL))
+    {
+        mBufferPool->Release(mDir, mData, mBufferKey, mBufferReallocs);
+        mData = NULL;
+    }
+    else if (mData != NULL)
     {
         ::dsDataBufferDeAllocate(mDir, mData);
         mData = NULL;
@@ -1156,7 +2527,15 @@ void CDirectoryService::RemoveBuffer()
 //
 void CDirectoryService::ReallocBuffer()
 {
-    RemoveBuffer();
+    if (mBufferPool != NULL)
+    {
+        // The outgrown buffer can still serve smaller calls
+        mBufferPool->Recycle(mDir, mData);
+        mData = NULL;
+        mBufferReallocs++;
+    }
+    else
+        RemoveBuffer();
     mData = ::dsDataBufferAllocate(mDir, 2 * mDataSize);
     if (mData == NULL)
     {
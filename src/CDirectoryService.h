@@ -19,16 +19,26 @@
 
 #pragma once
 
+#include "CDirectoryServiceTaskGroup.h"
+
 #include <CoreFoundation/CoreFoundation.h>
 #include <DirectoryService/DirectoryService.h>
 #include <Python.h>
 
+#include <string>
+
 class CFStringUtil;
+class CDirectoryServiceBufferPool;
+class CDirectoryServiceException;
+class CDirectoryServiceManager;
+class CDirectoryServiceAttributeSchema;
+class CDirectoryServiceRecordArena;
+class CDirectoryServiceSessionPool;
 
 class CDirectoryService
 {
 public:
-    CDirectoryService(const char* nodename);
+    CDirectoryService(const char* nodename, CDirectoryServiceManager* manager=NULL);
     virtual ~CDirectoryService();
 
     CFMutableArrayRef		ListNodes(bool using_python=true);
@@ -38,6 +48,31 @@ public:
     CFMutableArrayRef QueryRecordsWithAttribute(const char* attr, const char* value, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool using_python=true);
     CFMutableArrayRef QueryRecordsWithAttributes(const char* query, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool using_python=true);
 
+    CFMutableArrayRef GetRecordsByNames(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, bool using_python=true);
+
+    bool LoadMirror(CFArrayRef recordTypes, CFDictionaryRef attributes, bool using_python=true);
+    bool RefreshMirror(bool full=false, bool using_python=true);
+    bool WriteMirrorSnapshot(const char* path, bool& written, bool using_python=true);
+    bool LoadMirrorSnapshot(const char* path, bool using_python=true);
+
+    PyObject* ListAllRecordsWithAttributesAsPython(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool list=false);
+    PyObject* QueryRecordsWithAttributeAsPython(const char* attr, const char* value, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool list=false);
+    PyObject* QueryRecordsWithAttributesAsPython(const char* query, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool list=false);
+
+    PyObject* GetRecordsByNamesAsPython(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attributes, bool list=false);
+    PyObject* QueryRecordsWithAttributeValuesAsPython(const char* attr, CFArrayRef values, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes);
+    PyObject* QueryNodesWithAttributesAsPython(CFArrayRef nodes, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool dedupe=false);
+
+    // A call run on the manager's work queue. Run is called on a worker thread without the GIL,
+    // GetResultAsPython with the GIL once the call has completed without error.
+    class CAsyncTask : public CDirectoryServiceTask
+    {
+    public:
+        virtual PyObject* GetResultAsPython() = 0;
+    };
+
+    CAsyncTask* NewQueryTask(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0);
+
 protected:
 
     class StPythonThreadState
@@ -61,26 +96,72 @@ protected:
         PyThreadState* mSavedState;
     };
 
+    // Re-acquires the GIL for a thread that released it via StPythonThreadState.
+    class StPythonGILState
+    {
+    public:
+        StPythonGILState()
+        {
+			mState = PyGILState_Ensure();
+		}
+
+        ~StPythonGILState()
+        {
+			PyGILState_Release(mState);
+        }
+
+    private:
+        PyGILState_STATE mState;
+    };
+
+    class CArenaTask;
+    class CAsyncQueryTask;
+
     const char*           mNodeName;
     tDirReference         mDir;
     tDirNodeReference     mNode;
     tDataBufferPtr        mData;
     UInt32                mDataSize;
 
+    CDirectoryServiceManager*       mManager;
+    bool                            mUseMirror;         // false for calls that feed the mirror
+    bool                            mCoalesce;          // false for calls made on behalf of coalesced queries
+    bool                            mUseCache;          // false for calls that fill the query cache
+    CDirectoryServiceSessionPool*   mPool;
+    tDirReference                   mSessionDir;        // last pooled session used, for RecoverSession
+    tDirNodeReference               mSessionNode;
+
+    CDirectoryServiceBufferPool*    mBufferPool;
+    std::string                     mBufferKey;         // operation and record types mData was acquired for
+    UInt32                          mBufferReallocs;
+
     CFMutableArrayRef _ListNodes();
     CFMutableDictionaryRef	_GetNodeAttributes(const char* nodename, CFDictionaryRef attributes);
 
-    CFMutableArrayRef _ListAllRecordsWithAttributes(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attrs, UInt32 maxRecordCount);
-    CFMutableArrayRef _QueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attrs, UInt32 maxRecordCount);
+    CFMutableArrayRef _ListAllRecordsWithAttributes(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attrs, UInt32 maxRecordCount, PyObject* pyresult=NULL, CDirectoryServiceRecordArena* arenaresult=NULL);
+    CFMutableArrayRef _QueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attrs, UInt32 maxRecordCount, PyObject* pyresult=NULL, CDirectoryServiceRecordArena* arenaresult=NULL);
+
+    CFMutableArrayRef _GetRecordsByNames(CFArrayRef recordTypes, CFArrayRef names, CFDictionaryRef attrs, PyObject* pyresult=NULL);
+    void _LoadMirror(CFArrayRef recordTypes, CFDictionaryRef attrs);
+    void _RefreshMirror(bool full);
+    void _QueryRecordsWithAttributeValues(const char* attr, CFArrayRef values, bool casei, CFArrayRef recordTypes, CFDictionaryRef attrs, PyObject* pyresult);
+    void _QueryNodes(CFArrayRef nodes, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attrs, UInt32 maxRecordCount, bool dedupe, PyObject* pyresult);
+
+    bool UseFanOut(CFArrayRef recordTypes) const;
+    CFMutableArrayRef _FanOutRecordTypes(const CArenaTask& prototype, CFArrayRef recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, PyObject* pyresult, CDirectoryServiceRecordArena* arenaresult=NULL);
+    void AppendRecords(const CDirectoryServiceRecordArena& arena, const CDirectoryServiceAttributeSchema& schema, size_t count, PyObject* pyresult, CFMutableArrayRef result, CDirectoryServiceRecordArena* arenaresult=NULL);
+    static std::string QueryCacheKey(const char* nodename, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount);
 
     virtual void OpenService();
     virtual void CloseService();
+    virtual void DiscardService(tDirStatus error);
+    bool RecoverSession(const CDirectoryServiceException& dserror);
 
     void OpenNode();
     virtual tDirNodeReference OpenNamedNode(const char* nodename);
     void CloseNode();
 
-    void CreateBuffer();
+    void CreateBuffer(const char* operation=NULL, CFArrayRef recordTypes=NULL);
     void RemoveBuffer();
     void ReallocBuffer();
 
@@ -0,0 +1,115 @@
+/**
+ * A class that pre-resolves the attributes requested by a Directory
+ * Service query so that returned attributes can be decoded quickly.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceAttributeSchema.h"
+
+#include "CDirectoryServiceException.h"
+#include "CFStringUtil.h"
+
+#include <string.h>
+
+#pragma mark -----Public API
+
+// Compile the requested attribute dictionary into slots and a hash table.
+//
+// @param attributes: CFDictionary of CFString attribute name to CFString encoding ("str" or "base64").
+// @throw: yes
+//
+CDirectoryServiceAttributeSchema::CDirectoryServiceAttributeSchema(CFDictionaryRef attributes)
+{
+    CFIndex count = ::CFDictionaryGetCount(attributes);
+    std::vector<const void*> keys(count);
+    std::vector<const void*> values(count);
+    if (count > 0)
+        ::CFDictionaryGetKeysAndValues(attributes, &keys[0], &values[0]);
+
+    // Keep the table at most half full so probe sequences stay short
+    size_t tableSize = 8;
+    while(tableSize < (size_t)count * 2)
+        tableSize <<= 1;
+    mTable.assign(tableSize, -1);
+    mTableMask = tableSize - 1;
+
+    mSlots.reserve(count);
+    for(CFIndex i = 0; i < count; i++)
+    {
+        CFStringUtil name((CFStringRef)keys[i]);
+        const char* cname = name.temp_str();
+        ThrowIfNULL(cname);
+
+        Slot slot;
+        slot.mIndex = mSlots.size();
+        slot.mName = cname;
+        CFStringRef encoding = (CFStringRef)values[i];
+        if (encoding && (::CFStringCompare(encoding, CFSTR("base64"), 0) == kCFCompareEqualTo))
+            slot.mKind = eDecodeBase64;
+        else
+            slot.mKind = eDecodeString;
+        slot.mCFName = (CFStringRef)keys[i];
+        ::CFRetain(slot.mCFName);
+        mSlots.push_back(slot);
+
+        size_t pos = Hash(slot.mName.data(), slot.mName.size()) & mTableMask;
+        while(mTable[pos] != -1)
+            pos = (pos + 1) & mTableMask;
+        mTable[pos] = slot.mIndex;
+    }
+}
+
+CDirectoryServiceAttributeSchema::~CDirectoryServiceAttributeSchema()
+{
+    for(std::vector<Slot>::iterator iter = mSlots.begin(); iter != mSlots.end(); iter++)
+        ::CFRelease((*iter).mCFName);
+}
+
+// Find
+//
+// Look up the slot for an attribute signature returned by Directory Services.
+//
+// @param name: the attribute signature bytes (need not be NUL terminated).
+// @param len: the length of the signature.
+// @return: the matching slot, or NULL if the attribute was not requested.
+//
+const CDirectoryServiceAttributeSchema::Slot* CDirectoryServiceAttributeSchema::Find(const char* name, size_t len) const
+{
+    size_t pos = Hash(name, len) & mTableMask;
+    while(mTable[pos] != -1)
+    {
+        const Slot& slot = mSlots[mTable[pos]];
+        if ((slot.mName.size() == len) && (::memcmp(slot.mName.data(), name, len) == 0))
+            return &slot;
+        pos = (pos + 1) & mTableMask;
+    }
+
+    return NULL;
+}
+
+#pragma mark -----Private API
+
+// 32-bit FNV-1a hash of the signature bytes.
+UInt32 CDirectoryServiceAttributeSchema::Hash(const char* name, size_t len)
+{
+    UInt32 result = 2166136261U;
+    for(size_t i = 0; i < len; i++)
+    {
+        result ^= (unsigned char)name[i];
+        result *= 16777619U;
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+/**
+ * A class that pre-resolves the attributes requested by a Directory
+ * Service query so that returned attributes can be decoded quickly.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <string>
+#include <vector>
+
+// Built once per query from the requested attribute dictionary (attribute name to encoding).
+// Each attribute gets a slot holding its decode kind and a ready made CFString key, found by a
+// single hash probe on the raw attribute signature bytes returned by Directory Services.
+class CDirectoryServiceAttributeSchema
+{
+public:
+    enum EDecodeKind
+    {
+        eDecodeString,
+        eDecodeBase64
+    };
+
+    struct Slot
+    {
+        size_t          mIndex;
+        std::string     mName;
+        EDecodeKind     mKind;
+        CFStringRef     mCFName;
+    };
+
+    explicit CDirectoryServiceAttributeSchema(CFDictionaryRef attributes);
+    ~CDirectoryServiceAttributeSchema();
+
+    size_t GetCount() const
+    {
+        return mSlots.size();
+    }
+    const Slot& GetSlot(size_t index) const
+    {
+        return mSlots[index];
+    }
+
+    const Slot* Find(const char* name, size_t len) const;
+
+private:
+    std::vector<Slot>   mSlots;
+    std::vector<int>    mTable;         // open addressing table of slot indexes, -1 when empty
+    size_t              mTableMask;
+
+    static UInt32 Hash(const char* name, size_t len);
+
+    // Not copyable as the slots own their CFString keys
+    CDirectoryServiceAttributeSchema(const CDirectoryServiceAttributeSchema& copy);
+    CDirectoryServiceAttributeSchema& operator=(const CDirectoryServiceAttributeSchema& copy);
+};
@@ -26,11 +26,80 @@
 #endif
 #define kSASLDIGESTMD5 "DIGEST-MD5"
 
+// Runs a Basic or Digest authentication on the manager's work queue, using a session from the
+// manager's auth pool. The password is wiped as soon as it has been used.
+class CDirectoryServiceAuth::CAsyncAuthTask : public CDirectoryService::CAsyncTask
+{
+public:
+    std::string     mNodeName;
+    std::string     mUser;
+    std::string     mPassword;          // Basic only
+    std::string     mChallenge;         // Digest only
+    std::string     mResponse;
+    std::string     mMethod;
+    bool            mDigest;
+    bool            mResult;
+    CDirectoryServiceAuthPool*  mAuthPool;
+    CDirectoryServiceAuthCache* mAuthCache;
+
+    CAsyncAuthTask()
+    {
+        mAuthPool = NULL;
+        mAuthCache = NULL;
+        mDigest = false;
+        mResult = false;
+    }
+
+    virtual ~CAsyncAuthTask()
+    {
+        WipePassword();
+    }
+
+    virtual PyObject* GetResultAsPython()
+    {
+        PyObject* result = mResult ? Py_True : Py_False;
+        Py_INCREF(result);
+        return result;
+    }
+
+protected:
+    virtual void Run()
+    {
+        CDirectoryServiceAuth auth(mAuthPool, mAuthCache);
+        if (mDigest)
+            mResult = auth.NativeAuthenticationDigestToNode(mNodeName.c_str(), mUser.c_str(), mChallenge.c_str(), mResponse.c_str(), mMethod.c_str());
+        else
+        {
+            try
+            {
+                mResult = auth.NativeAuthenticationBasicToNode(mNodeName.c_str(), mUser.c_str(), mPassword.c_str());
+            }
+            catch(...)
+            {
+                WipePassword();
+                throw;
+            }
+            WipePassword();
+        }
+    }
+
+    void WipePassword()
+    {
+        for(std::string::iterator iter = mPassword.begin(); iter != mPassword.end(); iter++)
+            *iter = 0;
+        mPassword.clear();
+    }
+};
+
 #pragma mark -----Public API
 
-CDirectoryServiceAuth::CDirectoryServiceAuth() :
+CDirectoryServiceAuth::CDirectoryServiceAuth(CDirectoryServiceAuthPool* pool, CDirectoryServiceAuthCache* cache, CDirectoryServiceChallengePool* challenges) :
 	CDirectoryService("")
 {
+	mAuthPool = pool;
+	mSessions = NULL;
+	mAuthCache = cache;
+	mChallengePool = challenges;
 }
 
 CDirectoryServiceAuth::~CDirectoryServiceAuth()
@@ -142,7 +211,8 @@ bool CDirectoryServiceAuth::AuthenticateUserDigestToActiveDirectory(const char*
 
 // GetDigestMD5ChallengeFromActiveDirectory
 //
-// Authenticate a user to the directory using SASL Digest credentials.
+// Authenticate a user to the directory using SASL Digest credentials. A challenge prefetched by
+// the challenge pool is used if one is ready.
 //
 // @param nodename: the directory nodename for the user record.
 // @return: challange as CFStringRef
@@ -152,7 +222,9 @@ CFStringRef CDirectoryServiceAuth::GetDigestMD5ChallengeFromActiveDirectory(cons
     try
     {
         StPythonThreadState threading(using_python);
-		CFStringRef challenge = NULL;
+		CFStringRef challenge = (mChallengePool != NULL) ? mChallengePool->Take(nodename) : NULL;
+		if (challenge != NULL)
+			return challenge;
         (void) NativeAuthenticationSASLDigestToNode(nodename, "anonymous", "", &challenge);
         return challenge;
     }
@@ -172,6 +244,51 @@ CFStringRef CDirectoryServiceAuth::GetDigestMD5ChallengeFromActiveDirectory(cons
 }
 
 
+// NewAuthenticateUserBasicTask
+//
+// Create a task that authenticates a user with plain text credentials on the manager's work queue.
+//
+// @param nodename: the directory nodename for the user record.
+// @param user: the identifier/directory record name of the user.
+// @param pswd: the plain text password to authenticate with.
+// @return: the task, owned by the caller.
+//
+CDirectoryService::CAsyncTask* CDirectoryServiceAuth::NewAuthenticateUserBasicTask(const char* nodename, const char* user, const char* pswd)
+{
+    CAsyncAuthTask* result = new CAsyncAuthTask;
+    result->mAuthPool = mAuthPool;
+    result->mAuthCache = mAuthCache;
+    result->mNodeName = nodename;
+    result->mUser = user;
+    result->mPassword = pswd;
+    return result;
+}
+
+// NewAuthenticateUserDigestTask
+//
+// Create a task that authenticates a user with HTTP DIGEST credentials on the manager's work queue.
+//
+// @param nodename: the directory nodename for the user record.
+// @param user: the identifier/directory record name of the user.
+// @param challenge: HTTP challenge sent by server.
+// @param response: HTTP response sent by client.
+// @param method: the HTTP method of the request.
+// @return: the task, owned by the caller.
+//
+CDirectoryService::CAsyncTask* CDirectoryServiceAuth::NewAuthenticateUserDigestTask(const char* nodename, const char* user, const char* challenge, const char* response, const char* method)
+{
+    CAsyncAuthTask* result = new CAsyncAuthTask;
+    result->mAuthPool = mAuthPool;
+    result->mAuthCache = mAuthCache;
+    result->mDigest = true;
+    result->mNodeName = nodename;
+    result->mUser = user;
+    result->mChallenge = challenge;
+    result->mResponse = response;
+    result->mMethod = method;
+    return result;
+}
+
 #pragma mark -----Private API
 
 // NativeAuthenticationBasicToNode
@@ -191,6 +308,10 @@ bool CDirectoryServiceAuth::NativeAuthenticationBasicToNode(const char* nodename
     tDataBufferPtr authData = NULL;
     tContextData context = NULL;
 
+    // A password matching a recent successful authentication needs no round trip
+    if ((mAuthCache != NULL) && mAuthCache->Verify(nodename, user, pswd))
+        return true;
+
     try
     {
         // Make sure we have a valid directory service
@@ -223,6 +344,8 @@ bool CDirectoryServiceAuth::NativeAuthenticationBasicToNode(const char* nodename
         // Do authentication
         tDirStatus dirStatus = ::dsDoDirNodeAuth(node, authType, true,  authData,  mData, &context);
         result = (dirStatus == eDSNoErr);
+        if (result && (mAuthCache != NULL))
+            mAuthCache->Insert(nodename, user, pswd);
 
         // Cleanup
         ::dsDataBufferDeAllocate(mDir, authData);
@@ -231,11 +354,13 @@ bool CDirectoryServiceAuth::NativeAuthenticationBasicToNode(const char* nodename
         authType = NULL;
         RemoveBuffer();
 
-		// If fatal error, force full reset
+		// If fatal error, reopen the session, leaving other nodes alone
 		if (not result and (dirStatus != eDSAuthFailed))
 		{
-			CloseService();
+			DiscardService(dirStatus);
 		}
+		else
+			ReleaseService();
     }
     catch(...)
     {
@@ -320,11 +445,13 @@ bool CDirectoryServiceAuth::NativeAuthenticationDigestToNode(const char* nodenam
         authType = NULL;
         RemoveBuffer();
 
-		// If fatal error, force full reset
+		// If fatal error, reopen the session, leaving other nodes alone
 		if (not result and (dirStatus != eDSAuthFailed))
 		{
-			CloseService();
+			DiscardService(dirStatus);
 		}
+		else
+			ReleaseService();
     }
     catch(...)
     {
@@ -413,11 +540,13 @@ bool CDirectoryServiceAuth::NativeAuthenticationSASLDigestToNode(const char* nod
         authType = NULL;
         RemoveBuffer();
 
-		// If fatal error, force full reset
+		// If fatal error, reopen the session, leaving other nodes alone
 		if (not result and (dirStatus != eDSAuthFailed))
 		{
-			CloseService();
+			DiscardService(dirStatus);
 		}
+		else
+			ReleaseService();
     }
     catch(...)
     {
@@ -483,29 +612,69 @@ bool CDirectoryServiceAuth::NativeGenerateClientResponse(const char* serverChall
 */
 
 
+// OpenService
+//
+// Open the directory service unless sessions come from the auth pool, in which case one is checked
+// out together with the node by OpenNamedNode.
+//
+// @throw: yes
+//
+void CDirectoryServiceAuth::OpenService()
+{
+    if (mAuthPool == NULL)
+        CDirectoryService::OpenService();
+}
+
 // CloseService
 //
-// Close the directory service if previously open.
-// Also close any open/cached nodes.
+// Close the directory service if previously open, or discard a session checked out from the auth
+// pool. Also close any open node.
 //
 void CDirectoryServiceAuth::CloseService()
 {
-    if (mDir != 0L)
+    DiscardService(eDSOperationFailed);
+}
+
+// DiscardService
+//
+// Discard a session checked out from the auth pool after a call using it failed, so its node is
+// reopened. Without an auth pool the node and the directory service are closed.
+//
+// @param error: the error the call failed with.
+//
+void CDirectoryServiceAuth::DiscardService(tDirStatus error)
+{
+    if (mSessions != NULL)
+        mAuthPool->Discard(mSessions, mDir, mNode, error);
+    else if (mNode != 0L)
     {
-		// Close all open nodes
-		for(TNodeMap::const_iterator iter = mNodeMap.begin(); iter != mNodeMap.end(); iter++)
-		{
-            ::dsCloseDirNode((*iter).second);
-		}
-		mNodeMap.clear();
+        ::dsCloseDirNode(mNode);
+        mNode = 0L;
     }
-	
+
 	CDirectoryService::CloseService();
 }
 
+// ReleaseService
+//
+// Return a session checked out from the auth pool once a call is done with it. Without a pool the
+// node is closed and the directory service is kept open for the next call.
+//
+void CDirectoryServiceAuth::ReleaseService()
+{
+    if (mSessions != NULL)
+        mAuthPool->Checkin(mSessions, mDir, mNode);
+    else if (mNode != 0L)
+    {
+        ::dsCloseDirNode(mNode);
+        mNode = 0L;
+    }
+}
+
 // OpenNamedNode
 //
-// Open a named node in the directory.
+// Open a named node in the directory. With an auth pool a session on the node is checked out, which
+// usually comes with the node already open.
 //
 // @param nodename: the name of the node to open.
 // @return: node reference if success, NULL otherwise.
@@ -513,16 +682,9 @@ void CDirectoryServiceAuth::CloseService()
 //
 tDirNodeReference CDirectoryServiceAuth::OpenNamedNode(const char* nodename)
 {
-	// Check cache first
-    tDirNodeReference result = NULL;
-	TNodeMap::const_iterator found = mNodeMap.find(nodename);
-	if (found != mNodeMap.end())
-	{
-		return (*found).second;
-	}
-	
-	// Create a new one and cache
-	result = CDirectoryService::OpenNamedNode(nodename);
-	mNodeMap[nodename] = result;
-    return result;
+    if (mAuthPool != NULL)
+        mAuthPool->Checkout(nodename, mSessions, mDir, mNode);
+    else
+        mNode = CDirectoryService::OpenNamedNode(nodename);
+    return mNode;
 }
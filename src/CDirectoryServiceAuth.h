@@ -20,14 +20,14 @@
 #pragma once
 
 #include "CDirectoryService.h"
-
-#include <map>
-#include <string>
+#include "CDirectoryServiceAuthCache.h"
+#include "CDirectoryServiceAuthPool.h"
+#include "CDirectoryServiceChallengePool.h"
 
 class CDirectoryServiceAuth : public CDirectoryService
 {
 public:
-    CDirectoryServiceAuth();
+    CDirectoryServiceAuth(CDirectoryServiceAuthPool* pool=NULL, CDirectoryServiceAuthCache* cache=NULL, CDirectoryServiceChallengePool* challenges=NULL);
     virtual ~CDirectoryServiceAuth();
 
     bool AuthenticateUserBasic(const char* nodename, const char* user, const char* pswd, bool& result, bool using_python=true);
@@ -36,15 +36,25 @@ public:
 	
 	CFStringRef GetDigestMD5ChallengeFromActiveDirectory(const char* nodename, bool using_python=true);
 
+    CAsyncTask* NewAuthenticateUserBasicTask(const char* nodename, const char* user, const char* pswd);
+    CAsyncTask* NewAuthenticateUserDigestTask(const char* nodename, const char* user, const char* challenge, const char* response, const char* method);
+
 protected:
 
-	typedef std::map<std::string, tDirNodeReference> TNodeMap;
-	TNodeMap mNodeMap;
+    class CAsyncAuthTask;
+
+	CDirectoryServiceAuthPool* mAuthPool;     // sessions are checked out for each call when set
+	CDirectoryServiceSessionPool* mSessions;  // the node's session pool while a session is checked out
+	CDirectoryServiceAuthCache* mAuthCache;   // remembers successful Basic authentications when set
+	CDirectoryServiceChallengePool* mChallengePool;   // hands out prefetched SASL challenges when set
 
     bool NativeAuthenticationBasicToNode(const char* nodename, const char* user, const char* pswd);
     bool NativeAuthenticationDigestToNode(const char* nodename, const char* user, const char* challenge, const char* response, const char* method);
 	bool NativeAuthenticationSASLDigestToNode(const char* nodename, const char* user, const char* sasldata, CFStringRef* saslResult = NULL);
 
+    virtual void OpenService();
     virtual void CloseService();
+    virtual void DiscardService(tDirStatus error);
+    void ReleaseService();
     virtual tDirNodeReference OpenNamedNode(const char* nodename);
 };
@@ -0,0 +1,269 @@
+/**
+ * A class that remembers recent successful Basic authentications as
+ * salted, slow-hashed password verifiers.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#include "CDirectoryServiceAuthCache.h"
+
+#include <CommonCrypto/CommonHMAC.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark -----Public API
+
+CDirectoryServiceAuthCache::CDirectoryServiceAuthCache(size_t maxEntries)
+{
+    mTTL = 0;
+    mIterations = 1000;
+    mMaxEntries = maxEntries;
+    mHits = 0;
+    mMisses = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceAuthCache::~CDirectoryServiceAuthCache()
+{
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// SetTTL
+//
+// Change how long a successful authentication is remembered for. Zero turns the cache off and
+// forgets everything in it.
+//
+// @param ttl: the time to live in seconds.
+//
+void CDirectoryServiceAuthCache::SetTTL(CFTimeInterval ttl)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mTTL = ttl;
+    if (mTTL <= 0)
+        mEntries.clear();
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// SetIterations
+//
+// Change the number of PBKDF2 iterations used for new verifiers. Existing entries keep the count
+// they were made with.
+//
+// @param iterations: the iteration count, at least one.
+//
+void CDirectoryServiceAuthCache::SetIterations(UInt32 iterations)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mIterations = (iterations > 0) ? iterations : 1;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Verify
+//
+// Check a password against the remembered authentication for a user. The verifier is derived
+// without holding the lock.
+//
+// @param nodename: the directory nodename for the user record.
+// @param user: the identifier/directory record name of the user.
+// @param pswd: the plain text password.
+// @return: true if the password matches an unexpired entry, false if the directory must be asked.
+//
+bool CDirectoryServiceAuthCache::Verify(const char* nodename, const char* user, const char* pswd)
+{
+    if (!IsEnabled())
+        return false;
+
+    std::string key = MakeKey(nodename, user);
+    Entry entry;
+    bool found = false;
+
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator iter = mEntries.find(key);
+    if ((iter != mEntries.end()) && ((*iter).second.mExpires <= ::CFAbsoluteTimeGetCurrent()))
+    {
+        mEntries.erase(iter);
+        iter = mEntries.end();
+    }
+    if (iter != mEntries.end())
+    {
+        entry = (*iter).second;
+        found = true;
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    bool result = false;
+    if (found)
+    {
+        UInt8 verifier[cVerifierSize];
+        DeriveVerifier(pswd, entry.mSalt, entry.mIterations, verifier);
+
+        // Compare in constant time
+        UInt8 diff = 0;
+        for(size_t i = 0; i < cVerifierSize; i++)
+            diff |= verifier[i] ^ entry.mVerifier[i];
+        result = (diff == 0);
+        ::memset(verifier, 0, sizeof(verifier));
+    }
+
+    ::pthread_mutex_lock(&mMutex);
+    if (result)
+        mHits++;
+    else
+        mMisses++;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// Insert
+//
+// Remember a successful authentication, replacing any entry for the user. Must only be called
+// once the directory has accepted the password.
+//
+// @param nodename: the directory nodename for the user record.
+// @param user: the identifier/directory record name of the user.
+// @param pswd: the plain text password that was accepted.
+//
+void CDirectoryServiceAuthCache::Insert(const char* nodename, const char* user, const char* pswd)
+{
+    if (!IsEnabled())
+        return;
+
+    Entry entry;
+    for(size_t i = 0; i < cSaltSize; i++)
+        entry.mSalt[i] = (UInt8)::arc4random();
+
+    ::pthread_mutex_lock(&mMutex);
+    entry.mIterations = mIterations;
+    ::pthread_mutex_unlock(&mMutex);
+
+    DeriveVerifier(pswd, entry.mSalt, entry.mIterations, entry.mVerifier);
+
+    ::pthread_mutex_lock(&mMutex);
+    if (mTTL > 0)
+    {
+        entry.mExpires = ::CFAbsoluteTimeGetCurrent() + mTTL;
+        mEntries[MakeKey(nodename, user)] = entry;
+        Trim();
+    }
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Invalidate
+//
+// Forget remembered authentications, for example after a password change.
+//
+// @param nodename: the node to forget entries for, or NULL for all nodes.
+// @param user: the user to forget the entry for, or NULL for all users of the node.
+//
+void CDirectoryServiceAuthCache::Invalidate(const char* nodename, const char* user)
+{
+    ::pthread_mutex_lock(&mMutex);
+    if (nodename == NULL)
+        mEntries.clear();
+    else if (user != NULL)
+        mEntries.erase(MakeKey(nodename, user));
+    else
+    {
+        std::string prefix = MakeKey(nodename, "");
+        TEntryMap::iterator iter = mEntries.lower_bound(prefix);
+        while((iter != mEntries.end()) && ((*iter).first.compare(0, prefix.size(), prefix) == 0))
+            mEntries.erase(iter++);
+    }
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// GetStatistics
+//
+// Add the cache's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceAuthCache::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["auth_cache_hits"] = mHits;
+    stats["auth_cache_misses"] = mMisses;
+    stats["auth_cache_entries"] = mEntries.size();
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+// The node name cannot contain a NUL, so it separates the node from the user.
+std::string CDirectoryServiceAuthCache::MakeKey(const char* nodename, const char* user)
+{
+    std::string result(nodename);
+    result += '\0';
+    result += user;
+    return result;
+}
+
+// DeriveVerifier
+//
+// Derive a verifier from a password with PBKDF2-HMAC-SHA256 (RFC 2898), producing a single block.
+//
+// @param pswd: the plain text password.
+// @param salt: the entry's salt.
+// @param iterations: the iteration count.
+// @param verifier: set to the verifier.
+//
+void CDirectoryServiceAuthCache::DeriveVerifier(const char* pswd, const UInt8* salt, UInt32 iterations, UInt8* verifier)
+{
+    size_t pswdLength = ::strlen(pswd);
+    UInt8 block[cSaltSize + 4];
+    ::memcpy(block, salt, cSaltSize);
+    block[cSaltSize] = 0;
+    block[cSaltSize + 1] = 0;
+    block[cSaltSize + 2] = 0;
+    block[cSaltSize + 3] = 1;
+
+    UInt8 u[cVerifierSize];
+    UInt8 next[cVerifierSize];
+    ::CCHmac(kCCHmacAlgSHA256, pswd, pswdLength, block, sizeof(block), u);
+    ::memcpy(verifier, u, cVerifierSize);
+    for(UInt32 i = 1; i < iterations; i++)
+    {
+        ::CCHmac(kCCHmacAlgSHA256, pswd, pswdLength, u, sizeof(u), next);
+        for(size_t j = 0; j < cVerifierSize; j++)
+        {
+            u[j] = next[j];
+            verifier[j] ^= next[j];
+        }
+    }
+    ::memset(u, 0, sizeof(u));
+    ::memset(next, 0, sizeof(next));
+}
+
+// Drop expired entries when the cache is full, and everything if that is not enough. Called with
+// the lock held.
+void CDirectoryServiceAuthCache::Trim()
+{
+    if (mEntries.size() <= mMaxEntries)
+        return;
+
+    CFAbsoluteTime now = ::CFAbsoluteTimeGetCurrent();
+    for(TEntryMap::iterator iter = mEntries.begin(); iter != mEntries.end(); )
+    {
+        if ((*iter).second.mExpires <= now)
+            mEntries.erase(iter++);
+        else
+            iter++;
+    }
+    if (mEntries.size() > mMaxEntries)
+        mEntries.clear();
+}
@@ -0,0 +1,87 @@
+/**
+ * A class that remembers recent successful Basic authentications as
+ * salted, slow-hashed password verifiers.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <map>
+#include <pthread.h>
+#include <string>
+
+// Entries are keyed by node and user and hold a random salt plus a PBKDF2-HMAC-SHA256 verifier
+// derived from the password, never the password itself. A later Basic authentication with the
+// same password is accepted if its verifier matches, until the entry expires or is invalidated.
+// Only successful authentications are ever added, and a password that does not match an entry is
+// always checked with the directory. The cache is off while the time to live is zero.
+class CDirectoryServiceAuthCache
+{
+public:
+    CDirectoryServiceAuthCache(size_t maxEntries=10000);
+    ~CDirectoryServiceAuthCache();
+
+    bool IsEnabled() const
+    {
+        return mTTL > 0;
+    }
+
+    void SetTTL(CFTimeInterval ttl);
+    void SetIterations(UInt32 iterations);
+
+    bool Verify(const char* nodename, const char* user, const char* pswd);
+    void Insert(const char* nodename, const char* user, const char* pswd);
+    void Invalidate(const char* nodename=NULL, const char* user=NULL);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    enum
+    {
+        cSaltSize = 16,
+        cVerifierSize = 32
+    };
+    struct Entry
+    {
+        UInt8           mSalt[cSaltSize];
+        UInt8           mVerifier[cVerifierSize];
+        UInt32          mIterations;
+        CFAbsoluteTime  mExpires;
+    };
+    typedef std::map<std::string, Entry> TEntryMap;
+
+    CFTimeInterval      mTTL;
+    UInt32              mIterations;
+    size_t              mMaxEntries;
+    TEntryMap           mEntries;
+    pthread_mutex_t     mMutex;
+
+    UInt64              mHits;
+    UInt64              mMisses;
+
+    static std::string MakeKey(const char* nodename, const char* user);
+    static void DeriveVerifier(const char* pswd, const UInt8* salt, UInt32 iterations, UInt8* verifier);
+    void Trim();
+
+    // Not copyable as it holds a lock
+    CDirectoryServiceAuthCache(const CDirectoryServiceAuthCache& copy);
+    CDirectoryServiceAuthCache& operator=(const CDirectoryServiceAuthCache& copy);
+};
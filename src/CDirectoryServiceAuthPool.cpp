@@ -0,0 +1,165 @@
+/**
+ * A class that hands out authentication sessions (a directory reference
+ * and a node reference) so concurrent authentications each get one.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceAuthPool.h"
+
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServiceNodeCache.h"
+#include "CDirectoryServiceSessionPool.h"
+
+#pragma mark -----Public API
+
+CDirectoryServiceAuthPool::CDirectoryServiceAuthPool(CDirectoryServiceNodeCache* nodes, size_t maxSessions)
+{
+    mNodes = nodes;
+    mMaxSessions = (maxSessions > 0) ? maxSessions : 1;
+    mBusy = 0;
+    mWaits = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+    ::pthread_cond_init(&mAvailable, NULL);
+}
+
+CDirectoryServiceAuthPool::~CDirectoryServiceAuthPool()
+{
+    ::pthread_cond_destroy(&mAvailable);
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Checkout
+//
+// Get a session on a node for exclusive use, from the node's session pool in the node cache. When
+// the most sessions allowed are all checked out this waits for one to come back, so it must not be
+// called while holding the Python GIL. A node that cannot be opened is reported as failing.
+//
+// @param nodename: the node to authenticate to.
+// @param sessions: set to the node's session pool, to be passed back to Checkin or Discard.
+// @param dir: set to the directory reference.
+// @param node: set to the node reference.
+// @throw: yes
+//
+void CDirectoryServiceAuthPool::Checkout(const char* nodename, CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node)
+{
+    Enter();
+
+    sessions = mNodes->Acquire(nodename);
+    try
+    {
+        sessions->Checkout(dir, node);
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        mNodes->ReportFailure(sessions, dserror.GetDSError());
+        mNodes->Release(sessions);
+        sessions = NULL;
+        Leave();
+        throw;
+    }
+}
+
+// Checkin
+//
+// Return a session obtained from Checkout for reuse by queries and authentications.
+//
+// @param sessions: the node's session pool, reset to NULL.
+// @param dir: the directory reference, reset to 0.
+// @param node: the node reference, reset to 0.
+//
+void CDirectoryServiceAuthPool::Checkin(CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node)
+{
+    sessions->Checkin(dir, node);
+    mNodes->Release(sessions);
+    sessions = NULL;
+    dir = 0L;
+    node = 0L;
+    Leave();
+}
+
+// Discard
+//
+// Close a session obtained from Checkout after a call using it failed in a way that may leave it
+// unusable, and report its node as failing. Sessions on other nodes are not affected.
+//
+// @param sessions: the node's session pool, reset to NULL.
+// @param dir: the directory reference, reset to 0.
+// @param node: the node reference, reset to 0.
+// @param error: the error the call failed with.
+//
+void CDirectoryServiceAuthPool::Discard(CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node, tDirStatus error)
+{
+    sessions->Discard(dir, node);
+    mNodes->ReportFailure(sessions, error);
+    mNodes->Release(sessions);
+    sessions = NULL;
+    dir = 0L;
+    node = 0L;
+    Leave();
+}
+
+// SetMaxSessions
+//
+// Change the most sessions checked out at once. Callers already holding a session keep it.
+//
+// @param maxSessions: the most sessions, at least one.
+//
+void CDirectoryServiceAuthPool::SetMaxSessions(size_t maxSessions)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mMaxSessions = (maxSessions > 0) ? maxSessions : 1;
+    ::pthread_cond_broadcast(&mAvailable);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// GetStatistics
+//
+// Add the pool's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceAuthPool::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["auth_sessions"] = mBusy;
+    stats["auth_session_waits"] = mWaits;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+// Wait until fewer than the most sessions allowed are checked out, then count one more.
+void CDirectoryServiceAuthPool::Enter()
+{
+    ::pthread_mutex_lock(&mMutex);
+    if (mBusy >= mMaxSessions)
+    {
+        mWaits++;
+        while(mBusy >= mMaxSessions)
+            ::pthread_cond_wait(&mAvailable, &mMutex);
+    }
+    mBusy++;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Count one session fewer and wake a caller waiting for one.
+void CDirectoryServiceAuthPool::Leave()
+{
+    ::pthread_mutex_lock(&mMutex);
+    mBusy--;
+    ::pthread_cond_signal(&mAvailable);
+    ::pthread_mutex_unlock(&mMutex);
+}
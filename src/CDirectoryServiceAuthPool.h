@@ -0,0 +1,66 @@
+/**
+ * A class that hands out authentication sessions (a directory reference
+ * and a node reference) so concurrent authentications each get one.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <pthread.h>
+
+class CDirectoryServiceNodeCache;
+class CDirectoryServiceSessionPool;
+
+// Each authentication checks out a session (a directory reference and the node it authenticates
+// to) from the node's session pool in the manager's node cache, so authentications reuse the node
+// references queries opened and the other way round. A session is checked out to one
+// authentication at a time, so calls never share a reference or data buffer. At most a given
+// number of authentications hold a session at once; callers wait for one to finish when all of
+// them are in use. A failed session is closed on its own and only its node is reported to the
+// node cache as failing.
+class CDirectoryServiceAuthPool
+{
+public:
+    CDirectoryServiceAuthPool(CDirectoryServiceNodeCache* nodes, size_t maxSessions=4);
+    ~CDirectoryServiceAuthPool();
+
+    void Checkout(const char* nodename, CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node);
+    void Checkin(CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node);
+    void Discard(CDirectoryServiceSessionPool*& sessions, tDirReference& dir, tDirNodeReference& node, tDirStatus error);
+
+    void SetMaxSessions(size_t maxSessions);
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    CDirectoryServiceNodeCache* mNodes;
+    size_t              mMaxSessions;
+    size_t              mBusy;              // sessions checked out
+    pthread_mutex_t     mMutex;
+    pthread_cond_t      mAvailable;
+
+    UInt64              mWaits;
+
+    void Enter();
+    void Leave();
+
+    // Not copyable as it holds a lock
+    CDirectoryServiceAuthPool(const CDirectoryServiceAuthPool& copy);
+    CDirectoryServiceAuthPool& operator=(const CDirectoryServiceAuthPool& copy);
+};
@@ -0,0 +1,214 @@
+/**
+ * A class that recycles Directory Service data buffers and remembers
+ * how large a buffer each kind of call needs.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceBufferPool.h"
+
+#include "CDirectoryServiceException.h"
+
+const UInt32 cDecayUses = 32;       // calls without growing before a size hint is halved
+const size_t cMaxHints = 256;       // size hints kept before starting afresh
+
+#pragma mark -----Public API
+
+CDirectoryServiceBufferPool::CDirectoryServiceBufferPool(UInt32 minSize, size_t maxFree)
+{
+    mMinSize = minSize;
+    mMaxFree = maxFree;
+    mAllocated = 0;
+    mReused = 0;
+    mReallocs = 0;
+    mReallocsAvoided = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceBufferPool::~CDirectoryServiceBufferPool()
+{
+    // Data buffers are not tied to the directory reference used to allocate them
+    for(TBufferList::iterator iter = mFree.begin(); iter != mFree.end(); iter++)
+        ::dsDataBufferDeAllocate(0L, *iter);
+    mFree.clear();
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Acquire
+//
+// Get a data buffer for a call, sized by what previous calls with the same key needed.
+//
+// @param dir: the directory reference to allocate with.
+// @param key: the operation and record types of the call.
+// @return: the buffer, which must be returned with Release.
+// @throw: yes
+//
+tDataBufferPtr CDirectoryServiceBufferPool::Acquire(tDirReference dir, const std::string& key)
+{
+    UInt32 size = mMinSize;
+    tDataBufferPtr result = NULL;
+
+    ::pthread_mutex_lock(&mMutex);
+    THintMap::const_iterator found = mHints.find(key);
+    if (found != mHints.end())
+        size = (*found).second.mSize;
+    result = TakeFree(size);
+    if (result != NULL)
+        mReused++;
+    else
+        mAllocated++;
+
+    // Count each doubling from the minimum size that the hint lets the call skip
+    for(UInt32 skipped = mMinSize; skipped < size; skipped *= 2)
+        mReallocsAvoided++;
+    ::pthread_mutex_unlock(&mMutex);
+
+    if (result == NULL)
+    {
+        result = ::dsDataBufferAllocate(dir, size);
+        if (result == NULL)
+        {
+            ThrowIfDSErr(eDSNullDataBuff);
+        }
+    }
+    result->fBufferLength = 0;
+
+    return result;
+}
+
+// Release
+//
+// Return a buffer obtained from Acquire, updating the size hint for its key.
+//
+// @param dir: the directory reference to deallocate with if the buffer is not kept.
+// @param data: the buffer.
+// @param key: the key the buffer was acquired with.
+// @param reallocs: the number of times the call had to grow the buffer.
+//
+void CDirectoryServiceBufferPool::Release(tDirReference dir, tDataBufferPtr data, const std::string& key, UInt32 reallocs)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mReallocs += reallocs;
+
+    if ((mHints.size() >= cMaxHints) && (mHints.find(key) == mHints.end()))
+        mHints.clear();
+    THintMap::iterator found = mHints.find(key);
+    if (found == mHints.end())
+    {
+        SizeHint hint;
+        hint.mSize = mMinSize;
+        hint.mQuietUses = 0;
+        found = mHints.insert(THintMap::value_type(key, hint)).first;
+    }
+
+    SizeHint& hint = (*found).second;
+    if (reallocs > 0)
+    {
+        hint.mSize = data->fBufferSize;
+        hint.mQuietUses = 0;
+    }
+    else if ((hint.mSize > mMinSize) && (++hint.mQuietUses >= cDecayUses))
+    {
+        hint.mSize /= 2;
+        if (hint.mSize < mMinSize)
+            hint.mSize = mMinSize;
+        hint.mQuietUses = 0;
+    }
+
+    tDataBufferPtr evicted = PutFree(data);
+    ::pthread_mutex_unlock(&mMutex);
+
+    if (evicted != NULL)
+        ::dsDataBufferDeAllocate(dir, evicted);
+}
+
+// Recycle
+//
+// Return a buffer that a call has outgrown, without affecting any size hint.
+//
+// @param dir: the directory reference to deallocate with if the buffer is not kept.
+// @param data: the buffer.
+//
+void CDirectoryServiceBufferPool::Recycle(tDirReference dir, tDataBufferPtr data)
+{
+    ::pthread_mutex_lock(&mMutex);
+    tDataBufferPtr evicted = PutFree(data);
+    ::pthread_mutex_unlock(&mMutex);
+
+    if (evicted != NULL)
+        ::dsDataBufferDeAllocate(dir, evicted);
+}
+
+// GetStatistics
+//
+// Add the pool's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceBufferPool::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["buffers_allocated"] = mAllocated;
+    stats["buffers_reused"] = mReused;
+    stats["buffer_reallocs"] = mReallocs;
+    stats["buffer_reallocs_avoided"] = mReallocsAvoided;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+// Remove and return the smallest free buffer of at least the given size, if any. Called with the lock held.
+tDataBufferPtr CDirectoryServiceBufferPool::TakeFree(UInt32 size)
+{
+    TBufferList::iterator best = mFree.end();
+    for(TBufferList::iterator iter = mFree.begin(); iter != mFree.end(); iter++)
+    {
+        if (((*iter)->fBufferSize >= size) && ((best == mFree.end()) || ((*iter)->fBufferSize < (*best)->fBufferSize)))
+            best = iter;
+    }
+
+    tDataBufferPtr result = NULL;
+    if (best != mFree.end())
+    {
+        result = *best;
+        mFree.erase(best);
+    }
+    return result;
+}
+
+// Add a buffer to the free list. When the list is full the smallest buffer is dropped, and returned
+// so it can be deallocated outside the lock. Called with the lock held.
+tDataBufferPtr CDirectoryServiceBufferPool::PutFree(tDataBufferPtr data)
+{
+    if (mFree.size() < mMaxFree)
+    {
+        mFree.push_back(data);
+        return NULL;
+    }
+
+    TBufferList::iterator smallest = mFree.begin();
+    for(TBufferList::iterator iter = mFree.begin(); iter != mFree.end(); iter++)
+    {
+        if ((*iter)->fBufferSize < (*smallest)->fBufferSize)
+            smallest = iter;
+    }
+    if ((smallest != mFree.end()) && ((*smallest)->fBufferSize < data->fBufferSize))
+    {
+        tDataBufferPtr result = *smallest;
+        *smallest = data;
+        return result;
+    }
+    return data;
+}
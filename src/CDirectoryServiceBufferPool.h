@@ -0,0 +1,73 @@
+/**
+ * A class that recycles Directory Service data buffers and remembers
+ * how large a buffer each kind of call needs.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <map>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+// Calls are identified by a key made up of the operation and its record types. For each key the
+// pool keeps a size hint: the buffer size that last avoided eDSBufferTooSmall. The hint is halved
+// again after a run of calls that did not need to grow the buffer, so one unusually large result
+// does not pin a large buffer forever.
+class CDirectoryServiceBufferPool
+{
+public:
+    CDirectoryServiceBufferPool(UInt32 minSize=32 * 1024, size_t maxFree=8);
+    ~CDirectoryServiceBufferPool();
+
+    tDataBufferPtr Acquire(tDirReference dir, const std::string& key);
+    void Release(tDirReference dir, tDataBufferPtr data, const std::string& key, UInt32 reallocs);
+    void Recycle(tDirReference dir, tDataBufferPtr data);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    struct SizeHint
+    {
+        UInt32  mSize;
+        UInt32  mQuietUses;     // calls since the buffer last had to grow
+    };
+    typedef std::map<std::string, SizeHint> THintMap;
+    typedef std::vector<tDataBufferPtr> TBufferList;
+
+    UInt32              mMinSize;
+    size_t              mMaxFree;
+    THintMap            mHints;
+    TBufferList         mFree;
+    pthread_mutex_t     mMutex;
+
+    UInt64              mAllocated;
+    UInt64              mReused;
+    UInt64              mReallocs;
+    UInt64              mReallocsAvoided;
+
+    tDataBufferPtr TakeFree(UInt32 size);
+    tDataBufferPtr PutFree(tDataBufferPtr data);
+
+    // Not copyable as the pool owns its buffers
+    CDirectoryServiceBufferPool(const CDirectoryServiceBufferPool& copy);
+    CDirectoryServiceBufferPool& operator=(const CDirectoryServiceBufferPool& copy);
+};
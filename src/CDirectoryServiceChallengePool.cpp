@@ -0,0 +1,315 @@
+/**
+ * A class that keeps SASL DIGEST-MD5 challenges fetched ahead of time
+ * from Active Directory nodes.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceChallengePool.h"
+
+#include "CDirectoryServiceAuth.h"
+
+#include <sys/time.h>
+
+// Seconds to wait before fetching from a node again after a fetch failed
+#define kRetryInterval  5.0
+
+// Fetches in a row that may fail before a node is dropped
+#define kMaxFailures    5
+
+// Seconds after which a node nobody has asked for a challenge is dropped
+#define kIdleInterval   600.0
+
+#pragma mark -----Public API
+
+CDirectoryServiceChallengePool::CDirectoryServiceChallengePool(CDirectoryServiceAuthPool* authPool)
+{
+    mAuthPool = authPool;
+    mDepth = 0;
+    mMaxAge = 60;
+    mRunning = false;
+    mStopping = false;
+    mHits = 0;
+    mMisses = 0;
+    mFetched = 0;
+    mExpired = 0;
+    mDropped = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+    ::pthread_cond_init(&mWork, NULL);
+    ::pthread_cond_init(&mExited, NULL);
+}
+
+CDirectoryServiceChallengePool::~CDirectoryServiceChallengePool()
+{
+    // Let a fetch in progress finish, then wait for the refill thread to go
+    ::pthread_mutex_lock(&mMutex);
+    mStopping = true;
+    ::pthread_cond_broadcast(&mWork);
+    while(mRunning)
+        ::pthread_cond_wait(&mExited, &mMutex);
+    ::pthread_mutex_unlock(&mMutex);
+
+    for(TNodeMap::iterator iter = mNodes.begin(); iter != mNodes.end(); iter++)
+        ClearEntries((*iter).second.mEntries);
+    ::pthread_cond_destroy(&mExited);
+    ::pthread_cond_destroy(&mWork);
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// SetDepth
+//
+// Change the number of challenges kept ready for each node. Zero turns the pool off and releases
+// every challenge in it.
+//
+// @param depth: the number of challenges per node.
+//
+void CDirectoryServiceChallengePool::SetDepth(size_t depth)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mDepth = depth;
+    if (mDepth == 0)
+    {
+        for(TNodeMap::iterator iter = mNodes.begin(); iter != mNodes.end(); iter++)
+            ClearEntries((*iter).second.mEntries);
+    }
+    else if (!mNodes.empty())
+        StartThread();
+    ::pthread_cond_broadcast(&mWork);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// SetMaxAge
+//
+// Change how old a challenge may be when it is handed out. Older ones are dropped and fetched again.
+//
+// @param maxAge: the maximum age in seconds, zero for no limit.
+//
+void CDirectoryServiceChallengePool::SetMaxAge(CFTimeInterval maxAge)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mMaxAge = maxAge;
+    ::pthread_cond_broadcast(&mWork);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Take
+//
+// Take the oldest unexpired challenge kept for a node and wake the refill thread to replace it. The
+// first call for a node, or the first since it was dropped, finds nothing and only adds it to the pool.
+//
+// @param nodename: the directory nodename to get a challenge for.
+// @return: the challenge, owned by the caller, or NULL if none is ready and the caller must fetch one itself.
+//
+CFStringRef CDirectoryServiceChallengePool::Take(const char* nodename)
+{
+    if (!IsEnabled())
+        return NULL;
+
+    CFStringRef result = NULL;
+
+    ::pthread_mutex_lock(&mMutex);
+    Node& node = mNodes[nodename];
+    node.mLastTaken = ::CFAbsoluteTimeGetCurrent();
+    Expire(node, node.mLastTaken);
+    if (!node.mEntries.empty())
+    {
+        result = node.mEntries.front().mChallenge;
+        node.mEntries.pop_front();
+        mHits++;
+    }
+    else
+        mMisses++;
+    if (mDepth > 0)
+    {
+        StartThread();
+        ::pthread_cond_signal(&mWork);
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// GetStatistics
+//
+// Add the pool's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceChallengePool::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    size_t ready = 0;
+    for(TNodeMap::const_iterator iter = mNodes.begin(); iter != mNodes.end(); iter++)
+        ready += (*iter).second.mEntries.size();
+    stats["challenge_pool_hits"] = mHits;
+    stats["challenge_pool_misses"] = mMisses;
+    stats["challenge_pool_fetched"] = mFetched;
+    stats["challenge_pool_expired"] = mExpired;
+    stats["challenge_pool_ready"] = ready;
+    stats["challenge_pool_nodes"] = mNodes.size();
+    stats["challenge_pool_dropped"] = mDropped;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+void* CDirectoryServiceChallengePool::ThreadEntry(void* pool)
+{
+    static_cast<CDirectoryServiceChallengePool*>(pool)->Refill();
+    return NULL;
+}
+
+// Fetch challenges for nodes that are short of them until the pool is stopped or turned off.
+void CDirectoryServiceChallengePool::Refill()
+{
+    ::pthread_mutex_lock(&mMutex);
+    while(!mStopping && (mDepth > 0))
+    {
+        // Drop nodes nobody has asked for in a while, and pick the first node that is short, noting
+        // when the next one will be
+        CFAbsoluteTime now = ::CFAbsoluteTimeGetCurrent();
+        CFAbsoluteTime wake = 0;
+        std::string nodename;
+        bool found = false;
+        for(TNodeMap::iterator iter = mNodes.begin(); iter != mNodes.end(); )
+        {
+            Node& node = (*iter).second;
+            if (node.mLastTaken + kIdleInterval <= now)
+            {
+                ClearEntries(node.mEntries);
+                mNodes.erase(iter++);
+                mDropped++;
+                continue;
+            }
+            Expire(node, now);
+            CFAbsoluteTime next = node.mLastTaken + kIdleInterval;
+            if (node.mEntries.size() >= mDepth)
+            {
+                if ((mMaxAge > 0) && (node.mEntries.front().mFetched + mMaxAge < next))
+                    next = node.mEntries.front().mFetched + mMaxAge;
+            }
+            else if (node.mRetryAfter > now)
+            {
+                if (node.mRetryAfter < next)
+                    next = node.mRetryAfter;
+            }
+            else
+            {
+                nodename = (*iter).first;
+                found = true;
+                break;
+            }
+            if ((wake == 0) || (next < wake))
+                wake = next;
+            iter++;
+        }
+
+        if (!found)
+        {
+            if (wake == 0)
+                ::pthread_cond_wait(&mWork, &mMutex);
+            else
+            {
+                struct timeval tv;
+                ::gettimeofday(&tv, NULL);
+                double deadline = tv.tv_sec + tv.tv_usec / 1.0e6 + (wake - now);
+                struct timespec ts;
+                ts.tv_sec = (time_t)deadline;
+                ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1.0e9);
+                ::pthread_cond_timedwait(&mWork, &mMutex, &ts);
+            }
+            continue;
+        }
+
+        // Fetch without the lock, as this is the round trip callers are spared
+        ::pthread_mutex_unlock(&mMutex);
+        CFStringRef challenge = NULL;
+        {
+            CDirectoryServiceAuth auth(mAuthPool);
+            challenge = auth.GetDigestMD5ChallengeFromActiveDirectory(nodename.c_str(), false);
+        }
+        ::pthread_mutex_lock(&mMutex);
+
+        // Look the node up again, as the map may have changed while the lock was released
+        TNodeMap::iterator iter = mNodes.find(nodename);
+        if (challenge != NULL)
+        {
+            Entry entry;
+            entry.mChallenge = challenge;
+            entry.mFetched = ::CFAbsoluteTimeGetCurrent();
+            if ((mDepth > 0) && (iter != mNodes.end()))
+            {
+                (*iter).second.mEntries.push_back(entry);
+                (*iter).second.mRetryAfter = 0;
+                (*iter).second.mFailures = 0;
+            }
+            else
+                ::CFRelease(challenge);
+            mFetched++;
+        }
+        else if (iter != mNodes.end())
+        {
+            // Give up on a node that keeps failing until it is asked for again
+            if (++(*iter).second.mFailures >= kMaxFailures)
+            {
+                ClearEntries((*iter).second.mEntries);
+                mNodes.erase(iter);
+                mDropped++;
+            }
+            else
+                (*iter).second.mRetryAfter = ::CFAbsoluteTimeGetCurrent() + kRetryInterval;
+        }
+    }
+    mRunning = false;
+    ::pthread_cond_signal(&mExited);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Start the refill thread if it is not running. The thread is detached, the destructor waits for it
+// through mRunning instead. Called with the lock held.
+void CDirectoryServiceChallengePool::StartThread()
+{
+    if (mRunning || mStopping)
+        return;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    ::pthread_attr_init(&attr);
+    ::pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (::pthread_create(&thread, &attr, ThreadEntry, this) == 0)
+        mRunning = true;
+    ::pthread_attr_destroy(&attr);
+}
+
+// Release the challenges of a node that are older than the maximum age. Called with the lock held.
+void CDirectoryServiceChallengePool::Expire(Node& node, CFAbsoluteTime now)
+{
+    if (mMaxAge <= 0)
+        return;
+    while(!node.mEntries.empty() && (node.mEntries.front().mFetched + mMaxAge <= now))
+    {
+        ::CFRelease(node.mEntries.front().mChallenge);
+        node.mEntries.pop_front();
+        mExpired++;
+    }
+}
+
+// Release every challenge in a list.
+void CDirectoryServiceChallengePool::ClearEntries(TEntryList& entries)
+{
+    for(TEntryList::iterator iter = entries.begin(); iter != entries.end(); iter++)
+        ::CFRelease((*iter).mChallenge);
+    entries.clear();
+}
@@ -0,0 +1,105 @@
+/**
+ * A class that keeps SASL DIGEST-MD5 challenges fetched ahead of time
+ * from Active Directory nodes.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <deque>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+class CDirectoryServiceAuthPool;
+
+// Challenges are kept per node, oldest first, and each one is handed out at most once. A node is
+// added the first time a challenge is asked for on it. One background thread, started when first
+// needed, tops every node up to the configured depth using sessions from the auth pool, replaces
+// challenges that have grown older than the maximum age, and backs off from a node whose fetches
+// fail. Nodes whose fetches keep failing, or that nobody has asked for in a while, are dropped
+// until they are asked for again. The pool is off while the depth is zero.
+class CDirectoryServiceChallengePool
+{
+public:
+    CDirectoryServiceChallengePool(CDirectoryServiceAuthPool* authPool);
+    ~CDirectoryServiceChallengePool();
+
+    bool IsEnabled() const
+    {
+        return mDepth > 0;
+    }
+
+    void SetDepth(size_t depth);
+    void SetMaxAge(CFTimeInterval maxAge);
+
+    CFStringRef Take(const char* nodename);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    struct Entry
+    {
+        CFStringRef     mChallenge;
+        CFAbsoluteTime  mFetched;
+    };
+    typedef std::deque<Entry> TEntryList;
+    struct Node
+    {
+        TEntryList      mEntries;
+        CFAbsoluteTime  mRetryAfter;        // set after a failed fetch
+        UInt32          mFailures;          // fetches failed in a row
+        CFAbsoluteTime  mLastTaken;         // last time a challenge was asked for
+
+        Node()
+        {
+            mRetryAfter = 0;
+            mFailures = 0;
+            mLastTaken = 0;
+        }
+    };
+    typedef std::map<std::string, Node> TNodeMap;
+
+    CDirectoryServiceAuthPool*  mAuthPool;
+    size_t              mDepth;
+    CFTimeInterval      mMaxAge;
+    TNodeMap            mNodes;
+    bool                mRunning;           // the refill thread has been started and not exited
+    bool                mStopping;
+    pthread_mutex_t     mMutex;
+    pthread_cond_t      mWork;
+    pthread_cond_t      mExited;
+
+    UInt64              mHits;
+    UInt64              mMisses;
+    UInt64              mFetched;
+    UInt64              mExpired;
+    UInt64              mDropped;
+
+    static void* ThreadEntry(void* pool);
+    void Refill();
+    void StartThread();
+    void Expire(Node& node, CFAbsoluteTime now);
+    static void ClearEntries(TEntryList& entries);
+
+    // Not copyable as the pool owns its challenges and thread
+    CDirectoryServiceChallengePool(const CDirectoryServiceChallengePool& copy);
+    CDirectoryServiceChallengePool& operator=(const CDirectoryServiceChallengePool& copy);
+};
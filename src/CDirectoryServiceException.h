@@ -32,6 +32,11 @@ public:
 
     void SetPythonException();
 
+    tDirStatus GetDSError() const
+    {
+        return mDSError;
+    }
+
 private:
 	tDirStatus  mDSError;
     char        mDescription[1024];
@@ -39,3 +44,4 @@ private:
 
 # define ThrowIfDSErr(x) { if (x != eDSNoErr) CDirectoryServiceException::ThrowDSError(x, __FILE__, __LINE__); }
 # define ThrowIfNULL(x) { if (x == NULL) CDirectoryServiceException::ThrowDSError(eUndefinedError, __FILE__, __LINE__); }
+# define ThrowIfPyErr(x) { if (x != 0) CDirectoryServiceException::ThrowDSError(eUndefinedError, __FILE__, __LINE__); }
@@ -21,34 +21,322 @@
 
 #include "CDirectoryService.h"
 #include "CDirectoryServiceAuth.h"
+#include "CDirectoryServiceAuthCache.h"
+#include "CDirectoryServiceAuthPool.h"
+#include "CDirectoryServiceChallengePool.h"
+#include "CDirectoryServiceBufferPool.h"
+#include "CDirectoryServiceMirror.h"
+#include "CDirectoryServiceNodeCache.h"
+#include "CDirectoryServicePreparedQuery.h"
+#include "CDirectoryServiceQueryCache.h"
+#include "CDirectoryServiceRecordIterator.h"
+#include "CDirectoryServiceSingleFlight.h"
+#include "CDirectoryServiceWorkQueue.h"
 #include "CDirectoryServiceException.h"
 
+#include <string.h>
+
 #pragma mark -----Public API
 
 CDirectoryServiceManager::CDirectoryServiceManager(const char* nodename)
 {
     mNodeName = ::strdup(nodename);
-	mAuthService = NULL;
+	mNodeCache = new CDirectoryServiceNodeCache();
+	mAuthPool = new CDirectoryServiceAuthPool(mNodeCache, 4);
+	mAuthCache = new CDirectoryServiceAuthCache();
+	mChallengePool = new CDirectoryServiceChallengePool(mAuthPool);
+	mBufferPool = new CDirectoryServiceBufferPool();
+	mQueryCache = new CDirectoryServiceQueryCache();
+	mMirror = new CDirectoryServiceMirror();
+	mWorkQueue = new CDirectoryServiceWorkQueue(4);
+	mSingleFlight = new CDirectoryServiceSingleFlight();
+	::pthread_mutex_init(&mMutex, NULL);
+	mCoalesceQueries = true;
+	mFanOut = false;
+	mFanOutThreads = 4;
+	mBatchWidth = 32;
+	mMirrorReconcileInterval = 60 * 60;
+	mCursorIdleTimeout = 5 * 60;
 }
 
 CDirectoryServiceManager::~CDirectoryServiceManager()
 {
-	if (mAuthService != NULL)
-	{
-		delete mAuthService;
-		mAuthService = NULL;
-	}
+	// Stop the work queue first, as its tasks use everything else
+	delete mWorkQueue;
+	mWorkQueue = NULL;
+	delete mChallengePool;
+	mChallengePool = NULL;
+	delete mAuthPool;
+	mAuthPool = NULL;
+	delete mAuthCache;
+	mAuthCache = NULL;
+	delete mNodeCache;
+	mNodeCache = NULL;
+	delete mBufferPool;
+	mBufferPool = NULL;
+	delete mQueryCache;
+	mQueryCache = NULL;
+	delete mMirror;
+	mMirror = NULL;
+	delete mSingleFlight;
+	mSingleFlight = NULL;
+	::pthread_mutex_destroy(&mMutex);
     ::free(mNodeName);
 }
 
 CDirectoryService* CDirectoryServiceManager::GetService()
 {
-    return new CDirectoryService(mNodeName);
+    return new CDirectoryService(mNodeName, this);
+}
+
+CDirectoryServiceRecordIterator* CDirectoryServiceManager::GetRecordIterator()
+{
+    return new CDirectoryServiceRecordIterator(mNodeName, this);
+}
+
+CDirectoryServicePreparedQuery* CDirectoryServiceManager::GetPreparedQuery()
+{
+    return new CDirectoryServicePreparedQuery(mNodeName, this);
 }
 
+// GetAuthService
+//
+// Get an object to authenticate with. Each call it makes uses a session from the manager's auth
+// pool, so any number of them may authenticate concurrently.
+//
+// @return: the object, owned by the caller.
+//
 CDirectoryServiceAuth* CDirectoryServiceManager::GetAuthService()
 {
-	if (mAuthService == NULL)
-		mAuthService = new CDirectoryServiceAuth();
-    return mAuthService;
+    return new CDirectoryServiceAuth(mAuthPool, mAuthCache, mChallengePool);
+}
+
+// GetSingleFlight
+//
+// Get the table of queries in flight, if identical queries are to be coalesced.
+//
+// @return: the table, or NULL when coalescing is turned off.
+//
+CDirectoryServiceSingleFlight* CDirectoryServiceManager::GetSingleFlight()
+{
+	::pthread_mutex_lock(&mMutex);
+	bool coalesce = mCoalesceQueries;
+	::pthread_mutex_unlock(&mMutex);
+	return coalesce ? mSingleFlight : NULL;
+}
+
+bool CDirectoryServiceManager::GetFanOut()
+{
+	::pthread_mutex_lock(&mMutex);
+	bool result = mFanOut;
+	::pthread_mutex_unlock(&mMutex);
+	return result;
+}
+
+size_t CDirectoryServiceManager::GetFanOutThreads()
+{
+	::pthread_mutex_lock(&mMutex);
+	size_t result = mFanOutThreads;
+	::pthread_mutex_unlock(&mMutex);
+	return result;
+}
+
+size_t CDirectoryServiceManager::GetBatchWidth()
+{
+	::pthread_mutex_lock(&mMutex);
+	size_t result = mBatchWidth;
+	::pthread_mutex_unlock(&mMutex);
+	return result;
+}
+
+double CDirectoryServiceManager::GetMirrorReconcileInterval()
+{
+	::pthread_mutex_lock(&mMutex);
+	double result = mMirrorReconcileInterval;
+	::pthread_mutex_unlock(&mMutex);
+	return result;
+}
+
+double CDirectoryServiceManager::GetCursorIdleTimeout()
+{
+	::pthread_mutex_lock(&mMutex);
+	double result = mCursorIdleTimeout;
+	::pthread_mutex_unlock(&mMutex);
+	return result;
+}
+
+// GetStatistics
+//
+// Gather the counters kept by the manager's pools.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceManager::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+	mBufferPool->GetStatistics(stats);
+	mQueryCache->GetStatistics(stats);
+	mMirror->GetStatistics(stats);
+	mWorkQueue->GetStatistics(stats);
+	mSingleFlight->GetStatistics(stats);
+	mAuthPool->GetStatistics(stats);
+	mNodeCache->GetStatistics(stats);
+	mAuthCache->GetStatistics(stats);
+	mChallengePool->GetStatistics(stats);
+}
+
+// SetOption
+//
+// Change an option controlling how calls are made. Known options are:
+//
+//   fanout:         non-zero to run calls covering several record types as concurrent
+//                   per-type calls, merged in the order the record types were given.
+//   fanout_threads: the most threads a single fanned out call may use.
+//   batch_width:    the most values looked up by one compound query in a batched lookup.
+//   query_cache_ttl:          seconds query results are cached for, zero (the default) turns the cache off.
+//   query_cache_negative_ttl: seconds empty query results are cached for, zero uses query_cache_ttl.
+//   query_cache_bytes:        the most bytes of query results cached.
+//   mirror_reconcile_interval: seconds after which refreshing the mirror reloads it completely,
+//                              zero to only do so when asked.
+//   cursor_idle_timeout:       seconds after which an unused paged query is closed, zero to
+//                              keep it open until closed.
+//   async_threads:  the most worker threads running calls submitted asynchronously.
+//   auth_sessions:  the most directory sessions used by concurrent authentications.
+//   node_cache_size: the most nodes whose directory and node references are kept open.
+//   auth_cache_ttl: seconds a successful Basic authentication is remembered for, zero (the
+//                   default) turns the cache off.
+//   auth_cache_iterations: PBKDF2 iterations used to derive a remembered password verifier.
+//   challenge_pool_depth:   SASL DIGEST-MD5 challenges fetched ahead for each Active Directory
+//                           node, zero (the default) turns the pool off.
+//   challenge_pool_max_age: seconds a prefetched challenge may be kept, zero for no limit.
+//   coalesce_queries: non-zero (the default) to let a query identical to one already in
+//                     flight wait for and share its result.
+//
+// @param name: the option name.
+// @param value: the new value.
+// @return: true if the option was changed, false if the name or value is not valid.
+//
+bool CDirectoryServiceManager::SetOption(const char* name, int value)
+{
+	if (::strcmp(name, "fanout") == 0)
+	{
+		::pthread_mutex_lock(&mMutex);
+		mFanOut = (value != 0);
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+	else if (::strcmp(name, "fanout_threads") == 0)
+	{
+		if (value < 1)
+			return false;
+		::pthread_mutex_lock(&mMutex);
+		mFanOutThreads = value;
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+	else if (::strcmp(name, "batch_width") == 0)
+	{
+		if (value < 1)
+			return false;
+		::pthread_mutex_lock(&mMutex);
+		mBatchWidth = value;
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+	else if (::strcmp(name, "query_cache_ttl") == 0)
+	{
+		if (value < 0)
+			return false;
+		mQueryCache->SetTTL(value);
+		return true;
+	}
+	else if (::strcmp(name, "query_cache_negative_ttl") == 0)
+	{
+		if (value < 0)
+			return false;
+		mQueryCache->SetNegativeTTL(value);
+		return true;
+	}
+	else if (::strcmp(name, "query_cache_bytes") == 0)
+	{
+		if (value < 0)
+			return false;
+		mQueryCache->SetMaxBytes(value);
+		return true;
+	}
+	else if (::strcmp(name, "mirror_reconcile_interval") == 0)
+	{
+		if (value < 0)
+			return false;
+		::pthread_mutex_lock(&mMutex);
+		mMirrorReconcileInterval = value;
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+	else if (::strcmp(name, "cursor_idle_timeout") == 0)
+	{
+		if (value < 0)
+			return false;
+		::pthread_mutex_lock(&mMutex);
+		mCursorIdleTimeout = value;
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+	else if (::strcmp(name, "async_threads") == 0)
+	{
+		if (value < 1)
+			return false;
+		mWorkQueue->SetMaxThreads(value);
+		return true;
+	}
+	else if (::strcmp(name, "auth_sessions") == 0)
+	{
+		if (value < 1)
+			return false;
+		mAuthPool->SetMaxSessions(value);
+		return true;
+	}
+	else if (::strcmp(name, "node_cache_size") == 0)
+	{
+		if (value < 1)
+			return false;
+		mNodeCache->SetMaxNodes(value);
+		return true;
+	}
+	else if (::strcmp(name, "auth_cache_ttl") == 0)
+	{
+		if (value < 0)
+			return false;
+		mAuthCache->SetTTL(value);
+		return true;
+	}
+	else if (::strcmp(name, "auth_cache_iterations") == 0)
+	{
+		if (value < 1)
+			return false;
+		mAuthCache->SetIterations(value);
+		return true;
+	}
+	else if (::strcmp(name, "challenge_pool_depth") == 0)
+	{
+		if (value < 0)
+			return false;
+		mChallengePool->SetDepth(value);
+		return true;
+	}
+	else if (::strcmp(name, "challenge_pool_max_age") == 0)
+	{
+		if (value < 0)
+			return false;
+		mChallengePool->SetMaxAge(value);
+		return true;
+	}
+	else if (::strcmp(name, "coalesce_queries") == 0)
+	{
+		::pthread_mutex_lock(&mMutex);
+		mCoalesceQueries = (value != 0);
+		::pthread_mutex_unlock(&mMutex);
+		return true;
+	}
+
+	return false;
 }
@@ -19,8 +19,24 @@
 
 #pragma once
 
+#include "CDirectoryServiceStatistics.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
 class CDirectoryService;
 class CDirectoryServiceAuth;
+class CDirectoryServiceAuthPool;
+class CDirectoryServiceAuthCache;
+class CDirectoryServiceChallengePool;
+class CDirectoryServiceRecordIterator;
+class CDirectoryServicePreparedQuery;
+class CDirectoryServiceNodeCache;
+class CDirectoryServiceBufferPool;
+class CDirectoryServiceQueryCache;
+class CDirectoryServiceMirror;
+class CDirectoryServiceWorkQueue;
+class CDirectoryServiceSingleFlight;
 
 class CDirectoryServiceManager
 {
@@ -29,9 +45,60 @@ public:
     ~CDirectoryServiceManager();
 
     CDirectoryService* GetService();
+    CDirectoryServiceRecordIterator* GetRecordIterator();
+    CDirectoryServicePreparedQuery* GetPreparedQuery();
     CDirectoryServiceAuth* GetAuthService();
 
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+    bool SetOption(const char* name, int value);
+
+    CDirectoryServiceNodeCache* GetNodeCache() const
+    {
+        return mNodeCache;
+    }
+    CDirectoryServiceBufferPool* GetBufferPool() const
+    {
+        return mBufferPool;
+    }
+    CDirectoryServiceQueryCache* GetQueryCache() const
+    {
+        return mQueryCache;
+    }
+    CDirectoryServiceMirror* GetMirror() const
+    {
+        return mMirror;
+    }
+    CDirectoryServiceWorkQueue* GetWorkQueue() const
+    {
+        return mWorkQueue;
+    }
+    CDirectoryServiceAuthCache* GetAuthCache() const
+    {
+        return mAuthCache;
+    }
+    CDirectoryServiceSingleFlight* GetSingleFlight();
+    bool GetFanOut();
+    size_t GetFanOutThreads();
+    size_t GetBatchWidth();
+    double GetMirrorReconcileInterval();
+    double GetCursorIdleTimeout();
+
 private:
     char*					mNodeName;
-	CDirectoryServiceAuth*	mAuthService;
+	CDirectoryServiceAuthPool*	mAuthPool;      // sessions used by authentication calls
+	CDirectoryServiceAuthCache*	mAuthCache;     // verifiers of recent successful Basic authentications
+	CDirectoryServiceChallengePool*	mChallengePool; // SASL challenges fetched ahead of Digest logins
+	CDirectoryServiceNodeCache*	mNodeCache;     // session pools of recently used nodes, shared by queries and authentication
+	CDirectoryServiceBufferPool*	mBufferPool;
+	CDirectoryServiceQueryCache*	mQueryCache;
+	CDirectoryServiceMirror*		mMirror;
+	CDirectoryServiceWorkQueue*		mWorkQueue;         // runs calls submitted from Python asynchronously
+	CDirectoryServiceSingleFlight*	mSingleFlight;      // shares identical queries that are in flight
+	pthread_mutex_t			mMutex;             // guards the options below, which SetOption may change at any time
+	bool					mCoalesceQueries;
+	bool					mFanOut;            // split multi-type calls into concurrent per-type calls
+	size_t					mFanOutThreads;
+	size_t					mBatchWidth;        // values per compound query in batched lookups
+	double					mMirrorReconcileInterval;   // seconds between full mirror reloads
+	double					mCursorIdleTimeout;         // seconds before an unused paged query is closed
 };
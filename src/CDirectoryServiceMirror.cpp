@@ -0,0 +1,667 @@
+/**
+ * A class that mirrors Directory Service records in memory.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceMirror.h"
+
+#include "CDirectoryServiceQueryExpression.h"
+#include "CDirectoryServiceSnapshot.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <iterator>
+#include <string.h>
+
+// Attributes with a secondary index
+static const char* cIndexedAttributes[] = {
+    kDS1AttrGeneratedUID,
+    kDSNAttrRecordName,
+    kDSNAttrEMailAddress,
+    kDSNAttrServicesLocator,
+    NULL
+};
+
+#pragma mark -----Public API
+
+CDirectoryServiceMirror::CDirectoryServiceMirror()
+{
+    mLoadedAt = 0;
+    mSnapshot = NULL;
+    mHits = 0;
+    mLoads = 0;
+    mUpdates = 0;
+    mSkipped = 0;
+    mExpressionHits = 0;
+    mScans = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceMirror::~CDirectoryServiceMirror()
+{
+    delete mSnapshot;
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Load
+//
+// Replace the contents of the mirror. Records without a GeneratedUID are left out, and lookups on
+// their record types are not answered from the mirror.
+//
+// @param nodename: the node the records were listed from.
+// @param recordTypes: the record types mirrored.
+// @param schema: the attributes mirrored, which must include all indexed attributes.
+// @param arenas: the records of each record type, in the same order as recordTypes.
+//
+void CDirectoryServiceMirror::Load(const char* nodename, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, const std::vector<const CDirectoryServiceRecordArena*>& arenas)
+{
+    ::pthread_mutex_lock(&mMutex);
+    Reset();
+
+    mNodeName = nodename;
+    mRecordTypeOrder = recordTypes;
+    mRecordTypes.insert(recordTypes.begin(), recordTypes.end());
+    for(size_t i = 0; i < schema.GetCount(); i++)
+        mAttributes[schema.GetSlot(i).mName] = schema.GetSlot(i).mKind;
+    for(size_t i = 0; (i < recordTypes.size()) && (i < arenas.size()); i++)
+    {
+        for(size_t j = 0; j < arenas[i]->GetRecordCount(); j++)
+            AddRecord(recordTypes[i], *arenas[i], j);
+    }
+    mLoadedAt = ::CFAbsoluteTimeGetCurrent();
+    mLoads++;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Put
+//
+// Add a record to the mirror, replacing any record with the same GeneratedUID.
+//
+// @param recordType: the record type of the record.
+// @param arena: the arena holding the record.
+// @param index: the index of the record in the arena.
+//
+void CDirectoryServiceMirror::Put(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index)
+{
+    ::pthread_mutex_lock(&mMutex);
+    AddRecord(recordType, arena, index);
+    mUpdates++;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Clear
+//
+// Remove everything from the mirror, so it no longer answers any lookups.
+//
+void CDirectoryServiceMirror::Clear()
+{
+    ::pthread_mutex_lock(&mMutex);
+    Reset();
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// WriteSnapshot
+//
+// Write the records held to a snapshot file, replacing any file already there. Record types the
+// mirror does not hold completely are left out.
+//
+// @param path: the file to write.
+// @return: true if the snapshot was written, false if nothing is loaded.
+// @throw: yes
+//
+bool CDirectoryServiceMirror::WriteSnapshot(const char* path)
+{
+    // Lay the records out under the lock, but do the file I/O without it
+    CDirectoryServiceSnapshotWriter writer;
+    ::pthread_mutex_lock(&mMutex);
+    if (mRecordTypeOrder.empty())
+    {
+        ::pthread_mutex_unlock(&mMutex);
+        return false;
+    }
+    writer.SetNodeName(mNodeName);
+    for(std::vector<std::string>::const_iterator iter = mRecordTypeOrder.begin(); iter != mRecordTypeOrder.end(); iter++)
+    {
+        if (mIncomplete.find(*iter) == mIncomplete.end())
+            writer.AddRecordType(*iter);
+    }
+    for(std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>::const_iterator iter = mAttributes.begin(); iter != mAttributes.end(); iter++)
+        writer.AddAttributeKind((*iter).first, (*iter).second);
+    std::map<std::string, UInt32> numbers;
+    for(TRecordMap::const_iterator iter = mRecords.begin(); iter != mRecords.end(); iter++)
+    {
+        if (mIncomplete.find((*iter).second.mRecordType) == mIncomplete.end())
+            numbers[(*iter).first] = writer.AddRecord((*iter).second.mRecordType, (*iter).second.mRecord, 0);
+    }
+    for(TIndexMap::const_iterator index = mIndexes.begin(); index != mIndexes.end(); index++)
+    {
+        for(TIndex::const_iterator iter = (*index).second.begin(); iter != (*index).second.end(); iter++)
+        {
+            std::map<std::string, UInt32>::const_iterator number = numbers.find((*iter).second);
+            if (number != numbers.end())
+                writer.AddIndexEntry((*index).first, (*iter).first, (*number).second);
+        }
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    writer.Write(path);
+    return true;
+}
+
+// LoadSnapshot
+//
+// Replace the contents of the mirror with a snapshot file, which answers lookups until the
+// mirror is next loaded.
+//
+// @param path: the file to map.
+// @throw: yes
+//
+void CDirectoryServiceMirror::LoadSnapshot(const char* path)
+{
+    CDirectoryServiceSnapshot* snapshot = new CDirectoryServiceSnapshot(path);
+
+    ::pthread_mutex_lock(&mMutex);
+    Reset();
+    mSnapshot = snapshot;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// GetProfile
+//
+// Get what the mirror was last loaded with, so it can be refreshed or reloaded the same way.
+//
+// @param nodename: set to the node the records were loaded from.
+// @param recordTypes: set to the record types mirrored.
+// @param attributes: set to the attributes mirrored and their encodings.
+// @param watermark: set to the latest ModificationTimestamp of any record held, or empty if none had one.
+// @param loadedAt: set to the time of the last full load.
+// @return: true if the mirror is loaded or serving a snapshot, false otherwise.
+//
+bool CDirectoryServiceMirror::GetProfile(std::string& nodename, std::vector<std::string>& recordTypes, std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>& attributes, std::string& watermark, CFAbsoluteTime& loadedAt)
+{
+    ::pthread_mutex_lock(&mMutex);
+    bool result = !mRecordTypeOrder.empty();
+    nodename = mNodeName;
+    recordTypes = mRecordTypeOrder;
+    attributes = mAttributes;
+    watermark = mWatermark;
+    loadedAt = mLoadedAt;
+    if (!result && (mSnapshot != NULL))
+    {
+        result = true;
+        nodename = mSnapshot->GetNodeName();
+        recordTypes = mSnapshot->GetRecordTypes();
+        attributes = mSnapshot->GetAttributes();
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// Query
+//
+// Answer an exact lookup from the mirror if it can. Records are returned in the order of the
+// requested record types. Index keys are only lower-cased for ASCII, so a case-insensitive lookup of
+// any other value is left to the directory.
+//
+// @param nodename: the node the lookup is for.
+// @param attr: the attribute to look up.
+// @param value: the value to look for.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to look in.
+// @param schema: the attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param result: arena to add the matching records to.
+// @return: true if the mirror answered the lookup, false if it has to go to the directory.
+// @throw: yes
+//
+bool CDirectoryServiceMirror::Query(const char* nodename, const char* attr, const char* value, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result)
+{
+    if (casei && !IsASCII(value))
+        return false;
+
+    ::pthread_mutex_lock(&mMutex);
+    if (mRecordTypes.empty() && (mSnapshot != NULL))
+    {
+        if (mSnapshot->GetNodeName() != nodename)
+        {
+            ::pthread_mutex_unlock(&mMutex);
+            return false;
+        }
+
+        bool answered = false;
+        try
+        {
+            answered = mSnapshot->Query(attr, value, casei, recordTypes, schema, maxRecordCount, result);
+        }
+        catch(...)
+        {
+            ::pthread_mutex_unlock(&mMutex);
+            throw;
+        }
+        if (answered)
+            mHits++;
+        ::pthread_mutex_unlock(&mMutex);
+        return answered;
+    }
+    if ((mNodeName != nodename) || !CanAnswer(attr, recordTypes, schema))
+    {
+        ::pthread_mutex_unlock(&mMutex);
+        return false;
+    }
+
+    // Find candidate records, grouped by record type
+    std::vector< std::vector<const Entry*> > found(recordTypes.size());
+    std::set<std::string> seen;
+    const TIndex& index = mIndexes[attr];
+    std::pair<TIndex::const_iterator, TIndex::const_iterator> range = index.equal_range(LowerCase(value));
+    for(TIndex::const_iterator iter = range.first; iter != range.second; iter++)
+    {
+        if (!seen.insert((*iter).second).second)
+            continue;
+        TRecordMap::const_iterator record = mRecords.find((*iter).second);
+        if (record == mRecords.end())
+            continue;
+        const Entry& entry = (*record).second;
+        if (!casei && !HasValue(entry.mRecord, attr, value))
+            continue;
+        for(size_t i = 0; i < recordTypes.size(); i++)
+        {
+            if (recordTypes[i] == entry.mRecordType)
+            {
+                found[i].push_back(&entry);
+                break;
+            }
+        }
+    }
+
+    // Copy out just the requested attributes
+    size_t count = 0;
+    CDirectoryServiceArenaOutput output(result);
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        for(std::vector<const Entry*>::const_iterator iter = found[i].begin(); iter != found[i].end(); iter++)
+        {
+            if ((maxRecordCount != 0) && (count >= maxRecordCount))
+                break;
+            (*iter)->mRecord.Replay(schema, output, 0, 1, true);
+            count++;
+        }
+    }
+    mHits++;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return true;
+}
+
+// QueryExpression
+//
+// Answer a compound query from the records held if it can, using the indexes to narrow down the
+// records to evaluate. Records are returned in the order of the requested record types. As with
+// Query, a case-insensitive query on values that are not ASCII is left to the directory, as is a
+// query with a less than or greater than match, since the directory orders numeric attributes
+// numerically.
+//
+// @param nodename: the node the query is for.
+// @param expr: the query.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to look in.
+// @param schema: the attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param result: arena to add the matching records to.
+// @return: true if the mirror answered the query, false if it has to go to the directory.
+//
+bool CDirectoryServiceMirror::QueryExpression(const char* nodename, const CDirectoryServiceQueryExpression& expr, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result)
+{
+    if ((casei && !expr.IsASCII()) || expr.HasOrdering())
+        return false;
+
+    // Every attribute tested must be mirrored, or a missing value would look like no match
+    std::set<std::string> tested;
+    expr.GetAttributes(tested);
+
+    ::pthread_mutex_lock(&mMutex);
+    bool answerable = (mNodeName == nodename) && CanReturn(recordTypes, schema);
+    for(std::set<std::string>::const_iterator iter = tested.begin(); answerable && (iter != tested.end()); iter++)
+        answerable = (*iter == kDSNAttrRecordName) || (mAttributes.find(*iter) != mAttributes.end());
+    if (!answerable)
+    {
+        ::pthread_mutex_unlock(&mMutex);
+        return false;
+    }
+
+    // Evaluate the candidate records, grouped by record type
+    std::vector< std::vector<const Entry*> > found(recordTypes.size());
+    std::set<std::string> candidates;
+    bool indexed = GetCandidates(expr, candidates);
+    if (!indexed)
+        mScans++;
+    TRecordMap::const_iterator record = mRecords.begin();
+    std::set<std::string>::const_iterator candidate = candidates.begin();
+    while(indexed ? (candidate != candidates.end()) : (record != mRecords.end()))
+    {
+        const Entry* entry = NULL;
+        if (indexed)
+        {
+            TRecordMap::const_iterator held = mRecords.find(*candidate++);
+            if (held != mRecords.end())
+                entry = &(*held).second;
+        }
+        else
+            entry = &(*record++).second;
+        if ((entry == NULL) || !expr.Matches(entry->mRecord, 0, casei))
+            continue;
+        for(size_t i = 0; i < recordTypes.size(); i++)
+        {
+            if (recordTypes[i] == entry->mRecordType)
+            {
+                found[i].push_back(entry);
+                break;
+            }
+        }
+    }
+
+    // Copy out just the requested attributes
+    size_t count = 0;
+    CDirectoryServiceArenaOutput output(result);
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        for(std::vector<const Entry*>::const_iterator iter = found[i].begin(); iter != found[i].end(); iter++)
+        {
+            if ((maxRecordCount != 0) && (count >= maxRecordCount))
+                break;
+            (*iter)->mRecord.Replay(schema, output, 0, 1, true);
+            count++;
+        }
+    }
+    mExpressionHits++;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return true;
+}
+
+// GetStatistics
+//
+// Add the mirror's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceMirror::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["mirror_records"] = mRecords.size();
+    stats["mirror_hits"] = mHits;
+    stats["mirror_loads"] = mLoads;
+    stats["mirror_updates"] = mUpdates;
+    stats["mirror_skipped"] = mSkipped;
+    stats["mirror_incomplete_types"] = mIncomplete.size();
+    stats["mirror_expression_hits"] = mExpressionHits;
+    stats["mirror_scans"] = mScans;
+    stats["mirror_snapshot_records"] = (mSnapshot != NULL) ? mSnapshot->GetRecordCount() : 0;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// IsIndexed
+//
+// Check whether an attribute has a secondary index.
+//
+// @param attr: the attribute.
+// @return: true if the attribute is indexed, false otherwise.
+//
+bool CDirectoryServiceMirror::IsIndexed(const char* attr)
+{
+    for(const char** indexed = cIndexedAttributes; *indexed != NULL; indexed++)
+    {
+        if (::strcmp(*indexed, attr) == 0)
+            return true;
+    }
+    return false;
+}
+
+#pragma mark -----Private API
+
+// Forget everything loaded. Called with the lock held.
+void CDirectoryServiceMirror::Reset()
+{
+    mNodeName.clear();
+    mRecordTypeOrder.clear();
+    mRecordTypes.clear();
+    mIncomplete.clear();
+    mAttributes.clear();
+    mRecords.clear();
+    mIndexes.clear();
+    mWatermark.clear();
+    mLoadedAt = 0;
+    delete mSnapshot;
+    mSnapshot = NULL;
+}
+
+// Add or replace a record and index it, moving the watermark on. A record without a GeneratedUID
+// marks its record type as incomplete instead. Called with the lock held.
+void CDirectoryServiceMirror::AddRecord(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index)
+{
+    Entry entry;
+    entry.mRecordType = recordType;
+    entry.mRecord.CopyRecord(arena, index);
+
+    std::vector<std::string> uids;
+    GetValues(entry.mRecord, kDS1AttrGeneratedUID, uids);
+    if (uids.empty())
+    {
+        mIncomplete.insert(recordType);
+        mSkipped++;
+        return;
+    }
+    const std::string& uid = uids[0];
+
+    // Timestamps are in generalized time format, so compare in the same order as strings
+    std::vector<std::string> timestamps;
+    GetValues(entry.mRecord, kDS1AttrModificationTimestamp, timestamps);
+    for(std::vector<std::string>::const_iterator iter = timestamps.begin(); iter != timestamps.end(); iter++)
+    {
+        if (*iter > mWatermark)
+            mWatermark = *iter;
+    }
+
+    RemoveRecord(uid);
+    mRecords[uid] = entry;
+    for(const char** indexed = cIndexedAttributes; *indexed != NULL; indexed++)
+    {
+        std::vector<std::string> values;
+        GetValues(entry.mRecord, *indexed, values);
+        TIndex& index = mIndexes[*indexed];
+        for(std::vector<std::string>::const_iterator iter = values.begin(); iter != values.end(); iter++)
+            index.insert(TIndex::value_type(LowerCase(*iter), uid));
+    }
+}
+
+// Remove a record and its index entries, if present. Called with the lock held.
+void CDirectoryServiceMirror::RemoveRecord(const std::string& uid)
+{
+    TRecordMap::iterator found = mRecords.find(uid);
+    if (found == mRecords.end())
+        return;
+
+    for(const char** indexed = cIndexedAttributes; *indexed != NULL; indexed++)
+    {
+        std::vector<std::string> values;
+        GetValues((*found).second.mRecord, *indexed, values);
+        TIndex& index = mIndexes[*indexed];
+        for(std::vector<std::string>::const_iterator iter = values.begin(); iter != values.end(); iter++)
+        {
+            std::pair<TIndex::iterator, TIndex::iterator> range = index.equal_range(LowerCase(*iter));
+            for(TIndex::iterator entry = range.first; entry != range.second; )
+            {
+                if ((*entry).second == uid)
+                    index.erase(entry++);
+                else
+                    entry++;
+            }
+        }
+    }
+    mRecords.erase(found);
+}
+
+// Check that the lookup is on an indexed attribute and that everything it asks for is mirrored.
+// Called with the lock held.
+bool CDirectoryServiceMirror::CanAnswer(const char* attr, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const
+{
+    return IsIndexed(attr) && CanReturn(recordTypes, schema);
+}
+
+// Check that the record types and attributes asked for are mirrored, and that no records of those
+// types were left out. Called with the lock held.
+bool CDirectoryServiceMirror::CanReturn(const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const
+{
+    if (mRecordTypes.empty())
+        return false;
+    for(std::vector<std::string>::const_iterator iter = recordTypes.begin(); iter != recordTypes.end(); iter++)
+    {
+        if ((mRecordTypes.find(*iter) == mRecordTypes.end()) || (mIncomplete.find(*iter) != mIncomplete.end()))
+            return false;
+    }
+    for(size_t i = 0; i < schema.GetCount(); i++)
+    {
+        const CDirectoryServiceAttributeSchema::Slot& slot = schema.GetSlot(i);
+        std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>::const_iterator found = mAttributes.find(slot.mName);
+        if ((found == mAttributes.end()) || ((*found).second != slot.mKind))
+            return false;
+    }
+    return true;
+}
+
+// Find the records that can match an expression from the indexes: exact and starts with matches
+// on indexed attributes, intersected for AND and combined for OR. The candidates are a superset of
+// the matching records, as index keys are lower-cased. Returns false if the indexes cannot narrow
+// the records down, in which case every record has to be evaluated. Called with the lock held.
+bool CDirectoryServiceMirror::GetCandidates(const CDirectoryServiceQueryExpression& expr, std::set<std::string>& uids)
+{
+    switch(expr.GetOperator())
+    {
+    case CDirectoryServiceQueryExpression::eMatch:
+        {
+            if (!IsIndexed(expr.GetAttribute().c_str()))
+                return false;
+            const TIndex& index = mIndexes[expr.GetAttribute()];
+            std::string key = LowerCase(expr.GetValue());
+            if (expr.GetMatchType() == eDSExact)
+            {
+                std::pair<TIndex::const_iterator, TIndex::const_iterator> range = index.equal_range(key);
+                for(TIndex::const_iterator iter = range.first; iter != range.second; iter++)
+                    uids.insert((*iter).second);
+                return true;
+            }
+            if (expr.GetMatchType() == eDSStartsWith)
+            {
+                for(TIndex::const_iterator iter = index.lower_bound(key); (iter != index.end()) && ((*iter).first.compare(0, key.length(), key) == 0); iter++)
+                    uids.insert((*iter).second);
+                return true;
+            }
+        }
+        return false;
+    case CDirectoryServiceQueryExpression::eAnd:
+        {
+            // Intersect on the side, as uids may already hold the candidates of an enclosing OR
+            std::set<std::string> all;
+            bool narrowed = false;
+            for(size_t i = 0; i < expr.GetCount(); i++)
+            {
+                std::set<std::string> sub;
+                if (!GetCandidates(expr.GetSubexpression(i), sub))
+                    continue;
+                if (narrowed)
+                {
+                    std::set<std::string> both;
+                    std::set_intersection(all.begin(), all.end(), sub.begin(), sub.end(), std::inserter(both, both.begin()));
+                    all.swap(both);
+                }
+                else
+                    all.swap(sub);
+                narrowed = true;
+            }
+            if (narrowed)
+                uids.insert(all.begin(), all.end());
+            return narrowed;
+        }
+    case CDirectoryServiceQueryExpression::eOr:
+        for(size_t i = 0; i < expr.GetCount(); i++)
+        {
+            if (!GetCandidates(expr.GetSubexpression(i), uids))
+                return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Check whether a record has exactly the given value for an attribute.
+bool CDirectoryServiceMirror::HasValue(const CDirectoryServiceRecordArena& record, const char* attr, const char* value) const
+{
+    std::vector<std::string> values;
+    GetValues(record, attr, values);
+    for(std::vector<std::string>::const_iterator iter = values.begin(); iter != values.end(); iter++)
+    {
+        if (*iter == value)
+            return true;
+    }
+    return false;
+}
+
+// Get the values of an attribute of the single record in an arena. The record name counts as a
+// value of RecordName.
+void CDirectoryServiceMirror::GetValues(const CDirectoryServiceRecordArena& record, const char* attr, std::vector<std::string>& values)
+{
+    if (record.GetRecordCount() == 0)
+        return;
+
+    const CDirectoryServiceRecordArena::Record& rec = record.GetRecord(0);
+    if (::strcmp(attr, kDSNAttrRecordName) == 0)
+        values.push_back(std::string(record.GetString(rec.mName), rec.mName.mLength));
+    for(size_t i = 0; i < rec.mAttributeCount; i++)
+    {
+        const CDirectoryServiceRecordArena::Attribute& attribute = record.GetAttribute(rec, i);
+        if (::strcmp(record.GetString(attribute.mName), attr) != 0)
+            continue;
+        for(size_t j = 0; j < attribute.mValueCount; j++)
+        {
+            const CDirectoryServiceRecordArena::Value& value = record.GetValue(attribute, j);
+            values.push_back(std::string(record.GetString(value), value.mLength));
+        }
+    }
+}
+
+// ASCII lower-case copy of a string, used for index keys. Other characters are left as they are.
+std::string CDirectoryServiceMirror::LowerCase(const std::string& str)
+{
+    std::string result(str);
+    for(std::string::iterator iter = result.begin(); iter != result.end(); iter++)
+        *iter = ::tolower((unsigned char)*iter);
+    return result;
+}
+
+// Check whether a string is all ASCII, so that LowerCase folds its case completely.
+bool CDirectoryServiceMirror::IsASCII(const std::string& str)
+{
+    for(std::string::const_iterator iter = str.begin(); iter != str.end(); iter++)
+    {
+        if ((unsigned char)*iter >= 0x80)
+            return false;
+    }
+    return true;
+}
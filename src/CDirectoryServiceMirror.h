@@ -0,0 +1,120 @@
+/**
+ * A class that mirrors Directory Service records in memory.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceAttributeSchema.h"
+#include "CDirectoryServiceRecordOutput.h"
+#include "CDirectoryServiceStatistics.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <map>
+#include <pthread.h>
+#include <set>
+#include <string>
+#include <vector>
+
+class CDirectoryServiceQueryExpression;
+class CDirectoryServiceSnapshot;
+
+// Records of a set of record types, with a set of attributes, are kept keyed by GeneratedUID.
+// Secondary indexes map the lower-cased values of GeneratedUID, RecordName, EMailAddress and
+// ServicesLocator to records, so exact lookups on those attributes can be answered without going
+// to the directory. Compound queries, and lookups with other match types, are evaluated against
+// the records held, using the indexes to find candidates where the query allows and scanning every
+// record otherwise. Less than and greater than matches always go to the directory, which orders
+// numeric attributes numerically. The mirror is only used for lookups that it can answer
+// completely: all record types, requested attributes and tested attributes must be mirrored. A
+// record without a GeneratedUID cannot be held, so once one is seen its record type goes to the
+// directory until the next load. Only lookups on the node the records were loaded from are
+// answered. Results are only as fresh as the last load.
+//
+// The mirror also keeps a watermark, the latest ModificationTimestamp of any record it holds, so
+// that records changed since can be fetched and put into it without listing everything again.
+//
+// The records can be written to a snapshot file, which another process can map to answer lookups
+// straight away. A mirror serving from a snapshot has no watermark, so its next refresh is a full
+// load, which replaces the snapshot.
+class CDirectoryServiceMirror
+{
+public:
+    CDirectoryServiceMirror();
+    ~CDirectoryServiceMirror();
+
+    void Load(const char* nodename, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, const std::vector<const CDirectoryServiceRecordArena*>& arenas);
+    void Put(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index);
+    void Clear();
+
+    bool WriteSnapshot(const char* path);
+    void LoadSnapshot(const char* path);
+
+    bool GetProfile(std::string& nodename, std::vector<std::string>& recordTypes, std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>& attributes, std::string& watermark, CFAbsoluteTime& loadedAt);
+
+    bool Query(const char* nodename, const char* attr, const char* value, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result);
+    bool QueryExpression(const char* nodename, const CDirectoryServiceQueryExpression& expr, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+    static bool IsIndexed(const char* attr);
+
+private:
+    struct Entry
+    {
+        std::string                     mRecordType;
+        CDirectoryServiceRecordArena    mRecord;        // holds just this record
+    };
+    typedef std::map<std::string, Entry> TRecordMap;
+    typedef std::multimap<std::string, std::string> TIndex;
+    typedef std::map<std::string, TIndex> TIndexMap;
+
+    std::string                                                     mNodeName;      // the node the records were loaded from
+    std::vector<std::string>                                        mRecordTypeOrder;
+    std::set<std::string>                                           mRecordTypes;
+    std::set<std::string>                                           mIncomplete;    // record types with records skipped
+    std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>    mAttributes;
+    TRecordMap          mRecords;       // by GeneratedUID
+    TIndexMap           mIndexes;       // by attribute, then lower-cased value to GeneratedUID
+    std::string         mWatermark;     // latest ModificationTimestamp seen
+    CFAbsoluteTime      mLoadedAt;
+    CDirectoryServiceSnapshot*  mSnapshot;  // used while nothing is loaded
+    pthread_mutex_t     mMutex;
+
+    UInt64              mHits;
+    UInt64              mLoads;
+    UInt64              mUpdates;
+    UInt64              mSkipped;       // records without a GeneratedUID
+    UInt64              mExpressionHits;
+    UInt64              mScans;         // expressions evaluated against every record
+
+    void AddRecord(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index);
+    void Reset();
+    void RemoveRecord(const std::string& uid);
+    bool CanAnswer(const char* attr, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const;
+    bool CanReturn(const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const;
+    bool GetCandidates(const CDirectoryServiceQueryExpression& expr, std::set<std::string>& uids);
+    bool HasValue(const CDirectoryServiceRecordArena& record, const char* attr, const char* value) const;
+
+    static void GetValues(const CDirectoryServiceRecordArena& record, const char* attr, std::vector<std::string>& values);
+    static std::string LowerCase(const std::string& str);
+    static bool IsASCII(const std::string& str);
+
+    // Not copyable
+    CDirectoryServiceMirror(const CDirectoryServiceMirror& copy);
+    CDirectoryServiceMirror& operator=(const CDirectoryServiceMirror& copy);
+};
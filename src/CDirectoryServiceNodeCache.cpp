@@ -0,0 +1,208 @@
+/**
+ * A class that keeps the session pools of recently used nodes, so queries
+ * and authentications share their directory and node references.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceNodeCache.h"
+
+#include "CDirectoryServiceSessionPool.h"
+
+#include <vector>
+
+#pragma mark -----Public API
+
+CDirectoryServiceNodeCache::CDirectoryServiceNodeCache(size_t maxNodes)
+{
+    mMaxNodes = (maxNodes > 0) ? maxNodes : 1;
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+    mFailures = 0;
+    mReopens = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceNodeCache::~CDirectoryServiceNodeCache()
+{
+    for(TEntryMap::iterator iter = mEntries.begin(); iter != mEntries.end(); iter++)
+        delete (*iter).second.mPool;
+    mEntries.clear();
+    mUsedOrder.clear();
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Acquire
+//
+// Get the session pool for a node, creating it the first time the node is asked for. A node
+// reported as failing is reopened first if nobody else holds it.
+//
+// @param nodename: the node the sessions are for.
+// @return: the session pool, owned by the cache until given back with Release.
+//
+CDirectoryServiceSessionPool* CDirectoryServiceNodeCache::Acquire(const char* nodename)
+{
+    CDirectoryServiceSessionPool* unhealthy = NULL;
+    std::vector<CDirectoryServiceSessionPool*> evicted;
+
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator found = mEntries.find(nodename);
+    if (found != mEntries.end())
+    {
+        Entry& entry = (*found).second;
+        mUsedOrder.splice(mUsedOrder.begin(), mUsedOrder, entry.mUsed);
+        if (!entry.mHealthy && (entry.mUsers == 0))
+        {
+            // Only this node's references are closed
+            unhealthy = entry.mPool;
+            entry.mPool = new CDirectoryServiceSessionPool(nodename);
+            entry.mHealthy = true;
+            entry.mFailures = 0;
+            mReopens++;
+        }
+        mHits++;
+    }
+    else
+    {
+        Entry& entry = mEntries[nodename];
+        entry.mPool = new CDirectoryServiceSessionPool(nodename);
+        entry.mUsers = 0;
+        entry.mHealthy = true;
+        entry.mFailures = 0;
+        entry.mLastError = eDSNoErr;
+        entry.mUsed = mUsedOrder.insert(mUsedOrder.begin(), nodename);
+        found = mEntries.find(nodename);
+        mMisses++;
+    }
+    (*found).second.mUsers++;
+    CDirectoryServiceSessionPool* result = (*found).second.mPool;
+
+    // Evict now so closing the references happens without the lock
+    while(mEntries.size() > mMaxNodes)
+    {
+        TKeyList::reverse_iterator iter = mUsedOrder.rbegin();
+        while((iter != mUsedOrder.rend()) && ((*mEntries.find(*iter)).second.mUsers != 0))
+            iter++;
+        if (iter == mUsedOrder.rend())
+            break;
+        TEntryMap::iterator victim = mEntries.find(*iter);
+        evicted.push_back((*victim).second.mPool);
+        mUsedOrder.erase((*victim).second.mUsed);
+        mEntries.erase(victim);
+        mEvictions++;
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    delete unhealthy;
+    for(std::vector<CDirectoryServiceSessionPool*>::iterator iter = evicted.begin(); iter != evicted.end(); iter++)
+        delete *iter;
+
+    return result;
+}
+
+// Release
+//
+// Give back a session pool obtained from Acquire. All sessions checked out of it must have been
+// checked in or discarded.
+//
+// @param pool: the session pool.
+//
+void CDirectoryServiceNodeCache::Release(CDirectoryServiceSessionPool* pool)
+{
+    if (pool == NULL)
+        return;
+
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator found = Find(pool);
+    if ((found != mEntries.end()) && ((*found).second.mUsers > 0))
+        (*found).second.mUsers--;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// ReportFailure
+//
+// Note that a call on a node failed in a way that may have left its references unusable. The node's
+// idle references are reopened once nobody holds it, other nodes are not affected.
+//
+// @param pool: the node's session pool, obtained from Acquire.
+// @param error: the error the call failed with.
+//
+void CDirectoryServiceNodeCache::ReportFailure(CDirectoryServiceSessionPool* pool, tDirStatus error)
+{
+    if (pool == NULL)
+        return;
+
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator found = Find(pool);
+    if (found != mEntries.end())
+    {
+        Entry& entry = (*found).second;
+        entry.mHealthy = false;
+        entry.mFailures++;
+        entry.mLastError = error;
+        mFailures++;
+    }
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// SetMaxNodes
+//
+// Change the most nodes kept open. Surplus nodes nobody holds are closed by the next Acquire.
+//
+// @param maxNodes: the most nodes, at least one.
+//
+void CDirectoryServiceNodeCache::SetMaxNodes(size_t maxNodes)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mMaxNodes = (maxNodes > 0) ? maxNodes : 1;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// GetStatistics
+//
+// Add the cache's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceNodeCache::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    size_t unhealthy = 0;
+    for(TEntryMap::const_iterator iter = mEntries.begin(); iter != mEntries.end(); iter++)
+    {
+        if (!(*iter).second.mHealthy)
+            unhealthy++;
+    }
+    stats["node_cache_nodes"] = mEntries.size();
+    stats["node_cache_unhealthy"] = unhealthy;
+    stats["node_cache_hits"] = mHits;
+    stats["node_cache_misses"] = mMisses;
+    stats["node_cache_evictions"] = mEvictions;
+    stats["node_cache_failures"] = mFailures;
+    stats["node_cache_reopens"] = mReopens;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+// Find the entry holding a session pool. Called with the lock held.
+CDirectoryServiceNodeCache::TEntryMap::iterator CDirectoryServiceNodeCache::Find(CDirectoryServiceSessionPool* pool)
+{
+    TEntryMap::iterator result = mEntries.find(pool->GetNodeName());
+    if ((result != mEntries.end()) && ((*result).second.mPool != pool))
+        result = mEntries.end();
+    return result;
+}
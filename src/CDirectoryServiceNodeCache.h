@@ -0,0 +1,80 @@
+/**
+ * A class that keeps the session pools of recently used nodes, so queries
+ * and authentications share their directory and node references.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+class CDirectoryServiceSessionPool;
+
+// Each entry is the session pool of one node, keyed by node name, plus its health. An entry is held
+// between Acquire and Release, and only entries nobody holds are closed: the least recently used
+// ones once there are more than a given number of nodes. A call that fails on a node reports it,
+// which marks just that entry unhealthy. Its idle references are closed and reopened the next time
+// it is acquired with nobody holding it, while other nodes keep theirs.
+class CDirectoryServiceNodeCache
+{
+public:
+    CDirectoryServiceNodeCache(size_t maxNodes=32);
+    ~CDirectoryServiceNodeCache();
+
+    CDirectoryServiceSessionPool* Acquire(const char* nodename);
+    void Release(CDirectoryServiceSessionPool* pool);
+    void ReportFailure(CDirectoryServiceSessionPool* pool, tDirStatus error);
+
+    void SetMaxNodes(size_t maxNodes);
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    typedef std::list<std::string> TKeyList;
+    struct Entry
+    {
+        CDirectoryServiceSessionPool*   mPool;
+        size_t                          mUsers;     // Acquire calls not released yet
+        bool                            mHealthy;
+        UInt32                          mFailures;  // reported since the node was last reopened
+        tDirStatus                      mLastError;
+        TKeyList::iterator              mUsed;      // position in mUsedOrder
+    };
+    typedef std::map<std::string, Entry> TEntryMap;
+
+    size_t              mMaxNodes;
+    TEntryMap           mEntries;
+    TKeyList            mUsedOrder;     // most recently used first
+    pthread_mutex_t     mMutex;
+
+    UInt64              mHits;
+    UInt64              mMisses;
+    UInt64              mEvictions;
+    UInt64              mFailures;
+    UInt64              mReopens;
+
+    TEntryMap::iterator Find(CDirectoryServiceSessionPool* pool);
+
+    // Not copyable as the cache owns its session pools
+    CDirectoryServiceNodeCache(const CDirectoryServiceNodeCache& copy);
+    CDirectoryServiceNodeCache& operator=(const CDirectoryServiceNodeCache& copy);
+};
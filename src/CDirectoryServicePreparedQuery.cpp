@@ -0,0 +1,492 @@
+/**
+ * A class that runs the same Directory Service attribute query for
+ * different values, reusing everything built for the first one.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServicePreparedQuery.h"
+
+#include "CDirectoryServiceAttributeSchema.h"
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServiceManager.h"
+#include "CDirectoryServiceMirror.h"
+#include "CDirectoryServiceQueryCache.h"
+#include "CDirectoryServiceQueryExpression.h"
+#include "CDirectoryServiceRecordDecoder.h"
+#include "CDirectoryServiceSingleFlight.h"
+#include "CFStringUtil.h"
+
+#include <stdlib.h>
+
+#pragma mark -----Public API
+
+CDirectoryServicePreparedQuery::CDirectoryServicePreparedQuery(const char* nodename, CDirectoryServiceManager* manager) :
+	CDirectoryService(nodename, manager)
+{
+    mSchema = NULL;
+    mRecordTypes = NULL;
+    mRecTypes = NULL;
+    mAttrTypes = NULL;
+    mQueryAttr = NULL;
+    mMatchType = eDSExact;
+    mCaseI = false;
+}
+
+CDirectoryServicePreparedQuery::~CDirectoryServicePreparedQuery()
+{
+	// Clean-up
+	Close();
+}
+
+// Prepare
+//
+// Build everything needed to query one attribute of records of the specified types, apart from the
+// value to look for.
+//
+// @param attr: the attribute to query.
+// @param matchType: the match type of the query.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to query.
+// @param attributes: CFDictionary of CFString listing the attributes to return for each record.
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the query was prepared, false otherwise.
+//
+bool CDirectoryServicePreparedQuery::Prepare(const char* attr, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, bool using_python)
+{
+    try
+    {
+        StPythonThreadState threading(using_python);
+
+        _Prepare(attr, matchType, casei, recordTypes, attributes);
+        return true;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+		if (using_python)
+			dserror.SetPythonException();
+        return false;
+    }
+    catch(...)
+    {
+        CDirectoryServiceException dserror;
+		if (using_python)
+	        dserror.SetPythonException();
+        return false;
+    }
+}
+
+// Execute
+//
+// Run the prepared query for a value.
+//
+// @param value: the value to query.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record, or NULL if it fails.
+//
+CFMutableArrayRef CDirectoryServicePreparedQuery::Execute(const char* value, UInt32 maxRecordCount, bool using_python)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        try
+        {
+            StPythonThreadState threading(using_python);
+
+            return _Execute(value, maxRecordCount);
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            if (using_python)
+                dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            CDirectoryServiceException dserror;
+            if (using_python)
+                dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// ExecuteAsPython
+//
+// Run the prepared query for a value, decoding the directory data straight into Python objects.
+// Must only be called from Python.
+//
+// @param value: the value to query.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @return: PyObject list of [record name, dict of attributes] lists, or NULL if it fails.
+//
+PyObject* CDirectoryServicePreparedQuery::ExecuteAsPython(const char* value, UInt32 maxRecordCount)
+{
+    for(int attempt = 1; ; attempt++)
+    {
+        PyObject* result = PyList_New(0);
+        try
+        {
+            StPythonThreadState threading;
+
+            _Execute(value, maxRecordCount, result);
+            return result;
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            Py_DECREF(result);
+            if ((attempt == 1) && RecoverSession(dserror))
+                continue;
+            dserror.SetPythonException();
+            return NULL;
+        }
+        catch(...)
+        {
+            Py_DECREF(result);
+            CDirectoryServiceException dserror;
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+}
+
+// Close
+//
+// Release everything built by Prepare.
+//
+void CDirectoryServicePreparedQuery::Close()
+{
+    // Data lists and nodes are not tied to the directory reference used to allocate them
+    if (mRecTypes != NULL)
+    {
+        ::dsDataListDeallocate(0L, mRecTypes);
+        free(mRecTypes);
+        mRecTypes = NULL;
+    }
+    if (mAttrTypes != NULL)
+    {
+        ::dsDataListDeallocate(0L, mAttrTypes);
+        free(mAttrTypes);
+        mAttrTypes = NULL;
+    }
+    if (mQueryAttr != NULL)
+    {
+        ::dsDataNodeDeAllocate(0L, mQueryAttr);
+        mQueryAttr = NULL;
+    }
+    if (mSchema != NULL)
+    {
+        delete mSchema;
+        mSchema = NULL;
+    }
+    if (mRecordTypes != NULL)
+    {
+        ::CFRelease(mRecordTypes);
+        mRecordTypes = NULL;
+    }
+    mTypes.clear();
+    mAttr.clear();
+}
+
+#pragma mark -----Private API
+
+// _Prepare
+//
+// Build the data lists, attribute schema and query attribute node used by every subsequent
+// execution of the query.
+//
+// @param attr: the attribute to query.
+// @param matchType: the match type of the query.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to query.
+// @param attributes: a list of attributes to return.
+// @throw: yes
+//
+void CDirectoryServicePreparedQuery::_Prepare(const char* attr, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes)
+{
+    // Must have attributes
+    if (::CFDictionaryGetCount(attributes) == 0)
+        ThrowIfDSErr(eDSEmptyAttributeTypeList);
+
+    // Discard anything prepared before
+    Close();
+
+    try
+    {
+        mQueryAttr = ::dsDataNodeAllocateString(0L, attr);
+        ThrowIfNULL(mQueryAttr);
+
+        // Build data list of types
+        mRecTypes = ::dsDataListAllocate(0L);
+        ThrowIfNULL(mRecTypes);
+        BuildStringDataList(recordTypes, mRecTypes);
+
+        // Build data list of attributes
+        mAttrTypes = ::dsDataListAllocate(0L);
+        ThrowIfNULL(mAttrTypes);
+        BuildStringDataListFromKeys(attributes, mAttrTypes);
+
+        for(CFIndex i = 0; i < ::CFArrayGetCount(recordTypes); i++)
+        {
+            CFStringUtil recordType((CFStringRef)::CFArrayGetValueAtIndex(recordTypes, i));
+            mTypes.push_back(recordType.temp_str());
+        }
+        mRecordTypes = recordTypes;
+        ::CFRetain(mRecordTypes);
+
+        mSchema = new CDirectoryServiceAttributeSchema(attributes);
+        mAttr = attr;
+        mMatchType = matchType & 0xFEFF;
+        mCaseI = casei;
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        Close();
+        throw;
+    }
+}
+
+// _Execute
+//
+// Run the prepared query for a value.
+//
+// @param value: the value to query.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param pyresult: Python list to add records to directly, or NULL to return CoreFoundation objects.
+// @param arenaresult: arena to add records to directly, used to fill the query cache and coalesced queries.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record, or NULL if pyresult or arenaresult is used.
+// @throw: yes
+//
+CFMutableArrayRef CDirectoryServicePreparedQuery::_Execute(const char* value, UInt32 maxRecordCount, PyObject* pyresult, CDirectoryServiceRecordArena* arenaresult)
+{
+    if (!IsPrepared())
+        ThrowIfDSErr(eDSNullParameter);
+
+    CFMutableArrayRef result = NULL;
+    tDataNodePtr queryValue = NULL;
+    tContextData context = NULL;
+
+    if ((pyresult == NULL) && (arenaresult == NULL))
+        result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+
+    // Answer from the manager's mirror when it holds everything asked for
+    if (_ExecuteMirrored(value, maxRecordCount, pyresult, result, arenaresult))
+        return result;
+
+    // Answer from the manager's result cache when it is turned on, sharing entries with plain
+    // queries. A miss is filled by executing into an arena without the cache.
+    CDirectoryServiceQueryCache* cache = (mUseCache && (mManager != NULL)) ? mManager->GetQueryCache() : NULL;
+    if ((cache != NULL) && cache->IsEnabled())
+    {
+        try
+        {
+            std::string key = QueryCacheKey(mNodeName, mAttr.c_str(), value, mMatchType, NULL, mCaseI, mRecordTypes, *mSchema, maxRecordCount);
+            CDirectoryServiceRecordArena arena;
+            if (!cache->Find(key, arena))
+            {
+                mUseCache = false;
+                try
+                {
+                    _Execute(value, maxRecordCount, NULL, &arena);
+                }
+                catch(...)
+                {
+                    mUseCache = true;
+                    throw;
+                }
+                mUseCache = true;
+                cache->Insert(key, arena);
+            }
+            AppendRecords(arena, *mSchema, arena.GetRecordCount(), pyresult, result, arenaresult);
+        }
+        catch(...)
+        {
+            if (result != NULL)
+                ::CFRelease(result);
+            throw;
+        }
+        return result;
+    }
+
+    // Share the result of an identical query that is already in flight rather than repeating it
+    CDirectoryServiceSingleFlight* flight = (mCoalesce && (mManager != NULL)) ? mManager->GetSingleFlight() : NULL;
+    if (flight != NULL)
+    {
+        std::string key = QueryCacheKey(mNodeName, mAttr.c_str(), value, mMatchType, NULL, mCaseI, mRecordTypes, *mSchema, maxRecordCount);
+        bool leader = false;
+        CDirectoryServiceSingleFlight::Call* call = flight->Join(key, leader);
+        tDirStatus error = eDSNoErr;
+        if (leader)
+        {
+            mCoalesce = false;
+            try
+            {
+                _Execute(value, maxRecordCount, NULL, &call->GetArena());
+            }
+            catch(CDirectoryServiceException& dserror)
+            {
+                error = dserror.GetDSError();
+            }
+            catch(...)
+            {
+                error = eUndefinedError;
+            }
+            mCoalesce = true;
+            flight->Finish(key, call, error);
+        }
+        else
+            error = flight->Wait(call);
+
+        try
+        {
+            ThrowIfDSErr(error);
+            const CDirectoryServiceRecordArena& arena = call->GetArena();
+            AppendRecords(arena, *mSchema, arena.GetRecordCount(), pyresult, result, arenaresult);
+        }
+        catch(...)
+        {
+            if (result != NULL)
+                ::CFRelease(result);
+            flight->Release(call);
+            throw;
+        }
+        flight->Release(call);
+        return result;
+    }
+
+    try
+    {
+        // Make sure we have a valid directory service
+        OpenService();
+
+        // Open the node we want to query
+        OpenNode();
+
+        // We need a buffer for what comes next
+        CreateBuffer("query", mRecordTypes);
+
+        queryValue = ::dsDataNodeAllocateString(mDir, value);
+        ThrowIfNULL(queryValue);
+
+        tDirPatternMatch matchType = (tDirPatternMatch)(mCaseI ? (mMatchType | 0x0100) : mMatchType);
+        UInt32 total = 0;
+        do
+        {
+            // Query the next set of records, never asking for more than the overall limit allows
+            UInt32 recCount = (maxRecordCount != 0) ? maxRecordCount - total : 0;
+            tDirStatus err;
+            do
+            {
+                err = ::dsDoAttributeValueSearchWithData(mNode, mData, mRecTypes, mQueryAttr, matchType, queryValue, mAttrTypes, false, &recCount, &context);
+                if (err == eDSBufferTooSmall)
+                    ReallocBuffer();
+            } while(err == eDSBufferTooSmall);
+            ThrowIfDSErr(err);
+
+            // Never decode past the limit, whatever the directory sends back
+            if ((maxRecordCount != 0) && (recCount > maxRecordCount - total))
+                recCount = maxRecordCount - total;
+            if (pyresult != NULL)
+            {
+                // Decode directly into Python objects - the GIL is only held while this chunk is decoded
+                StPythonGILState gil;
+                CDirectoryServicePyOutput output(pyresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServicePyOutput>(mDir, mNode, mData, *mSchema, output).DecodeRecords(recCount);
+            }
+            else if (arenaresult != NULL)
+            {
+                CDirectoryServiceArenaOutput output(*arenaresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceArenaOutput>(mDir, mNode, mData, *mSchema, output).DecodeRecords(recCount);
+            }
+            else
+            {
+                CDirectoryServiceCFOutput output(result);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceCFOutput>(mDir, mNode, mData, *mSchema, output).DecodeRecords(recCount);
+            }
+            total += recCount;
+
+            // Stop the directory gathering any more once the limit has been reached
+            if ((maxRecordCount != 0) && (total >= maxRecordCount) && (context != NULL))
+            {
+                ::dsReleaseContinueData(mDir, context);
+                context = NULL;
+            }
+        } while (context != NULL); // Loop until all data has been obtained.
+
+        // Cleanup
+        ::dsDataNodeDeAllocate(mDir, queryValue);
+        RemoveBuffer();
+        CloseNode();
+        CloseService();
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        // Cleanup
+        if (context != NULL)
+            ::dsReleaseContinueData(mDir, context);
+        if (queryValue != NULL)
+        {
+            ::dsDataNodeDeAllocate(mDir, queryValue);
+            queryValue = NULL;
+        }
+        RemoveBuffer();
+        CloseNode();
+        DiscardService(dsStatus.GetDSError());
+
+        if (result != NULL)
+        {
+            ::CFRelease(result);
+            result = NULL;
+        }
+        throw;
+    }
+
+    return result;
+}
+
+// _ExecuteMirrored
+//
+// Run the prepared query against the manager's mirror, as a plain query would be.
+//
+// @param value: the value to query.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param pyresult: Python list to add records to directly, or NULL to use result.
+// @param result: CoreFoundation array to add records to when pyresult is not used.
+// @param arenaresult: arena to add records to instead, or NULL.
+// @return: true if the mirror answered the query, false if it has to go to the directory.
+//
+bool CDirectoryServicePreparedQuery::_ExecuteMirrored(const char* value, UInt32 maxRecordCount, PyObject* pyresult, CFMutableArrayRef result, CDirectoryServiceRecordArena* arenaresult)
+{
+    CDirectoryServiceMirror* mirror = ((mManager != NULL) && mUseMirror) ? mManager->GetMirror() : NULL;
+    if (mirror == NULL)
+        return false;
+
+    CDirectoryServiceRecordArena arena;
+    bool answered = false;
+    if ((mMatchType == eDSExact) && CDirectoryServiceMirror::IsIndexed(mAttr.c_str()))
+        answered = mirror->Query(mNodeName, mAttr.c_str(), value, mCaseI, mTypes, *mSchema, maxRecordCount, arena);
+    else if ((mMatchType >= eDSExact) && (mMatchType <= eDSContains))
+    {
+        CDirectoryServiceQueryExpression expr(mAttr.c_str(), value, mMatchType);
+        answered = mirror->QueryExpression(mNodeName, expr, mCaseI, mTypes, *mSchema, maxRecordCount, arena);
+    }
+    if (answered)
+        AppendRecords(arena, *mSchema, arena.GetRecordCount(), pyresult, result, arenaresult);
+    return answered;
+}
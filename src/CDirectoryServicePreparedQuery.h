@@ -0,0 +1,63 @@
+/**
+ * A class that runs the same Directory Service attribute query for
+ * different values, reusing everything built for the first one.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryService.h"
+
+#include <string>
+#include <vector>
+
+class CDirectoryServiceAttributeSchema;
+
+// The record type and attribute data lists, the attribute schema and the query attribute node are
+// built once by Prepare. Each Execute only has to allocate the value node, and check out a session
+// and a buffer for the length of the call. Executing for a value goes through the mirror, the query
+// cache and coalescing in the same way, and with the same key, as a plain query would.
+class CDirectoryServicePreparedQuery : public CDirectoryService
+{
+public:
+    CDirectoryServicePreparedQuery(const char* nodename, CDirectoryServiceManager* manager=NULL);
+    virtual ~CDirectoryServicePreparedQuery();
+
+    bool Prepare(const char* attr, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, bool using_python=true);
+    CFMutableArrayRef Execute(const char* value, UInt32 maxRecordCount=0, bool using_python=true);
+    PyObject* ExecuteAsPython(const char* value, UInt32 maxRecordCount=0);
+    void Close();
+
+    bool IsPrepared() const
+    {
+        return mSchema != NULL;
+    }
+
+protected:
+    CDirectoryServiceAttributeSchema* mSchema;
+    CFArrayRef                        mRecordTypes;
+    std::vector<std::string>          mTypes;               // mRecordTypes, for the mirror
+    std::string                       mAttr;
+    tDataListPtr                      mRecTypes;
+    tDataListPtr                      mAttrTypes;
+    tDataNodePtr                      mQueryAttr;
+    int                               mMatchType;           // without the case-insensitive bit
+    bool                              mCaseI;
+
+    void _Prepare(const char* attr, int matchType, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes);
+    CFMutableArrayRef _Execute(const char* value, UInt32 maxRecordCount, PyObject* pyresult=NULL, CDirectoryServiceRecordArena* arenaresult=NULL);
+    bool _ExecuteMirrored(const char* value, UInt32 maxRecordCount, PyObject* pyresult, CFMutableArrayRef result, CDirectoryServiceRecordArena* arenaresult);
+};
@@ -0,0 +1,199 @@
+/**
+ * A class that caches the results of Directory Service queries.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceQueryCache.h"
+
+#pragma mark -----Public API
+
+CDirectoryServiceQueryCache::CDirectoryServiceQueryCache(size_t maxBytes)
+{
+    mTTL = 0;
+    mNegativeTTL = 0;
+    mMaxBytes = maxBytes;
+    mBytes = 0;
+    mHits = 0;
+    mNegativeHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceQueryCache::~CDirectoryServiceQueryCache()
+{
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// SetTTL
+//
+// Set how long results are kept. Setting zero turns the cache off and empties it.
+//
+// @param ttl: the time to live in seconds.
+//
+void CDirectoryServiceQueryCache::SetTTL(CFTimeInterval ttl)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mTTL = ttl;
+    ::pthread_mutex_unlock(&mMutex);
+    if (ttl <= 0)
+        Clear();
+}
+
+// SetNegativeTTL
+//
+// Set how long empty results are kept. Zero means they are kept as long as other results.
+//
+// @param ttl: the time to live in seconds.
+//
+void CDirectoryServiceQueryCache::SetNegativeTTL(CFTimeInterval ttl)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mNegativeTTL = ttl;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// SetMaxBytes
+//
+// Set the byte budget for the cached results, evicting entries if it is now exceeded.
+//
+// @param maxBytes: the byte budget.
+//
+void CDirectoryServiceQueryCache::SetMaxBytes(size_t maxBytes)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mMaxBytes = maxBytes;
+    Trim();
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Find
+//
+// Look up the result of a query.
+//
+// @param key: the key describing the query.
+// @param arena: set to a copy of the cached records if found.
+// @return: true if a result that has not expired was found, false otherwise.
+//
+bool CDirectoryServiceQueryCache::Find(const std::string& key, CDirectoryServiceRecordArena& arena)
+{
+    bool result = false;
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator found = mEntries.find(key);
+    if ((found != mEntries.end()) && ((*found).second.mExpires <= ::CFAbsoluteTimeGetCurrent()))
+    {
+        Remove(found);
+        found = mEntries.end();
+    }
+    if (found != mEntries.end())
+    {
+        Entry& entry = (*found).second;
+        mUsedOrder.splice(mUsedOrder.begin(), mUsedOrder, entry.mUsed);
+        arena = entry.mArena;
+        if (arena.GetRecordCount() == 0)
+            mNegativeHits++;
+        else
+            mHits++;
+        result = true;
+    }
+    else
+        mMisses++;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// Insert
+//
+// Add the result of a query, replacing any previous result for it. Results larger than the whole
+// byte budget are not kept.
+//
+// @param key: the key describing the query.
+// @param arena: the records the query returned.
+//
+void CDirectoryServiceQueryCache::Insert(const std::string& key, const CDirectoryServiceRecordArena& arena)
+{
+    size_t bytes = arena.GetByteSize() + key.size();
+
+    ::pthread_mutex_lock(&mMutex);
+    TEntryMap::iterator found = mEntries.find(key);
+    if (found != mEntries.end())
+        Remove(found);
+
+    if ((mTTL > 0) && (bytes <= mMaxBytes))
+    {
+        CFTimeInterval ttl = ((arena.GetRecordCount() == 0) && (mNegativeTTL > 0)) ? mNegativeTTL : mTTL;
+        Entry& entry = mEntries[key];
+        entry.mArena = arena;
+        entry.mExpires = ::CFAbsoluteTimeGetCurrent() + ttl;
+        entry.mBytes = bytes;
+        entry.mUsed = mUsedOrder.insert(mUsedOrder.begin(), key);
+        mBytes += bytes;
+        Trim();
+    }
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Clear
+//
+// Remove all cached results.
+//
+void CDirectoryServiceQueryCache::Clear()
+{
+    ::pthread_mutex_lock(&mMutex);
+    mEntries.clear();
+    mUsedOrder.clear();
+    mBytes = 0;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// GetStatistics
+//
+// Add the cache's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceQueryCache::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["query_cache_hits"] = mHits;
+    stats["query_cache_negative_hits"] = mNegativeHits;
+    stats["query_cache_misses"] = mMisses;
+    stats["query_cache_evictions"] = mEvictions;
+    stats["query_cache_entries"] = mEntries.size();
+    stats["query_cache_bytes"] = mBytes;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+// Remove an entry. Called with the lock held.
+void CDirectoryServiceQueryCache::Remove(TEntryMap::iterator entry)
+{
+    mBytes -= (*entry).second.mBytes;
+    mUsedOrder.erase((*entry).second.mUsed);
+    mEntries.erase(entry);
+}
+
+// Evict the least recently used entries until the cache is within its byte budget. Called with the lock held.
+void CDirectoryServiceQueryCache::Trim()
+{
+    while((mBytes > mMaxBytes) && !mUsedOrder.empty())
+    {
+        Remove(mEntries.find(mUsedOrder.back()));
+        mEvictions++;
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * A class that caches the results of Directory Service queries.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceRecordOutput.h"
+#include "CDirectoryServiceStatistics.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <list>
+#include <map>
+#include <pthread.h>
+#include <string>
+
+// Query results are kept as record arenas, so a hit can be turned into either CoreFoundation or
+// Python objects and no Python objects are shared between callers. Each entry expires after a time
+// to live, with a separate one for empty results, and the least recently used entries are evicted
+// to keep the total size of the arenas within a byte budget. The cache is off while the time to live
+// is zero.
+class CDirectoryServiceQueryCache
+{
+public:
+    CDirectoryServiceQueryCache(size_t maxBytes=8 * 1024 * 1024);
+    ~CDirectoryServiceQueryCache();
+
+    bool IsEnabled() const
+    {
+        return mTTL > 0;
+    }
+
+    void SetTTL(CFTimeInterval ttl);
+    void SetNegativeTTL(CFTimeInterval ttl);
+    void SetMaxBytes(size_t maxBytes);
+
+    bool Find(const std::string& key, CDirectoryServiceRecordArena& arena);
+    void Insert(const std::string& key, const CDirectoryServiceRecordArena& arena);
+    void Clear();
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    typedef std::list<std::string> TKeyList;
+    struct Entry
+    {
+        CDirectoryServiceRecordArena    mArena;
+        CFAbsoluteTime                  mExpires;
+        size_t                          mBytes;
+        TKeyList::iterator              mUsed;      // position in mUsedOrder
+    };
+    typedef std::map<std::string, Entry> TEntryMap;
+
+    CFTimeInterval      mTTL;
+    CFTimeInterval      mNegativeTTL;
+    size_t              mMaxBytes;
+    size_t              mBytes;
+    TEntryMap           mEntries;
+    TKeyList            mUsedOrder;     // most recently used first
+    pthread_mutex_t     mMutex;
+
+    UInt64              mHits;
+    UInt64              mNegativeHits;
+    UInt64              mMisses;
+    UInt64              mEvictions;
+
+    void Remove(TEntryMap::iterator entry);
+    void Trim();
+
+    // Not copyable as entries refer into the use order
+    CDirectoryServiceQueryCache(const CDirectoryServiceQueryCache& copy);
+    CDirectoryServiceQueryCache& operator=(const CDirectoryServiceQueryCache& copy);
+};
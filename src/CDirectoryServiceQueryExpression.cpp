@@ -0,0 +1,524 @@
+/**
+ * A class that builds, parses and generates Directory Service compound
+ * query expressions.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceQueryExpression.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+// Compare two strings of the same length, ignoring ASCII case if asked.
+static bool EqualChars(const char* str1, const char* str2, size_t len, bool casei)
+{
+    if (!casei)
+        return ::memcmp(str1, str2, len) == 0;
+    for(size_t i = 0; i < len; i++)
+    {
+        if (::tolower((unsigned char)str1[i]) != ::tolower((unsigned char)str2[i]))
+            return false;
+    }
+    return true;
+}
+
+// Order two strings as strcmp does, ignoring ASCII case if asked.
+static int CompareChars(const char* str1, size_t len1, const char* str2, size_t len2, bool casei)
+{
+    for(size_t i = 0; (i < len1) && (i < len2); i++)
+    {
+        int c1 = casei ? ::tolower((unsigned char)str1[i]) : (unsigned char)str1[i];
+        int c2 = casei ? ::tolower((unsigned char)str2[i]) : (unsigned char)str2[i];
+        if (c1 != c2)
+            return c1 - c2;
+    }
+    return (len1 < len2) ? -1 : ((len1 > len2) ? 1 : 0);
+}
+
+#pragma mark -----Public API
+
+CDirectoryServiceQueryExpression::CDirectoryServiceQueryExpression(const char* attr, const char* value, int matchType) :
+    mAttribute(attr), mValue(value)
+{
+    mOperator = eMatch;
+    mMatchType = matchType;
+}
+
+CDirectoryServiceQueryExpression::CDirectoryServiceQueryExpression(EOperator op)
+{
+    mOperator = op;
+    mMatchType = 0;
+}
+
+CDirectoryServiceQueryExpression::~CDirectoryServiceQueryExpression()
+{
+    for(TExpressionList::iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+        delete *iter;
+    mSubexpressions.clear();
+}
+
+// AddSubexpression
+//
+// Add an operand to a boolean operator, which takes ownership of it.
+//
+// @param sub: the operand to add.
+//
+void CDirectoryServiceQueryExpression::AddSubexpression(CDirectoryServiceQueryExpression* sub)
+{
+    mSubexpressions.push_back(sub);
+}
+
+// Generate
+//
+// Generate the compound query string that Directory Services expects. An AND or OR with a single
+// operand generates just that operand.
+//
+// @return: the query string.
+//
+std::string CDirectoryServiceQueryExpression::Generate() const
+{
+    std::string result;
+    Generate(result);
+    return result;
+}
+
+// GenerateCanonical
+//
+// Generate a query string equivalent to the one from Generate, with AND/OR operands flattened,
+// de-duplicated and sorted, and double negations removed.
+//
+// @return: the canonical query string.
+//
+std::string CDirectoryServiceQueryExpression::GenerateCanonical() const
+{
+    const CDirectoryServiceQueryExpression* expr = Unwrap();
+    std::string result;
+    switch(expr->mOperator)
+    {
+    case eMatch:
+        expr->GenerateMatch(result);
+        break;
+    case eNot:
+        if (expr->mSubexpressions.empty())
+            result = "(!)";
+        else
+        {
+            const CDirectoryServiceQueryExpression* sub = expr->mSubexpressions[0]->Unwrap();
+            if ((sub->mOperator == eNot) && !sub->mSubexpressions.empty())
+                result = sub->mSubexpressions[0]->GenerateCanonical();
+            else
+                result = "(!" + sub->GenerateCanonical() + ")";
+        }
+        break;
+    case eAnd:
+    case eOr:
+        {
+            std::vector<std::string> operands;
+            for(TExpressionList::const_iterator iter = expr->mSubexpressions.begin(); iter != expr->mSubexpressions.end(); iter++)
+                (*iter)->CollectCanonical(expr->mOperator, operands);
+            std::sort(operands.begin(), operands.end());
+            operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+
+            if (operands.size() == 1)
+                result = operands[0];
+            else if (operands.size() > 1)
+            {
+                result = (expr->mOperator == eAnd) ? "(&" : "(|";
+                for(std::vector<std::string>::const_iterator iter = operands.begin(); iter != operands.end(); iter++)
+                    result += *iter;
+                result += ")";
+            }
+        }
+        break;
+    }
+    return result;
+}
+
+// Matches
+//
+// Evaluate the expression against a record.
+//
+// @param arena: the arena holding the record.
+// @param index: the index of the record in the arena.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @return: true if the record matches, false otherwise.
+//
+bool CDirectoryServiceQueryExpression::Matches(const CDirectoryServiceRecordArena& arena, size_t index, bool casei) const
+{
+    switch(mOperator)
+    {
+    case eMatch:
+        {
+            const CDirectoryServiceRecordArena::Record& record = arena.GetRecord(index);
+            if ((mAttribute == kDSNAttrRecordName) && MatchesValue(arena.GetString(record.mName), record.mName.mLength, casei))
+                return true;
+            for(size_t i = 0; i < record.mAttributeCount; i++)
+            {
+                const CDirectoryServiceRecordArena::Attribute& attribute = arena.GetAttribute(record, i);
+                if ((attribute.mName.mLength != mAttribute.length()) || (::memcmp(arena.GetString(attribute.mName), mAttribute.c_str(), mAttribute.length()) != 0))
+                    continue;
+                for(size_t j = 0; j < attribute.mValueCount; j++)
+                {
+                    const CDirectoryServiceRecordArena::Value& value = arena.GetValue(attribute, j);
+                    if (MatchesValue(arena.GetString(value), value.mLength, casei))
+                        return true;
+                }
+            }
+        }
+        return false;
+    case eNot:
+        return !mSubexpressions.empty() && !mSubexpressions[0]->Matches(arena, index, casei);
+    case eAnd:
+        for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+        {
+            if (!(*iter)->Matches(arena, index, casei))
+                return false;
+        }
+        return true;
+    case eOr:
+        for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+        {
+            if ((*iter)->Matches(arena, index, casei))
+                return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+// GetAttributes
+//
+// Get the attributes the expression tests.
+//
+// @param attributes: set to add the attributes to.
+//
+void CDirectoryServiceQueryExpression::GetAttributes(std::set<std::string>& attributes) const
+{
+    if (mOperator == eMatch)
+        attributes.insert(mAttribute);
+    for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+        (*iter)->GetAttributes(attributes);
+}
+
+// IsASCII
+//
+// Check whether every value the expression matches against is ASCII, so that case-insensitive
+// evaluation gives the same result as the directory.
+//
+// @return: true if all values are ASCII, false otherwise.
+//
+bool CDirectoryServiceQueryExpression::IsASCII() const
+{
+    for(std::string::const_iterator iter = mValue.begin(); iter != mValue.end(); iter++)
+    {
+        if ((unsigned char)*iter >= 0x80)
+            return false;
+    }
+    for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+    {
+        if (!(*iter)->IsASCII())
+            return false;
+    }
+    return true;
+}
+
+// HasOrdering
+//
+// Check whether the expression contains a less than or greater than match, which evaluation
+// compares as strings where the directory may compare numerically.
+//
+// @return: true if there is an ordering match, false otherwise.
+//
+bool CDirectoryServiceQueryExpression::HasOrdering() const
+{
+    if ((mOperator == eMatch) && ((mMatchType == eDSLessThan) || (mMatchType == eDSGreaterThan)))
+        return true;
+    for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+    {
+        if ((*iter)->HasOrdering())
+            return true;
+    }
+    return false;
+}
+
+// Parse
+//
+// Parse a compound query string of the form produced by Generate.
+//
+// @param compound: the query string.
+// @return: the expression, which the caller owns, or NULL if the string is not understood.
+//
+CDirectoryServiceQueryExpression* CDirectoryServiceQueryExpression::Parse(const char* compound)
+{
+    const char* p = compound;
+    CDirectoryServiceQueryExpression* result = ParseExpression(p);
+    if ((result != NULL) && (*p != 0))
+    {
+        delete result;
+        result = NULL;
+    }
+    return result;
+}
+
+// Canonicalize
+//
+// Get the canonical form of a compound query string.
+//
+// @param compound: the query string.
+// @return: the canonical query string, or the original one if it is not understood.
+//
+std::string CDirectoryServiceQueryExpression::Canonicalize(const char* compound)
+{
+    CDirectoryServiceQueryExpression* expr = Parse(compound);
+    if (expr == NULL)
+        return compound;
+
+    std::string result = expr->GenerateCanonical();
+    delete expr;
+    return result;
+}
+
+#pragma mark -----Private API
+
+void CDirectoryServiceQueryExpression::Generate(std::string& result) const
+{
+    switch(mOperator)
+    {
+    case eMatch:
+        GenerateMatch(result);
+        break;
+    case eNot:
+        result += "(!";
+        if (!mSubexpressions.empty())
+            mSubexpressions[0]->Generate(result);
+        result += ")";
+        break;
+    case eAnd:
+    case eOr:
+        if (mSubexpressions.size() > 1)
+            result += (mOperator == eAnd) ? "(&" : "(|";
+        for(TExpressionList::const_iterator iter = mSubexpressions.begin(); iter != mSubexpressions.end(); iter++)
+            (*iter)->Generate(result);
+        if (mSubexpressions.size() > 1)
+            result += ")";
+        break;
+    }
+}
+
+// Unknown match types are treated as contains, as pysrc/dsquery.py does.
+void CDirectoryServiceQueryExpression::GenerateMatch(std::string& result) const
+{
+    result += "(";
+    result += mAttribute;
+    switch(mMatchType)
+    {
+    case eDSExact:
+        result += "=";
+        result += mValue;
+        break;
+    case eDSStartsWith:
+        result += "=";
+        result += mValue;
+        result += "*";
+        break;
+    case eDSEndsWith:
+        result += "=*";
+        result += mValue;
+        break;
+    case eDSLessThan:
+        result += "<";
+        result += mValue;
+        break;
+    case eDSGreaterThan:
+        result += ">";
+        result += mValue;
+        break;
+    default:
+        result += "=*";
+        result += mValue;
+        result += "*";
+        break;
+    }
+    result += ")";
+}
+
+// Add the canonical strings of the operands of an AND or OR, taking the operands of nested
+// expressions using the same operator as operands of the outer one.
+void CDirectoryServiceQueryExpression::CollectCanonical(EOperator op, std::vector<std::string>& operands) const
+{
+    const CDirectoryServiceQueryExpression* expr = Unwrap();
+    if (expr->mOperator == op)
+    {
+        for(TExpressionList::const_iterator iter = expr->mSubexpressions.begin(); iter != expr->mSubexpressions.end(); iter++)
+            (*iter)->CollectCanonical(op, operands);
+    }
+    else
+    {
+        std::string operand = expr->GenerateCanonical();
+        if (!operand.empty())
+            operands.push_back(operand);
+    }
+}
+
+// Skip over AND and OR expressions with a single operand, which mean the same as the operand.
+const CDirectoryServiceQueryExpression* CDirectoryServiceQueryExpression::Unwrap() const
+{
+    const CDirectoryServiceQueryExpression* result = this;
+    while(((result->mOperator == eAnd) || (result->mOperator == eOr)) && (result->mSubexpressions.size() == 1))
+        result = result->mSubexpressions[0];
+    return result;
+}
+
+// Test one value of the attribute of a match. Unknown match types are treated as contains.
+bool CDirectoryServiceQueryExpression::MatchesValue(const char* data, size_t len, bool casei) const
+{
+    const char* value = mValue.c_str();
+    size_t valueLen = mValue.length();
+    switch(mMatchType)
+    {
+    case eDSExact:
+        return (len == valueLen) && EqualChars(data, value, len, casei);
+    case eDSStartsWith:
+        return (len >= valueLen) && EqualChars(data, value, valueLen, casei);
+    case eDSEndsWith:
+        return (len >= valueLen) && EqualChars(data + len - valueLen, value, valueLen, casei);
+    case eDSLessThan:
+        return CompareChars(data, len, value, valueLen, casei) < 0;
+    case eDSGreaterThan:
+        return CompareChars(data, len, value, valueLen, casei) > 0;
+    default:
+        for(size_t i = 0; i + valueLen <= len; i++)
+        {
+            if (EqualChars(data + i, value, valueLen, casei))
+                return true;
+        }
+        return false;
+    }
+}
+
+// Parse a parenthesized expression, leaving p after its closing parenthesis.
+CDirectoryServiceQueryExpression* CDirectoryServiceQueryExpression::ParseExpression(const char*& p)
+{
+    if (*p != '(')
+        return NULL;
+    p++;
+
+    CDirectoryServiceQueryExpression* result = NULL;
+    switch(*p)
+    {
+    case '&':
+    case '|':
+        result = new CDirectoryServiceQueryExpression((*p == '&') ? eAnd : eOr);
+        p++;
+        while(*p == '(')
+        {
+            CDirectoryServiceQueryExpression* sub = ParseExpression(p);
+            if (sub == NULL)
+            {
+                delete result;
+                return NULL;
+            }
+            result->AddSubexpression(sub);
+        }
+        if (result->mSubexpressions.empty())
+        {
+            delete result;
+            return NULL;
+        }
+        break;
+    case '!':
+        {
+            p++;
+            CDirectoryServiceQueryExpression* sub = ParseExpression(p);
+            if (sub == NULL)
+                return NULL;
+            result = new CDirectoryServiceQueryExpression(eNot);
+            result->AddSubexpression(sub);
+        }
+        break;
+    default:
+        return ParseMatch(p);
+    }
+
+    if (*p != ')')
+    {
+        delete result;
+        return NULL;
+    }
+    p++;
+    return result;
+}
+
+// Parse an attribute/value match after its opening parenthesis, leaving p after its closing one.
+// A value of just "*" is taken as a starts with match on an empty value, which is what dsquery
+// generates to test that an attribute is present.
+CDirectoryServiceQueryExpression* CDirectoryServiceQueryExpression::ParseMatch(const char*& p)
+{
+    const char* attr = p;
+    while((*p != 0) && (::strchr("=<>()", *p) == NULL))
+        p++;
+    if ((p == attr) || (*p == 0) || (*p == '(') || (*p == ')'))
+        return NULL;
+    std::string attribute(attr, p - attr);
+    char op = *p++;
+
+    const char* value = p;
+    while((*p != 0) && (*p != '(') && (*p != ')'))
+        p++;
+    if (*p != ')')
+        return NULL;
+    std::string data(value, p - value);
+    p++;
+
+    int matchType = eDSExact;
+    if (op == '<')
+        matchType = eDSLessThan;
+    else if (op == '>')
+        matchType = eDSGreaterThan;
+    else if (data == "*")
+    {
+        matchType = eDSStartsWith;
+        data.clear();
+    }
+    else
+    {
+        bool leading = !data.empty() && (data[0] == '*');
+        bool trailing = (data.size() > 1) && (data[data.size() - 1] == '*');
+        if (leading && trailing)
+        {
+            matchType = eDSContains;
+            data = data.substr(1, data.size() - 2);
+        }
+        else if (leading)
+        {
+            matchType = eDSEndsWith;
+            data = data.substr(1);
+        }
+        else if (trailing)
+        {
+            matchType = eDSStartsWith;
+            data = data.substr(0, data.size() - 1);
+        }
+    }
+
+    // Substring matches with more than one wildcard cannot be represented, and '=' after '<' or
+    // '>' would be an ordering match that dsquery never generates
+    if ((data.find('*') != std::string::npos) || ((op != '=') && !data.empty() && (data[0] == '=')))
+        return NULL;
+
+    return new CDirectoryServiceQueryExpression(attribute.c_str(), data.c_str(), matchType);
+}
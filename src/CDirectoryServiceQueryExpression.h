@@ -0,0 +1,115 @@
+/**
+ * A class that builds, parses and generates Directory Service compound
+ * query expressions.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceRecordOutput.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+// A node of a compound query: either a single attribute/value match, or a boolean operator over
+// sub-expressions (exactly one for NOT). Generate produces the same string as pysrc/dsquery.py.
+// GenerateCanonical produces a string that is the same for expressions that differ only in the
+// order or nesting of AND/OR operands, duplicate operands or double negation, so it can be used
+// to key query results.
+//
+// An expression can also be evaluated against a record held in memory. A match is true if any
+// value of the attribute matches, the record name counting as a value of RecordName, and ordering
+// matches compare values as strings. That is not how the directory orders numeric attributes, so
+// evaluation is only exact for expressions without ordering matches. Case-insensitive evaluation
+// only folds ASCII, so it is only exact for expressions whose values are all ASCII.
+class CDirectoryServiceQueryExpression
+{
+public:
+    enum EOperator
+    {
+        eMatch,
+        eAnd,
+        eOr,
+        eNot
+    };
+
+    CDirectoryServiceQueryExpression(const char* attr, const char* value, int matchType);
+    explicit CDirectoryServiceQueryExpression(EOperator op);
+    ~CDirectoryServiceQueryExpression();
+
+    void AddSubexpression(CDirectoryServiceQueryExpression* sub);
+
+    EOperator GetOperator() const
+    {
+        return mOperator;
+    }
+    const std::string& GetAttribute() const
+    {
+        return mAttribute;
+    }
+    const std::string& GetValue() const
+    {
+        return mValue;
+    }
+    int GetMatchType() const
+    {
+        return mMatchType;
+    }
+    size_t GetCount() const
+    {
+        return mSubexpressions.size();
+    }
+    const CDirectoryServiceQueryExpression& GetSubexpression(size_t index) const
+    {
+        return *mSubexpressions[index];
+    }
+
+    std::string Generate() const;
+    std::string GenerateCanonical() const;
+
+    bool Matches(const CDirectoryServiceRecordArena& arena, size_t index, bool casei) const;
+    void GetAttributes(std::set<std::string>& attributes) const;
+    bool IsASCII() const;
+    bool HasOrdering() const;
+
+    static CDirectoryServiceQueryExpression* Parse(const char* compound);
+    static std::string Canonicalize(const char* compound);
+
+private:
+    typedef std::vector<CDirectoryServiceQueryExpression*> TExpressionList;
+
+    EOperator           mOperator;
+    std::string         mAttribute;
+    std::string         mValue;
+    int                 mMatchType;
+    TExpressionList     mSubexpressions;
+
+    void Generate(std::string& result) const;
+    void GenerateMatch(std::string& result) const;
+    void CollectCanonical(EOperator op, std::vector<std::string>& operands) const;
+    const CDirectoryServiceQueryExpression* Unwrap() const;
+    bool MatchesValue(const char* data, size_t len, bool casei) const;
+
+    static CDirectoryServiceQueryExpression* ParseExpression(const char*& p);
+    static CDirectoryServiceQueryExpression* ParseMatch(const char*& p);
+
+    // Not copyable as the expression owns its sub-expressions
+    CDirectoryServiceQueryExpression(const CDirectoryServiceQueryExpression& copy);
+    CDirectoryServiceQueryExpression& operator=(const CDirectoryServiceQueryExpression& copy);
+};
@@ -0,0 +1,186 @@
+/**
+ * A template that decodes the records and attributes returned in a
+ * Directory Service data buffer into a choice of output formats.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceAttributeSchema.h"
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServiceRecordOutput.h"
+
+#include "base64.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <DirectoryService/DirectoryService.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Walks the records, attributes and values in a data buffer, handing each one to an output
+// policy (see CDirectoryServiceRecordOutput.h). The policy is a template parameter so each
+// output format gets its own decode loop with the policy calls inlined.
+template <class TOutput> class CDirectoryServiceRecordDecoder
+{
+public:
+    CDirectoryServiceRecordDecoder(tDirReference dir, tDirNodeReference node, tDataBufferPtr data, const CDirectoryServiceAttributeSchema& schema, TOutput& output) :
+        mDir(dir), mNode(node), mData(data), mSchema(schema), mOutput(output)
+    {
+    }
+
+    // DecodeRecords
+    //
+    // Decode the records returned in the data buffer by a record list or search call.
+    //
+    // @param recCount: the number of records to decode.
+    // @param firstRecord: the index in the data buffer of the first record to decode, counting from one.
+    // @throw: yes
+    //
+    void DecodeRecords(UInt32 recCount, UInt32 firstRecord=1)
+    {
+        tAttributeListRef attrListRef = 0L;
+        tRecordEntry* pRecEntry = NULL;
+
+        try
+        {
+            for(UInt32 i = firstRecord; i < firstRecord + recCount; i++)
+            {
+                // Get the record entry
+                ThrowIfDSErr(::dsGetRecordEntry(mNode, mData, i, &attrListRef, &pRecEntry));
+
+                // Get the entry's name
+                char* temp = NULL;
+                ThrowIfDSErr(::dsGetRecordNameFromEntry(pRecEntry, &temp));
+                try
+                {
+                    mOutput.BeginRecord(temp, ::strlen(temp));
+                }
+                catch(CDirectoryServiceException& dsStatus)
+                {
+                    ::free(temp);
+                    throw;
+                }
+                ::free(temp);
+
+                DecodeAttributes(attrListRef, pRecEntry->fRecordAttributeCount);
+                mOutput.EndRecord();
+
+                // Clean-up
+                ::dsCloseAttributeList(attrListRef);
+                attrListRef = 0L;
+                ::dsDeallocRecordEntry(mDir, pRecEntry);
+                pRecEntry = NULL;
+            }
+        }
+        catch(CDirectoryServiceException& dsStatus)
+        {
+            // Cleanup
+            if (attrListRef != 0L)
+                ::dsCloseAttributeList(attrListRef);
+            if (pRecEntry != NULL)
+                ::dsDeallocRecordEntry(mDir, pRecEntry);
+            throw;
+        }
+    }
+
+    // DecodeAttributes
+    //
+    // Decode the attributes of a single record, or of a node.
+    //
+    // @param attrListRef: the attribute list to decode.
+    // @param attrCount: the number of attributes in the list.
+    // @throw: yes
+    //
+    void DecodeAttributes(tAttributeListRef attrListRef, UInt32 attrCount)
+    {
+        tAttributeValueListRef attributeValueListRef = 0L;
+        tAttributeEntryPtr attributeInfoPtr = NULL;
+        tAttributeValueEntryPtr attributeValue = NULL;
+
+        try
+        {
+            for(UInt32 j = 1; j <= attrCount; j++)
+            {
+                ThrowIfDSErr(::dsGetAttributeEntry(mNode, mData, attrListRef, j, &attributeValueListRef, &attributeInfoPtr));
+
+                if (attributeInfoPtr->fAttributeValueCount > 0)
+                {
+                    // Determine what the attribute is and whether string/base64 encoding is needed
+                    tDataNodePtr signature = &attributeInfoPtr->fAttributeSignature;
+                    size_t signatureLen = ::strnlen(signature->fBufferData, signature->fBufferLength);
+                    const CDirectoryServiceAttributeSchema::Slot* slot = mSchema.Find(signature->fBufferData, signatureLen);
+                    bool base64 = (slot != NULL) && (slot->mKind == CDirectoryServiceAttributeSchema::eDecodeBase64);
+
+                    mOutput.BeginAttribute(signature->fBufferData, signatureLen, attributeInfoPtr->fAttributeValueCount, slot);
+                    for(unsigned long k = 1; k <= attributeInfoPtr->fAttributeValueCount; k++)
+                    {
+                        // Get the attribute value and store in results
+                        ThrowIfDSErr(::dsGetAttributeValue(mNode, mData, k, attributeValueListRef, &attributeValue));
+                        tDataBufferPtr data = &attributeValue->fAttributeValueData;
+                        if (base64)
+                            AddBase64Value(data);
+                        else
+                            mOutput.AddValue(data->fBufferData, ::strnlen(data->fBufferData, data->fBufferLength));
+                        ::dsDeallocAttributeValueEntry(mDir, attributeValue);
+                        attributeValue = NULL;
+                    }
+                    mOutput.EndAttribute();
+                }
+
+                ::dsCloseAttributeValueList(attributeValueListRef);
+                attributeValueListRef = 0L;
+                ::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
+                attributeInfoPtr = NULL;
+            }
+        }
+        catch(CDirectoryServiceException& dsStatus)
+        {
+            // Cleanup
+            if (attributeValue != NULL)
+                ::dsDeallocAttributeValueEntry(mDir, attributeValue);
+            if (attributeValueListRef != 0L)
+                ::dsCloseAttributeValueList(attributeValueListRef);
+            if (attributeInfoPtr != NULL)
+                ::dsDeallocAttributeEntry(mDir, attributeInfoPtr);
+            throw;
+        }
+    }
+
+private:
+    tDirReference                           mDir;
+    tDirNodeReference                       mNode;
+    tDataBufferPtr                          mData;
+    const CDirectoryServiceAttributeSchema& mSchema;
+    TOutput&                                mOutput;
+
+    // Base64 encode all of the value data (not just up to the first NUL) and add it to the output.
+    void AddBase64Value(tDataBufferPtr data)
+    {
+        char* encoded = ::base64_encode((const unsigned char*)data->fBufferData, data->fBufferLength);
+        ThrowIfNULL(encoded);
+        try
+        {
+            mOutput.AddValue(encoded, ::strlen(encoded));
+        }
+        catch(CDirectoryServiceException& dsStatus)
+        {
+            ::free(encoded);
+            throw;
+        }
+        ::free(encoded);
+    }
+};
@@ -0,0 +1,467 @@
+/**
+ * A class that incrementally returns records from a Directory Service
+ * record listing or query.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceRecordIterator.h"
+
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServiceRecordDecoder.h"
+
+#include <stdlib.h>
+
+#pragma mark -----Public API
+
+CDirectoryServiceRecordIterator::CDirectoryServiceRecordIterator(const char* nodename, CDirectoryServiceManager* manager) :
+	CDirectoryService(nodename, manager)
+{
+    mSchema = NULL;
+    mRecNames = NULL;
+    mRecTypes = NULL;
+    mAttrTypes = NULL;
+    mQueryAttr = NULL;
+    mQueryValue = NULL;
+    mMatchType = eDSExact;
+    mContext = NULL;
+    mMaxRecordCount = 0;
+    mRecordCount = 0;
+    mBuffered = 0;
+    mDecoded = 0;
+    mComplete = true;
+}
+
+CDirectoryServiceRecordIterator::~CDirectoryServiceRecordIterator()
+{
+	// Clean-up
+	Close();
+}
+
+// StartListAllRecordsWithAttributes
+//
+// Prepare to list all records of the specified types. No records are fetched until
+// NextRecords is called.
+//
+// @param recordTypes: the record types to list.
+// @param attributes: CFDictionary of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the listing was started, false otherwise.
+//
+bool CDirectoryServiceRecordIterator::StartListAllRecordsWithAttributes(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
+{
+    try
+    {
+        StPythonThreadState threading(using_python);
+
+        _StartListAllRecordsWithAttributes(recordTypes, attributes, maxRecordCount);
+        return true;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+		if (using_python)
+			dserror.SetPythonException();
+        return false;
+    }
+    catch(...)
+    {
+        CDirectoryServiceException dserror;
+		if (using_python)
+	        dserror.SetPythonException();
+        return false;
+    }
+}
+
+// StartQueryRecordsWithAttributes
+//
+// Prepare to query records of the specified types. No records are fetched until NextRecords or
+// NextRecordsAsPython is called, and the directory's continuation data is kept in between, so
+// the query can be read a page at a time.
+//
+// @param attr: the attribute to query.
+// @param value: the value to query.
+// @param matchType: the match type of the query.
+// @param compound: compound query to use instead of attr, value and matchType, or NULL.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to query.
+// @param attributes: CFDictionary of CFString listing the attributes to return for each record.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: true if the query was started, false otherwise.
+//
+bool CDirectoryServiceRecordIterator::StartQueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount, bool using_python)
+{
+    try
+    {
+        StPythonThreadState threading(using_python);
+
+        _StartQueryRecordsWithAttributes(attr, value, matchType, compound, casei, recordTypes, attributes, maxRecordCount);
+        return true;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+		if (using_python)
+			dserror.SetPythonException();
+        return false;
+    }
+    catch(...)
+    {
+        CDirectoryServiceException dserror;
+		if (using_python)
+	        dserror.SetPythonException();
+        return false;
+    }
+}
+
+// NextRecords
+//
+// Fetch and decode the next data buffer of records from the directory.
+//
+// @param using_python: set to true if called as a Python module, false to call directly from C/C++.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record in the next chunk (empty once the listing is complete), or NULL if it fails.
+//
+CFMutableArrayRef CDirectoryServiceRecordIterator::NextRecords(bool using_python)
+{
+    try
+    {
+        StPythonThreadState threading(using_python);
+
+        return _NextRecords();
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+		if (using_python)
+			dserror.SetPythonException();
+        return NULL;
+    }
+    catch(...)
+    {
+        CDirectoryServiceException dserror;
+		if (using_python)
+	        dserror.SetPythonException();
+        return NULL;
+    }
+}
+
+// NextRecordsAsPython
+//
+// Fetch the next records from the directory, decoding them straight into Python objects. Must
+// only be called from Python.
+//
+// @param count: the most records to return, asking the directory for no more than that, or
+//               zero to fetch the next data buffer.
+// @return: PyObject list of [record name, dict of attributes] lists for each record fetched
+//          (empty once the listing is complete), or NULL if it fails.
+//
+PyObject* CDirectoryServiceRecordIterator::NextRecordsAsPython(UInt32 count)
+{
+    PyObject* result = PyList_New(0);
+    try
+    {
+        StPythonThreadState threading;
+
+        _NextRecords(result, count);
+        return result;
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        Py_DECREF(result);
+        dserror.SetPythonException();
+        return NULL;
+    }
+    catch(...)
+    {
+        Py_DECREF(result);
+        CDirectoryServiceException dserror;
+        dserror.SetPythonException();
+        return NULL;
+    }
+}
+
+// Close
+//
+// Stop the listing, releasing any outstanding continuation data and closing the node.
+//
+// @param error: the error the listing failed with, or eDSNoErr.
+//
+void CDirectoryServiceRecordIterator::Close(tDirStatus error)
+{
+    if (mContext != NULL)
+    {
+        ::dsReleaseContinueData(mDir, mContext);
+        mContext = NULL;
+    }
+    if (mRecNames != NULL)
+    {
+        ::dsDataListDeallocate(mDir, mRecNames);
+        free(mRecNames);
+        mRecNames = NULL;
+    }
+    if (mRecTypes != NULL)
+    {
+        ::dsDataListDeallocate(mDir, mRecTypes);
+        free(mRecTypes);
+        mRecTypes = NULL;
+    }
+    if (mAttrTypes != NULL)
+    {
+        ::dsDataListDeallocate(mDir, mAttrTypes);
+        free(mAttrTypes);
+        mAttrTypes = NULL;
+    }
+    if (mQueryAttr != NULL)
+    {
+        ::dsDataNodeDeAllocate(mDir, mQueryAttr);
+        mQueryAttr = NULL;
+    }
+    if (mQueryValue != NULL)
+    {
+        ::dsDataNodeDeAllocate(mDir, mQueryValue);
+        mQueryValue = NULL;
+    }
+    if (mSchema != NULL)
+    {
+        delete mSchema;
+        mSchema = NULL;
+    }
+    RemoveBuffer();
+    CloseNode();
+    DiscardService(error);
+
+    mComplete = true;
+}
+
+#pragma mark -----Private API
+
+// _StartListAllRecordsWithAttributes
+//
+// Open the node and build the data lists used for each subsequent record list call.
+//
+// @param recordTypes: the record types to list.
+// @param attributes: a list of attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @throw: yes
+//
+void CDirectoryServiceRecordIterator::_StartListAllRecordsWithAttributes(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount)
+{
+    // Must have attributes
+    if (::CFDictionaryGetCount(attributes) == 0)
+        ThrowIfDSErr(eDSEmptyAttributeTypeList);
+
+    // Discard any previous listing
+    Close();
+
+    try
+    {
+        // Make sure we have a valid directory service
+        OpenService();
+
+        // Open the node we want to query
+        OpenNode();
+
+        // We need a buffer for what comes next
+        CreateBuffer("list", recordTypes);
+
+        // Build data list of names
+        mRecNames = ::dsDataListAllocate(mDir);
+        ThrowIfNULL(mRecNames);
+        ThrowIfDSErr(::dsBuildListFromStringsAlloc(mDir, mRecNames,  kDSRecordsAll, NULL));
+
+        // Build data list of types
+        mRecTypes = ::dsDataListAllocate(mDir);
+        ThrowIfNULL(mRecTypes);
+        BuildStringDataList(recordTypes, mRecTypes);
+
+        // Build data list of attributes
+        mAttrTypes = ::dsDataListAllocate(mDir);
+        ThrowIfNULL(mAttrTypes);
+        BuildStringDataListFromKeys(attributes, mAttrTypes);
+
+        mSchema = new CDirectoryServiceAttributeSchema(attributes);
+        mMaxRecordCount = maxRecordCount;
+        mRecordCount = 0;
+        mBuffered = 0;
+        mDecoded = 0;
+        mComplete = false;
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        Close(dsStatus.GetDSError());
+        throw;
+    }
+}
+
+// _StartQueryRecordsWithAttributes
+//
+// Open the node and build the data lists and query nodes used for each subsequent query call.
+//
+// @param attr: the attribute to query.
+// @param value: the value to query.
+// @param matchType: the match type of the query.
+// @param compound: compound query to use instead of attr, value and matchType, or NULL.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to query.
+// @param attributes: a list of attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @throw: yes
+//
+void CDirectoryServiceRecordIterator::_StartQueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount)
+{
+    // Must have attributes
+    if (::CFDictionaryGetCount(attributes) == 0)
+        ThrowIfDSErr(eDSEmptyAttributeTypeList);
+
+    // Discard any previous listing
+    Close();
+
+    try
+    {
+        // Make sure we have a valid directory service
+        OpenService();
+
+        // Open the node we want to query
+        OpenNode();
+
+        // We need a buffer for what comes next
+        CreateBuffer("query", recordTypes);
+
+        if (compound == NULL)
+        {
+            // Determine attribute to search
+            mQueryAttr = ::dsDataNodeAllocateString(mDir, attr);
+            ThrowIfNULL(mQueryAttr);
+
+            mQueryValue = ::dsDataNodeAllocateString(mDir, value);
+            ThrowIfNULL(mQueryValue);
+
+            mMatchType = (tDirPatternMatch)(casei ? (matchType | 0x0100) : (matchType & 0xFEFF));
+        }
+        else
+        {
+            mQueryAttr = ::dsDataNodeAllocateString(mDir, kDS1AttrDistinguishedName);
+            ThrowIfNULL(mQueryAttr);
+
+            mQueryValue = ::dsDataNodeAllocateString(mDir, compound);
+            ThrowIfNULL(mQueryValue);
+
+            mMatchType = casei ? eDSiCompoundExpression : eDSCompoundExpression;
+        }
+
+        // Build data list of types
+        mRecTypes = ::dsDataListAllocate(mDir);
+        ThrowIfNULL(mRecTypes);
+        BuildStringDataList(recordTypes, mRecTypes);
+
+        // Build data list of attributes
+        mAttrTypes = ::dsDataListAllocate(mDir);
+        ThrowIfNULL(mAttrTypes);
+        BuildStringDataListFromKeys(attributes, mAttrTypes);
+
+        mSchema = new CDirectoryServiceAttributeSchema(attributes);
+        mMaxRecordCount = maxRecordCount;
+        mRecordCount = 0;
+        mBuffered = 0;
+        mDecoded = 0;
+        mComplete = false;
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        Close(dsStatus.GetDSError());
+        throw;
+    }
+}
+
+// _NextRecords
+//
+// Fetch and decode the next records from the directory. Empty buffers returned part way through
+// the listing are skipped. The directory may return more records than asked for, so records past
+// the page are kept in the data buffer for the next call and records past the limit are dropped.
+//
+// @param pyresult: Python list to add records to directly, or NULL to return CoreFoundation objects.
+// @param count: the number of records to fetch, or zero to fetch the next data buffer.
+// @return: CFMutableArrayRef composed of CFMutableArrayRef with a CFStringRef/CFMutableDictionaryRef tuple for
+//          each record fetched (empty once the listing is complete), or NULL if pyresult is used.
+// @throw: yes
+//
+CFMutableArrayRef CDirectoryServiceRecordIterator::_NextRecords(PyObject* pyresult, UInt32 count)
+{
+    CFMutableArrayRef result = NULL;
+    if (pyresult == NULL)
+        result = ::CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+
+    try
+    {
+        UInt32 startCount = mRecordCount;
+        while(!mComplete && ((count == 0) ? (mRecordCount == startCount) : (mRecordCount - startCount < count)))
+        {
+            // The most records this call may still return, zero for no limit
+            UInt32 wanted = (mMaxRecordCount != 0) ? mMaxRecordCount - mRecordCount : 0;
+            if ((count != 0) && ((wanted == 0) || (count - (mRecordCount - startCount) < wanted)))
+                wanted = count - (mRecordCount - startCount);
+
+            // Get the next set of records once the previous ones have all been returned
+            if (mDecoded == mBuffered)
+            {
+                UInt32 recCount = wanted;
+                tDirStatus err;
+                do
+                {
+                    if (mQueryAttr != NULL)
+                        err = ::dsDoAttributeValueSearchWithData(mNode, mData, mRecTypes, mQueryAttr, mMatchType, mQueryValue, mAttrTypes, false, &recCount, &mContext);
+                    else
+                        err = ::dsGetRecordList(mNode, mData, mRecNames, eDSExact, mRecTypes, mAttrTypes, false, &recCount, &mContext);
+                    if (err == eDSBufferTooSmall)
+                        ReallocBuffer();
+                } while(err == eDSBufferTooSmall);
+                ThrowIfDSErr(err);
+                mBuffered = recCount;
+                mDecoded = 0;
+            }
+
+            // Never decode past the page or the limit, whatever the directory sent back
+            UInt32 decodeCount = mBuffered - mDecoded;
+            if ((wanted != 0) && (decodeCount > wanted))
+                decodeCount = wanted;
+            if (pyresult != NULL)
+            {
+                StPythonGILState gil;
+                CDirectoryServicePyOutput output(pyresult);
+                CDirectoryServiceRecordDecoder<CDirectoryServicePyOutput>(mDir, mNode, mData, *mSchema, output).DecodeRecords(decodeCount, mDecoded + 1);
+            }
+            else
+            {
+                CDirectoryServiceCFOutput output(result);
+                CDirectoryServiceRecordDecoder<CDirectoryServiceCFOutput>(mDir, mNode, mData, *mSchema, output).DecodeRecords(decodeCount, mDecoded + 1);
+            }
+            mDecoded += decodeCount;
+            mRecordCount += decodeCount;
+
+            // Done once all data has been obtained and returned or the limit has been reached
+            if (((mContext == NULL) && (mDecoded == mBuffered)) || ((mMaxRecordCount != 0) && (mRecordCount >= mMaxRecordCount)))
+                Close();
+        }
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        Close(dsStatus.GetDSError());
+        if (result != NULL)
+            ::CFRelease(result);
+        throw;
+    }
+
+    return result;
+}
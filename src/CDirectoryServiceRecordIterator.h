@@ -0,0 +1,61 @@
+/**
+ * A class that incrementally returns records from a Directory Service
+ * record listing or query.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryService.h"
+
+class CDirectoryServiceAttributeSchema;
+
+class CDirectoryServiceRecordIterator : public CDirectoryService
+{
+public:
+    CDirectoryServiceRecordIterator(const char* nodename, CDirectoryServiceManager* manager=NULL);
+    virtual ~CDirectoryServiceRecordIterator();
+
+    bool StartListAllRecordsWithAttributes(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool using_python=true);
+    bool StartQueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount=0, bool using_python=true);
+    CFMutableArrayRef NextRecords(bool using_python=true);
+    PyObject* NextRecordsAsPython(UInt32 count=0);
+    void Close(tDirStatus error=eDSNoErr);
+
+    bool IsComplete() const
+    {
+        return mComplete;
+    }
+
+protected:
+    CDirectoryServiceAttributeSchema* mSchema;
+    tDataListPtr                      mRecNames;
+    tDataListPtr                      mRecTypes;
+    tDataListPtr                      mAttrTypes;
+    tDataNodePtr                      mQueryAttr;           // set for a query, NULL for a listing
+    tDataNodePtr                      mQueryValue;
+    tDirPatternMatch                  mMatchType;
+    tContextData                      mContext;
+    UInt32                            mMaxRecordCount;
+    UInt32                            mRecordCount;
+    UInt32                            mBuffered;            // records in the data buffer from the last call
+    UInt32                            mDecoded;             // of those, the ones already returned
+    bool                              mComplete;
+
+    void _StartListAllRecordsWithAttributes(CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount);
+    void _StartQueryRecordsWithAttributes(const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef recordTypes, CFDictionaryRef attributes, UInt32 maxRecordCount);
+    CFMutableArrayRef _NextRecords(PyObject* pyresult=NULL, UInt32 count=0);
+};
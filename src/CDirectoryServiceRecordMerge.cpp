@@ -0,0 +1,137 @@
+/**
+ * A class that merges records decoded from several Directory Service calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceRecordMerge.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <string.h>
+
+// Orders record indexes of one arena by record name.
+class CRecordNameLess
+{
+public:
+    CRecordNameLess(const CDirectoryServiceRecordArena& arena) :
+        mArena(arena)
+    {
+    }
+
+    bool operator()(size_t x, size_t y) const
+    {
+        return ::strcmp(mArena.GetString(mArena.GetRecord(x).mName), mArena.GetString(mArena.GetRecord(y).mName)) < 0;
+    }
+
+private:
+    const CDirectoryServiceRecordArena& mArena;
+};
+
+#pragma mark -----Public API
+
+CDirectoryServiceRecordMerge::CDirectoryServiceRecordMerge(bool dedupe)
+{
+    mDedupe = dedupe;
+}
+
+// Add
+//
+// Add the next arena to merge. The arena must outlive the merge.
+//
+// @param arena: the arena to add.
+//
+void CDirectoryServiceRecordMerge::Add(const CDirectoryServiceRecordArena& arena)
+{
+    mArenas.push_back(&arena);
+}
+
+// Merge
+//
+// Work out the merged order of the records in all arenas.
+//
+// @param entries: set to the arena and record index of each record in merged order.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+//
+void CDirectoryServiceRecordMerge::Merge(TEntryList& entries, size_t maxRecordCount) const
+{
+    entries.clear();
+
+    // Order each arena by name first
+    std::vector< std::vector<size_t> > orders(mArenas.size());
+    std::vector<size_t> heads(mArenas.size(), 0);
+    for(size_t i = 0; i < mArenas.size(); i++)
+    {
+        orders[i].resize(mArenas[i]->GetRecordCount());
+        for(size_t j = 0; j < orders[i].size(); j++)
+            orders[i][j] = j;
+        std::stable_sort(orders[i].begin(), orders[i].end(), CRecordNameLess(*mArenas[i]));
+    }
+
+    // There are only ever a handful of arenas, so a linear scan for the smallest head will do
+    std::set<std::string> seen;
+    while((maxRecordCount == 0) || (entries.size() < maxRecordCount))
+    {
+        size_t best = mArenas.size();
+        const char* bestName = NULL;
+        for(size_t i = 0; i < mArenas.size(); i++)
+        {
+            if (heads[i] >= orders[i].size())
+                continue;
+            const char* name = GetRecordName(*mArenas[i], orders[i][heads[i]]);
+            if ((bestName == NULL) || (::strcmp(name, bestName) < 0))
+            {
+                best = i;
+                bestName = name;
+            }
+        }
+        if (best == mArenas.size())
+            break;
+
+        Entry entry;
+        entry.mArena = best;
+        entry.mRecord = orders[best][heads[best]++];
+        if (mDedupe)
+        {
+            const char* uid = GetGeneratedUID(*mArenas[best], entry.mRecord);
+            if ((uid != NULL) && !seen.insert(uid).second)
+                continue;
+        }
+        entries.push_back(entry);
+    }
+}
+
+#pragma mark -----Private API
+
+const char* CDirectoryServiceRecordMerge::GetRecordName(const CDirectoryServiceRecordArena& arena, size_t index)
+{
+    return arena.GetString(arena.GetRecord(index).mName);
+}
+
+// Return the first GeneratedUID value of a record, or NULL if it has none.
+const char* CDirectoryServiceRecordMerge::GetGeneratedUID(const CDirectoryServiceRecordArena& arena, size_t index)
+{
+    const CDirectoryServiceRecordArena::Record& record = arena.GetRecord(index);
+    for(size_t i = 0; i < record.mAttributeCount; i++)
+    {
+        const CDirectoryServiceRecordArena::Attribute& attribute = arena.GetAttribute(record, i);
+        if ((attribute.mValueCount > 0) && (::strcmp(arena.GetString(attribute.mName), kDS1AttrGeneratedUID) == 0))
+            return arena.GetString(arena.GetValue(attribute, 0));
+    }
+    return NULL;
+}
@@ -0,0 +1,56 @@
+/**
+ * A class that merges records decoded from several Directory Service calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceRecordOutput.h"
+
+#include <vector>
+
+// Merges the records held by several arenas into one stable order. Each arena is ordered by
+// record name and the arenas are then merged by name, ties keeping the order the arenas were
+// added in and then the order within each arena. Records can also be de-duplicated by
+// GeneratedUID, in which case the first record in the merged order wins. Records without a
+// GeneratedUID are never dropped.
+class CDirectoryServiceRecordMerge
+{
+public:
+    struct Entry
+    {
+        size_t  mArena;
+        size_t  mRecord;
+    };
+    typedef std::vector<Entry> TEntryList;
+
+    CDirectoryServiceRecordMerge(bool dedupe);
+
+    void Add(const CDirectoryServiceRecordArena& arena);
+    void Merge(TEntryList& entries, size_t maxRecordCount=0) const;
+
+    const CDirectoryServiceRecordArena& GetArena(size_t index) const
+    {
+        return *mArenas[index];
+    }
+
+private:
+    bool                                                mDedupe;
+    std::vector<const CDirectoryServiceRecordArena*>    mArenas;
+
+    static const char* GetRecordName(const CDirectoryServiceRecordArena& arena, size_t index);
+    static const char* GetGeneratedUID(const CDirectoryServiceRecordArena& arena, size_t index);
+};
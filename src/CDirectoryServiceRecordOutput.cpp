@@ -0,0 +1,386 @@
+/**
+ * Output policies used by CDirectoryServiceRecordDecoder to build the
+ * results of Directory Service record and attribute calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceRecordOutput.h"
+
+#include "CDirectoryServiceException.h"
+
+#pragma mark -----CDirectoryServiceCFOutput
+
+CDirectoryServiceCFOutput::CDirectoryServiceCFOutput(CFMutableArrayRef records)
+{
+    mRecords = records;
+    mRecord = NULL;
+    mRecordName = NULL;
+    mAttributeName = NULL;
+    mValues = NULL;
+    mValue = NULL;
+}
+
+CDirectoryServiceCFOutput::CDirectoryServiceCFOutput(CFMutableDictionaryRef attributes)
+{
+    // Attributes go straight into the caller's dictionary
+    mRecords = NULL;
+    mRecord = attributes;
+    ::CFRetain(mRecord);
+    mRecordName = NULL;
+    mAttributeName = NULL;
+    mValues = NULL;
+    mValue = NULL;
+}
+
+CDirectoryServiceCFOutput::~CDirectoryServiceCFOutput()
+{
+    if (mValue != NULL)
+        ::CFRelease(mValue);
+    if (mValues != NULL)
+        ::CFRelease(mValues);
+    if (mAttributeName != NULL)
+        ::CFRelease(mAttributeName);
+    if (mRecordName != NULL)
+        ::CFRelease(mRecordName);
+    if (mRecord != NULL)
+        ::CFRelease(mRecord);
+}
+
+void CDirectoryServiceCFOutput::BeginRecord(const char* name, size_t len)
+{
+    mRecordName = ::CFStringCreateWithBytes(kCFAllocatorDefault, (const UInt8*)name, len, kCFStringEncodingUTF8, false);
+    ThrowIfNULL(mRecordName);
+    mRecord = ::CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    ThrowIfNULL(mRecord);
+}
+
+void CDirectoryServiceCFOutput::BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot)
+{
+    if (slot != NULL)
+    {
+        mAttributeName = slot->mCFName;
+        ::CFRetain(mAttributeName);
+    }
+    else
+    {
+        mAttributeName = ::CFStringCreateWithBytes(kCFAllocatorDefault, (const UInt8*)name, len, kCFStringEncodingUTF8, false);
+        ThrowIfNULL(mAttributeName);
+    }
+    if (valueCount > 1)
+    {
+        mValues = ::CFArrayCreateMutable(kCFAllocatorDefault, valueCount, &kCFTypeArrayCallBacks);
+        ThrowIfNULL(mValues);
+    }
+}
+
+void CDirectoryServiceCFOutput::AddValue(const char* data, size_t len)
+{
+    // Values that are not valid UTF-8 are skipped
+    CFStringRef value = ::CFStringCreateWithBytes(kCFAllocatorDefault, (const UInt8*)data, len, kCFStringEncodingUTF8, false);
+    if (value == NULL)
+        return;
+
+    if (mValues != NULL)
+    {
+        ::CFArrayAppendValue(mValues, value);
+        ::CFRelease(value);
+    }
+    else
+    {
+        if (mValue != NULL)
+            ::CFRelease(mValue);
+        mValue = value;
+    }
+}
+
+void CDirectoryServiceCFOutput::EndAttribute()
+{
+    if (mValues != NULL)
+    {
+        ::CFDictionarySetValue(mRecord, mAttributeName, mValues);
+        ::CFRelease(mValues);
+        mValues = NULL;
+    }
+    else if (mValue != NULL)
+    {
+        ::CFDictionarySetValue(mRecord, mAttributeName, mValue);
+        ::CFRelease(mValue);
+        mValue = NULL;
+    }
+    ::CFRelease(mAttributeName);
+    mAttributeName = NULL;
+}
+
+void CDirectoryServiceCFOutput::EndRecord()
+{
+    // Create tuple of record name and record values and append to results array
+    CFMutableArrayRef record_tuple = ::CFArrayCreateMutable(kCFAllocatorDefault, 2, &kCFTypeArrayCallBacks);
+    ThrowIfNULL(record_tuple);
+    ::CFArrayAppendValue(record_tuple, mRecordName);
+    ::CFArrayAppendValue(record_tuple, mRecord);
+    ::CFArrayAppendValue(mRecords, record_tuple);
+    ::CFRelease(record_tuple);
+
+    ::CFRelease(mRecord);
+    mRecord = NULL;
+    ::CFRelease(mRecordName);
+    mRecordName = NULL;
+}
+
+#pragma mark -----CDirectoryServicePyOutput
+
+CDirectoryServicePyOutput::CDirectoryServicePyOutput(PyObject* result)
+{
+    mResult = result;
+    mList = PyList_Check(result);
+    mRecord = NULL;
+    mRecordName = NULL;
+    mAttributeName = NULL;
+    mValues = NULL;
+    mValue = NULL;
+}
+
+CDirectoryServicePyOutput::~CDirectoryServicePyOutput()
+{
+    Py_XDECREF(mValue);
+    Py_XDECREF(mValues);
+    Py_XDECREF(mAttributeName);
+    Py_XDECREF(mRecordName);
+    Py_XDECREF(mRecord);
+    for(std::vector<PyObject*>::iterator iter = mSlotNames.begin(); iter != mSlotNames.end(); iter++)
+        Py_XDECREF(*iter);
+}
+
+void CDirectoryServicePyOutput::BeginRecord(const char* name, size_t len)
+{
+    mRecordName = PyString_FromStringAndSize(name, len);
+    ThrowIfNULL(mRecordName);
+    mRecord = PyDict_New();
+    ThrowIfNULL(mRecord);
+}
+
+void CDirectoryServicePyOutput::BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot)
+{
+    if (slot != NULL)
+    {
+        // Each requested attribute name string is created once and shared by all records
+        if (slot->mIndex >= mSlotNames.size())
+            mSlotNames.resize(slot->mIndex + 1, NULL);
+        if (mSlotNames[slot->mIndex] == NULL)
+        {
+            mSlotNames[slot->mIndex] = PyString_FromStringAndSize(slot->mName.data(), slot->mName.size());
+            ThrowIfNULL(mSlotNames[slot->mIndex]);
+        }
+        mAttributeName = mSlotNames[slot->mIndex];
+        Py_INCREF(mAttributeName);
+    }
+    else
+    {
+        mAttributeName = PyString_FromStringAndSize(name, len);
+        ThrowIfNULL(mAttributeName);
+    }
+    if (valueCount > 1)
+    {
+        mValues = PyList_New(0);
+        ThrowIfNULL(mValues);
+    }
+}
+
+void CDirectoryServicePyOutput::AddValue(const char* data, size_t len)
+{
+    PyObject* value = PyString_FromStringAndSize(data, len);
+    ThrowIfNULL(value);
+
+    if (mValues != NULL)
+    {
+        int err = PyList_Append(mValues, value);
+        Py_DECREF(value);
+        ThrowIfPyErr(err);
+    }
+    else
+    {
+        Py_XDECREF(mValue);
+        mValue = value;
+    }
+}
+
+void CDirectoryServicePyOutput::EndAttribute()
+{
+    int err = 0;
+    if (mValues != NULL)
+    {
+        err = PyDict_SetItem(mRecord, mAttributeName, mValues);
+        Py_DECREF(mValues);
+        mValues = NULL;
+    }
+    else if (mValue != NULL)
+    {
+        err = PyDict_SetItem(mRecord, mAttributeName, mValue);
+        Py_DECREF(mValue);
+        mValue = NULL;
+    }
+    Py_DECREF(mAttributeName);
+    mAttributeName = NULL;
+    ThrowIfPyErr(err);
+}
+
+void CDirectoryServicePyOutput::EndRecord()
+{
+    // Add record name and record values to results
+    if (mList)
+    {
+        PyObject* pyrecord_list = PyList_New(2);
+        ThrowIfNULL(pyrecord_list);
+        PyList_SET_ITEM(pyrecord_list, 0, mRecordName);
+        PyList_SET_ITEM(pyrecord_list, 1, mRecord);
+        mRecordName = NULL;
+        mRecord = NULL;
+        int err = PyList_Append(mResult, pyrecord_list);
+        Py_DECREF(pyrecord_list);
+        ThrowIfPyErr(err);
+    }
+    else
+    {
+        int err = PyDict_SetItem(mResult, mRecordName, mRecord);
+        Py_DECREF(mRecordName);
+        mRecordName = NULL;
+        Py_DECREF(mRecord);
+        mRecord = NULL;
+        ThrowIfPyErr(err);
+    }
+}
+
+#pragma mark -----CDirectoryServiceRecordArena
+
+CDirectoryServiceRecordArena::CDirectoryServiceRecordArena()
+{
+}
+
+void CDirectoryServiceRecordArena::AddRecord(const char* name, size_t len)
+{
+    Record record;
+    record.mName = AddString(name, len);
+    record.mFirstAttribute = mAttributes.size();
+    record.mAttributeCount = 0;
+    mRecords.push_back(record);
+}
+
+void CDirectoryServiceRecordArena::AddAttribute(const char* name, size_t len)
+{
+    Attribute attribute;
+    attribute.mName = AddString(name, len);
+    attribute.mFirstValue = mValues.size();
+    attribute.mValueCount = 0;
+    mAttributes.push_back(attribute);
+    mRecords.back().mAttributeCount++;
+}
+
+void CDirectoryServiceRecordArena::AddValue(const char* data, size_t len)
+{
+    mValues.push_back(AddString(data, len));
+    mAttributes.back().mValueCount++;
+}
+
+// Append a copy of a record held in another arena.
+void CDirectoryServiceRecordArena::CopyRecord(const CDirectoryServiceRecordArena& from, size_t index)
+{
+    const Record& record = from.GetRecord(index);
+    AddRecord(from.GetString(record.mName), record.mName.mLength);
+    for(size_t i = 0; i < record.mAttributeCount; i++)
+    {
+        const Attribute& attribute = from.GetAttribute(record, i);
+        AddAttribute(from.GetString(attribute.mName), attribute.mName.mLength);
+        for(size_t j = 0; j < attribute.mValueCount; j++)
+        {
+            const Value& value = from.GetValue(attribute, j);
+            AddValue(from.GetString(value), value.mLength);
+        }
+    }
+}
+
+// Discard the last record added along with its attributes, values and strings.
+void CDirectoryServiceRecordArena::RemoveLastRecord()
+{
+    if (mRecords.empty())
+        return;
+
+    const Record& record = mRecords.back();
+    if (record.mFirstAttribute < mAttributes.size())
+    {
+        mValues.resize(mAttributes[record.mFirstAttribute].mFirstValue);
+        mAttributes.resize(record.mFirstAttribute);
+    }
+    mStrings.resize(record.mName.mOffset);
+    mRecords.pop_back();
+}
+
+void CDirectoryServiceRecordArena::Clear()
+{
+    mStrings.clear();
+    mRecords.clear();
+    mAttributes.clear();
+    mValues.clear();
+}
+
+// Copy a string into the arena, NUL terminating it so it can also be used as a c-string.
+CDirectoryServiceRecordArena::Value CDirectoryServiceRecordArena::AddString(const char* str, size_t len)
+{
+    Value result;
+    result.mOffset = mStrings.size();
+    result.mLength = len;
+    mStrings.insert(mStrings.end(), str, str + len);
+    mStrings.push_back(0);
+    return result;
+}
+
+#pragma mark -----CDirectoryServiceArenaOutput
+
+CDirectoryServiceArenaOutput::CDirectoryServiceArenaOutput(CDirectoryServiceRecordArena& arena) :
+    mArena(arena)
+{
+    mInRecord = false;
+}
+
+CDirectoryServiceArenaOutput::~CDirectoryServiceArenaOutput()
+{
+    if (mInRecord)
+        mArena.RemoveLastRecord();
+}
+
+void CDirectoryServiceArenaOutput::BeginRecord(const char* name, size_t len)
+{
+    mArena.AddRecord(name, len);
+    mInRecord = true;
+}
+
+void CDirectoryServiceArenaOutput::BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot)
+{
+    mArena.AddAttribute(name, len);
+}
+
+void CDirectoryServiceArenaOutput::AddValue(const char* data, size_t len)
+{
+    mArena.AddValue(data, len);
+}
+
+void CDirectoryServiceArenaOutput::EndAttribute()
+{
+}
+
+void CDirectoryServiceArenaOutput::EndRecord()
+{
+    mInRecord = false;
+}
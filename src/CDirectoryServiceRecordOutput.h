@@ -0,0 +1,209 @@
+/**
+ * Output policies used by CDirectoryServiceRecordDecoder to build the
+ * results of Directory Service record and attribute calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceAttributeSchema.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <Python.h>
+
+#include <vector>
+
+// Every output policy implements the same set of calls, made by the decoder in this order:
+//
+//   BeginRecord(name, len)                    - once per record (not used for node attributes)
+//     BeginAttribute(name, len, count, slot)  - once per attribute with at least one value
+//       AddValue(data, len)                   - once per value
+//     EndAttribute()
+//   EndRecord()
+//
+// Strings passed in are not NUL terminated and are only valid for the duration of the call.
+// The schema slot for an attribute is NULL if Directory Services returned one not requested.
+// Any partially built record is discarded when the policy object is destroyed.
+
+// Builds CoreFoundation objects: either an array of CFStringRef/CFMutableDictionaryRef tuples
+// for each record, or a single dictionary of attributes.
+class CDirectoryServiceCFOutput
+{
+public:
+    CDirectoryServiceCFOutput(CFMutableArrayRef records);
+    CDirectoryServiceCFOutput(CFMutableDictionaryRef attributes);
+    ~CDirectoryServiceCFOutput();
+
+    void BeginRecord(const char* name, size_t len);
+    void BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot);
+    void AddValue(const char* data, size_t len);
+    void EndAttribute();
+    void EndRecord();
+
+private:
+    CFMutableArrayRef       mRecords;
+    CFMutableDictionaryRef  mRecord;
+    CFStringRef             mRecordName;
+    CFStringRef             mAttributeName;
+    CFMutableArrayRef       mValues;
+    CFStringRef             mValue;
+};
+
+// Builds Python objects: either a dict of record name to attribute dict, or a list of
+// [record name, attribute dict] lists. The caller must hold the GIL.
+class CDirectoryServicePyOutput
+{
+public:
+    CDirectoryServicePyOutput(PyObject* result);
+    ~CDirectoryServicePyOutput();
+
+    void BeginRecord(const char* name, size_t len);
+    void BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot);
+    void AddValue(const char* data, size_t len);
+    void EndAttribute();
+    void EndRecord();
+
+private:
+    PyObject*               mResult;
+    bool                    mList;
+    PyObject*               mRecord;
+    PyObject*               mRecordName;
+    PyObject*               mAttributeName;
+    PyObject*               mValues;
+    PyObject*               mValue;
+    std::vector<PyObject*>  mSlotNames;     // attribute name strings cached by schema slot
+};
+
+// Flat storage for decoded records: all strings live in a single character buffer, and
+// records, attributes and values are described by offsets into it. Needs neither
+// CoreFoundation nor the GIL, so it can be filled from any thread.
+class CDirectoryServiceRecordArena
+{
+public:
+    struct Value
+    {
+        size_t  mOffset;
+        size_t  mLength;
+    };
+    struct Attribute
+    {
+        Value   mName;
+        size_t  mFirstValue;
+        size_t  mValueCount;
+    };
+    struct Record
+    {
+        Value   mName;
+        size_t  mFirstAttribute;
+        size_t  mAttributeCount;
+    };
+
+    CDirectoryServiceRecordArena();
+
+    size_t GetRecordCount() const
+    {
+        return mRecords.size();
+    }
+    const Record& GetRecord(size_t index) const
+    {
+        return mRecords[index];
+    }
+    const Attribute& GetAttribute(const Record& record, size_t index) const
+    {
+        return mAttributes[record.mFirstAttribute + index];
+    }
+    const Value& GetValue(const Attribute& attribute, size_t index) const
+    {
+        return mValues[attribute.mFirstValue + index];
+    }
+    const char* GetString(const Value& value) const
+    {
+        return &mStrings[value.mOffset];
+    }
+    size_t GetByteSize() const
+    {
+        return mStrings.size() + mRecords.size() * sizeof(Record) + mAttributes.size() * sizeof(Attribute) + mValues.size() * sizeof(Value);
+    }
+
+    // Replay
+    //
+    // Feed stored records through another output policy, for instance to turn records decoded
+    // on a worker thread into Python objects once the GIL is held.
+    //
+    // @param schema: the schema the records were decoded with.
+    // @param output: the output policy to feed.
+    // @param first: index of the first record to replay.
+    // @param count: the number of records to replay.
+    // @param requestedOnly: true to leave out attributes that are not in the schema.
+    //
+    template <class TOutput> void Replay(const CDirectoryServiceAttributeSchema& schema, TOutput& output, size_t first, size_t count, bool requestedOnly=false) const
+    {
+        for(size_t i = first; i < first + count; i++)
+        {
+            const Record& record = mRecords[i];
+            output.BeginRecord(GetString(record.mName), record.mName.mLength);
+            for(size_t j = 0; j < record.mAttributeCount; j++)
+            {
+                const Attribute& attribute = GetAttribute(record, j);
+                const char* name = GetString(attribute.mName);
+                const CDirectoryServiceAttributeSchema::Slot* slot = schema.Find(name, attribute.mName.mLength);
+                if (requestedOnly && (slot == NULL))
+                    continue;
+                output.BeginAttribute(name, attribute.mName.mLength, (UInt32)attribute.mValueCount, slot);
+                for(size_t k = 0; k < attribute.mValueCount; k++)
+                {
+                    const Value& value = GetValue(attribute, k);
+                    output.AddValue(GetString(value), value.mLength);
+                }
+                output.EndAttribute();
+            }
+            output.EndRecord();
+        }
+    }
+
+    void AddRecord(const char* name, size_t len);
+    void AddAttribute(const char* name, size_t len);
+    void AddValue(const char* data, size_t len);
+    void CopyRecord(const CDirectoryServiceRecordArena& from, size_t index);
+    void RemoveLastRecord();
+    void Clear();
+
+private:
+    std::vector<char>       mStrings;
+    std::vector<Record>     mRecords;
+    std::vector<Attribute>  mAttributes;
+    std::vector<Value>      mValues;
+
+    Value AddString(const char* str, size_t len);
+};
+
+// Appends records to a CDirectoryServiceRecordArena.
+class CDirectoryServiceArenaOutput
+{
+public:
+    CDirectoryServiceArenaOutput(CDirectoryServiceRecordArena& arena);
+    ~CDirectoryServiceArenaOutput();
+
+    void BeginRecord(const char* name, size_t len);
+    void BeginAttribute(const char* name, size_t len, UInt32 valueCount, const CDirectoryServiceAttributeSchema::Slot* slot);
+    void AddValue(const char* data, size_t len);
+    void EndAttribute();
+    void EndRecord();
+
+private:
+    CDirectoryServiceRecordArena&   mArena;
+    bool                            mInRecord;
+};
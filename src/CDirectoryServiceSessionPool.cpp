@@ -0,0 +1,243 @@
+/**
+ * A class that keeps Directory Service sessions (directory and node
+ * references) open so they can be reused across calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceSessionPool.h"
+
+#include "CDirectoryServiceException.h"
+
+#include <stdlib.h>
+
+#pragma mark -----Public API
+
+CDirectoryServiceSessionPool::CDirectoryServiceSessionPool(const char* nodename, size_t maxIdle) :
+    mNodeName(nodename)
+{
+    mMaxIdle = maxIdle;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceSessionPool::~CDirectoryServiceSessionPool()
+{
+    for(TSessionList::iterator iter = mIdle.begin(); iter != mIdle.end(); iter++)
+        CloseSession(*iter);
+    mIdle.clear();
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Checkout
+//
+// Get an open session for exclusive use, reusing an idle one if possible. Reused directory
+// references are verified first, and a missing node reference is reopened.
+//
+// @param dir: set to the directory reference.
+// @param node: set to the node reference.
+// @throw: yes
+//
+void CDirectoryServiceSessionPool::Checkout(tDirReference& dir, tDirNodeReference& node)
+{
+    Session session;
+    session.mDir = 0L;
+    session.mNode = 0L;
+
+    ::pthread_mutex_lock(&mMutex);
+    if (!mIdle.empty())
+    {
+        session = mIdle.back();
+        mIdle.pop_back();
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    if ((session.mDir != 0L) && (::dsVerifyDirRefNum(session.mDir) != eDSNoErr))
+        CloseSession(session);
+
+    if (session.mDir == 0L)
+        OpenSession(session);
+    else if (session.mNode == 0L)
+    {
+        try
+        {
+            OpenNode(session);
+        }
+        catch(CDirectoryServiceException& dsStatus)
+        {
+            CloseSession(session);
+            throw;
+        }
+    }
+
+    dir = session.mDir;
+    node = session.mNode;
+}
+
+// Checkin
+//
+// Return a session obtained from Checkout. It is kept for reuse unless there are already enough
+// idle sessions.
+//
+// @param dir: the directory reference.
+// @param node: the node reference.
+//
+void CDirectoryServiceSessionPool::Checkin(tDirReference dir, tDirNodeReference node)
+{
+    Session session;
+    session.mDir = dir;
+    session.mNode = node;
+
+    ::pthread_mutex_lock(&mMutex);
+    bool keep = (mIdle.size() < mMaxIdle);
+    if (keep)
+        mIdle.push_back(session);
+    ::pthread_mutex_unlock(&mMutex);
+
+    if (!keep)
+        CloseSession(session);
+}
+
+// Discard
+//
+// Close a session obtained from Checkout instead of returning it, after a call using it failed in a
+// way that may have left it unusable.
+//
+// @param dir: the directory reference.
+// @param node: the node reference.
+//
+void CDirectoryServiceSessionPool::Discard(tDirReference dir, tDirNodeReference node)
+{
+    Session session;
+    session.mDir = dir;
+    session.mNode = node;
+    CloseSession(session);
+}
+
+// Invalidate
+//
+// Discard the broken part of an idle session after a call using it failed with a stale reference.
+// A bad node reference only causes the node to be reopened, a bad directory reference causes the
+// whole session to be reopened. Sessions already checked out again are left to fail on their own.
+//
+// @param dir: the directory reference used by the failed call.
+// @param node: the node reference used by the failed call.
+// @param error: the error the call failed with.
+//
+void CDirectoryServiceSessionPool::Invalidate(tDirReference dir, tDirNodeReference node, tDirStatus error)
+{
+    Session session;
+    session.mDir = 0L;
+    session.mNode = 0L;
+
+    ::pthread_mutex_lock(&mMutex);
+    for(TSessionList::iterator iter = mIdle.begin(); iter != mIdle.end(); iter++)
+    {
+        if (((*iter).mDir == dir) && ((*iter).mNode == node))
+        {
+            if (error == eDSInvalidNodeRef)
+            {
+                session.mNode = (*iter).mNode;
+                (*iter).mNode = 0L;
+            }
+            else
+            {
+                session = *iter;
+                mIdle.erase(iter);
+            }
+            break;
+        }
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    CloseSession(session);
+}
+
+// IsStaleReference
+//
+// Check whether an error means that a directory or node reference is no longer usable.
+//
+// @param error: the error to check.
+// @return: true if the reference should be reopened, false otherwise.
+//
+bool CDirectoryServiceSessionPool::IsStaleReference(tDirStatus error)
+{
+    return (error == eDSInvalidReference) || (error == eDSInvalidDirRef) || (error == eDSInvalidNodeRef);
+}
+
+#pragma mark -----Private API
+
+// OpenSession
+//
+// Open the directory service and the pool's node.
+//
+// @param session: the session to open.
+// @throw: yes
+//
+void CDirectoryServiceSessionPool::OpenSession(Session& session)
+{
+    ThrowIfDSErr(::dsOpenDirService(&session.mDir));
+    try
+    {
+        OpenNode(session);
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        CloseSession(session);
+        throw;
+    }
+}
+
+// OpenNode
+//
+// Open the pool's node using the session's directory reference.
+//
+// @param session: the session to open the node for.
+// @throw: yes
+//
+void CDirectoryServiceSessionPool::OpenNode(Session& session)
+{
+    tDataListPtr nodePath = ::dsDataListAllocate(session.mDir);
+    ThrowIfNULL(nodePath);
+    tDirStatus dirStatus = ::dsBuildListFromPathAlloc(session.mDir, nodePath, mNodeName.c_str(), "/");
+    if (dirStatus == eDSNoErr)
+        dirStatus = ::dsOpenDirNode(session.mDir, nodePath, &session.mNode);
+    ::dsDataListDeallocate(session.mDir, nodePath);
+    free(nodePath);
+    if (dirStatus != eDSNoErr)
+    {
+        session.mNode = 0L;
+        ThrowIfDSErr(dirStatus);
+    }
+}
+
+// CloseSession
+//
+// Close whichever of the session's references are open.
+//
+// @param session: the session to close.
+//
+void CDirectoryServiceSessionPool::CloseSession(Session& session)
+{
+    if (session.mNode != 0L)
+    {
+        ::dsCloseDirNode(session.mNode);
+        session.mNode = 0L;
+    }
+    if (session.mDir != 0L)
+    {
+        ::dsCloseDirService(session.mDir);
+        session.mDir = 0L;
+    }
+}
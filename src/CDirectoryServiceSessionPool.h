@@ -0,0 +1,68 @@
+/**
+ * A class that keeps Directory Service sessions (directory and node
+ * references) open so they can be reused across calls.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+// Each session is a directory reference plus a reference to the pool's node. A session is
+// checked out to one caller at a time; idle sessions are kept for reuse up to a limit.
+class CDirectoryServiceSessionPool
+{
+public:
+    CDirectoryServiceSessionPool(const char* nodename, size_t maxIdle=4);
+    ~CDirectoryServiceSessionPool();
+
+    const std::string& GetNodeName() const
+    {
+        return mNodeName;
+    }
+
+    void Checkout(tDirReference& dir, tDirNodeReference& node);
+    void Checkin(tDirReference dir, tDirNodeReference node);
+    void Discard(tDirReference dir, tDirNodeReference node);
+    void Invalidate(tDirReference dir, tDirNodeReference node, tDirStatus error);
+
+    static bool IsStaleReference(tDirStatus error);
+
+private:
+    struct Session
+    {
+        tDirReference       mDir;
+        tDirNodeReference   mNode;
+    };
+    typedef std::vector<Session> TSessionList;
+
+    std::string         mNodeName;
+    size_t              mMaxIdle;
+    TSessionList        mIdle;
+    pthread_mutex_t     mMutex;
+
+    void OpenSession(Session& session);
+    void OpenNode(Session& session);
+    void CloseSession(Session& session);
+
+    // Not copyable as the pool owns its sessions
+    CDirectoryServiceSessionPool(const CDirectoryServiceSessionPool& copy);
+    CDirectoryServiceSessionPool& operator=(const CDirectoryServiceSessionPool& copy);
+};
@@ -0,0 +1,132 @@
+/**
+ * A class that lets identical concurrent queries share a single
+ * Directory Service call.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceSingleFlight.h"
+
+#pragma mark -----Public API
+
+CDirectoryServiceSingleFlight::CDirectoryServiceSingleFlight()
+{
+    mCoalesced = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+    ::pthread_cond_init(&mFinished, NULL);
+}
+
+CDirectoryServiceSingleFlight::~CDirectoryServiceSingleFlight()
+{
+    // Calls still in flight belong to their callers, which must be gone by now
+    ::pthread_cond_destroy(&mFinished);
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Join
+//
+// Take part in the call for a key, starting it if none is in flight.
+//
+// @param key: the key identifying the query.
+// @param leader: set to true if the caller must make the call and then Finish it, false if it
+//                must Wait for the call to finish.
+// @return: the call, which must be given back with Release.
+//
+CDirectoryServiceSingleFlight::Call* CDirectoryServiceSingleFlight::Join(const std::string& key, bool& leader)
+{
+    ::pthread_mutex_lock(&mMutex);
+    Call*& result = mCalls[key];
+    leader = (result == NULL);
+    if (leader)
+    {
+        result = new Call;
+        result->mError = eDSNoErr;
+        result->mDone = false;
+        result->mRefs = 0;
+    }
+    else
+        mCoalesced++;
+    result->mRefs++;
+    Call* call = result;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return call;
+}
+
+// Finish
+//
+// Record the outcome of a call made by its leader and wake its waiters. Callers arriving after
+// this start a new call.
+//
+// @param key: the key the call was joined with.
+// @param call: the call.
+// @param error: the error the call failed with, or eDSNoErr.
+//
+void CDirectoryServiceSingleFlight::Finish(const std::string& key, Call* call, tDirStatus error)
+{
+    ::pthread_mutex_lock(&mMutex);
+    call->mError = error;
+    call->mDone = true;
+    mCalls.erase(key);
+    ::pthread_cond_broadcast(&mFinished);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Wait
+//
+// Wait for the leader of a call to finish it.
+//
+// @param call: the call.
+// @return: the error the call failed with, or eDSNoErr.
+//
+tDirStatus CDirectoryServiceSingleFlight::Wait(Call* call)
+{
+    ::pthread_mutex_lock(&mMutex);
+    while(!call->mDone)
+        ::pthread_cond_wait(&mFinished, &mMutex);
+    tDirStatus result = call->mError;
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// Release
+//
+// Give back a call obtained from Join, deleting it once nobody is using it.
+//
+// @param call: the call.
+//
+void CDirectoryServiceSingleFlight::Release(Call* call)
+{
+    ::pthread_mutex_lock(&mMutex);
+    bool last = (--call->mRefs == 0);
+    ::pthread_mutex_unlock(&mMutex);
+
+    if (last)
+        delete call;
+}
+
+// GetStatistics
+//
+// Add the number of queries answered by another caller's call to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceSingleFlight::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["queries_coalesced"] = mCoalesced;
+    ::pthread_mutex_unlock(&mMutex);
+}
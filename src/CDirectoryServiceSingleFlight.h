@@ -0,0 +1,81 @@
+/**
+ * A class that lets identical concurrent queries share a single
+ * Directory Service call.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceRecordOutput.h"
+#include "CDirectoryServiceStatistics.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <map>
+#include <pthread.h>
+#include <string>
+
+// Calls are identified by the same key as the query cache uses. The first caller with a key becomes
+// the leader and makes the directory call into the shared arena, any caller arriving with the same
+// key while that is in flight waits for it and replays the arena instead. A call stays alive until
+// the leader and every waiter has released it.
+class CDirectoryServiceSingleFlight
+{
+public:
+    class Call
+    {
+    public:
+        const CDirectoryServiceRecordArena& GetArena() const
+        {
+            return mArena;
+        }
+        CDirectoryServiceRecordArena& GetArena()
+        {
+            return mArena;
+        }
+
+    private:
+        friend class CDirectoryServiceSingleFlight;
+
+        CDirectoryServiceRecordArena    mArena;
+        tDirStatus                      mError;
+        bool                            mDone;
+        size_t                          mRefs;
+    };
+
+    CDirectoryServiceSingleFlight();
+    ~CDirectoryServiceSingleFlight();
+
+    Call* Join(const std::string& key, bool& leader);
+    void Finish(const std::string& key, Call* call, tDirStatus error);
+    tDirStatus Wait(Call* call);
+    void Release(Call* call);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    typedef std::map<std::string, Call*> TCallMap;
+
+    TCallMap            mCalls;
+    pthread_mutex_t     mMutex;
+    pthread_cond_t      mFinished;
+
+    UInt64              mCoalesced;
+
+    // Not copyable as the calls are shared
+    CDirectoryServiceSingleFlight(const CDirectoryServiceSingleFlight& copy);
+    CDirectoryServiceSingleFlight& operator=(const CDirectoryServiceSingleFlight& copy);
+};
@@ -0,0 +1,531 @@
+/**
+ * Classes that write and map read-only snapshot files of mirrored
+ * Directory Service records.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceSnapshot.h"
+
+#include "CDirectoryServiceException.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace DirectoryServiceSnapshot;
+
+static const char cMagic[8] = { 'P', 'Y', 'O', 'D', 'S', 'N', 'A', 'P' };
+
+// 32-bit FNV-1a hash of a lower-cased value, the same on every platform.
+UInt32 DirectoryServiceSnapshot::Hash(const char* str, size_t len)
+{
+    UInt32 result = 2166136261U;
+    for(size_t i = 0; i < len; i++)
+    {
+        result ^= (unsigned char)str[i];
+        result *= 16777619U;
+    }
+    return result;
+}
+
+// Append a table to a file image, returning where it starts.
+template <class T> static Section AppendTable(std::vector<char>& image, const std::vector<T>& table)
+{
+    Section result;
+    result.mOffset = (UInt32)image.size();
+    result.mCount = (UInt32)table.size();
+    if (!table.empty())
+        image.insert(image.end(), reinterpret_cast<const char*>(&table[0]), reinterpret_cast<const char*>(&table[0] + table.size()));
+    return result;
+}
+
+#pragma mark -----CDirectoryServiceSnapshotWriter
+
+CDirectoryServiceSnapshotWriter::CDirectoryServiceSnapshotWriter()
+{
+    mNodeName = AddString("", 0);
+}
+
+// SetNodeName
+//
+// Set the node the records were loaded from. Only lookups on that node are answered from the snapshot.
+//
+// @param nodename: the node name.
+//
+void CDirectoryServiceSnapshotWriter::SetNodeName(const std::string& nodename)
+{
+    mNodeName = AddString(nodename.c_str(), nodename.length());
+}
+
+// AddRecordType
+//
+// Add a record type held by the snapshot.
+//
+// @param recordType: the record type.
+//
+void CDirectoryServiceSnapshotWriter::AddRecordType(const std::string& recordType)
+{
+    if (mRecordTypeIndexes.find(recordType) != mRecordTypeIndexes.end())
+        return;
+    mRecordTypeIndexes[recordType] = (UInt32)mRecordTypes.size();
+    mRecordTypes.push_back(AddString(recordType.c_str(), recordType.length()));
+}
+
+// AddAttributeKind
+//
+// Add an attribute held by the snapshot, with the encoding its values were fetched with.
+//
+// @param name: the attribute.
+// @param kind: its encoding.
+//
+void CDirectoryServiceSnapshotWriter::AddAttributeKind(const std::string& name, CDirectoryServiceAttributeSchema::EDecodeKind kind)
+{
+    AttributeKind attributeKind;
+    attributeKind.mName = AddString(name.c_str(), name.length());
+    attributeKind.mKind = kind;
+    mAttributeKinds.push_back(attributeKind);
+}
+
+// AddRecord
+//
+// Add a record to the snapshot.
+//
+// @param recordType: the record type of the record.
+// @param arena: the arena holding the record.
+// @param index: the index of the record in the arena.
+// @return: the record's number, used to add index entries for it.
+//
+UInt32 CDirectoryServiceSnapshotWriter::AddRecord(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index)
+{
+    AddRecordType(recordType);
+
+    const CDirectoryServiceRecordArena::Record& from = arena.GetRecord(index);
+    Record record;
+    record.mRecordType = mRecordTypeIndexes[recordType];
+    record.mName = AddString(arena.GetString(from.mName), from.mName.mLength);
+    record.mFirstAttribute = (UInt32)mAttributes.size();
+    record.mAttributeCount = (UInt32)from.mAttributeCount;
+    for(size_t i = 0; i < from.mAttributeCount; i++)
+    {
+        const CDirectoryServiceRecordArena::Attribute& fromAttribute = arena.GetAttribute(from, i);
+        Attribute attribute;
+        attribute.mName = AddString(arena.GetString(fromAttribute.mName), fromAttribute.mName.mLength);
+        attribute.mFirstValue = (UInt32)mValues.size();
+        attribute.mValueCount = (UInt32)fromAttribute.mValueCount;
+        for(size_t j = 0; j < fromAttribute.mValueCount; j++)
+        {
+            const CDirectoryServiceRecordArena::Value& value = arena.GetValue(fromAttribute, j);
+            mValues.push_back(AddString(arena.GetString(value), value.mLength));
+        }
+        mAttributes.push_back(attribute);
+    }
+    mRecords.push_back(record);
+
+    return (UInt32)(mRecords.size() - 1);
+}
+
+// AddIndexEntry
+//
+// Add an entry to the index of an attribute.
+//
+// @param attr: the indexed attribute.
+// @param key: the lower-cased value.
+// @param record: the number of the record holding the value.
+//
+void CDirectoryServiceSnapshotWriter::AddIndexEntry(const std::string& attr, const std::string& key, UInt32 record)
+{
+    IndexEntry entry;
+    entry.mHash = Hash(key.c_str(), key.length());
+    entry.mKey = AddString(key.c_str(), key.length());
+    entry.mRecord = record;
+    mIndexEntries[attr].push_back(entry);
+}
+
+// Write
+//
+// Lay out the snapshot and write it to a file. The file is written under a temporary name and
+// then renamed, so a process mapping the old file keeps a consistent view of it.
+//
+// @param path: the file to write.
+// @throw: yes
+//
+void CDirectoryServiceSnapshotWriter::Write(const char* path) const
+{
+    // Build the hash tables, at most half full
+    std::vector<Index> indexes;
+    std::vector<Slot> slots;
+    std::vector<char> strings(mStrings);
+    for(TIndexEntries::const_iterator iter = mIndexEntries.begin(); iter != mIndexEntries.end(); iter++)
+    {
+        const std::vector<IndexEntry>& entries = (*iter).second;
+        Index index;
+        index.mAttribute.mOffset = (UInt32)strings.size();
+        index.mAttribute.mLength = (UInt32)(*iter).first.length();
+        strings.insert(strings.end(), (*iter).first.begin(), (*iter).first.end());
+        strings.push_back(0);
+        index.mFirstSlot = (UInt32)slots.size();
+        index.mSlotCount = 1;
+        while(index.mSlotCount < entries.size() * 2)
+            index.mSlotCount *= 2;
+
+        Slot empty;
+        empty.mHash = 0;
+        empty.mKey.mOffset = 0;
+        empty.mKey.mLength = 0;
+        empty.mRecord = cNoRecord;
+        slots.insert(slots.end(), index.mSlotCount, empty);
+        for(std::vector<IndexEntry>::const_iterator entry = entries.begin(); entry != entries.end(); entry++)
+        {
+            UInt32 mask = index.mSlotCount - 1;
+            UInt32 probe = (*entry).mHash & mask;
+            while(slots[index.mFirstSlot + probe].mRecord != cNoRecord)
+                probe = (probe + 1) & mask;
+            Slot& slot = slots[index.mFirstSlot + probe];
+            slot.mHash = (*entry).mHash;
+            slot.mKey = (*entry).mKey;
+            slot.mRecord = (*entry).mRecord;
+        }
+        indexes.push_back(index);
+    }
+
+    // Every table is made of 32-bit fields, so each stays aligned when packed one after another
+    Header header;
+    ::memset(&header, 0, sizeof(header));
+    std::vector<char> image(sizeof(Header));
+    header.mRecordTypes = AppendTable(image, mRecordTypes);
+    header.mAttributeKinds = AppendTable(image, mAttributeKinds);
+    header.mRecords = AppendTable(image, mRecords);
+    header.mAttributes = AppendTable(image, mAttributes);
+    header.mValues = AppendTable(image, mValues);
+    header.mIndexes = AppendTable(image, indexes);
+    header.mSlots = AppendTable(image, slots);
+    header.mStrings = AppendTable(image, strings);
+    if ((UInt64)image.size() > 0xFFFFFFFFULL)
+        ThrowIfDSErr(eDSOperationFailed);
+    ::memcpy(header.mMagic, cMagic, sizeof(header.mMagic));
+    header.mVersion = cVersion;
+    header.mByteOrder = cByteOrder;
+    header.mFileSize = (UInt32)image.size();
+    header.mNodeName = mNodeName;
+    ::memcpy(&image[0], &header, sizeof(header));
+
+    std::string temp(path);
+    temp += ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        ThrowIfDSErr(eDSOperationFailed);
+    size_t written = 0;
+    while(written < image.size())
+    {
+        ssize_t result = ::write(fd, &image[written], image.size() - written);
+        if ((result < 0) && (errno == EINTR))
+            continue;
+        if (result <= 0)
+            break;
+        written += result;
+    }
+    bool failed = (written < image.size()) || (::fsync(fd) != 0);
+    failed = (::close(fd) != 0) || failed;
+    if (failed || (::rename(temp.c_str(), path) != 0))
+    {
+        ::unlink(temp.c_str());
+        ThrowIfDSErr(eDSOperationFailed);
+    }
+}
+
+// Add a NUL terminated copy of a string to the string table.
+StringRef CDirectoryServiceSnapshotWriter::AddString(const char* str, size_t len)
+{
+    StringRef result;
+    result.mOffset = (UInt32)mStrings.size();
+    result.mLength = (UInt32)len;
+    mStrings.insert(mStrings.end(), str, str + len);
+    mStrings.push_back(0);
+    return result;
+}
+
+#pragma mark -----CDirectoryServiceSnapshot
+
+// Map a snapshot file and check that it is one this code can read.
+//
+// @param path: the file to map.
+// @throw: yes
+//
+CDirectoryServiceSnapshot::CDirectoryServiceSnapshot(const char* path)
+{
+    mData = NULL;
+    mSize = 0;
+    mHeader = NULL;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        ThrowIfDSErr(eDSOperationFailed);
+    struct stat info;
+    if ((::fstat(fd, &info) != 0) || (info.st_size < (off_t)sizeof(Header)))
+    {
+        ::close(fd);
+        ThrowIfDSErr(eDSInvalidBuffFormat);
+    }
+    mSize = (size_t)info.st_size;
+    void* data = ::mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        ThrowIfDSErr(eDSOperationFailed);
+    mData = static_cast<const char*>(data);
+    mHeader = reinterpret_cast<const Header*>(mData);
+
+    try
+    {
+        Validate();
+    }
+    catch(...)
+    {
+        ::munmap(const_cast<char*>(mData), mSize);
+        throw;
+    }
+}
+
+CDirectoryServiceSnapshot::~CDirectoryServiceSnapshot()
+{
+    ::munmap(const_cast<char*>(mData), mSize);
+}
+
+// Query
+//
+// Answer an exact lookup from the snapshot if it can. Records are returned in the order of the
+// requested record types.
+//
+// @param attr: the attribute to look up.
+// @param value: the value to look for.
+// @param casei: true if case-insensitive match is to be used, false otherwise.
+// @param recordTypes: the record types to look in.
+// @param schema: the attributes to return.
+// @param maxRecordCount: maximum number of records to return (zero returns all).
+// @param result: arena to add the matching records to.
+// @return: true if the snapshot answered the lookup, false if it cannot.
+// @throw: yes
+//
+bool CDirectoryServiceSnapshot::Query(const char* attr, const char* value, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result) const
+{
+    if (!CanAnswer(attr, recordTypes, schema))
+        return false;
+
+    // Keys are only lower-cased for ASCII, so other values cannot be looked up case-insensitively
+    std::string key(value);
+    for(std::string::iterator iter = key.begin(); iter != key.end(); iter++)
+    {
+        if (casei && ((unsigned char)*iter >= 0x80))
+            return false;
+        *iter = ::tolower((unsigned char)*iter);
+    }
+    UInt32 hash = Hash(key.c_str(), key.length());
+
+    // Probe the hash table, grouping the candidate records by record type
+    const Index* index = FindIndex(attr);
+    std::vector< std::vector<UInt32> > found(recordTypes.size());
+    std::set<UInt32> seen;
+    UInt32 mask = index->mSlotCount - 1;
+    for(UInt32 i = 0, probe = hash & mask; i < index->mSlotCount; i++, probe = (probe + 1) & mask)
+    {
+        const Slot& slot = GetEntry<Slot>(mHeader->mSlots, index->mFirstSlot + probe);
+        if (slot.mRecord == cNoRecord)
+            break;
+        if ((slot.mHash != hash) || (slot.mKey.mLength != key.length()) || (::memcmp(GetString(slot.mKey), key.c_str(), key.length()) != 0))
+            continue;
+        if (!seen.insert(slot.mRecord).second)
+            continue;
+
+        const Record& record = GetEntry<Record>(mHeader->mRecords, slot.mRecord);
+        if (record.mRecordType >= mRecordTypeNames.size())
+            ThrowIfDSErr(eDSInvalidBuffFormat);
+        const std::string& recordType = mRecordTypeNames[record.mRecordType];
+        if (!casei && !HasValue(record, attr, value))
+            continue;
+        for(size_t j = 0; j < recordTypes.size(); j++)
+        {
+            if (recordTypes[j] == recordType)
+            {
+                found[j].push_back(slot.mRecord);
+                break;
+            }
+        }
+    }
+
+    // Copy out just the requested attributes
+    size_t count = 0;
+    for(size_t i = 0; i < found.size(); i++)
+    {
+        for(std::vector<UInt32>::const_iterator iter = found[i].begin(); iter != found[i].end(); iter++)
+        {
+            if ((maxRecordCount != 0) && (count >= maxRecordCount))
+                break;
+            CopyRecord(GetEntry<Record>(mHeader->mRecords, *iter), schema, result);
+            count++;
+        }
+    }
+
+    return true;
+}
+
+#pragma mark -----Private API
+
+// Check the header and that every table lies within the file. Entries are checked as they are
+// used, so a damaged file cannot cause a read outside the mapping.
+void CDirectoryServiceSnapshot::Validate()
+{
+    if ((::memcmp(mHeader->mMagic, cMagic, sizeof(cMagic)) != 0) || (mHeader->mVersion != cVersion) ||
+        (mHeader->mByteOrder != cByteOrder) || (mHeader->mFileSize != mSize))
+        ThrowIfDSErr(eDSInvalidBuffFormat);
+    ValidateSection(mHeader->mRecordTypes, sizeof(StringRef));
+    ValidateSection(mHeader->mAttributeKinds, sizeof(AttributeKind));
+    ValidateSection(mHeader->mRecords, sizeof(Record));
+    ValidateSection(mHeader->mAttributes, sizeof(Attribute));
+    ValidateSection(mHeader->mValues, sizeof(StringRef));
+    ValidateSection(mHeader->mIndexes, sizeof(Index));
+    ValidateSection(mHeader->mSlots, sizeof(Slot));
+    ValidateSection(mHeader->mStrings, 1);
+
+    for(UInt32 i = 0; i < mHeader->mIndexes.mCount; i++)
+    {
+        const Index& index = GetEntry<Index>(mHeader->mIndexes, i);
+        if ((index.mSlotCount == 0) || ((index.mSlotCount & (index.mSlotCount - 1)) != 0) ||
+            ((UInt64)index.mFirstSlot + index.mSlotCount > mHeader->mSlots.mCount))
+            ThrowIfDSErr(eDSInvalidBuffFormat);
+        GetString(index.mAttribute);
+    }
+
+    // The profile is small, so keep it in a form the mirror can hand out directly
+    mNodeName.assign(GetString(mHeader->mNodeName), mHeader->mNodeName.mLength);
+    for(UInt32 i = 0; i < mHeader->mRecordTypes.mCount; i++)
+    {
+        const StringRef& recordType = GetEntry<StringRef>(mHeader->mRecordTypes, i);
+        mRecordTypeNames.push_back(std::string(GetString(recordType), recordType.mLength));
+    }
+    for(UInt32 i = 0; i < mHeader->mAttributeKinds.mCount; i++)
+    {
+        const AttributeKind& attributeKind = GetEntry<AttributeKind>(mHeader->mAttributeKinds, i);
+        mAttributeKinds[std::string(GetString(attributeKind.mName), attributeKind.mName.mLength)] =
+            (attributeKind.mKind == CDirectoryServiceAttributeSchema::eDecodeBase64) ? CDirectoryServiceAttributeSchema::eDecodeBase64 : CDirectoryServiceAttributeSchema::eDecodeString;
+    }
+}
+
+// Check that a table lies within the file and is aligned for its entries.
+void CDirectoryServiceSnapshot::ValidateSection(const Section& section, size_t entrySize) const
+{
+    if ((section.mOffset < sizeof(Header)) || ((section.mOffset % sizeof(UInt32)) != 0) ||
+        ((UInt64)section.mOffset + (UInt64)section.mCount * entrySize > mSize))
+        ThrowIfDSErr(eDSInvalidBuffFormat);
+}
+
+// Get an entry of a table, checking it is in the table.
+template <class T> const T& CDirectoryServiceSnapshot::GetEntry(const Section& section, UInt32 index) const
+{
+    if (index >= section.mCount)
+        ThrowIfDSErr(eDSInvalidBuffFormat);
+    return GetTable<T>(section)[index];
+}
+
+// Get a string from the string table, checking it is in the table. It is not necessarily NUL terminated.
+const char* CDirectoryServiceSnapshot::GetString(const StringRef& str) const
+{
+    if ((UInt64)str.mOffset + str.mLength > mHeader->mStrings.mCount)
+        ThrowIfDSErr(eDSInvalidBuffFormat);
+    return mData + mHeader->mStrings.mOffset + str.mOffset;
+}
+
+// Find the hash table of an attribute.
+const Index* CDirectoryServiceSnapshot::FindIndex(const char* attr) const
+{
+    size_t len = ::strlen(attr);
+    for(UInt32 i = 0; i < mHeader->mIndexes.mCount; i++)
+    {
+        const Index& index = GetEntry<Index>(mHeader->mIndexes, i);
+        if ((index.mAttribute.mLength == len) && (::memcmp(GetString(index.mAttribute), attr, len) == 0))
+            return &index;
+    }
+    return NULL;
+}
+
+// Check that the lookup is on an indexed attribute and that everything it asks for is in the snapshot.
+bool CDirectoryServiceSnapshot::CanAnswer(const char* attr, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const
+{
+    if (FindIndex(attr) == NULL)
+        return false;
+    for(std::vector<std::string>::const_iterator iter = recordTypes.begin(); iter != recordTypes.end(); iter++)
+    {
+        if (std::find(mRecordTypeNames.begin(), mRecordTypeNames.end(), *iter) == mRecordTypeNames.end())
+            return false;
+    }
+    for(size_t i = 0; i < schema.GetCount(); i++)
+    {
+        const CDirectoryServiceAttributeSchema::Slot& slot = schema.GetSlot(i);
+        std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>::const_iterator found = mAttributeKinds.find(slot.mName);
+        if ((found == mAttributeKinds.end()) || ((*found).second != slot.mKind))
+            return false;
+    }
+    return true;
+}
+
+// Check whether a record has exactly the given value for an attribute. The record name counts as
+// a value of RecordName.
+bool CDirectoryServiceSnapshot::HasValue(const Record& record, const char* attr, const char* value) const
+{
+    size_t attrLen = ::strlen(attr);
+    size_t valueLen = ::strlen(value);
+    if ((::strcmp(attr, kDSNAttrRecordName) == 0) && (record.mName.mLength == valueLen) && (::memcmp(GetString(record.mName), value, valueLen) == 0))
+        return true;
+    for(UInt32 i = 0; i < record.mAttributeCount; i++)
+    {
+        const Attribute& attribute = GetEntry<Attribute>(mHeader->mAttributes, record.mFirstAttribute + i);
+        if ((attribute.mName.mLength != attrLen) || (::memcmp(GetString(attribute.mName), attr, attrLen) != 0))
+            continue;
+        for(UInt32 j = 0; j < attribute.mValueCount; j++)
+        {
+            const StringRef& str = GetEntry<StringRef>(mHeader->mValues, attribute.mFirstValue + j);
+            if ((str.mLength == valueLen) && (::memcmp(GetString(str), value, valueLen) == 0))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Add a record to an arena with just the requested attributes.
+void CDirectoryServiceSnapshot::CopyRecord(const Record& record, const CDirectoryServiceAttributeSchema& schema, CDirectoryServiceRecordArena& result) const
+{
+    result.AddRecord(GetString(record.mName), record.mName.mLength);
+    for(UInt32 i = 0; i < record.mAttributeCount; i++)
+    {
+        const Attribute& attribute = GetEntry<Attribute>(mHeader->mAttributes, record.mFirstAttribute + i);
+        const char* name = GetString(attribute.mName);
+        if (schema.Find(name, attribute.mName.mLength) == NULL)
+            continue;
+        result.AddAttribute(name, attribute.mName.mLength);
+        for(UInt32 j = 0; j < attribute.mValueCount; j++)
+        {
+            const StringRef& str = GetEntry<StringRef>(mHeader->mValues, attribute.mFirstValue + j);
+            result.AddValue(GetString(str), str.mLength);
+        }
+    }
+}
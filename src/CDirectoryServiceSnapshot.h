@@ -0,0 +1,191 @@
+/**
+ * Classes that write and map read-only snapshot files of mirrored
+ * Directory Service records.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceAttributeSchema.h"
+#include "CDirectoryServiceRecordOutput.h"
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// A snapshot file holds a set of mirrored records in a form that can be used where it lies once
+// mapped into memory: a header, fixed size tables of records, attributes, values and index slots,
+// and one string table they all point into by offset. Each indexed attribute has an open
+// addressing hash table, keyed on the lower-cased value, giving the records holding that value.
+// All fields are 32-bit and in the byte order of the machine that wrote the file; a file written
+// with a different version or byte order is rejected rather than converted.
+namespace DirectoryServiceSnapshot
+{
+    const UInt32 cVersion = 2;
+    const UInt32 cByteOrder = 0x01020304;
+    const UInt32 cNoRecord = 0xFFFFFFFF;
+
+    struct StringRef
+    {
+        UInt32  mOffset;
+        UInt32  mLength;
+    };
+    struct Section
+    {
+        UInt32  mOffset;        // from the start of the file
+        UInt32  mCount;         // entries, or bytes for the string table
+    };
+    struct Header
+    {
+        char    mMagic[8];
+        UInt32  mVersion;
+        UInt32  mByteOrder;
+        UInt32  mFileSize;
+        StringRef mNodeName;    // the node the records were loaded from
+        Section mRecordTypes;   // StringRef
+        Section mAttributeKinds;// AttributeKind
+        Section mRecords;       // Record
+        Section mAttributes;    // Attribute
+        Section mValues;        // StringRef
+        Section mIndexes;       // Index
+        Section mSlots;         // Slot
+        Section mStrings;       // char
+    };
+    struct AttributeKind
+    {
+        StringRef   mName;
+        UInt32      mKind;      // CDirectoryServiceAttributeSchema::EDecodeKind
+    };
+    struct Record
+    {
+        UInt32      mRecordType;
+        StringRef   mName;
+        UInt32      mFirstAttribute;
+        UInt32      mAttributeCount;
+    };
+    struct Attribute
+    {
+        StringRef   mName;
+        UInt32      mFirstValue;
+        UInt32      mValueCount;
+    };
+    struct Index
+    {
+        StringRef   mAttribute;
+        UInt32      mFirstSlot;
+        UInt32      mSlotCount; // a power of two
+    };
+    struct Slot
+    {
+        UInt32      mHash;
+        StringRef   mKey;       // lower-cased value
+        UInt32      mRecord;    // cNoRecord when the slot is empty
+    };
+
+    UInt32 Hash(const char* str, size_t len);
+}
+
+// Collects records and index entries, then lays them out and writes them as a snapshot file.
+class CDirectoryServiceSnapshotWriter
+{
+public:
+    CDirectoryServiceSnapshotWriter();
+
+    void SetNodeName(const std::string& nodename);
+    void AddRecordType(const std::string& recordType);
+    void AddAttributeKind(const std::string& name, CDirectoryServiceAttributeSchema::EDecodeKind kind);
+    UInt32 AddRecord(const std::string& recordType, const CDirectoryServiceRecordArena& arena, size_t index);
+    void AddIndexEntry(const std::string& attr, const std::string& key, UInt32 record);
+
+    void Write(const char* path) const;
+
+private:
+    struct IndexEntry
+    {
+        UInt32  mHash;
+        DirectoryServiceSnapshot::StringRef mKey;
+        UInt32  mRecord;
+    };
+    typedef std::map<std::string, std::vector<IndexEntry> > TIndexEntries;
+
+    DirectoryServiceSnapshot::StringRef                     mNodeName;
+    std::vector<DirectoryServiceSnapshot::StringRef>        mRecordTypes;
+    std::map<std::string, UInt32>                           mRecordTypeIndexes;
+    std::vector<DirectoryServiceSnapshot::AttributeKind>    mAttributeKinds;
+    std::vector<DirectoryServiceSnapshot::Record>           mRecords;
+    std::vector<DirectoryServiceSnapshot::Attribute>        mAttributes;
+    std::vector<DirectoryServiceSnapshot::StringRef>        mValues;
+    TIndexEntries                                           mIndexEntries;
+    std::vector<char>                                       mStrings;
+
+    DirectoryServiceSnapshot::StringRef AddString(const char* str, size_t len);
+};
+
+// A snapshot file mapped read-only. Lookups read the mapped tables directly, so a snapshot can
+// answer them as soon as it is opened. It never changes once opened, so it needs no lock.
+class CDirectoryServiceSnapshot
+{
+public:
+    explicit CDirectoryServiceSnapshot(const char* path);
+    ~CDirectoryServiceSnapshot();
+
+    const std::string& GetNodeName() const
+    {
+        return mNodeName;
+    }
+    const std::vector<std::string>& GetRecordTypes() const
+    {
+        return mRecordTypeNames;
+    }
+    const std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>& GetAttributes() const
+    {
+        return mAttributeKinds;
+    }
+    size_t GetRecordCount() const
+    {
+        return mHeader->mRecords.mCount;
+    }
+
+    bool Query(const char* attr, const char* value, bool casei, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema, UInt32 maxRecordCount, CDirectoryServiceRecordArena& result) const;
+
+private:
+    const char*                                 mData;
+    size_t                                      mSize;
+    const DirectoryServiceSnapshot::Header*     mHeader;
+    std::string                                 mNodeName;
+    std::vector<std::string>                    mRecordTypeNames;
+    std::map<std::string, CDirectoryServiceAttributeSchema::EDecodeKind>    mAttributeKinds;
+
+    void Validate();
+    void ValidateSection(const DirectoryServiceSnapshot::Section& section, size_t entrySize) const;
+    const char* GetString(const DirectoryServiceSnapshot::StringRef& str) const;
+    const DirectoryServiceSnapshot::Index* FindIndex(const char* attr) const;
+    bool CanAnswer(const char* attr, const std::vector<std::string>& recordTypes, const CDirectoryServiceAttributeSchema& schema) const;
+    bool HasValue(const DirectoryServiceSnapshot::Record& record, const char* attr, const char* value) const;
+    void CopyRecord(const DirectoryServiceSnapshot::Record& record, const CDirectoryServiceAttributeSchema& schema, CDirectoryServiceRecordArena& result) const;
+
+    template <class T> const T* GetTable(const DirectoryServiceSnapshot::Section& section) const
+    {
+        return reinterpret_cast<const T*>(mData + section.mOffset);
+    }
+    template <class T> const T& GetEntry(const DirectoryServiceSnapshot::Section& section, UInt32 index) const;
+
+    // Not copyable as the snapshot owns its mapping
+    CDirectoryServiceSnapshot(const CDirectoryServiceSnapshot& copy);
+    CDirectoryServiceSnapshot& operator=(const CDirectoryServiceSnapshot& copy);
+};
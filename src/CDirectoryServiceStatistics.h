@@ -0,0 +1,27 @@
+/**
+ * Counters reported by the Directory Service manager's pools and caches.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+
+#include <map>
+#include <string>
+
+// Counter name to value, as returned to Python by getStatistics.
+typedef std::map<std::string, UInt64> TDirectoryServiceStatistics;
@@ -0,0 +1,143 @@
+/**
+ * Classes that run independent Directory Service calls concurrently.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceTaskGroup.h"
+
+#include "CDirectoryServiceException.h"
+
+#pragma mark -----CDirectoryServiceTask
+
+CDirectoryServiceTask::CDirectoryServiceTask()
+{
+    mError = eDSNoErr;
+}
+
+CDirectoryServiceTask::~CDirectoryServiceTask()
+{
+}
+
+// Execute
+//
+// Run the task, recording any failure rather than letting it escape the thread.
+//
+void CDirectoryServiceTask::Execute()
+{
+    try
+    {
+        Run();
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        mError = dserror.GetDSError();
+    }
+    catch(...)
+    {
+        mError = eUndefinedError;
+    }
+}
+
+#pragma mark -----CDirectoryServiceTaskGroup
+
+CDirectoryServiceTaskGroup::CDirectoryServiceTaskGroup(size_t maxThreads)
+{
+    mMaxThreads = (maxThreads > 0) ? maxThreads : 1;
+    mNext = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+}
+
+CDirectoryServiceTaskGroup::~CDirectoryServiceTaskGroup()
+{
+    for(TTaskList::iterator iter = mTasks.begin(); iter != mTasks.end(); iter++)
+        delete *iter;
+    mTasks.clear();
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// Add
+//
+// Add a task to the group, which takes ownership of it.
+//
+// @param task: the task to add.
+//
+void CDirectoryServiceTaskGroup::Add(CDirectoryServiceTask* task)
+{
+    mTasks.push_back(task);
+}
+
+// Run
+//
+// Run all tasks and wait for them to finish. If a thread cannot be started its share of the
+// tasks is simply picked up by the threads that are running.
+//
+void CDirectoryServiceTaskGroup::Run()
+{
+    mNext = 0;
+    size_t threadCount = (mTasks.size() < mMaxThreads) ? mTasks.size() : mMaxThreads;
+
+    std::vector<pthread_t> threads;
+    for(size_t i = 1; i < threadCount; i++)
+    {
+        pthread_t thread;
+        if (::pthread_create(&thread, NULL, ThreadEntry, this) == 0)
+            threads.push_back(thread);
+    }
+
+    RunTasks();
+
+    for(std::vector<pthread_t>::iterator iter = threads.begin(); iter != threads.end(); iter++)
+        ::pthread_join(*iter, NULL);
+}
+
+// ThrowIfFailed
+//
+// Throw the error of the first task that failed, if any.
+//
+// @throw: yes
+//
+void CDirectoryServiceTaskGroup::ThrowIfFailed() const
+{
+    for(TTaskList::const_iterator iter = mTasks.begin(); iter != mTasks.end(); iter++)
+    {
+        ThrowIfDSErr((*iter)->GetError());
+    }
+}
+
+#pragma mark -----Private API
+
+void* CDirectoryServiceTaskGroup::ThreadEntry(void* group)
+{
+    static_cast<CDirectoryServiceTaskGroup*>(group)->RunTasks();
+    return NULL;
+}
+
+// Keep taking the next task to run until there are none left.
+void CDirectoryServiceTaskGroup::RunTasks()
+{
+    while(true)
+    {
+        CDirectoryServiceTask* task = NULL;
+        ::pthread_mutex_lock(&mMutex);
+        if (mNext < mTasks.size())
+            task = mTasks[mNext++];
+        ::pthread_mutex_unlock(&mMutex);
+
+        if (task == NULL)
+            break;
+        task->Execute();
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * Classes that run independent Directory Service calls concurrently.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <pthread.h>
+#include <vector>
+
+// A unit of work run by a CDirectoryServiceTaskGroup. Run is called on an arbitrary thread
+// without the Python GIL, and any CDirectoryServiceException it throws is recorded.
+class CDirectoryServiceTask
+{
+public:
+    CDirectoryServiceTask();
+    virtual ~CDirectoryServiceTask();
+
+    void Execute();
+
+    tDirStatus GetError() const
+    {
+        return mError;
+    }
+
+protected:
+    tDirStatus  mError;
+
+    virtual void Run() = 0;
+};
+
+// Runs a set of tasks using up to a given number of threads, the calling thread being one of
+// them, and waits for all of them to finish. The group owns the tasks added to it.
+class CDirectoryServiceTaskGroup
+{
+public:
+    CDirectoryServiceTaskGroup(size_t maxThreads);
+    ~CDirectoryServiceTaskGroup();
+
+    void Add(CDirectoryServiceTask* task);
+    void Run();
+    void ThrowIfFailed() const;
+
+    size_t GetCount() const
+    {
+        return mTasks.size();
+    }
+    CDirectoryServiceTask* GetTask(size_t index) const
+    {
+        return mTasks[index];
+    }
+
+private:
+    typedef std::vector<CDirectoryServiceTask*> TTaskList;
+
+    size_t              mMaxThreads;
+    TTaskList           mTasks;
+    size_t              mNext;
+    pthread_mutex_t     mMutex;
+
+    static void* ThreadEntry(void* group);
+    void RunTasks();
+
+    // Not copyable as the group owns its tasks
+    CDirectoryServiceTaskGroup(const CDirectoryServiceTaskGroup& copy);
+    CDirectoryServiceTaskGroup& operator=(const CDirectoryServiceTaskGroup& copy);
+};
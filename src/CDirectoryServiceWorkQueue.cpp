@@ -0,0 +1,265 @@
+/**
+ * A class that runs Directory Service calls on a pool of worker threads
+ * and signals their completion through a file descriptor.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#include "CDirectoryServiceWorkQueue.h"
+
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServiceTaskGroup.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#pragma mark -----Public API
+
+CDirectoryServiceWorkQueue::CDirectoryServiceWorkQueue(size_t maxThreads)
+{
+    mMaxThreads = (maxThreads > 0) ? maxThreads : 1;
+    mThreads = 0;
+    mIdle = 0;
+    mStopping = false;
+    mNextHandle = 1;
+    mPipe[0] = -1;
+    mPipe[1] = -1;
+    mSubmitted = 0;
+    mFinished = 0;
+    ::pthread_mutex_init(&mMutex, NULL);
+    ::pthread_cond_init(&mWork, NULL);
+    ::pthread_cond_init(&mExited, NULL);
+}
+
+CDirectoryServiceWorkQueue::~CDirectoryServiceWorkQueue()
+{
+    // Let running tasks finish, then wait for every worker to go
+    ::pthread_mutex_lock(&mMutex);
+    mStopping = true;
+    ::pthread_cond_broadcast(&mWork);
+    while(mThreads > 0)
+        ::pthread_cond_wait(&mExited, &mMutex);
+    ::pthread_mutex_unlock(&mMutex);
+
+    for(TEntryList::iterator iter = mPending.begin(); iter != mPending.end(); iter++)
+        delete (*iter).mTask;
+    for(TEntryList::iterator iter = mCompleted.begin(); iter != mCompleted.end(); iter++)
+        delete (*iter).mTask;
+    if (mPipe[0] != -1)
+    {
+        ::close(mPipe[0]);
+        ::close(mPipe[1]);
+    }
+    ::pthread_cond_destroy(&mExited);
+    ::pthread_cond_destroy(&mWork);
+    ::pthread_mutex_destroy(&mMutex);
+}
+
+// SetMaxThreads
+//
+// Change the number of worker threads. Surplus threads exit once they finish their current task.
+//
+// @param maxThreads: the most worker threads to run.
+//
+void CDirectoryServiceWorkQueue::SetMaxThreads(size_t maxThreads)
+{
+    ::pthread_mutex_lock(&mMutex);
+    mMaxThreads = (maxThreads > 0) ? maxThreads : 1;
+    ::pthread_cond_broadcast(&mWork);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Submit
+//
+// Queue a task to be run on a worker thread, starting another worker if all of them are busy.
+// The queue takes ownership of the task, even if this fails.
+//
+// @param task: the task to run.
+// @return: the handle identifying the task when it is taken back with TakeCompleted.
+// @throw: yes
+//
+UInt64 CDirectoryServiceWorkQueue::Submit(CDirectoryServiceTask* task)
+{
+    ::pthread_mutex_lock(&mMutex);
+    try
+    {
+        OpenPipe();
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        ::pthread_mutex_unlock(&mMutex);
+        delete task;
+        throw;
+    }
+
+    Entry entry;
+    entry.mHandle = mNextHandle++;
+    entry.mTask = task;
+    mPending.push_back(entry);
+    mSubmitted++;
+
+    // Workers are detached, the destructor waits for them through mThreads instead
+    if ((mIdle < mPending.size()) && (mThreads < mMaxThreads))
+    {
+        pthread_t thread;
+        pthread_attr_t attr;
+        ::pthread_attr_init(&attr);
+        ::pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (::pthread_create(&thread, &attr, ThreadEntry, this) == 0)
+            mThreads++;
+        ::pthread_attr_destroy(&attr);
+    }
+    ::pthread_cond_signal(&mWork);
+    bool running = (mThreads > 0);
+    ::pthread_mutex_unlock(&mMutex);
+
+    // With no worker at all the task would never run
+    if (!running)
+        ThrowIfDSErr(eDSOperationFailed);
+
+    return entry.mHandle;
+}
+
+// GetCompletionFD
+//
+// Get the file descriptor that becomes readable when a task has completed.
+//
+// @return: the read end of the completion pipe.
+// @throw: yes
+//
+int CDirectoryServiceWorkQueue::GetCompletionFD()
+{
+    ::pthread_mutex_lock(&mMutex);
+    try
+    {
+        OpenPipe();
+    }
+    catch(CDirectoryServiceException& dsStatus)
+    {
+        ::pthread_mutex_unlock(&mMutex);
+        throw;
+    }
+    int result = mPipe[0];
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// TakeCompleted
+//
+// Take back the next completed task, whose GetError shows whether it succeeded. Any completion
+// notifications waiting in the pipe are consumed once there is nothing left to take.
+//
+// @param handle: set to the handle Submit returned for the task.
+// @return: the task, now owned by the caller, or NULL if no task has completed.
+//
+CDirectoryServiceTask* CDirectoryServiceWorkQueue::TakeCompleted(UInt64& handle)
+{
+    CDirectoryServiceTask* result = NULL;
+
+    ::pthread_mutex_lock(&mMutex);
+    if (!mCompleted.empty())
+    {
+        handle = mCompleted.front().mHandle;
+        result = mCompleted.front().mTask;
+        mCompleted.pop_front();
+    }
+    else if (mPipe[0] != -1)
+    {
+        // Drained under the lock so a notification for a task completing now is not lost
+        char drain[64];
+        while(::read(mPipe[0], drain, sizeof(drain)) > 0)
+        {
+        }
+    }
+    ::pthread_mutex_unlock(&mMutex);
+
+    return result;
+}
+
+// GetStatistics
+//
+// Add the queue's counters to a set of statistics.
+//
+// @param stats: the statistics to add to.
+//
+void CDirectoryServiceWorkQueue::GetStatistics(TDirectoryServiceStatistics& stats)
+{
+    ::pthread_mutex_lock(&mMutex);
+    stats["async_submitted"] = mSubmitted;
+    stats["async_completed"] = mFinished;
+    stats["async_threads"] = mThreads;
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+#pragma mark -----Private API
+
+void* CDirectoryServiceWorkQueue::ThreadEntry(void* queue)
+{
+    static_cast<CDirectoryServiceWorkQueue*>(queue)->RunTasks();
+    return NULL;
+}
+
+// Run pending tasks until the queue is stopped or has more workers than it should.
+void CDirectoryServiceWorkQueue::RunTasks()
+{
+    ::pthread_mutex_lock(&mMutex);
+    while(!mStopping && (mThreads <= mMaxThreads))
+    {
+        if (mPending.empty())
+        {
+            mIdle++;
+            ::pthread_cond_wait(&mWork, &mMutex);
+            mIdle--;
+            continue;
+        }
+
+        Entry entry = mPending.front();
+        mPending.pop_front();
+        ::pthread_mutex_unlock(&mMutex);
+
+        entry.mTask->Execute();
+
+        ::pthread_mutex_lock(&mMutex);
+        mCompleted.push_back(entry);
+        mFinished++;
+
+        // A full pipe already has a wakeup waiting, so a failed write does not matter
+        char notify = 1;
+        ssize_t written = ::write(mPipe[1], &notify, 1);
+        (void)written;
+    }
+    mThreads--;
+    ::pthread_cond_signal(&mExited);
+    ::pthread_mutex_unlock(&mMutex);
+}
+
+// Create the non-blocking completion pipe if it does not exist yet. Called with the lock held.
+void CDirectoryServiceWorkQueue::OpenPipe()
+{
+    if (mPipe[0] != -1)
+        return;
+
+    int fds[2];
+    if (::pipe(fds) != 0)
+        ThrowIfDSErr(eDSOperationFailed);
+    for(int i = 0; i < 2; i++)
+    {
+        ::fcntl(fds[i], F_SETFL, ::fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        ::fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    mPipe[0] = fds[0];
+    mPipe[1] = fds[1];
+}
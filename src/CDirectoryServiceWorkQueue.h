@@ -0,0 +1,80 @@
+/**
+ * A class that runs Directory Service calls on a pool of worker threads
+ * and signals their completion through a file descriptor.
+ **
+ * Copyright (c) 2009 Apple Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ **/
+
+#pragma once
+
+#include "CDirectoryServiceStatistics.h"
+
+#include <DirectoryService/DirectoryService.h>
+
+#include <deque>
+#include <pthread.h>
+
+class CDirectoryServiceTask;
+
+// Tasks submitted to the queue are identified by a handle and run, in order of submission, on up to
+// a given number of worker threads that are started as work arrives and kept until the queue is
+// destroyed. A finished task is put on the completed list and a byte is written to a pipe, so an
+// event loop can watch the read end of the pipe and collect results without blocking. The queue owns
+// its tasks until they are taken back with TakeCompleted.
+class CDirectoryServiceWorkQueue
+{
+public:
+    CDirectoryServiceWorkQueue(size_t maxThreads);
+    ~CDirectoryServiceWorkQueue();
+
+    void SetMaxThreads(size_t maxThreads);
+
+    UInt64 Submit(CDirectoryServiceTask* task);
+    int GetCompletionFD();
+    CDirectoryServiceTask* TakeCompleted(UInt64& handle);
+
+    void GetStatistics(TDirectoryServiceStatistics& stats);
+
+private:
+    struct Entry
+    {
+        UInt64                  mHandle;
+        CDirectoryServiceTask*  mTask;
+    };
+    typedef std::deque<Entry> TEntryList;
+
+    size_t              mMaxThreads;
+    size_t              mThreads;           // worker threads running
+    size_t              mIdle;              // worker threads waiting for work
+    bool                mStopping;
+    TEntryList          mPending;
+    TEntryList          mCompleted;
+    UInt64              mNextHandle;
+    int                 mPipe[2];           // read and write ends, -1 until first needed
+    pthread_mutex_t     mMutex;
+    pthread_cond_t      mWork;
+    pthread_cond_t      mExited;
+
+    UInt64              mSubmitted;
+    UInt64              mFinished;
+
+    static void* ThreadEntry(void* queue);
+    void RunTasks();
+    void OpenPipe();
+
+    // Not copyable as the queue owns its tasks and threads
+    CDirectoryServiceWorkQueue(const CDirectoryServiceWorkQueue& copy);
+    CDirectoryServiceWorkQueue& operator=(const CDirectoryServiceWorkQueue& copy);
+};
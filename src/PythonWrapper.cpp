@@ -20,10 +20,17 @@
 #include "CDirectoryServiceManager.h"
 #include "CDirectoryService.h"
 #include "CDirectoryServiceAuth.h"
+#include "CDirectoryServiceException.h"
+#include "CDirectoryServicePreparedQuery.h"
+#include "CDirectoryServiceQueryExpression.h"
+#include "CDirectoryServiceRecordIterator.h"
+#include "CDirectoryServiceWorkQueue.h"
 #include "CFStringUtil.h"
 
 #include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 #ifndef Py_RETURN_TRUE
 #define Py_RETURN_TRUE return Py_INCREF(Py_True), Py_True
@@ -379,8 +386,594 @@ static PyObject* CFArrayArrayDictionaryToPyDict(CFArrayRef list)
     return result;
 }
 
+// Utility function - not exposed to Python
+static std::string PyObjectToString(PyObject* item)
+{
+    PyObject* str = PyObject_Str(item);
+    if (str == NULL)
+    {
+        PyErr_Clear();
+        throw PyObjectException("Could not convert a value to a string in 'PyObjectToString'.");
+    }
+    std::string result(PyString_AsString(str));
+    Py_DECREF(str);
+    return result;
+}
+
+// Utility function - not exposed to Python
+static CDirectoryServiceQueryExpression* PyExpressionToQuery(PyObject* item)
+{
+    // dsquery.match objects have attribute, value and matchType
+    PyObject* pyop = PyObject_GetAttrString(item, "operator");
+    if (pyop == NULL)
+    {
+        PyErr_Clear();
+        PyObject* pyattr = PyObject_GetAttrString(item, "attribute");
+        PyObject* pyvalue = PyObject_GetAttrString(item, "value");
+        PyObject* pymatchType = PyObject_GetAttrString(item, "matchType");
+        if ((pyattr == NULL) || (pyvalue == NULL) || (pymatchType == NULL))
+        {
+            PyErr_Clear();
+            Py_XDECREF(pyattr);
+            Py_XDECREF(pyvalue);
+            Py_XDECREF(pymatchType);
+            throw PyObjectException("Expecting an expression or match in 'PyExpressionToQuery'.");
+        }
+
+        // Anything that is not a known match type is generated as contains, as dsquery does
+        int matchType = PyInt_Check(pymatchType) ? (int)PyInt_AsLong(pymatchType) : eDSContains;
+        Py_DECREF(pymatchType);
+        try
+        {
+            std::string attr = PyObjectToString(pyattr);
+            std::string value = PyObjectToString(pyvalue);
+            Py_DECREF(pyattr);
+            Py_DECREF(pyvalue);
+            return new CDirectoryServiceQueryExpression(attr.c_str(), value.c_str(), matchType);
+        }
+        catch(PyObjectException& ex)
+        {
+            Py_DECREF(pyattr);
+            Py_DECREF(pyvalue);
+            throw;
+        }
+    }
+
+    // dsquery.expression objects have operator and subexpressions, a single one for NOT
+    const char* op = PyString_Check(pyop) ? PyString_AsString(pyop) : "";
+    CDirectoryServiceQueryExpression::EOperator exprop;
+    if (::strcmp(op, "&") == 0)
+        exprop = CDirectoryServiceQueryExpression::eAnd;
+    else if (::strcmp(op, "|") == 0)
+        exprop = CDirectoryServiceQueryExpression::eOr;
+    else if (::strcmp(op, "!") == 0)
+        exprop = CDirectoryServiceQueryExpression::eNot;
+    else
+    {
+        Py_DECREF(pyop);
+        throw PyObjectException("Unknown operator in 'PyExpressionToQuery'.");
+    }
+    Py_DECREF(pyop);
+
+    PyObject* pysubs = PyObject_GetAttrString(item, "subexpressions");
+    if (pysubs == NULL)
+    {
+        PyErr_Clear();
+        throw PyObjectException("Expecting subexpressions in 'PyExpressionToQuery'.");
+    }
+    std::auto_ptr<CDirectoryServiceQueryExpression> result(new CDirectoryServiceQueryExpression(exprop));
+    try
+    {
+        if ((exprop == CDirectoryServiceQueryExpression::eNot) && !PyTupleOrList::typeOK(pysubs))
+            result->AddSubexpression(PyExpressionToQuery(pysubs));
+        else
+        {
+            PyTupleOrList subs(pysubs);
+            for(Py_ssize_t i = 0; i < subs.getSize(); i++)
+                result->AddSubexpression(PyExpressionToQuery(subs.get(i)));
+        }
+    }
+    catch(PyObjectException& ex)
+    {
+        Py_DECREF(pysubs);
+        throw;
+    }
+    Py_DECREF(pysubs);
+
+    return result.release();
+}
+
+// Utility function - not exposed to Python
+static PyObject* QueryToPyTuple(const CDirectoryServiceQueryExpression& expr)
+{
+    switch(expr.GetOperator())
+    {
+    case CDirectoryServiceQueryExpression::eMatch:
+        return Py_BuildValue("(ssi)", expr.GetAttribute().c_str(), expr.GetValue().c_str(), expr.GetMatchType());
+    case CDirectoryServiceQueryExpression::eNot:
+        {
+            PyObject* pysub = QueryToPyTuple(expr.GetSubexpression(0));
+            PyObject* result = Py_BuildValue("(sO)", "!", pysub);
+            Py_DECREF(pysub);
+            return result;
+        }
+    default:
+        {
+            PyObject* pysubs = PyList_New(expr.GetCount());
+            for(size_t i = 0; i < expr.GetCount(); i++)
+                PyList_SET_ITEM(pysubs, i, QueryToPyTuple(expr.GetSubexpression(i)));
+            PyObject* result = Py_BuildValue("(sO)", (expr.GetOperator() == CDirectoryServiceQueryExpression::eAnd) ? "&" : "|", pysubs);
+            Py_DECREF(pysubs);
+            return result;
+        }
+    }
+}
+
 PyObject* ODException_class = NULL;
 
+/*
+    Iterator object returned by iterAllRecordsWithAttributes. Records are fetched from the
+    directory one data buffer at a time, and handed back to Python one record at a time.
+ */
+typedef struct
+{
+    PyObject_HEAD
+    CDirectoryServiceRecordIterator* iterator;
+    PyObject* manager;                  // odInit object, kept alive while the iterator uses its session pool
+    PyObject* records;
+    Py_ssize_t index;
+    bool busy;
+} ODRecordIteratorObject;
+
+// Utility function - not exposed to Python
+static void ODRecordIteratorRelease(ODRecordIteratorObject* iter)
+{
+    if (iter->iterator != NULL)
+    {
+        delete iter->iterator;
+        iter->iterator = NULL;
+    }
+    Py_XDECREF(iter->manager);
+    iter->manager = NULL;
+    Py_XDECREF(iter->records);
+    iter->records = NULL;
+    iter->index = 0;
+}
+
+static void ODRecordIterator_dealloc(PyObject* self)
+{
+    ODRecordIteratorRelease((ODRecordIteratorObject*)self);
+    PyObject_Del(self);
+}
+
+static PyObject* ODRecordIterator_iternext(PyObject* self)
+{
+    ODRecordIteratorObject* iter = (ODRecordIteratorObject*)self;
+    if (iter->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "RecordIterator already executing");
+        return NULL;
+    }
+
+    while(true)
+    {
+        // Return any record left over from the last chunk
+        if ((iter->records != NULL) && (iter->index < PyList_Size(iter->records)))
+        {
+            PyObject* record = PyList_GetItem(iter->records, iter->index++);
+            Py_INCREF(record);
+            return record;
+        }
+        Py_XDECREF(iter->records);
+        iter->records = NULL;
+        iter->index = 0;
+
+        // Stop once the directory has nothing more to give
+        if ((iter->iterator == NULL) || iter->iterator->IsComplete())
+        {
+            ODRecordIteratorRelease(iter);
+            return NULL;
+        }
+
+        // Get the next chunk - the GIL is released while the directory is being read
+        iter->busy = true;
+        iter->records = iter->iterator->NextRecordsAsPython();
+        iter->busy = false;
+        if (iter->records == NULL)
+        {
+            ODRecordIteratorRelease(iter);
+            return NULL;
+        }
+    }
+}
+
+static PyObject* ODRecordIterator_close(PyObject* self, PyObject* args)
+{
+    ODRecordIteratorObject* iter = (ODRecordIteratorObject*)self;
+    if (iter->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "RecordIterator already executing");
+        return NULL;
+    }
+    ODRecordIteratorRelease(iter);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef ODRecordIterator_methods[] = {
+    {"close",  ODRecordIterator_close, METH_NOARGS,
+        "Stop iterating and release the directory resources held by the iterator."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject ODRecordIterator_type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "opendirectory.RecordIterator",     /* tp_name */
+    sizeof(ODRecordIteratorObject),     /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    ODRecordIterator_dealloc,           /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Iterator over Open Directory records.", /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    PyObject_SelfIter,                  /* tp_iter */
+    ODRecordIterator_iternext,          /* tp_iternext */
+    ODRecordIterator_methods,           /* tp_methods */
+};
+
+/*
+    Cursor object returned by queryRecordsWithAttribute(s)Paged. The directory's continuation
+    data is kept between calls to next_page, and a cursor left unused for longer than the
+    cursor_idle_timeout option is closed the next time any cursor is created or paged.
+ */
+typedef struct
+{
+    PyObject_HEAD
+    CDirectoryServiceRecordIterator* iterator;
+    PyObject* manager;                  // odInit object, kept alive while the cursor uses its session pool
+    CFAbsoluteTime lastUsed;
+    bool busy;
+    bool expired;
+} ODQueryCursorObject;
+
+static std::set<ODQueryCursorObject*> sOpenCursors;     // cursors with an open query, only touched with the GIL held
+
+// Utility function - not exposed to Python
+static void ODQueryCursorRelease(ODQueryCursorObject* cursor)
+{
+    sOpenCursors.erase(cursor);
+    if (cursor->iterator != NULL)
+    {
+        delete cursor->iterator;
+        cursor->iterator = NULL;
+    }
+    Py_XDECREF(cursor->manager);
+    cursor->manager = NULL;
+}
+
+// Utility function - not exposed to Python
+static void ODQueryCursorExpireIdle()
+{
+    CFAbsoluteTime now = ::CFAbsoluteTimeGetCurrent();
+    std::vector<ODQueryCursorObject*> expired;
+    for(std::set<ODQueryCursorObject*>::const_iterator iter = sOpenCursors.begin(); iter != sOpenCursors.end(); iter++)
+    {
+        ODQueryCursorObject* cursor = *iter;
+        if (cursor->busy || (cursor->manager == NULL))
+            continue;
+        CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(cursor->manager));
+        double timeout = dsmgr->GetCursorIdleTimeout();
+        if ((timeout > 0) && (now - cursor->lastUsed >= timeout))
+            expired.push_back(cursor);
+    }
+    for(std::vector<ODQueryCursorObject*>::iterator iter = expired.begin(); iter != expired.end(); iter++)
+    {
+        ODQueryCursorRelease(*iter);
+        (*iter)->expired = true;
+    }
+}
+
+static void ODQueryCursor_dealloc(PyObject* self)
+{
+    ODQueryCursorRelease((ODQueryCursorObject*)self);
+    PyObject_Del(self);
+}
+
+static PyObject* ODQueryCursor_next_page(PyObject* self, PyObject* args)
+{
+    ODQueryCursorObject* cursor = (ODQueryCursorObject*)self;
+	int count = 0;
+    if (!PyArg_ParseTuple(args, "|i", &count) || (count < 0))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices next_page: could not parse arguments", 0));
+        return NULL;
+    }
+    if (cursor->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "QueryCursor already executing");
+        return NULL;
+    }
+
+    ODQueryCursorExpireIdle();
+    if (cursor->expired)
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices next_page: cursor closed after being idle", 0));
+        return NULL;
+    }
+
+    // Nothing more once the query is complete or the cursor has been closed
+    if ((cursor->iterator == NULL) || cursor->iterator->IsComplete())
+    {
+        ODQueryCursorRelease(cursor);
+        return PyList_New(0);
+    }
+
+    // Get the next page - the GIL is released while the directory is being read
+    cursor->busy = true;
+    PyObject* result = cursor->iterator->NextRecordsAsPython(count);
+    cursor->busy = false;
+    cursor->lastUsed = ::CFAbsoluteTimeGetCurrent();
+    if ((result == NULL) || cursor->iterator->IsComplete())
+        ODQueryCursorRelease(cursor);
+    return result;
+}
+
+static PyObject* ODQueryCursor_close(PyObject* self, PyObject* args)
+{
+    ODQueryCursorObject* cursor = (ODQueryCursorObject*)self;
+    if (cursor->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "QueryCursor already executing");
+        return NULL;
+    }
+    ODQueryCursorRelease(cursor);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef ODQueryCursor_methods[] = {
+    {"next_page",  ODQueryCursor_next_page, METH_VARARGS,
+        "Return a list of up to count records, each a list of record name and attribute dict, or an empty list once the query is complete. "
+        "A count of zero returns whatever the directory sends next."},
+    {"close",  ODQueryCursor_close, METH_NOARGS,
+        "Stop the query and release the directory session held by the cursor."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject ODQueryCursor_type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "opendirectory.QueryCursor",        /* tp_name */
+    sizeof(ODQueryCursorObject),        /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    ODQueryCursor_dealloc,              /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Paged cursor over the results of an Open Directory query.", /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    ODQueryCursor_methods,              /* tp_methods */
+};
+
+/*
+    Prepared query object returned by prepareQuery. The record types, attributes and query
+    attribute are converted once, and each call to execute only supplies the value.
+ */
+typedef struct
+{
+    PyObject_HEAD
+    CDirectoryServicePreparedQuery* query;
+    PyObject* manager;                  // odInit object, kept alive while the query uses its session pool
+    bool busy;
+} ODPreparedQueryObject;
+
+// Utility function - not exposed to Python
+static void ODPreparedQueryRelease(ODPreparedQueryObject* prepared)
+{
+    if (prepared->query != NULL)
+    {
+        delete prepared->query;
+        prepared->query = NULL;
+    }
+    Py_XDECREF(prepared->manager);
+    prepared->manager = NULL;
+}
+
+static void ODPreparedQuery_dealloc(PyObject* self)
+{
+    ODPreparedQueryRelease((ODPreparedQueryObject*)self);
+    PyObject_Del(self);
+}
+
+static PyObject* ODPreparedQuery_execute(PyObject* self, PyObject* args)
+{
+    ODPreparedQueryObject* prepared = (ODPreparedQueryObject*)self;
+    const char* value;
+	int maxRecordCount = 0;
+    if (!PyArg_ParseTuple(args, "s|i", &value, &maxRecordCount))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices execute: could not parse arguments", 0));
+        return NULL;
+    }
+    if (prepared->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "PreparedQuery already executing");
+        return NULL;
+    }
+    if (prepared->query == NULL)
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices execute: prepared query has been closed", 0));
+        return NULL;
+    }
+
+    // The GIL is released while the directory is being read
+    prepared->busy = true;
+    PyObject* result = prepared->query->ExecuteAsPython(value, maxRecordCount);
+    prepared->busy = false;
+    return result;
+}
+
+static PyObject* ODPreparedQuery_close(PyObject* self, PyObject* args)
+{
+    ODPreparedQueryObject* prepared = (ODPreparedQueryObject*)self;
+    if (prepared->busy)
+    {
+        PyErr_SetString(PyExc_ValueError, "PreparedQuery already executing");
+        return NULL;
+    }
+    ODPreparedQueryRelease(prepared);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef ODPreparedQuery_methods[] = {
+    {"execute",  ODPreparedQuery_execute, METH_VARARGS,
+        "Run the query for a value, returning a list of record name and attribute dict lists, one for each record found. "
+        "An optional count limits the number of records returned."},
+    {"close",  ODPreparedQuery_close, METH_NOARGS,
+        "Release the directory resources held by the prepared query."},
+    {NULL, NULL, 0, NULL}        /* Sentinel */
+};
+
+static PyTypeObject ODPreparedQuery_type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                  /* ob_size */
+    "opendirectory.PreparedQuery",      /* tp_name */
+    sizeof(ODPreparedQueryObject),      /* tp_basicsize */
+    0,                                  /* tp_itemsize */
+    ODPreparedQuery_dealloc,            /* tp_dealloc */
+    0,                                  /* tp_print */
+    0,                                  /* tp_getattr */
+    0,                                  /* tp_setattr */
+    0,                                  /* tp_compare */
+    0,                                  /* tp_repr */
+    0,                                  /* tp_as_number */
+    0,                                  /* tp_as_sequence */
+    0,                                  /* tp_as_mapping */
+    0,                                  /* tp_hash */
+    0,                                  /* tp_call */
+    0,                                  /* tp_str */
+    0,                                  /* tp_getattro */
+    0,                                  /* tp_setattro */
+    0,                                  /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                 /* tp_flags */
+    "Open Directory attribute query prepared for repeated execution.", /* tp_doc */
+    0,                                  /* tp_traverse */
+    0,                                  /* tp_clear */
+    0,                                  /* tp_richcompare */
+    0,                                  /* tp_weaklistoffset */
+    0,                                  /* tp_iter */
+    0,                                  /* tp_iternext */
+    ODPreparedQuery_methods,            /* tp_methods */
+};
+
+// How the internal query methods hand back the records found
+enum EQueryResult
+{
+    eQueryResultDict,           // dict of record name to attributes
+    eQueryResultList,           // list of [record name, attributes] lists
+    eQueryResultCursor,         // QueryCursor fetching the list a page at a time
+    eQueryResultHandle          // handle of a call submitted to the work queue
+};
+
+// Utility function - not exposed to Python
+static PyObject* _submitTask(PyObject* pyds, CDirectoryService::CAsyncTask* task)
+{
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    try
+    {
+        UInt64 handle = dsmgr->GetWorkQueue()->Submit(task);
+        return PyLong_FromUnsignedLongLong(handle);
+    }
+    catch(CDirectoryServiceException& dserror)
+    {
+        dserror.SetPythonException();
+        return NULL;
+    }
+}
+
+// Utility function - not exposed to Python
+static PyObject* _submitQuery(PyObject* pyds, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef cfrecordtypes, CFDictionaryRef cfattributes, int maxRecordCount, const char* name)
+{
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr == NULL)
+    {
+        std::string msg("DirectoryServices ");
+        msg += name;
+        msg += ": invalid directory service argument";
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        return NULL;
+    }
+
+    std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+    return _submitTask(pyds, ds->NewQueryTask(attr, value, matchType, compound, casei, cfrecordtypes, cfattributes, maxRecordCount));
+}
+
+// Utility function - not exposed to Python
+static PyObject* _queryRecordsPaged(PyObject* pyds, const char* attr, const char* value, int matchType, const char* compound, bool casei, CFArrayRef cfrecordtypes, CFDictionaryRef cfattributes, int maxRecordCount, const char* name)
+{
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr == NULL)
+    {
+        std::string msg("DirectoryServices ");
+        msg += name;
+        msg += ": invalid directory service argument";
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        return NULL;
+    }
+
+    // Free up any sessions held by abandoned cursors before taking another
+    ODQueryCursorExpireIdle();
+
+    std::auto_ptr<CDirectoryServiceRecordIterator> ds(dsmgr->GetRecordIterator());
+    if (!ds->StartQueryRecordsWithAttributes(attr, value, matchType, compound, casei, cfrecordtypes, cfattributes, maxRecordCount))
+        return NULL;
+
+    ODQueryCursorObject* result = PyObject_New(ODQueryCursorObject, &ODQueryCursor_type);
+    if (result != NULL)
+    {
+        result->iterator = ds.release();
+        Py_INCREF(pyds);
+        result->manager = pyds;
+        result->lastUsed = ::CFAbsoluteTimeGetCurrent();
+        result->busy = false;
+        result->expired = false;
+        sOpenCursors.insert(result);
+    }
+    return (PyObject*)result;
+}
+
 /*
     Internal method.
  */
@@ -429,12 +1022,9 @@ static PyObject *_listAllRecordsWithAttributes(PyObject *self, PyObject *args, b
     if (dsmgr != NULL)
     {
         std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
-        CFMutableArrayRef results = NULL;
-        results = ds->ListAllRecordsWithAttributes(cfrecordtypes, cfattributes, maxRecordCount);
-        if (results != NULL)
+        PyObject* result = ds->ListAllRecordsWithAttributesAsPython(cfrecordtypes, cfattributes, maxRecordCount, list);
+        if (result != NULL)
         {
-            PyObject* result = list ? CFArrayArrayDictionaryToPyList(results) : CFArrayArrayDictionaryToPyDict(results);
-            CFRelease(results);
             CFRelease(cfattributes);
             CFRelease(cfrecordtypes);
 
@@ -449,7 +1039,7 @@ static PyObject *_listAllRecordsWithAttributes(PyObject *self, PyObject *args, b
     return NULL;
 }
 
-static PyObject *_queryRecordsWithAttribute(PyObject *self, PyObject *args, bool list)
+static PyObject *_queryRecordsWithAttribute(PyObject *self, PyObject *args, EQueryResult mode)
 {
     PyObject* pyds;
     const char* attr;
@@ -498,16 +1088,23 @@ static PyObject *_queryRecordsWithAttribute(PyObject *self, PyObject *args, bool
 		return NULL;
 	}
 
+    if ((mode == eQueryResultCursor) || (mode == eQueryResultHandle))
+    {
+        PyObject* result = (mode == eQueryResultCursor) ?
+            _queryRecordsPaged(pyds, attr, value, matchType, NULL, casei, cfrecordtypes, cfattributes, maxRecordCount, "queryRecordsWithAttributePaged") :
+            _submitQuery(pyds, attr, value, matchType, NULL, casei, cfrecordtypes, cfattributes, maxRecordCount, "submitQueryRecordsWithAttribute");
+        CFRelease(cfattributes);
+        CFRelease(cfrecordtypes);
+        return result;
+    }
+
     CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
     if (dsmgr != NULL)
     {
         std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
-        CFMutableArrayRef results = NULL;
-        results = ds->QueryRecordsWithAttribute(attr, value, matchType, casei, cfrecordtypes, cfattributes, maxRecordCount);
-        if (results != NULL)
+        PyObject* result = ds->QueryRecordsWithAttributeAsPython(attr, value, matchType, casei, cfrecordtypes, cfattributes, maxRecordCount, mode == eQueryResultList);
+        if (result != NULL)
         {
-            PyObject* result = list ? CFArrayArrayDictionaryToPyList(results) : CFArrayArrayDictionaryToPyDict(results);
-            CFRelease(results);
             CFRelease(cfattributes);
             CFRelease(cfrecordtypes);
 
@@ -522,7 +1119,7 @@ static PyObject *_queryRecordsWithAttribute(PyObject *self, PyObject *args, bool
     return NULL;
 }
 
-static PyObject *_queryRecordsWithAttributes(PyObject *self, PyObject *args, bool list)
+static PyObject *_queryRecordsWithAttributes(PyObject *self, PyObject *args, EQueryResult mode)
 {
     PyObject* pyds;
     const char* query;
@@ -569,16 +1166,23 @@ static PyObject *_queryRecordsWithAttributes(PyObject *self, PyObject *args, boo
 		return NULL;
 	}
 
+    if ((mode == eQueryResultCursor) || (mode == eQueryResultHandle))
+    {
+        PyObject* result = (mode == eQueryResultCursor) ?
+            _queryRecordsPaged(pyds, NULL, NULL, 0, query, casei, cfrecordtypes, cfattributes, maxRecordCount, "queryRecordsWithAttributesPaged") :
+            _submitQuery(pyds, NULL, NULL, 0, query, casei, cfrecordtypes, cfattributes, maxRecordCount, "submitQueryRecordsWithAttributes");
+        CFRelease(cfattributes);
+        CFRelease(cfrecordtypes);
+        return result;
+    }
+
     CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
     if (dsmgr != NULL)
     {
         std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
-        CFMutableArrayRef results = NULL;
-        results = ds->QueryRecordsWithAttributes(query, casei, cfrecordtypes, cfattributes, maxRecordCount);
-        if (results != NULL)
+        PyObject* result = ds->QueryRecordsWithAttributesAsPython(query, casei, cfrecordtypes, cfattributes, maxRecordCount, mode == eQueryResultList);
+        if (result != NULL)
         {
-            PyObject* result = list ? CFArrayArrayDictionaryToPyList(results) : CFArrayArrayDictionaryToPyDict(results);
-            CFRelease(results);
             CFRelease(cfattributes);
             CFRelease(cfrecordtypes);
 
@@ -594,23 +1198,191 @@ static PyObject *_queryRecordsWithAttributes(PyObject *self, PyObject *args, boo
 }
 
 /*
- This is an automatic destructor for the object obtained by odInit. It is not directly
- exposed to Python, instead Python calls it automatically when reclaiming the object.
+    Internal method.
  */
-extern "C" void odDestroy(void* obj)
+static PyObject *_getRecordsByNames(PyObject *self, PyObject *args, bool list)
 {
-    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(obj);
-    delete dsmgr;
-}
-
-/*
- def odInit(nodename):
-    """
-    Create an Open Directory object to operate on the specified directory service node name.
+    PyObject* pyds;
+    PyObject* recordType;
+    PyObject* names;
+    PyObject* attributes;
+    if (!PyArg_ParseTuple(args, "OOOO", &pyds, &recordType, &names, &attributes) ||
+        !PyCObject_Check(pyds) || !PyTupleOrList::typeOK(names) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getRecordsByNames: could not parse arguments", 0));
+        return NULL;
+    }
 
-    @param nodename: C{str} containing the node name.
-    @return: C{object} an object to be passed to all subsequent functions on success,
-        C{None} on failure.
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices getRecordsByNames: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+	// Convert tuple/list to CFArray
+    CFArrayRef cfnames = NULL;
+    try
+    {
+    	cfnames = PyTupleOrListToCFArray(names);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices getRecordsByNames: could not parse names: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices getRecordsByNames: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfnames);
+        CFRelease(cfrecordtypes);
+		return NULL;
+	}
+
+    PyObject* result = NULL;
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        result = ds->GetRecordsByNamesAsPython(cfrecordtypes, cfnames, cfattributes, list);
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getRecordsByNames: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfnames);
+    CFRelease(cfrecordtypes);
+    return result;
+}
+
+/*
+    Internal method.
+ */
+static PyObject *_queryNodesWithAttributes(PyObject *self, PyObject *args, bool compound)
+{
+    PyObject* pyds;
+    PyObject* nodes;
+    const char* attr = NULL;
+    const char* value = NULL;
+    int matchType = 0;
+    const char* query = NULL;
+    PyObject* caseio;
+    bool casei;
+    PyObject* recordType;
+    PyObject* attributes;
+    PyObject* dedupeo = Py_False;
+	int maxRecordCount = 0;
+    bool parsed;
+    if (compound)
+        parsed = PyArg_ParseTuple(args, "OOsOOO|Oi", &pyds, &nodes, &query, &caseio, &recordType, &attributes, &dedupeo, &maxRecordCount);
+    else
+        parsed = PyArg_ParseTuple(args, "OOssiOOO|Oi", &pyds, &nodes, &attr, &value, &matchType, &caseio, &recordType, &attributes, &dedupeo, &maxRecordCount);
+    if (!parsed || !PyCObject_Check(pyds) || !PyBool_Check(caseio) || !PyBool_Check(dedupeo) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices queryNodesWithAttributes: could not parse arguments", 0));
+        return NULL;
+    }
+
+    casei = (caseio == Py_True);
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfnodes = NULL;
+    try
+    {
+    	cfnodes = PyStringTupleOrListToCFArray(nodes);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryNodesWithAttributes: could not parse nodes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryNodesWithAttributes: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfnodes);
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryNodesWithAttributes: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+        CFRelease(cfnodes);
+		return NULL;
+	}
+
+    PyObject* result = NULL;
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        result = ds->QueryNodesWithAttributesAsPython(cfnodes, attr, value, matchType, query, casei, cfrecordtypes, cfattributes, maxRecordCount, dedupeo == Py_True);
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices queryNodesWithAttributes: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfrecordtypes);
+    CFRelease(cfnodes);
+    return result;
+}
+
+/*
+ This is an automatic destructor for the object obtained by odInit. It is not directly
+ exposed to Python, instead Python calls it automatically when reclaiming the object.
+ */
+extern "C" void odDestroy(void* obj)
+{
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(obj);
+    delete dsmgr;
+}
+
+/*
+ def odInit(nodename):
+    """
+    Create an Open Directory object to operate on the specified directory service node name.
+
+    @param nodename: C{str} containing the node name.
+    @return: C{object} an object to be passed to all subsequent functions on success,
+        C{None} on failure.
     """
  */
 extern "C" PyObject* odInit(PyObject* self, PyObject* args)
@@ -772,7 +1544,7 @@ def queryRecordsWithAttribute(obj, attr, value, matchType, casei, recordType, at
  */
 extern "C" PyObject *queryRecordsWithAttribute(PyObject *self, PyObject *args)
 {
-	return _queryRecordsWithAttribute(self, args, false);
+	return _queryRecordsWithAttribute(self, args, eQueryResultDict);
 }
 
 /*
@@ -794,7 +1566,7 @@ def queryRecordsWithAttributes(obj, query, casei, recordType, attributes, count=
  */
 extern "C" PyObject *queryRecordsWithAttributes(PyObject *self, PyObject *args)
 {
-	return _queryRecordsWithAttributes(self, args, false);
+	return _queryRecordsWithAttributes(self, args, eQueryResultDict);
 }
 
 /*
@@ -817,6 +1589,94 @@ extern "C" PyObject *listAllRecordsWithAttributes_list(PyObject *self, PyObject
 	return _listAllRecordsWithAttributes(self, args, true);
 }
 
+/*
+def iterAllRecordsWithAttributes(obj, recordType, attributes, count=0):
+    """
+    Iterate over records in Open Directory, returning key attributes for each one. Records are
+    read from the directory in chunks as the iterator is consumed, rather than all at once.
+    The attributes can be a C{str} for the attribute name, or a C{tuple} or C{list} where the first C{str}
+    is the attribute name, and the second C{str} is an encoding type, either "str" or "base64".
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+	@param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{iterator} yielding a C{list} of C{str} (record name) and C{dict} attributes
+         for each record found, or C{None} otherwise. Call C{close()} on the iterator to
+         stop early and release the directory resources it holds.
+    """
+ */
+extern "C" PyObject *iterAllRecordsWithAttributes(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    PyObject* recordType;
+    PyObject* attributes;
+	int maxRecordCount = 0;
+    if (!PyArg_ParseTuple(args, "OOO|i", &pyds, &recordType, &attributes, &maxRecordCount) || !PyCObject_Check(pyds) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices iterAllRecordsWithAttributes: could not parse arguments", 0));
+        return NULL;
+    }
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices iterAllRecordsWithAttributes: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices iterAllRecordsWithAttributes: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+		return NULL;
+	}
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServiceRecordIterator> ds(dsmgr->GetRecordIterator());
+        if (ds->StartListAllRecordsWithAttributes(cfrecordtypes, cfattributes, maxRecordCount))
+        {
+            ODRecordIteratorObject* result = PyObject_New(ODRecordIteratorObject, &ODRecordIterator_type);
+            if (result != NULL)
+            {
+                result->iterator = ds.release();
+                Py_INCREF(pyds);
+                result->manager = pyds;
+                result->records = NULL;
+                result->index = 0;
+                result->busy = false;
+            }
+            CFRelease(cfattributes);
+            CFRelease(cfrecordtypes);
+
+            return (PyObject*)result;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices iterAllRecordsWithAttributes: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfrecordtypes);
+    return NULL;
+}
+
 /*
 def queryRecordsWithAttribute_list(obj, attr, value, matchType, casei, recordType, attributes, count=0):
     """
@@ -838,7 +1698,7 @@ def queryRecordsWithAttribute_list(obj, attr, value, matchType, casei, recordTyp
  */
 extern "C" PyObject *queryRecordsWithAttribute_list(PyObject *self, PyObject *args)
 {
-	return _queryRecordsWithAttribute(self, args, true);
+	return _queryRecordsWithAttribute(self, args, eQueryResultList);
 }
 
 /*
@@ -860,99 +1720,1147 @@ def queryRecordsWithAttributes_list(obj, query, casei, recordType, attributes, c
  */
 extern "C" PyObject *queryRecordsWithAttributes_list(PyObject *self, PyObject *args)
 {
-	return _queryRecordsWithAttributes(self, args, true);
+	return _queryRecordsWithAttributes(self, args, eQueryResultList);
 }
 
 /*
-def authenticateUserBasic(obj, nodename, user, pswd):
+def queryRecordsWithAttributePaged(obj, attr, value, matchType, casei, recordType, attributes, count=0):
     """
-    Authenticate a user with a password to Open Directory.
+    Start a query for records in Open Directory matching specified attribute and value, returning a
+    cursor that fetches the matching records a page at a time. The cursor holds a directory session
+    until the query is complete or C{close()} is called, and is closed automatically once it has been
+    left unused for longer than the "cursor_idle_timeout" option.
 
     @param obj: C{object} the object obtained from an odInit call.
-    @param nodename: C{str} the directory nodename for the record to check.
-    @param user: C{str} the user identifier/directory record name to check.
-    @param pswd: C{str} containing the password to check.
-    @return: C{True} if the user was found, C{False} otherwise.
+    @param attr: C{str} for the attribute to query.
+    @param value: C{str} for the attribute value to query.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+	@param count: C{int} maximum number of records to return over all pages (zero returns all).
+    @return: C{QueryCursor} whose C{next_page(n)} returns a C{list} containing a C{list} of C{str}
+         (record name) and C{dict} attributes for up to C{n} records, or an empty C{list} once the
+         query is complete, or C{None} otherwise.
     """
  */
-extern "C" PyObject *authenticateUserBasic(PyObject *self, PyObject *args)
+extern "C" PyObject *queryRecordsWithAttributePaged(PyObject *self, PyObject *args)
 {
-    PyObject* pyds;
-    const char* nodename;
-    const char* user;
-    const char* pswd;
-    if (!PyArg_ParseTuple(args, "Osss", &pyds, &nodename, &user, &pswd) || !PyCObject_Check(pyds))
-    {
-        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserBasic: could not parse arguments", 0));
-        return NULL;
-    }
-
-    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
-    if (dsmgr != NULL)
-    {
-        CDirectoryServiceAuth* ds = dsmgr->GetAuthService();
-        bool result = false;
-        bool authresult = false;
-        result = ds->AuthenticateUserBasic(nodename, user, pswd, authresult);
-        if (result)
-        {
-            if (authresult)
-                Py_RETURN_TRUE;
-            else
-                Py_RETURN_FALSE;
-        }
-    }
-    else
-        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserBasic: invalid directory service argument", 0));
-
-    return NULL;
+	return _queryRecordsWithAttribute(self, args, eQueryResultCursor);
 }
 
 /*
-def authenticateUserDigest(obj, nodename, user, challenge, response, method):
+def queryRecordsWithAttributesPaged(obj, query, casei, recordType, attributes, count=0):
     """
-    Authenticate using HTTP Digest credentials to Open Directory.
+    Start a compound query for records in Open Directory, returning a cursor that fetches the matching
+    records a page at a time. The cursor behaves as for L{queryRecordsWithAttributePaged}.
 
     @param obj: C{object} the object obtained from an odInit call.
-    @param nodename: C{str} the directory nodename for the record to check.
-    @param user: C{str} the user identifier/directory record name to check.
-    @param challenge: C{str} the HTTP challenge sent to the client.
-    @param response: C{str} the HTTP response sent from the client.
-    @param method: C{str} the HTTP method being used.
-    @return: C{True} if the user was found, C{False} otherwise.
+    @param query: C{str} the compound query string.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+	@param count: C{int} maximum number of records to return over all pages (zero returns all).
+    @return: C{QueryCursor} whose C{next_page(n)} returns a C{list} containing a C{list} of C{str}
+         (record name) and C{dict} attributes for up to C{n} records, or an empty C{list} once the
+         query is complete, or C{None} otherwise.
     """
  */
-extern "C" PyObject *authenticateUserDigest(PyObject *self, PyObject *args)
+extern "C" PyObject *queryRecordsWithAttributesPaged(PyObject *self, PyObject *args)
 {
-    PyObject* pyds;
-    const char* nodename;
-    const char* user;
-    const char* challenge;
+	return _queryRecordsWithAttributes(self, args, eQueryResultCursor);
+}
+
+/*
+def prepareQuery(obj, attr, matchType, casei, recordType, attributes):
+    """
+    Prepare a query for records in Open Directory matching a value of the specified attribute, so that
+    it can be run for many values without converting the record types and attributes each time.
+    The attributes can be a C{str} for the attribute name, or a C{tuple} or C{list} where the first C{str}
+    is the attribute name, and the second C{str} is an encoding type, either "str" or "base64".
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} for the attribute to query.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{PreparedQuery} whose C{execute(value, count=0)} returns a C{list} containing a C{list}
+         of C{str} (record name) and C{dict} attributes for each record found, or C{None} otherwise.
+    """
+ */
+extern "C" PyObject *prepareQuery(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* attr;
+    int matchType;
+    PyObject* caseio;
+    PyObject* recordType;
+    PyObject* attributes;
+    if (!PyArg_ParseTuple(args, "OsiOOO", &pyds, &attr, &matchType, &caseio, &recordType, &attributes) ||
+        !PyCObject_Check(pyds) || !PyBool_Check(caseio) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices prepareQuery: could not parse arguments", 0));
+        return NULL;
+    }
+
+    bool casei = (caseio == Py_True);
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices prepareQuery: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices prepareQuery: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+		return NULL;
+	}
+
+    PyObject* result = NULL;
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServicePreparedQuery> ds(dsmgr->GetPreparedQuery());
+        if (ds->Prepare(attr, matchType, casei, cfrecordtypes, cfattributes))
+        {
+            ODPreparedQueryObject* prepared = PyObject_New(ODPreparedQueryObject, &ODPreparedQuery_type);
+            if (prepared != NULL)
+            {
+                prepared->query = ds.release();
+                Py_INCREF(pyds);
+                prepared->manager = pyds;
+                prepared->busy = false;
+            }
+            result = (PyObject*)prepared;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices prepareQuery: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfrecordtypes);
+    return result;
+}
+
+/*
+def getRecordsByNames(obj, recordType, names, attributes):
+    """
+    Get records in Open Directory by exact record name, and return key attributes for each one.
+    This is much cheaper than searching on the record name attribute. Long lists of names are
+    split into several concurrent lookups.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param names: C{list} or C{tuple} of C{str} record names to look up.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{dict} containing a C{dict} of attributes for each record found,
+        or C{None} otherwise.
+    """
+ */
+extern "C" PyObject *getRecordsByNames(PyObject *self, PyObject *args)
+{
+	return _getRecordsByNames(self, args, false);
+}
+
+/*
+def getRecordsByNames_list(obj, recordType, names, attributes):
+    """
+    Get records in Open Directory by exact record name, and return key attributes for each one.
+    This is much cheaper than searching on the record name attribute. Long lists of names are
+    split into several concurrent lookups.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param names: C{list} or C{tuple} of C{str} record names to look up.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes
+        for each record found, or C{None} otherwise.
+    """
+ */
+extern "C" PyObject *getRecordsByNames_list(PyObject *self, PyObject *args)
+{
+	return _getRecordsByNames(self, args, true);
+}
+
+/*
+def queryRecordsWithAttributeValues(obj, attr, values, casei, recordType, attributes):
+    """
+    Look up records in Open Directory by several exact values of one attribute in a single call,
+    for example to resolve many GeneratedUIDs or email addresses at once, and return key attributes
+    for each one. The values are looked up by concurrent compound queries that each cover up to
+    batch_width values (see setOption).
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} containing the attribute to search.
+    @param values: C{list} or C{tuple} of C{str} values to look up.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+        The searched attribute is always returned.
+    @return: C{dict} of each C{str} value to a C{list} containing a C{list} of C{str} (record name)
+        and C{dict} attributes for each record matching that value, which is empty if none did.
+    """
+ */
+extern "C" PyObject *queryRecordsWithAttributeValues(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* attr;
+    PyObject* values;
+    PyObject* caseio;
+    bool casei;
+    PyObject* recordType;
+    PyObject* attributes;
+    if (!PyArg_ParseTuple(args, "OsOOOO", &pyds, &attr, &values, &caseio, &recordType, &attributes) ||
+        !PyCObject_Check(pyds) || !PyBool_Check(caseio) || !PyTupleOrList::typeOK(values) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices queryRecordsWithAttributeValues: could not parse arguments", 0));
+        return NULL;
+    }
+
+    casei = (caseio == Py_True);
+
+	// Convert tuple/list to CFArray
+    CFArrayRef cfvalues = NULL;
+    try
+    {
+    	cfvalues = PyTupleOrListToCFArray(values);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryRecordsWithAttributeValues: could not parse values: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryRecordsWithAttributeValues: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfvalues);
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices queryRecordsWithAttributeValues: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+        CFRelease(cfvalues);
+		return NULL;
+	}
+
+    PyObject* result = NULL;
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        result = ds->QueryRecordsWithAttributeValuesAsPython(attr, cfvalues, casei, cfrecordtypes, cfattributes);
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices queryRecordsWithAttributeValues: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfrecordtypes);
+    CFRelease(cfvalues);
+    return result;
+}
+
+/*
+def queryNodesWithAttribute_list(obj, nodes, attr, value, matchType, casei, recordType, attributes, dedupe=False, count=0):
+    """
+    List records matching specified attribute/value in several Open Directory nodes, querying the
+    nodes concurrently, and return key attributes for each one.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodes: C{list} or C{tuple} of C{str} node names, such as those returned by listNodes.
+    @param attr: C{str} containing the attribute to search.
+    @param value: C{str} containing the value to search for.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param dedupe: C{True} to return only the first record with each GeneratedUID, C{False} otherwise.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes
+        for each record found, ordered by record name and then node order.
+    """
+ */
+extern "C" PyObject *queryNodesWithAttribute_list(PyObject *self, PyObject *args)
+{
+	return _queryNodesWithAttributes(self, args, false);
+}
+
+/*
+def queryNodesWithAttributes_list(obj, nodes, query, casei, recordType, attributes, dedupe=False, count=0):
+    """
+    List records matching specified compound query in several Open Directory nodes, querying the
+    nodes concurrently, and return key attributes for each one.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodes: C{list} or C{tuple} of C{str} node names, such as those returned by listNodes.
+    @param query: C{str} the compound query string.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+    @param dedupe: C{True} to return only the first record with each GeneratedUID, C{False} otherwise.
+    @param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{list} containing a C{list} of C{str} (record name) and C{dict} attributes
+        for each record found, ordered by record name and then node order.
+    """
+ */
+extern "C" PyObject *queryNodesWithAttributes_list(PyObject *self, PyObject *args)
+{
+	return _queryNodesWithAttributes(self, args, true);
+}
+
+/*
+def generateQuery(expr):
+    """
+    Generate the compound query string for a query built with dsquery, in native code. The result
+    is the same as expr.generate().
+
+    @param expr: C{dsquery.expression} or C{dsquery.match} the query.
+    @return: C{str} the compound query string.
+    """
+ */
+extern "C" PyObject *generateQuery(PyObject *self, PyObject *args)
+{
+    PyObject* pyexpr;
+    if (!PyArg_ParseTuple(args, "O", &pyexpr))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices generateQuery: could not parse arguments", 0));
+        return NULL;
+    }
+
+    try
+    {
+        std::auto_ptr<CDirectoryServiceQueryExpression> expr(PyExpressionToQuery(pyexpr));
+        return PyString_FromString(expr->Generate().c_str());
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices generateQuery: could not parse expression: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+}
+
+/*
+def canonicalQuery(expr):
+    """
+    Get the canonical form of a compound query: AND and OR operands are flattened, sorted and
+    de-duplicated, and double negations removed. Queries that differ only in those ways have the
+    same canonical form, which is also what the query cache keys results on.
+
+    @param expr: C{dsquery.expression}, C{dsquery.match} or C{str} compound query string.
+    @return: C{str} the canonical compound query string.
+    """
+ */
+extern "C" PyObject *canonicalQuery(PyObject *self, PyObject *args)
+{
+    PyObject* pyexpr;
+    if (!PyArg_ParseTuple(args, "O", &pyexpr))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices canonicalQuery: could not parse arguments", 0));
+        return NULL;
+    }
+
+    try
+    {
+        std::auto_ptr<CDirectoryServiceQueryExpression> expr(PyString_Check(pyexpr) ? CDirectoryServiceQueryExpression::Parse(PyString_AsString(pyexpr)) : PyExpressionToQuery(pyexpr));
+        if (expr.get() == NULL)
+            throw PyObjectException("Not a compound query string.");
+        return PyString_FromString(expr->GenerateCanonical().c_str());
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices canonicalQuery: could not parse expression: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+}
+
+/*
+def parseQuery(compound):
+    """
+    Parse a compound query string of the form dsquery generates.
+
+    @param compound: C{str} the compound query string.
+    @return: C{tuple} (attribute, value, matchType) for a match, (operator, C{list} of operands)
+        for AND and OR, or ("!", operand) for NOT. dsquery.parse turns this into dsquery objects.
+    """
+ */
+extern "C" PyObject *parseQuery(PyObject *self, PyObject *args)
+{
+    const char* compound;
+    if (!PyArg_ParseTuple(args, "s", &compound))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices parseQuery: could not parse arguments", 0));
+        return NULL;
+    }
+
+    std::auto_ptr<CDirectoryServiceQueryExpression> expr(CDirectoryServiceQueryExpression::Parse(compound));
+    if (expr.get() == NULL)
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices parseQuery: could not parse compound query", 0));
+        return NULL;
+    }
+    return QueryToPyTuple(*expr);
+}
+
+/*
+def authenticateUserBasic(obj, nodename, user, pswd):
+    """
+    Authenticate a user with a password to Open Directory. Calls from different threads
+    run concurrently, up to the auth_sessions option. With the auth_cache_ttl option set, a
+    password matching a recent successful authentication is accepted without asking the directory.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param pswd: C{str} containing the password to check.
+    @return: C{True} if the user was found, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *authenticateUserBasic(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    const char* user;
+    const char* pswd;
+    if (!PyArg_ParseTuple(args, "Osss", &pyds, &nodename, &user, &pswd) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserBasic: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+        bool result = false;
+        bool authresult = false;
+        result = ds->AuthenticateUserBasic(nodename, user, pswd, authresult);
+        if (result)
+        {
+            if (authresult)
+                Py_RETURN_TRUE;
+            else
+                Py_RETURN_FALSE;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserBasic: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def authenticateUserDigest(obj, nodename, user, challenge, response, method):
+    """
+    Authenticate using HTTP Digest credentials to Open Directory.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param challenge: C{str} the HTTP challenge sent to the client.
+    @param response: C{str} the HTTP response sent from the client.
+    @param method: C{str} the HTTP method being used.
+    @return: C{True} if the user was found, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *authenticateUserDigest(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    const char* user;
+    const char* challenge;
     const char* response;
     const char* method;
     if (!PyArg_ParseTuple(args, "Osssss", &pyds, &nodename, &user, &challenge, &response, &method) || !PyCObject_Check(pyds))
     {
-        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigest: could not parse arguments", 0));
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigest: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+        bool result = false;
+        bool authresult = false;
+        result = ds->AuthenticateUserDigest(nodename, user, challenge, response, method, authresult);
+        if (result)
+        {
+            if (authresult)
+                Py_RETURN_TRUE;
+            else
+                Py_RETURN_FALSE;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigest: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def getDigestMD5ChallengeFromActiveDirectory(obj, nodename):
+    """
+    Get a SASL DIGEST-MD5 challenge from an Active Directory node. With the challenge_pool_depth
+    option set, a challenge fetched ahead of time in the background is returned if one is ready.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename of the Active Directory node.
+    @return: C{str} the challenge, or C{None} if the node did not provide one.
+    """
+ */
+extern "C" PyObject *getDigestMD5ChallengeFromActiveDirectory(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    if (!PyArg_ParseTuple(args, "Os", &pyds, &nodename) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getDigestMD5ChallengeFromActiveDirectory: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+        CFStringRef challenge = ds->GetDigestMD5ChallengeFromActiveDirectory(nodename);
+        if (challenge != NULL)
+        {
+            PyObject* result = CFStringToPyStr(challenge);
+            ::CFRelease(challenge);
+            return result;
+        }
+        else if (PyErr_Occurred() == NULL)
+            Py_RETURN_NONE;
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getDigestMD5ChallengeFromActiveDirectory: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def authenticateUserDigestToActiveDirectory(obj, nodename, user, response):
+    """
+    Authenticate using SASL DIGEST-MD5 credentials to an Active Directory node.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param response: C{str} the response sent from the client to a challenge from
+        getDigestMD5ChallengeFromActiveDirectory.
+    @return: C{True} if the user was found, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *authenticateUserDigestToActiveDirectory(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    const char* user;
+    const char* response;
+    if (!PyArg_ParseTuple(args, "Osss", &pyds, &nodename, &user, &response) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigestToActiveDirectory: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+        bool result = false;
+        bool authresult = false;
+        result = ds->AuthenticateUserDigestToActiveDirectory(nodename, user, response, authresult);
+        if (result)
+        {
+            if (authresult)
+                Py_RETURN_TRUE;
+            else
+                Py_RETURN_FALSE;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigestToActiveDirectory: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def invalidateAuthCache(obj, nodename=None, user=None):
+    """
+    Forget remembered Basic authentications, for example after a password change. Only used when
+    the auth_cache_ttl option is set.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename to forget authentications for, or C{None} for all nodes.
+    @param user: C{str} the user to forget the authentication of, or C{None} for all users of the node.
+    """
+ */
+extern "C" PyObject *invalidateAuthCache(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename = NULL;
+    const char* user = NULL;
+    if (!PyArg_ParseTuple(args, "O|zz", &pyds, &nodename, &user) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices invalidateAuthCache: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        dsmgr->GetAuthCache()->Invalidate(nodename, (nodename != NULL) ? user : NULL);
+        Py_RETURN_NONE;
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices invalidateAuthCache: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def loadMirror(obj, recordType, attributes):
+    """
+    Load all records of the specified types into an in-memory mirror, replacing what it held before.
+    Exact queryRecordsWithAttribute lookups on GeneratedUID, RecordName, EMailAddress or
+    ServicesLocator are then answered from the mirror, as long as they are on the node it was
+    loaded from and all the record types and attributes asked for are mirrored. The mirror is only
+    as fresh as the last load.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to mirror,
+        or an empty C{list} to empty the mirror.
+    @param attributes: C{list} or C{tuple} containing the attributes to mirror for each record.
+        The indexed attributes are always mirrored.
+    """
+ */
+extern "C" PyObject *loadMirror(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    PyObject* recordType;
+    PyObject* attributes;
+    if (!PyArg_ParseTuple(args, "OOO", &pyds, &recordType, &attributes) || !PyCObject_Check(pyds) || !PyTupleOrList::typeOK(attributes))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices loadMirror: could not parse arguments", 0));
+        return NULL;
+    }
+
+	// Convert string/tuple/list to CFArray
+    CFArrayRef cfrecordtypes = NULL;
+    try
+    {
+    	cfrecordtypes = PyStringTupleOrListToCFArray(recordType);
+    }
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices loadMirror: could not parse recordTypes: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+		return NULL;
+	}
+
+    // Convert list to CFArray of CFString
+    CFDictionaryRef cfattributes = NULL;
+	try
+	{
+		cfattributes = AttributesToCFDictionary(attributes);
+	}
+	catch(PyObjectException& ex)
+	{
+		std::string msg("DirectoryServices loadMirror: could not parse attributes list: ");
+		msg += ex.what();
+		PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", msg.c_str(), 0));
+        CFRelease(cfrecordtypes);
+		return NULL;
+	}
+
+    bool result = false;
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        result = ds->LoadMirror(cfrecordtypes, cfattributes);
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices loadMirror: invalid directory service argument", 0));
+
+    CFRelease(cfattributes);
+    CFRelease(cfrecordtypes);
+    if (result)
+        Py_RETURN_NONE;
+    return NULL;
+}
+
+/*
+def refreshMirror(obj, full=False):
+    """
+    Bring the mirror loaded by loadMirror up to date by fetching only the records whose
+    ModificationTimestamp is at or after the latest one it holds. Deleted records are only noticed
+    by a full reload, which is done when asked for or when mirror_reconcile_interval (see setOption)
+    has passed since the last one, so this should be called periodically.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param full: C{True} to reload the mirror completely, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *refreshMirror(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    PyObject* fullo = Py_False;
+    if (!PyArg_ParseTuple(args, "O|O", &pyds, &fullo) || !PyCObject_Check(pyds) || !PyBool_Check(fullo))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices refreshMirror: could not parse arguments", 0));
         return NULL;
     }
 
     CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
     if (dsmgr != NULL)
     {
-        CDirectoryServiceAuth* ds = dsmgr->GetAuthService();
-        bool result = false;
-        bool authresult = false;
-        result = ds->AuthenticateUserDigest(nodename, user, challenge, response, method, authresult);
-        if (result)
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        if (ds->RefreshMirror(fullo == Py_True))
+            Py_RETURN_NONE;
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices refreshMirror: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def writeMirrorSnapshot(obj, path):
+    """
+    Write the records held by the mirror loaded by loadMirror to a snapshot file. The file is
+    written under a temporary name and renamed into place, so it can be replaced while other
+    processes have it loaded.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param path: C{str} the file to write.
+    @return: C{True} if the snapshot was written, C{False} if no mirror is loaded.
+    """
+ */
+extern "C" PyObject *writeMirrorSnapshot(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* path;
+    if (!PyArg_ParseTuple(args, "Os", &pyds, &path) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices writeMirrorSnapshot: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        bool written = false;
+        if (ds->WriteMirrorSnapshot(path, written))
         {
-            if (authresult)
+            if (written)
                 Py_RETURN_TRUE;
             else
                 Py_RETURN_FALSE;
         }
     }
     else
-        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices authenticateUserDigest: invalid directory service argument", 0));
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices writeMirrorSnapshot: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def loadMirrorSnapshot(obj, path):
+    """
+    Map a snapshot file written by writeMirrorSnapshot, replacing the contents of the mirror. Exact
+    lookups on indexed attributes of the node the snapshot was written from are answered from the
+    file straight away, without reading it into memory first. The next refreshMirror call reloads
+    the mirror from the directory.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param path: C{str} the file to map.
+    """
+ */
+extern "C" PyObject *loadMirrorSnapshot(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* path;
+    if (!PyArg_ParseTuple(args, "Os", &pyds, &path) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices loadMirrorSnapshot: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        std::auto_ptr<CDirectoryService> ds(dsmgr->GetService());
+        if (ds->LoadMirrorSnapshot(path))
+            Py_RETURN_NONE;
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices loadMirrorSnapshot: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def submitQueryRecordsWithAttribute(obj, attr, value, matchType, casei, recordType, attributes, count=0):
+    """
+    Start a query for records in Open Directory matching specified attribute and value on the module's
+    worker threads, returning straight away. The result is collected with L{getCompletedResults} once
+    the file descriptor from L{getCompletionFD} becomes readable.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param attr: C{str} for the attribute to query.
+    @param value: C{str} for the attribute value to query.
+    @param matchType: C{int} DS match type to use when searching.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+	@param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{int} handle identifying the call in the completed results, whose result is a C{list}
+         containing a C{list} of C{str} (record name) and C{dict} attributes for each record found.
+    """
+ */
+extern "C" PyObject *submitQueryRecordsWithAttribute(PyObject *self, PyObject *args)
+{
+	return _queryRecordsWithAttribute(self, args, eQueryResultHandle);
+}
+
+/*
+def submitQueryRecordsWithAttributes(obj, query, casei, recordType, attributes, count=0):
+    """
+    Start a compound query for records in Open Directory on the module's worker threads, returning
+    straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param query: C{str} the compound query string.
+    @param casei: C{True} to do case-insenstive match, C{False} otherwise.
+    @param recordType: C{str}, C{tuple} or C{list} containing the OD record types to lookup.
+    @param attributes: C{list} or C{tuple} containing the attributes to return for each record.
+	@param count: C{int} maximum number of records to return (zero returns all).
+    @return: C{int} handle identifying the call in the completed results, whose result is a C{list}
+         containing a C{list} of C{str} (record name) and C{dict} attributes for each record found.
+    """
+ */
+extern "C" PyObject *submitQueryRecordsWithAttributes(PyObject *self, PyObject *args)
+{
+	return _queryRecordsWithAttributes(self, args, eQueryResultHandle);
+}
+
+/*
+def submitAuthenticateUserBasic(obj, nodename, user, pswd):
+    """
+    Start authenticating a user with basic auth to Open Directory on the module's worker threads,
+    returning straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param pswd: C{str} containing the password to check.
+    @return: C{int} handle identifying the call in the completed results, whose result is C{True}
+        if the user was found and the password matches, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *submitAuthenticateUserBasic(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    const char* user;
+    const char* pswd;
+    if (!PyArg_ParseTuple(args, "Osss", &pyds, &nodename, &user, &pswd) || !PyCObject_Check(pyds) || (PyCObject_AsVoidPtr(pyds) == NULL))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices submitAuthenticateUserBasic: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+    return _submitTask(pyds, ds->NewAuthenticateUserBasicTask(nodename, user, pswd));
+}
+
+/*
+def submitAuthenticateUserDigest(obj, nodename, user, challenge, response, method):
+    """
+    Start authenticating a user with digest auth to Open Directory on the module's worker threads,
+    returning straight away. The result is collected as for L{submitQueryRecordsWithAttribute}.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param nodename: C{str} the directory nodename for the record to check.
+    @param user: C{str} the user identifier/directory record name to check.
+    @param challenge: C{str} the HTTP challenge sent to the client.
+    @param response: C{str} the HTTP response sent from the client.
+    @param method: C{str} the HTTP method being used.
+    @return: C{int} handle identifying the call in the completed results, whose result is C{True}
+        if the user was found and the response matches, C{False} otherwise.
+    """
+ */
+extern "C" PyObject *submitAuthenticateUserDigest(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* nodename;
+    const char* user;
+    const char* challenge;
+    const char* response;
+    const char* method;
+    if (!PyArg_ParseTuple(args, "Osssss", &pyds, &nodename, &user, &challenge, &response, &method) || !PyCObject_Check(pyds) || (PyCObject_AsVoidPtr(pyds) == NULL))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices submitAuthenticateUserDigest: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    std::auto_ptr<CDirectoryServiceAuth> ds(dsmgr->GetAuthService());
+    return _submitTask(pyds, ds->NewAuthenticateUserDigestTask(nodename, user, challenge, response, method));
+}
+
+/*
+def getCompletionFD(obj):
+    """
+    Return the file descriptor that becomes readable when calls submitted to the module's worker
+    threads have completed, for an event loop to watch. Call L{getCompletedResults} when it does.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{int} the file descriptor, which must not be read or closed by the caller.
+    """
+ */
+extern "C" PyObject *getCompletionFD(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    if (!PyArg_ParseTuple(args, "O", &pyds) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getCompletionFD: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        try
+        {
+            return PyInt_FromLong(dsmgr->GetWorkQueue()->GetCompletionFD());
+        }
+        catch(CDirectoryServiceException& dserror)
+        {
+            dserror.SetPythonException();
+            return NULL;
+        }
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getCompletionFD: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def getCompletedResults(obj):
+    """
+    Collect the results of calls submitted to the module's worker threads that have completed since
+    the last time this was called. All results are converted to Python objects in one go.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{list} of C{tuple} of C{int} handle returned when the call was submitted, the result of
+        the call (C{None} if it failed), and the L{ODError} it failed with (C{None} if it succeeded).
+    """
+ */
+extern "C" PyObject *getCompletedResults(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    if (!PyArg_ParseTuple(args, "O", &pyds) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getCompletedResults: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr == NULL)
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getCompletedResults: invalid directory service argument", 0));
+        return NULL;
+    }
+
+    PyObject* result = PyList_New(0);
+    if (result == NULL)
+        return NULL;
+    UInt64 handle = 0;
+    CDirectoryServiceTask* completed = NULL;
+    while((completed = dsmgr->GetWorkQueue()->TakeCompleted(handle)) != NULL)
+    {
+        std::auto_ptr<CDirectoryService::CAsyncTask> task(static_cast<CDirectoryService::CAsyncTask*>(completed));
+        PyObject* value = NULL;
+        PyObject* error = NULL;
+        if (task->GetError() == eDSNoErr)
+        {
+            value = task->GetResultAsPython();
+            error = Py_None;
+            Py_INCREF(error);
+        }
+        else
+        {
+            value = Py_None;
+            Py_INCREF(value);
+            PyObject* errorArgs = Py_BuildValue("((s:i))", "DirectoryServices Error: asynchronous call failed", task->GetError());
+            error = (errorArgs != NULL) ? PyObject_CallObject(ODException_class, errorArgs) : NULL;
+            Py_XDECREF(errorArgs);
+        }
+
+        PyObject* item = ((value != NULL) && (error != NULL)) ? Py_BuildValue("(KOO)", (unsigned PY_LONG_LONG)handle, value, error) : NULL;
+        Py_XDECREF(value);
+        Py_XDECREF(error);
+        if ((item == NULL) || (PyList_Append(result, item) != 0))
+        {
+            Py_XDECREF(item);
+            Py_DECREF(result);
+            return NULL;
+        }
+        Py_DECREF(item);
+    }
+    return result;
+}
+
+/*
+def getStatistics(obj):
+    """
+    Return counters kept by the module, such as how often data buffers were reused.
+    queries_coalesced counts the queries answered by an identical query already in flight.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @return: C{dict} of C{str} counter name to C{int} value.
+    """
+ */
+extern "C" PyObject *getStatistics(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    if (!PyArg_ParseTuple(args, "O", &pyds) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getStatistics: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        TDirectoryServiceStatistics stats;
+        dsmgr->GetStatistics(stats);
+
+        PyObject* result = PyDict_New();
+        for(TDirectoryServiceStatistics::const_iterator iter = stats.begin(); iter != stats.end(); iter++)
+        {
+            PyObject* value = PyLong_FromUnsignedLongLong((*iter).second);
+            PyDict_SetItemString(result, (*iter).first.c_str(), value);
+            Py_DECREF(value);
+        }
+        return result;
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices getStatistics: invalid directory service argument", 0));
+
+    return NULL;
+}
+
+/*
+def setOption(obj, name, value):
+    """
+    Change an option controlling how calls are made. Known options are:
+
+        fanout:         C{True} to run calls covering several record types as concurrent
+                        per-type calls, merged in the order the record types were given.
+        fanout_threads: the most threads a single fanned out call may use.
+        batch_width:    the most values looked up by one compound query in
+                        queryRecordsWithAttributeValues.
+        query_cache_ttl:          seconds query results are cached for, zero (the
+                                  default) turns the cache off.
+        query_cache_negative_ttl: seconds empty query results are cached for, zero
+                                  uses query_cache_ttl.
+        query_cache_bytes:        the most bytes of query results cached.
+        mirror_reconcile_interval: seconds after which refreshMirror reloads the mirror
+                                   completely, zero to only do so when asked.
+        cursor_idle_timeout:      seconds after which a paged query cursor left unused
+                                  is closed, zero to keep it open until closed.
+        async_threads:            the most worker threads running submitted calls.
+        auth_sessions:            the most directory sessions used by concurrent
+                                  authentications, further ones wait for a session.
+        node_cache_size:          the most nodes whose directory and node references are
+                                  kept open for queries and authentications, 32 by default.
+        auth_cache_ttl:           seconds a successful authenticateUserBasic is remembered
+                                  for, zero (the default) turns the cache off.
+        auth_cache_iterations:    PBKDF2 iterations used to derive a remembered password
+                                  verifier, 1000 by default.
+        challenge_pool_depth:     challenges getDigestMD5ChallengeFromActiveDirectory
+                                  keeps fetched ahead for each node, zero (the default)
+                                  turns the pool off.
+        challenge_pool_max_age:   seconds a prefetched challenge may be kept, 60 by
+                                  default, zero for no limit.
+        coalesce_queries:         C{True} (the default) to let a query identical to one
+                                  already in flight wait for and share its result.
+
+    @param obj: C{object} the object obtained from an odInit call.
+    @param name: C{str} the option name.
+    @param value: C{int} the new value.
+    """
+ */
+extern "C" PyObject *setOption(PyObject *self, PyObject *args)
+{
+    PyObject* pyds;
+    const char* name;
+    int value;
+    if (!PyArg_ParseTuple(args, "Osi", &pyds, &name, &value) || !PyCObject_Check(pyds))
+    {
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices setOption: could not parse arguments", 0));
+        return NULL;
+    }
+
+    CDirectoryServiceManager* dsmgr = static_cast<CDirectoryServiceManager*>(PyCObject_AsVoidPtr(pyds));
+    if (dsmgr != NULL)
+    {
+        if (dsmgr->SetOption(name, value))
+            Py_RETURN_NONE;
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices setOption: invalid option", 0));
+    }
+    else
+        PyErr_SetObject(ODException_class, Py_BuildValue("((s:i))", "DirectoryServices setOption: invalid directory service argument", 0));
 
     return NULL;
 }
@@ -972,14 +2880,68 @@ static PyMethodDef ODMethods[] = {
         "List records in Open Directory matching specified criteria, and return key attributes for each one."},
     {"listAllRecordsWithAttributes_list",  listAllRecordsWithAttributes_list, METH_VARARGS,
         "List all records of the specified type in Open Directory, returning requested attributes."},
+    {"iterAllRecordsWithAttributes",  iterAllRecordsWithAttributes, METH_VARARGS,
+        "Iterate over all records of the specified type in Open Directory, returning requested attributes."},
     {"queryRecordsWithAttribute_list",  queryRecordsWithAttribute_list, METH_VARARGS,
         "List records in Open Directory matching specified attribute/value, and return key attributes for each one."},
     {"queryRecordsWithAttributes_list",  queryRecordsWithAttributes_list, METH_VARARGS,
         "List records in Open Directory matching specified criteria, and return key attributes for each one."},
+    {"queryRecordsWithAttributePaged",  queryRecordsWithAttributePaged, METH_VARARGS,
+        "Start a query for records in Open Directory matching specified attribute/value, returning a cursor that fetches them a page at a time."},
+    {"queryRecordsWithAttributesPaged",  queryRecordsWithAttributesPaged, METH_VARARGS,
+        "Start a query for records in Open Directory matching specified criteria, returning a cursor that fetches them a page at a time."},
+    {"prepareQuery",  prepareQuery, METH_VARARGS,
+        "Prepare a query of one attribute in Open Directory that can be run repeatedly for different values."},
+    {"getRecordsByNames",  getRecordsByNames, METH_VARARGS,
+        "Get records in Open Directory by exact record name, returning requested attributes."},
+    {"getRecordsByNames_list",  getRecordsByNames_list, METH_VARARGS,
+        "Get records in Open Directory by exact record name, returning requested attributes."},
+    {"queryRecordsWithAttributeValues",  queryRecordsWithAttributeValues, METH_VARARGS,
+        "Look up records in Open Directory by several values of one attribute, returning the records matching each value."},
+    {"queryNodesWithAttribute_list",  queryNodesWithAttribute_list, METH_VARARGS,
+        "List records in several Open Directory nodes matching specified attribute/value, querying the nodes concurrently."},
+    {"queryNodesWithAttributes_list",  queryNodesWithAttributes_list, METH_VARARGS,
+        "List records in several Open Directory nodes matching specified criteria, querying the nodes concurrently."},
+    {"generateQuery",  generateQuery, METH_VARARGS,
+        "Generate the compound query string for a dsquery expression."},
+    {"canonicalQuery",  canonicalQuery, METH_VARARGS,
+        "Get the canonical form of a compound query."},
+    {"parseQuery",  parseQuery, METH_VARARGS,
+        "Parse a compound query string."},
     {"authenticateUserBasic",  authenticateUserBasic, METH_VARARGS,
         "Authenticate a user with a password to Open Directory using plain text authentication."},
     {"authenticateUserDigest",  authenticateUserDigest, METH_VARARGS,
         "Authenticate a user with a password to Open Directory using HTTP DIGEST authentication."},
+    {"getDigestMD5ChallengeFromActiveDirectory",  getDigestMD5ChallengeFromActiveDirectory, METH_VARARGS,
+        "Get a SASL DIGEST-MD5 challenge from an Active Directory node."},
+    {"authenticateUserDigestToActiveDirectory",  authenticateUserDigestToActiveDirectory, METH_VARARGS,
+        "Authenticate a user to Active Directory using SASL DIGEST-MD5 authentication."},
+    {"invalidateAuthCache",  invalidateAuthCache, METH_VARARGS,
+        "Forget remembered Basic authentications."},
+    {"loadMirror",  loadMirror, METH_VARARGS,
+        "Load records into an in-memory mirror that answers exact lookups on indexed attributes."},
+    {"refreshMirror",  refreshMirror, METH_VARARGS,
+        "Update the in-memory mirror with records changed since it was last loaded."},
+    {"writeMirrorSnapshot",  writeMirrorSnapshot, METH_VARARGS,
+        "Write the records in the in-memory mirror to a snapshot file."},
+    {"loadMirrorSnapshot",  loadMirrorSnapshot, METH_VARARGS,
+        "Map a snapshot file into the in-memory mirror to answer lookups from it."},
+    {"submitQueryRecordsWithAttribute",  submitQueryRecordsWithAttribute, METH_VARARGS,
+        "Start a query for records in Open Directory matching specified attribute/value on a worker thread, returning a handle."},
+    {"submitQueryRecordsWithAttributes",  submitQueryRecordsWithAttributes, METH_VARARGS,
+        "Start a query for records in Open Directory matching specified criteria on a worker thread, returning a handle."},
+    {"submitAuthenticateUserBasic",  submitAuthenticateUserBasic, METH_VARARGS,
+        "Start authenticating a user with basic auth to Open Directory on a worker thread, returning a handle."},
+    {"submitAuthenticateUserDigest",  submitAuthenticateUserDigest, METH_VARARGS,
+        "Start authenticating a user with digest auth to Open Directory on a worker thread, returning a handle."},
+    {"getCompletionFD",  getCompletionFD, METH_VARARGS,
+        "Return the file descriptor that becomes readable when submitted calls have completed."},
+    {"getCompletedResults",  getCompletedResults, METH_VARARGS,
+        "Collect the handle, result and error of each submitted call that has completed."},
+    {"getStatistics",  getStatistics, METH_VARARGS,
+        "Return counters kept by the module."},
+    {"setOption",  setOption, METH_VARARGS,
+        "Change an option controlling how calls are made."},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
@@ -994,6 +2956,13 @@ PyMODINIT_FUNC initopendirectory(void)
     PyDict_SetItemString(d, "ODError", ODException_class);
     Py_INCREF(ODException_class);
 
+    if (PyType_Ready(&ODRecordIterator_type) < 0)
+        goto error;
+    if (PyType_Ready(&ODQueryCursor_type) < 0)
+        goto error;
+    if (PyType_Ready(&ODPreparedQuery_type) < 0)
+        goto error;
+
 
 error:
     if (PyErr_Occurred())
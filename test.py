@@ -17,6 +17,8 @@
 import opendirectory
 import dsattributes
 from dsquery import expression, match
+import select
+import threading
 
 try:
 	ref = opendirectory.odInit("/Search")
@@ -246,6 +248,120 @@ try:
 				print "Name: %s" % name
 				print "dict: %s" % str(record)
 	
+	def iterUsers():
+		it = opendirectory.iterAllRecordsWithAttributes(ref, dsattributes.kDSStdRecordTypeUsers,
+													   [dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,])
+		if it is None:
+			print "Failed to iterate users"
+		else:
+			count = 0
+			for name, record in it:
+				count += 1
+				if count == 5:
+					it.close()
+			print "\niterUsers stopped early, number of results = %d" % (count,)
+	
+	def queryUsersPaged():
+		cursor = opendirectory.queryRecordsWithAttributePaged(
+			ref,
+			dsattributes.kDSNAttrRecordName,
+			"goo",
+			dsattributes.eDSStartsWith,
+			True,
+			dsattributes.kDSStdRecordTypeUsers,
+			[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+		)
+		if cursor is None:
+			print "Failed to query users"
+		else:
+			pages = 0
+			count = 0
+			while True:
+				page = cursor.next_page(2)
+				if not page:
+					break
+				pages += 1
+				count += len(page)
+			cursor.close()
+			print "\nqueryUsersPaged number of pages = %d, number of results = %d" % (pages, count,)
+	
+	def queryUsersPrepared():
+		query = opendirectory.prepareQuery(
+			ref,
+			dsattributes.kDS1AttrGeneratedUID,
+			dsattributes.eDSExact,
+			True,
+			dsattributes.kDSStdRecordTypeUsers,
+			[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+		)
+		if query is None:
+			print "Failed to prepare query"
+		else:
+			count = 0
+			for guid in ("D87B1F2D-2A49-4E26-B4F1-57C8BF7EAF8E", "B3B6AB37-F8F2-4B68-9D22-AC0C4B6B7A73",):
+				count += len(query.execute(guid))
+			query.close()
+			print "\nqueryUsersPrepared number of results = %d" % (count,)
+	
+	def queryUsersSubmitted():
+		handles = set()
+		for name in ("goo", "chris",):
+			handles.add(opendirectory.submitQueryRecordsWithAttribute(
+				ref,
+				dsattributes.kDSNAttrRecordName,
+				name,
+				dsattributes.eDSStartsWith,
+				True,
+				dsattributes.kDSStdRecordTypeUsers,
+				[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+			))
+		fd = opendirectory.getCompletionFD(ref)
+		count = 0
+		while handles:
+			select.select([fd], [], [])
+			for handle, result, error in opendirectory.getCompletedResults(ref):
+				handles.discard(handle)
+				if error is not None:
+					print "Failed submitted query: %s" % (error,)
+				else:
+					count += len(result)
+		print "\nqueryUsersSubmitted number of results = %d" % (count,)
+	
+	def queryUsersCoalesced():
+		# The same query submitted several times at once should mostly be answered by one call
+		before = opendirectory.getStatistics(ref).get("queries_coalesced", 0)
+		handles = set()
+		for i in range(4):
+			handles.add(opendirectory.submitQueryRecordsWithAttribute(
+				ref,
+				dsattributes.kDSNAttrRecordName,
+				"goo",
+				dsattributes.eDSStartsWith,
+				True,
+				dsattributes.kDSStdRecordTypeUsers,
+				[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+			))
+		fd = opendirectory.getCompletionFD(ref)
+		counts = set()
+		while handles:
+			select.select([fd], [], [])
+			for handle, result, error in opendirectory.getCompletedResults(ref):
+				handles.discard(handle)
+				if error is not None:
+					print "Failed coalesced query: %s" % (error,)
+				else:
+					counts.add(len(result))
+		if len(counts) > 1:
+			print "Coalesced queries returned different numbers of results: %s" % (sorted(counts),)
+		after = opendirectory.getStatistics(ref).get("queries_coalesced", 0)
+		print "\nqueryUsersCoalesced number of coalesced queries = %d" % (after - before,)
+	
+	def showStatistics():
+		stats = opendirectory.getStatistics(ref)
+		print "\nStatistics:"
+		for name in sorted(stats):
+			print "    %s: %s" % (name, stats[name],)
+	
 	def querySimple_list(title, attr, value, matchType, casei, recordType, attrs):
 		d = opendirectory.queryRecordsWithAttribute_list(
 		    ref,
@@ -363,12 +479,202 @@ try:
 			[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
 		)
 		
+	def queryUsersGroupsPlacesFanOut_list():
+		opendirectory.setOption(ref, "fanout", True)
+		try:
+			queryUsersGroupsPlaces_list()
+		finally:
+			opendirectory.setOption(ref, "fanout", False)
+		
+	def getUsersByNames():
+		d = opendirectory.getRecordsByNames(
+			ref,
+			dsattributes.kDSStdRecordTypeUsers,
+			("gooeyed", "nobody-by-that-name",),
+			[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+		)
+		if d is None:
+			print "Failed to get users by names"
+		else:
+			print "\ngetUsersByNames number of results = %d" % (len(d),)
+			for name, record in d.iteritems():
+				print "Name: %s" % name
+				print "dict: %s" % str(record)
+		
+	def queryUsersByGUIDs():
+		d = opendirectory.queryRecordsWithAttributeValues(
+			ref,
+		    dsattributes.kDS1AttrGeneratedUID,
+		    ("D87B1F2D-2A49-4E26-B4F1-57C8BF7EAF8E", "5A985493-EE2C-4665-94CF-4DFEA3A89500", "00000000-0000-0000-0000-000000000000",),
+		    True,
+			dsattributes.kDSStdRecordTypeUsers,
+			[dsattributes.kDS1AttrDistinguishedName,]
+		)
+		if d is None:
+			print "Failed to query users by GUIDs"
+		else:
+			print "\nqueryUsersByGUIDs number of values = %d" % (len(d),)
+			for value, records in d.iteritems():
+				print "Value: %s, records: %s" % (value, [name for name, record in records],)
+		
+	def queryUsersMirrored():
+		opendirectory.loadMirror(ref, dsattributes.kDSStdRecordTypeUsers, [dsattributes.kDS1AttrDistinguishedName,])
+		opendirectory.refreshMirror(ref)
+		try:
+			d = opendirectory.queryRecordsWithAttribute(
+				ref,
+				dsattributes.kDSNAttrRecordName,
+				"gooeyed",
+				dsattributes.eDSExact,
+				True,
+				dsattributes.kDSStdRecordTypeUsers,
+				[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+			)
+			if d is None:
+				print "Failed to query mirrored users"
+			else:
+				print "\nqueryUsersMirrored number of results = %d" % (len(d),)
+				for name, record in d.iteritems():
+					print "Name: %s" % name
+					print "dict: %s" % str(record)
+		finally:
+			opendirectory.loadMirror(ref, [], [])
+		
+	def queryUsersCompoundMirrored():
+		opendirectory.loadMirror(ref, dsattributes.kDSStdRecordTypeUsers, [dsattributes.kDS1AttrDistinguishedName, dsattributes.kDS1AttrFirstName, dsattributes.kDS1AttrLastName,])
+		try:
+			queryCompound(
+				"queryUsersCompoundMirrored",
+				expression(expression.OR,
+						   (match(dsattributes.kDS1AttrFirstName, "chris", dsattributes.eDSContains),
+							match(dsattributes.kDSNAttrRecordName, "goo", dsattributes.eDSStartsWith))).generate(),
+				True,
+				dsattributes.kDSStdRecordTypeUsers,
+				[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+			)
+		finally:
+			opendirectory.loadMirror(ref, [], [])
+		
+	def queryUsersNestedMirrored():
+		# An AND inside an OR must not lose the candidates the OR already found
+		compound = expression(expression.OR,
+							  (match(dsattributes.kDSNAttrRecordName, "gooeyed", dsattributes.eDSExact),
+							   expression(expression.AND,
+										  (match(dsattributes.kDSNAttrEMailAddress, "chris", dsattributes.eDSStartsWith),
+										   match(dsattributes.kDS1AttrFirstName, "chris", dsattributes.eDSContains))))).generate()
+		attrs = [dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+		expected = opendirectory.queryRecordsWithAttributes(ref, compound, True, dsattributes.kDSStdRecordTypeUsers, attrs)
+		opendirectory.loadMirror(ref, dsattributes.kDSStdRecordTypeUsers, [dsattributes.kDS1AttrDistinguishedName, dsattributes.kDS1AttrFirstName,])
+		try:
+			d = opendirectory.queryRecordsWithAttributes(ref, compound, True, dsattributes.kDSStdRecordTypeUsers, attrs)
+			if d is None or expected is None:
+				print "Failed to query nested mirrored users"
+			elif sorted(d.keys()) != sorted(expected.keys()):
+				print "queryUsersNestedMirrored mirror returned %s, directory returned %s" % (sorted(d.keys()), sorted(expected.keys()),)
+			else:
+				print "\nqueryUsersNestedMirrored number of results = %d" % (len(d),)
+		finally:
+			opendirectory.loadMirror(ref, [], [])
+		
+	def queryUsersFromSnapshot():
+		opendirectory.loadMirror(ref, dsattributes.kDSStdRecordTypeUsers, [dsattributes.kDS1AttrDistinguishedName,])
+		try:
+			if not opendirectory.writeMirrorSnapshot(ref, "/tmp/opendirectory.snapshot"):
+				print "Failed to write mirror snapshot"
+				return
+			opendirectory.loadMirrorSnapshot(ref, "/tmp/opendirectory.snapshot")
+			d = opendirectory.queryRecordsWithAttribute(
+				ref,
+				dsattributes.kDS1AttrGeneratedUID,
+				"D87B1F2D-2A49-4E26-B4F1-57C8BF7EAF8E",
+				dsattributes.eDSExact,
+				True,
+				dsattributes.kDSStdRecordTypeUsers,
+				[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,]
+			)
+			if d is None:
+				print "Failed to query users from snapshot"
+			else:
+				print "\nqueryUsersFromSnapshot number of results = %d" % (len(d),)
+				for name, record in d.iteritems():
+					print "Name: %s" % name
+					print "dict: %s" % str(record)
+		finally:
+			opendirectory.loadMirror(ref, [], [])
+		
+	def queryUsersCached_list():
+		opendirectory.setOption(ref, "query_cache_ttl", 60)
+		try:
+			queryUsersGroups_list()
+			queryUsersGroups_list()
+		finally:
+			opendirectory.setOption(ref, "query_cache_ttl", 0)
+		
+	def queryUsersAllNodes_list():
+		nodes = [n for n in opendirectory.listNodes(ref) if n != "/Search" and not n.startswith("/Search/")]
+		d = opendirectory.queryNodesWithAttribute_list(
+			ref,
+			nodes,
+		    dsattributes.kDS1AttrDistinguishedName,
+		    "burns",
+		    dsattributes.eDSContains,
+		    True,
+			dsattributes.kDSStdRecordTypeUsers,
+			[dsattributes.kDS1AttrGeneratedUID, dsattributes.kDS1AttrDistinguishedName,],
+			True
+		)
+		if d is None:
+			print "Failed to query users across nodes"
+		else:
+			print "\nqueryUsersAllNodes_list number of results = %d" % (len(d),)
+			for name, record in d:
+				print "Name: %s" % name
+				print "dict: %s" % str(record)
+		
 	def authentciateBasic():
 		if opendirectory.authenticateUserBasic(ref, "gooeyed", "test", "test"):
 			print "Authenticated user"
 		else:
 			print "Failed to authenticate user"
 	
+	def authenticateBasicConcurrent():
+		results = []
+		def authenticate():
+			results.append(opendirectory.authenticateUserBasic(ref, "gooeyed", "test", "test"))
+		threads = [threading.Thread(target=authenticate) for i in range(8)]
+		for thread in threads:
+			thread.start()
+		for thread in threads:
+			thread.join()
+		print "\nauthenticateBasicConcurrent authenticated %d of %d" % (results.count(True), len(threads),)
+	
+	def authenticateBasicCached():
+		opendirectory.setOption(ref, "auth_cache_ttl", 60)
+		try:
+			print "\nauthenticateBasicCached first: %s" % (opendirectory.authenticateUserBasic(ref, "gooeyed", "test", "test"),)
+			print "authenticateBasicCached repeat: %s" % (opendirectory.authenticateUserBasic(ref, "gooeyed", "test", "test"),)
+			print "authenticateBasicCached wrong password: %s" % (opendirectory.authenticateUserBasic(ref, "gooeyed", "test", "wrong"),)
+			opendirectory.invalidateAuthCache(ref, "gooeyed", "test")
+		finally:
+			opendirectory.setOption(ref, "auth_cache_ttl", 0)
+	
+	def authenticateBasicNodeCache():
+		opendirectory.setOption(ref, "node_cache_size", 1)
+		try:
+			queryUsersAllNodes_list()
+			authentciateBasic()
+		finally:
+			opendirectory.setOption(ref, "node_cache_size", 32)
+	
+	def getChallengesPooled():
+		opendirectory.setOption(ref, "challenge_pool_depth", 4)
+		try:
+			for i in range(8):
+				challenge = opendirectory.getDigestMD5ChallengeFromActiveDirectory(ref, "/Active Directory/All Domains")
+				print "\ngetChallengesPooled challenge: %s" % (challenge,)
+		finally:
+			opendirectory.setOption(ref, "challenge_pool_depth", 0)
+	
 	listNodes()
 	getNodeAttributes()
 
@@ -382,6 +688,11 @@ try:
 	listUsers_list()
 	listGroups_list()
 	listComputers_list()
+	iterUsers()
+	queryUsersPaged()
+	queryUsersPrepared()
+	queryUsersSubmitted()
+	queryUsersCoalesced()
 	queryUsers_list()
 	queryUsersCompoundOr_list()
 	queryUsersCompoundOrExact_list()
@@ -390,12 +701,27 @@ try:
 	listResourcesPlaces_list()
 	queryUsersGroups_list()
 	queryUsersGroupsPlaces_list()
+	queryUsersGroupsPlacesFanOut_list()
+	getUsersByNames()
+	queryUsersByGUIDs()
+	queryUsersAllNodes_list()
+	queryUsersCached_list()
+	queryUsersMirrored()
+	queryUsersCompoundMirrored()
+	queryUsersNestedMirrored()
+	queryUsersFromSnapshot()
 
 	listUsersCount()
 	queryUsersCountNotLimited()
 	queryUsersCountLimited()
 
 	#authentciateBasic()
+	#authenticateBasicConcurrent()
+	#authenticateBasicCached()
+	#getChallengesPooled()
+	#authenticateBasicNodeCache()
+
+	showStatistics()
 
 	ref = None
 except opendirectory.ODError, ex: